@@ -0,0 +1,193 @@
+#include "alloc.h"
+#include <new>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+std::atomic<bool> alloc_tracker::enabled(false);
+std::atomic<uint> alloc_tracker::num_tags(1);
+const char* alloc_tracker::names[alloc_tracker::max_tags] = { "untagged" };
+std::atomic<unsigned long long> alloc_tracker::allocations[alloc_tracker::max_tags];
+std::atomic<unsigned long long> alloc_tracker::bytes[alloc_tracker::max_tags];
+std::atomic<unsigned long long> alloc_tracker::frees[alloc_tracker::max_tags];
+std::atomic<unsigned long long> alloc_tracker::freed_bytes[alloc_tracker::max_tags];
+
+static thread_local uint current_tag = 0;
+static std::mutex tag_mutex;
+
+void alloc_tracker::reset()
+{
+	for (uint i = 0; i < max_tags; ++i)
+	{
+		allocations[i] = 0;
+		bytes[i] = 0;
+		frees[i] = 0;
+		freed_bytes[i] = 0;
+	}
+}
+
+uint alloc_tracker::find_tag(const char* name)
+{
+	std::lock_guard<std::mutex> lock(tag_mutex);
+
+	for (uint i = 0; i < num_tags; ++i)
+		if (names[i] == name || !strcmp(names[i], name))
+			return i;
+
+	if (num_tags == max_tags)
+		return 0; // out of tags, counted as untagged
+
+	names[num_tags] = name;
+	return num_tags++;
+}
+
+alloc_counters alloc_tracker::counters(uint tag)
+{
+	alloc_counters c;
+	c.allocations = allocations[tag];
+	c.bytes = bytes[tag];
+	c.frees = frees[tag];
+	c.freed_bytes = freed_bytes[tag];
+	return c;
+}
+
+alloc_counters alloc_tracker::total()
+{
+	alloc_counters c;
+
+	for (uint i = 0; i < num_tags; ++i)
+	{
+		c.allocations += allocations[i];
+		c.bytes += bytes[i];
+		c.frees += frees[i];
+		c.freed_bytes += freed_bytes[i];
+	}
+
+	return c;
+}
+
+uint alloc_tracker::on_alloc(std::size_t size)
+{
+	uint tag = current_tag;
+	if (!enabled) return tag;
+
+	allocations[tag].fetch_add(1, std::memory_order_relaxed);
+	bytes[tag].fetch_add(size, std::memory_order_relaxed);
+	return tag;
+}
+
+void alloc_tracker::on_free(std::size_t size, uint tag)
+{
+	if (!enabled) return;
+
+	frees[tag].fetch_add(1, std::memory_order_relaxed);
+	freed_bytes[tag].fetch_add(size, std::memory_order_relaxed);
+}
+
+alloc_scope::alloc_scope(const char* tag) : previous(current_tag)
+{
+	if (alloc_tracker::is_enabled())
+		current_tag = alloc_tracker::find_tag(tag);
+}
+
+alloc_scope::~alloc_scope()
+{
+	current_tag = previous;
+}
+
+
+#ifdef ALLOC_CHECK
+
+/*
+ *	replaced global allocation functions, in builds with ALLOC_CHECK defined (make linux-alloc-check)
+ *
+ *	every block is prefixed with a header that holds its size and the tag it was allocated under, so frees are
+ *	charged to that tag whichever scope frees them; the header is 16 bytes to keep the alignment that malloc
+ *	guarantees, or the alignment that was asked for when it is larger, so the block after it stays aligned
+ */
+
+struct block_header
+{
+	std::size_t size;
+	uint tag;
+};
+
+static const std::size_t HEADER_SIZE = 16;
+static_assert(sizeof(block_header) <= HEADER_SIZE, "the size and tag of a block fit in its header");
+
+static void* tracked_alloc(std::size_t size, std::size_t align = HEADER_SIZE)
+{
+	std::size_t header = std::max(align, HEADER_SIZE);
+
+#ifdef _WIN32
+	unsigned char* block = (unsigned char*)_aligned_malloc(size + header, header);
+#else
+	// aligned_alloc takes multiples of the alignment
+	unsigned char* block = header == HEADER_SIZE
+		? (unsigned char*)malloc(size + header)
+		: (unsigned char*)aligned_alloc(header, (size + header + header - 1) / header * header);
+#endif
+	if (!block) return nullptr;
+
+	// the size and the tag sit right before the block that is handed out, where tracked_free finds them
+	block_header* h = (block_header*)(block + header - HEADER_SIZE);
+	h->size = size;
+	h->tag = alloc_tracker::on_alloc(size);
+
+	return block + header;
+}
+
+static void tracked_free(void* p, std::size_t align = HEADER_SIZE)
+{
+	if (!p) return;
+
+	std::size_t header = std::max(align, HEADER_SIZE);
+	unsigned char* block = (unsigned char*)p - header;
+	const block_header* h = (const block_header*)(block + header - HEADER_SIZE);
+	alloc_tracker::on_free(h->size, h->tag);
+
+#ifdef _WIN32
+	_aligned_free(block);
+#else
+	free(block);
+#endif
+}
+
+static void* tracked_new(std::size_t size, std::size_t align = HEADER_SIZE)
+{
+	void* p = tracked_alloc(size, align);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(std::size_t size) { return tracked_new(size); }
+void* operator new[](std::size_t size) { return tracked_new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return tracked_alloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return tracked_alloc(size); }
+
+void operator delete(void* p) noexcept { tracked_free(p); }
+void operator delete[](void* p) noexcept { tracked_free(p); }
+void operator delete(void* p, std::size_t) noexcept { tracked_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { tracked_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { tracked_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { tracked_free(p); }
+
+// types aligned beyond what malloc guarantees
+void* operator new(std::size_t size, std::align_val_t align) { return tracked_new(size, (std::size_t)align); }
+void* operator new[](std::size_t size, std::align_val_t align) { return tracked_new(size, (std::size_t)align); }
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return tracked_alloc(size, (std::size_t)align); }
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return tracked_alloc(size, (std::size_t)align); }
+
+void operator delete(void* p, std::align_val_t align) noexcept { tracked_free(p, (std::size_t)align); }
+void operator delete[](void* p, std::align_val_t align) noexcept { tracked_free(p, (std::size_t)align); }
+void operator delete(void* p, std::size_t, std::align_val_t align) noexcept { tracked_free(p, (std::size_t)align); }
+void operator delete[](void* p, std::size_t, std::align_val_t align) noexcept { tracked_free(p, (std::size_t)align); }
+void operator delete(void* p, std::align_val_t align, const std::nothrow_t&) noexcept { tracked_free(p, (std::size_t)align); }
+void operator delete[](void* p, std::align_val_t align, const std::nothrow_t&) noexcept { tracked_free(p, (std::size_t)align); }
+
+#endif
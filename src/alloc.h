@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include "constants.h"
+
+// allocations and frees counted by the replaced global operator new and delete, in builds with ALLOC_CHECK defined
+struct alloc_counters
+{
+	unsigned long long allocations;
+	unsigned long long bytes;
+	unsigned long long frees;		// of blocks allocated under the tag, wherever they were freed
+	unsigned long long freed_bytes;
+
+	alloc_counters() : allocations(0), bytes(0), frees(0), freed_bytes(0) {}
+};
+
+// counts heap allocations per tag (see alloc_scope); counting is off until enabled
+class alloc_tracker
+{
+public:
+	static const uint max_tags = 32;
+
+private:
+	static std::atomic<bool> enabled;
+	static std::atomic<uint> num_tags;
+	static const char* names[max_tags];
+	static std::atomic<unsigned long long> allocations[max_tags];
+	static std::atomic<unsigned long long> bytes[max_tags];
+	static std::atomic<unsigned long long> frees[max_tags];
+	static std::atomic<unsigned long long> freed_bytes[max_tags];
+
+public:
+	// whether this build replaces operator new and delete, without which nothing is counted
+#ifdef ALLOC_CHECK
+	static bool available() { return true; }
+#else
+	static bool available() { return false; }
+#endif
+
+	static void enable(bool on) { enabled = on; }
+	static bool is_enabled() { return enabled; }
+	static void reset();
+
+	static uint find_tag(const char* name);
+	static uint tags() { return num_tags; }
+	static const char* tag_name(uint tag) { return names[tag]; }
+	static alloc_counters counters(uint tag);
+	static alloc_counters total();
+
+	// on_alloc returns the tag that the block is charged to, which on_free takes back when it is freed
+	static uint on_alloc(std::size_t size);
+	static void on_free(std::size_t size, uint tag);
+};
+
+// attributes the allocations of the current thread to a tag, for the lifetime of the scope; costs nothing while
+// counting is off
+class alloc_scope
+{
+private:
+	uint previous;
+
+public:
+	alloc_scope(const char* tag);
+	~alloc_scope();
+};
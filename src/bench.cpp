@@ -0,0 +1,1890 @@
+#include "bench.h"
+#include "timing.h"
+#include "alloc.h"
+#include "match.h"
+#include "blend.h"
+#include "spline.h"
+#include "ragdoll.h"
+#include "collision.h"
+#include "script.h"
+#include "history.h"
+#include "cloud.h"
+#include "pick.h"
+#include "quantize.h"
+#include "retarget.h"
+#include "clip_stream.h"
+#include "stream_server.h"
+#include "pose_export.h"
+#include "fixed_fk.h"
+
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// a uniform random number, from the sequence that run_benchmark seeds for every benchmark
+static float random_between(float lo, float hi)
+{
+	return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+// schedules a crowd of skeletons spread in depth, and checks that the updates of a frame stay within its budget and
+// that they reach every visible skeleton, in the end
+int lod_benchmark(const bench_args& args)
+{
+	uint count = args.counts[0];
+	uint frames = args.counts[1];
+	kinecontext* context = args.kine_3d;
+	uint joints = context->num_joints();
+
+	lod_scheduler lod;
+	std::vector<vec3> places(count);
+	std::vector<float> phases(count);
+
+	// log-uniform in depth, so the skeletons fall into every level; every tenth is out of view
+	for (uint i = 0; i < count; ++i)
+	{
+		lod.add_instance();
+		lod.set_visible(i, i % 10 != 0);
+		places[i] = vec3(random_between(-30.0f, 30.0f), random_between(-30.0f, 30.0f), CAMERA_DISTANCE - 40.0f * powf(400.0f, random_between(0.0f, 1.0f)));
+		phases[i] = random_between(0.0f, 2 * PI);
+	}
+
+	float identity[16];
+	identity_matrix(identity);
+
+	std::vector<float> angles(joints * context->degrees_of_freedom());
+	std::vector<vec3> positions(joints);
+	std::vector<uint> updates(count, 0);
+	std::vector<uint> last(count, 0);
+
+	// per level: updates, and the frames they came after the interval of the level
+	uint levels = lod.num_levels();
+	std::vector<uint> level_updates(levels, 0);
+	std::vector<double> level_late(levels, 0.0);
+	std::vector<uint> level_late_max(levels, 0);
+	std::vector<uint> level_interval(levels, 0);
+
+	frame_timings timings;
+	uint least = ~0u, most = 0;
+	uint over_budget = 0;
+	float worst_over = 0.0f;
+
+	for (uint f = 1; f <= frames; ++f)
+	{
+		auto start = std::chrono::steady_clock::now();
+		lod.begin_frame(identity);
+
+		uint done = 0;
+		float longest = 0.0f;	// update of the frame, which the budget may be overrun by as the last one starts within it
+
+		for (uint id = lod.next_due(); id != lod_scheduler::none; id = lod.next_due())
+		{
+			auto update_start = std::chrono::steady_clock::now();
+			const lod_level& level = lod.level(id);
+			uint l = lod.level_index(id);
+			level_interval[l] = level.update_interval;
+
+			if (updates[id] > 0)
+			{
+				uint late = f - last[id] - level.update_interval;
+				level_updates[l]++;
+				level_late[l] += late;
+				level_late_max[l] = std::max(level_late_max[l], late);
+			}
+
+			pose3& target = lod.begin_update(id);
+
+			for (uint k = 0; k < angles.size(); ++k)
+				angles[k] = 30.0f * sinf(f * 0.05f + phases[id] + k);
+			context->joint_positions(&angles[0], &positions[0]);
+
+			target.joints.resize(joints);
+			vec3 sum(0, 0, 0);
+
+			for (uint n = 0; n < joints; ++n)
+			{
+				target.joints[n].position = positions[n] + places[id];
+				target.joints[n].visible = n % level.joint_stride == 0 || n + 1 == joints;
+				sum = sum + target.joints[n].position;
+			}
+
+			// the bounding sphere that selects the level of the next frame
+			target.center = sum * (1.0f / joints);
+			target.radius = 0.0f;
+
+			for (uint n = 0; n < joints; ++n)
+			{
+				vec3 d = target.joints[n].position - target.center;
+				target.radius = std::max(target.radius, sqrtf(d.x * d.x + d.y * d.y + d.z * d.z));
+			}
+
+			lod.end_update(id);
+			longest = std::max(longest, std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - update_start).count());
+
+			done++;
+			updates[id]++;
+			last[id] = f;
+		}
+
+		timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		// the first frame evaluates every visible skeleton, whatever the budget
+		if (f == 1)
+			continue;
+
+		least = std::min(least, done);
+		most = std::max(most, done);
+
+		if (lod.spent_us() > LOD_FRAME_BUDGET + longest)
+		{
+			over_budget++;
+			worst_over = std::max(worst_over, lod.spent_us() - LOD_FRAME_BUDGET);
+		}
+	}
+
+	// every visible skeleton was updated after its first evaluation, and none out of view ever was
+	uint starved = 0, hidden_updates = 0, total = 0;
+
+	for (uint i = 0; i < count; ++i)
+	{
+		if (i % 10 == 0)
+			hidden_updates += updates[i];
+		else
+			starved += updates[i] < 2;
+
+		total += updates[i];
+	}
+
+	timings.report(std::cout, "schedule");
+	std::cout << count << " skeletons, " << frames << " frames, budget " << LOD_FRAME_BUDGET << " us: " << total << " updates, "
+		<< least << " to " << most << " per frame after the first" << std::endl;
+
+	for (uint l = 0; l < levels; ++l)
+	{
+		std::cout << "  level " << l << " (every " << level_interval[l] << " frames): " << level_updates[l] << " updates, "
+			<< level_late[l] / std::max(1u, level_updates[l]) << " frames late on average, " << level_late_max[l] << " at most" << std::endl;
+	}
+
+	std::cout << over_budget << " frames over budget (by up to " << worst_over << " us), " << starved << " visible skeletons starved, "
+		<< hidden_updates << " updates out of view" << std::endl;
+
+	return (over_budget || starved || hidden_updates) ? 1 : 0;
+}
+
+// searches a database of random clips, and checks the pruned search against the exhaustive one
+int match_benchmark(const bench_args& args)
+{
+	uint frames = args.counts[0];
+	bool three_dimensional = args.three_dimensional;
+	kinecontext* context = args.context();
+	uint count = context->num_joints() * context->degrees_of_freedom();
+	const uint clip_length = 240;
+
+	// every clip swings each joint with its own amplitude, frequency and phase
+	std::vector<float> clip(clip_length * count);
+	std::vector<float> amplitude(count), frequency(count), phase(count), offset(count);
+
+	pose_db poses;
+	auto start = std::chrono::steady_clock::now();
+	poses.reset(count);
+
+	for (uint first = 0; first < frames; first += clip_length)
+	{
+		for (uint i = 0; i < count; ++i)
+		{
+			amplitude[i] = random_between(10.0f, 90.0f);
+			frequency[i] = random_between(0.01f, 0.1f);
+			phase[i] = random_between(0.0f, 2 * PI);
+			offset[i] = random_between(0.0f, 360.0f);
+		}
+
+		uint length = std::min(clip_length, frames - first);
+		for (uint f = 0; f < length; ++f)
+			for (uint i = 0; i < count; ++i)
+				clip[f * count + i] = offset[i] + amplitude[i] * sinf(frequency[i] * f + phase[i]);
+
+		poses.add_clip(*context, &clip[0], length);
+	}
+
+	poses.finish();
+
+	std::cout << "Pose database: " << poses.size() << " frames of " << count << " angles built in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+
+	// queries near stored frames, as when a skeleton is driven by the database
+	const uint queries = 1000;
+	const uint checked = 100;
+	std::vector<float> query(count);
+	frame_timings search_timings;
+	unsigned long long tested = 0;
+	uint mismatches = 0;
+
+	for (uint q = 0; q < queries; ++q)
+	{
+		const float* source = poses.frame(rand() % poses.size());
+		for (uint i = 0; i < count; ++i)
+			query[i] = source[i] + random_between(-15.0f, 15.0f);
+
+		vec3 velocity(random_between(-MATCH_SPEED, MATCH_SPEED), random_between(-MATCH_SPEED, MATCH_SPEED), three_dimensional ? random_between(-MATCH_SPEED, MATCH_SPEED) : 0.0f);
+
+		auto search_start = std::chrono::steady_clock::now();
+		match_result best = poses.search(&query[0], velocity);
+		search_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - search_start).count());
+		tested += best.frames_tested;
+
+		// the kernels round differently, so ties within that are equally good
+		if (q < checked && poses.search_exhaustive(&query[0], velocity).distance < best.distance * 0.9999f)
+			mismatches++;
+	}
+
+	search_timings.report(std::cout, "search");
+	std::cout << "frames compared per search: " << tested / queries << " of " << poses.size()
+		<< ", worse than exhaustive: " << mismatches << " of " << checked << std::endl;
+
+	return mismatches ? 1 : 0;
+}
+
+// how far apart a joint of a character is in two batches: degrees around the circle, or the largest difference of
+// the quaternion components, whose sign does not matter
+static float blend_error(const pose_batch& a, const pose_batch& b, uint character, uint joint)
+{
+	if (a.num_channels() == BLEND_ANGLES)
+		return fabsf(remainderf(a.row(joint, 0)[character] - b.row(joint, 0)[character], 360.0f));
+
+	float dot = 0.0f;
+	for (uint c = 0; c < 4; ++c)
+		dot += a.row(joint, c)[character] * b.row(joint, c)[character];
+
+	float error = 0.0f;
+	for (uint c = 0; c < 4; ++c)
+		error = std::max(error, fabsf(a.row(joint, c)[character] - (dot < 0.0f ? -1.0f : 1.0f) * b.row(joint, c)[character]));
+	return error;
+}
+
+/*
+ *	the joint of a character blended on its own through the layers of blend_benchmark, one after the other
+ *
+ *	crossfades go the shorter way, along the circle or between quaternions (normalized), and additive layers add
+ *	w of their angle, or turn the result by w of their rotation: r = r * normalize(lerp(identity, layer, w))
+ */
+static void reference_blend(const std::vector<pose_batch>& sources, const std::vector<float>& weights,
+	const std::vector<float>& mask, uint character, uint joint, pose_batch& out)
+{
+	uint channels = sources[0].num_channels();
+	float r[4], q[4];
+
+	for (uint c = 0; c < channels; ++c)
+		r[c] = sources[0].row(joint, c)[character];
+
+	for (uint l = 1; l < sources.size(); ++l)
+	{
+		bool additive = l % 3 == 2;
+		float w = std::min(std::max(weights[l - 1] * (additive ? mask[joint] : 1.0f), 0.0f), 1.0f);
+
+		for (uint c = 0; c < channels; ++c)
+			q[c] = sources[l].row(joint, c)[character];
+
+		if (channels == BLEND_ANGLES)
+		{
+			float d = additive ? q[0] : remainderf(q[0] - r[0], 360.0f);
+			r[0] = fmodf(r[0] + w * d + 360.0f * 4, 360.0f);
+			continue;
+		}
+
+		float length = 0.0f;
+
+		if (additive)
+		{
+			float s = q[3] < 0.0f ? -w : w;
+			float d[4] = { q[0] * s, q[1] * s, q[2] * s, q[3] * s + (1.0f - w) };
+			length = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + d[3] * d[3]);
+
+			float x = (r[3] * d[0] + r[0] * d[3] + r[1] * d[2] - r[2] * d[1]) / length;
+			float y = (r[3] * d[1] - r[0] * d[2] + r[1] * d[3] + r[2] * d[0]) / length;
+			float z = (r[3] * d[2] + r[0] * d[1] - r[1] * d[0] + r[2] * d[3]) / length;
+			r[3] = (r[3] * d[3] - r[0] * d[0] - r[1] * d[1] - r[2] * d[2]) / length;
+			r[0] = x; r[1] = y; r[2] = z;
+			continue;
+		}
+
+		float dot = r[0] * q[0] + r[1] * q[1] + r[2] * q[2] + r[3] * q[3];
+		for (uint c = 0; c < 4; ++c)
+		{
+			r[c] = r[c] * (1.0f - w) + q[c] * (dot < 0.0f ? -w : w);
+			length += r[c] * r[c];
+		}
+		for (uint c = 0; c < 4; ++c)
+			r[c] /= sqrtf(length);
+	}
+
+	for (uint c = 0; c < channels; ++c)
+		out.row(joint, c)[character] = r[c];
+}
+
+// blends layers of random poses for many characters, alternating crossfades and masked additive layers, and checks
+// the kernels against the scalar ones and against blending every character on its own
+int blend_benchmark(const bench_args& args)
+{
+	uint characters = args.counts[0];
+	uint layers = args.counts[1];
+	bool three_dimensional = args.three_dimensional;
+	kinecontext* context = args.context();
+	uint joints = context->num_joints();
+	uint dof = context->degrees_of_freedom();
+	BlendChannels channels = three_dimensional ? BLEND_QUATERNIONS : BLEND_ANGLES;
+
+	std::vector<pose_batch> sources(layers);
+	std::vector<float> angles(joints * dof);
+
+	for (uint l = 0; l < layers; ++l)
+	{
+		sources[l].resize(characters, joints, channels);
+
+		// every third layer is additive, so it holds small offsets rather than a pose
+		float range = (l % 3 == 2) ? 20.0f : 180.0f;
+
+		for (uint c = 0; c < characters; ++c)
+		{
+			for (uint i = 0; i < angles.size(); ++i)
+				angles[i] = random_between(-range, range);
+			sources[l].set_angles(c, &angles[0]);
+		}
+	}
+
+	// upper joints only, for the additive layers
+	std::vector<float> upper(joints);
+	for (uint j = 0; j < joints; ++j)
+		upper[j] = j < joints / 2 ? 0.0f : 1.0f;
+
+	blend_tree tree;
+	tree.reset(characters, joints, channels);
+	int mask = tree.add_mask(&upper[0]);
+
+	std::vector<uint> layer_nodes;
+	uint root = tree.add_source(&sources[0]);
+
+	for (uint l = 1; l < layers; ++l)
+	{
+		uint source = tree.add_source(&sources[l]);
+		root = (l % 3 == 2) ? tree.add_additive(root, source, 0.5f, mask) : tree.add_crossfade(root, source, 0.5f);
+		layer_nodes.push_back(root);
+	}
+
+	pose_batch out;
+	frame_timings blend_timings;
+	std::vector<float> weights(layer_nodes.size());
+	const uint frames = 200;
+
+	for (uint f = 0; f < frames; ++f)
+	{
+		// weights move over time, and every fourth layer is faded out completely
+		for (uint i = 0; i < layer_nodes.size(); ++i)
+		{
+			weights[i] = (i % 4 == 3) ? 0.0f : 0.5f + 0.4f * sinf(f * 0.05f + i);
+			tree.set_weight(layer_nodes[i], weights[i]);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		tree.evaluate(root, out);
+		blend_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	blend_timings.report(std::cout, "blend");
+	std::cout << characters << " characters, " << layers << " layers of " << joints << " joints: "
+		<< tree.evaluated() << " nodes evaluated, " << tree.skipped() << " skipped, "
+		<< (double)characters * layers / (blend_timings.mean() * 1000.0) << " character layers per us" << std::endl;
+
+	// the last frame again through the scalar kernels, and every character on its own
+	pose_batch scalar, reference;
+	bool avx2 = blend_tree::select_kernels(true);
+	blend_tree::select_kernels(false);
+	tree.evaluate(root, scalar);
+	blend_tree::select_kernels(true);
+
+	reference.resize(characters, joints, channels);
+	for (uint c = 0; c < characters; ++c)
+		for (uint j = 0; j < joints; ++j)
+			reference_blend(sources, weights, upper, c, j, reference);
+
+	// degrees, or quaternion components
+	const float tolerance = three_dimensional ? 1e-4f : 1e-2f;
+	float kernel_error = 0.0f, reference_error = 0.0f;
+	uint wrong = 0;
+
+	for (uint c = 0; c < characters; ++c)
+	{
+		for (uint j = 0; j < joints; ++j)
+		{
+			float k = blend_error(out, scalar, c, j);
+			float r = blend_error(out, reference, c, j);
+			kernel_error = std::max(kernel_error, k);
+			reference_error = std::max(reference_error, r);
+
+			if (k > tolerance || r > tolerance)
+				wrong++;
+		}
+	}
+
+	std::cout << (avx2 ? "AVX2" : "scalar") << " kernels against the scalar ones: at most " << kernel_error
+		<< ", against blending each character: at most " << reference_error << (three_dimensional ? "" : " degrees")
+		<< ", " << wrong << " joints off" << std::endl;
+
+	return wrong ? 1 : 0;
+}
+
+// plays random splines on many skeletons at their own offsets and speeds, and checks that the splines pass their keys
+int spline_benchmark(const bench_args& args)
+{
+	uint skeletons = args.counts[0];
+	kinecontext* context = args.context();
+	uint count = context->num_joints() * context->degrees_of_freedom();
+
+	// keys anywhere on the circle, so many segments cross 0 degrees
+	const uint clips = 64;
+	const uint keys = 32;
+	std::vector<angle_spline> splines(clips);
+	std::vector<float> angles(count);
+	std::vector<std::vector<float> > key_angles(clips);
+	std::vector<std::vector<float> > key_times(clips);
+
+	for (uint c = 0; c < clips; ++c)
+	{
+		splines[c].reset(count);
+		float time = 0.0f;
+
+		for (uint k = 0; k < keys; ++k)
+		{
+			for (uint i = 0; i < count; ++i)
+				angles[i] = random_between(0.0f, 360.0f);
+
+			splines[c].add_key(time, &angles[0]);
+			key_angles[c].insert(key_angles[c].end(), angles.begin(), angles.end());
+			key_times[c].push_back(time);
+			time += random_between(0.1f, 0.5f);
+		}
+
+		splines[c].finish(c % 2 == 0);
+	}
+
+	// every key is met, up to rounding
+	float worst = 0.0f;
+	std::vector<float> out(splines[0].row_size());
+
+	for (uint c = 0; c < clips; ++c)
+	{
+		for (uint k = 0; k < keys; ++k)
+		{
+			splines[c].evaluate(key_times[c][k], &out[0]);
+
+			for (uint i = 0; i < count; ++i)
+				worst = std::max(worst, fabsf(shortest_arc(key_angles[c][k * count + i], out[i])));
+		}
+	}
+
+	spline_batch batch;
+	batch.reset(count);
+	std::vector<float> offsets(skeletons), speeds(skeletons);
+
+	for (uint s = 0; s < skeletons; ++s)
+	{
+		offsets[s] = random_between(0.0f, 8.0f);
+		speeds[s] = random_between(0.5f, 2.0f);
+		batch.add(&splines[s % clips], offsets[s], speeds[s]);
+	}
+
+	frame_timings spline_timings;
+	const uint frames = 200;
+
+	for (uint f = 0; f < frames; ++f)
+	{
+		auto start = std::chrono::steady_clock::now();
+		batch.evaluate(f * REPLAY_FRAME_TIME);
+		spline_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	// the last frame of every skeleton again, from its own spline through the scalar kernel
+	float time = (frames - 1) * REPLAY_FRAME_TIME;
+	float batch_error = 0.0f;
+	bool avx2 = angle_spline::select_kernels(true);
+	angle_spline::select_kernels(false);
+
+	for (uint s = 0; s < skeletons; ++s)
+	{
+		splines[s % clips].evaluate(offsets[s] + time * speeds[s], &out[0]);
+
+		for (uint i = 0; i < count; ++i)
+			batch_error = std::max(batch_error, fabsf(shortest_arc(out[i], batch.angles_of(s)[i])));
+	}
+
+	angle_spline::select_kernels(true);
+
+	spline_timings.report(std::cout, "splines");
+	std::cout << skeletons << " skeletons of " << count << " angles: "
+		<< (double)skeletons * count / (spline_timings.mean() * 1000.0) << " angles per us, "
+		<< "largest error at a key: " << worst << " degrees, " << (avx2 ? "AVX2" : "scalar")
+		<< " batch against the scalar splines: " << batch_error << " degrees" << std::endl;
+
+	return worst < 0.01f && batch_error < 0.01f ? 0 : 1;
+}
+
+// ticks many chains of the context at random poses, with their roots pinned and every other end effector dragged
+int ragdoll_benchmark(const bench_args& args)
+{
+	uint chains = args.counts[0];
+	kinecontext* context = args.context();
+	uint joints = context->num_joints();
+
+	std::vector<float> angles(joints * context->degrees_of_freedom());
+	std::vector<vec3> points(joints);
+	std::vector<vec3> roots(chains);
+	std::vector<vec3> ends(chains);
+
+	ragdoll chain_physics;
+	chain_physics.reset(chains, joints);
+	chain_physics.set_bend_limit(RAGDOLL_BEND_LIMIT);
+
+	for (uint c = 0; c < chains; ++c)
+	{
+		for (uint i = 0; i < angles.size(); ++i)
+			angles[i] = random_between(0.0f, 360.0f);
+
+		context->joint_positions(&angles[0], &points[0]);
+		chain_physics.set_chain(c, &points[0]);
+		chain_physics.pin(c, 0, points[0]);
+		roots[c] = points[0];
+		ends[c] = points[joints - 1];
+	}
+
+	vec3 d = points[1] - points[0];
+	chain_physics.set_gravity(vec3(0.0f, -RAGDOLL_GRAVITY * sqrtf(d.x * d.x + d.y * d.y + d.z * d.z), 0.0f));
+
+	frame_timings tick_timings;
+	const uint ticks = 2000;
+
+	for (uint t = 0; t < ticks; ++t)
+	{
+		// the dragged ends move to and from their roots, within reach
+		float pull = 0.8f + 0.1f * sinf(t * RAGDOLL_TICK * 2.0f * PI);
+		for (uint c = 0; c < chains; c += 2)
+			chain_physics.pin(c, joints - 1, roots[c] + (ends[c] - roots[c]) * pull);
+
+		auto start = std::chrono::steady_clock::now();
+		chain_physics.step(RAGDOLL_TICK, 1, RAGDOLL_ITERATIONS);
+		tick_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	tick_timings.report(std::cout, "tick");
+
+	// a dragged chain stretches when its bend limits cannot be met at the distance it is held at
+	float stretch[2] = { 0.0f, 0.0f };
+	for (uint c = 0; c < chains; ++c)
+		stretch[c % 2] = std::max(stretch[c % 2], chain_physics.stretch(c));
+
+	std::cout << chains << " chains of " << joints << " particles, " << RAGDOLL_ITERATIONS << " iterations: "
+		<< 1000.0 / tick_timings.mean() << " ticks per second, largest stretch of a link: "
+		<< stretch[1] * 100.0f << "% (dragged chains: " << stretch[0] * 100.0f << "%)" << std::endl;
+
+	// many ticks per thread launch, as a frame at 60 Hz runs them
+	uint threads = std::max(1u, std::thread::hardware_concurrency());
+	if (threads > 1)
+	{
+		auto start = std::chrono::steady_clock::now();
+		chain_physics.step(RAGDOLL_TICK, ticks, RAGDOLL_ITERATIONS, threads);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << threads << " threads: " << ticks / ms * 1000.0 << " ticks per second" << std::endl;
+	}
+
+	return (stretch[1] == stretch[1] && stretch[1] < 0.05f) ? 0 : 1;
+}
+
+// moves many skeletons that overlap their neighbours, and finds the contacts between all of their bones every frame
+int collision_benchmark(const bench_args& args)
+{
+	uint skeletons = args.counts[0];
+	bool three_dimensional = args.three_dimensional;
+	kinecontext* context = args.context();
+	uint joints = context->num_joints();
+	uint dof = context->degrees_of_freedom();
+
+	std::vector<float> base(skeletons * joints * dof);
+	for (uint i = 0; i < base.size(); ++i)
+		base[i] = random_between(0.0f, 360.0f);
+
+	std::vector<float> angles(joints * dof);
+	std::vector<vec3> points(joints);
+
+	// roots on a grid at half the length of a chain, so neighbours reach into each other
+	context->joint_positions(&base[0], &points[0]);
+	vec3 root = points[0];
+	float reach = 0.0f;
+	for (uint n = 1; n < joints; ++n)
+	{
+		vec3 d = points[n] - points[n - 1];
+		reach += sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+	}
+
+	uint side = (uint)ceilf(sqrtf((float)skeletons));
+	std::vector<vec3> offsets(skeletons);
+	for (uint k = 0; k < skeletons; ++k)
+	{
+		float u = (k % side) * reach * 0.5f;
+		float v = (k / side) * reach * 0.5f;
+		offsets[k] = three_dimensional ? vec3(u, 0.0f, v) : vec3(u, v, 0.0f);
+	}
+
+	bone_collider bones;
+	for (uint k = 0; k < skeletons; ++k)
+	{
+		for (uint n = 0; n + 1 < joints; ++n)
+		{
+			vec3 d = points[n + 1] - points[n];
+			bones.add_bone(k, n, BONE_RADIUS * sqrtf(d.x * d.x + d.y * d.y + d.z * d.z));
+		}
+	}
+
+	frame_timings detect_timings;
+	const uint frames = 100;
+	uint swaps = 0, candidates = 0, contacts = 0;
+
+	for (uint f = 0; f <= frames; ++f)
+	{
+		// every angle swings around its base
+		for (uint k = 0; k < skeletons; ++k)
+		{
+			for (uint i = 0; i < angles.size(); ++i)
+				angles[i] = base[k * angles.size() + i] + 20.0f * sinf(f * 0.05f + i + k);
+
+			context->joint_positions(&angles[0], &points[0]);
+
+			for (uint n = 0; n + 1 < joints; ++n)
+				bones.set_bone(k * (joints - 1) + n, points[n] - root + offsets[k], points[n + 1] - root + offsets[k]);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		bones.detect();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// the first frame sorts from scratch
+		if (f == 0)
+		{
+			std::cout << "first frame: " << ms << " ms" << std::endl;
+			continue;
+		}
+
+		detect_timings.add(ms);
+		swaps += bones.last_stats().swaps;
+		candidates += bones.last_stats().candidates;
+		contacts += bones.last_stats().contacts;
+	}
+
+	detect_timings.report(std::cout, "detect");
+	std::cout << bones.num_bones() << " bones: " << swaps / frames << " swaps, " << candidates / frames
+		<< " candidate pairs, " << contacts / frames << " contacts per frame" << std::endl;
+
+	// the sweep finds the same contacts as testing every pair
+	if (bones.num_bones() > 20000)
+		return 0;
+
+	std::vector<bone_contact> expected;
+	bones.detect_exhaustive(expected);
+
+	std::vector<std::pair<uint, uint> > found, all;
+	for (uint i = 0; i < bones.contacts().size(); ++i)
+		found.push_back(std::make_pair(bones.contacts()[i].a, bones.contacts()[i].b));
+	for (uint i = 0; i < expected.size(); ++i)
+		all.push_back(std::make_pair(expected[i].a, expected[i].b));
+
+	std::sort(found.begin(), found.end());
+	std::sort(all.begin(), all.end());
+
+	std::vector<std::pair<uint, uint> > missed;
+	std::set_difference(all.begin(), all.end(), found.begin(), found.end(), std::back_inserter(missed));
+
+	std::cout << "exhaustive: " << all.size() << " contacts, missed by the sweep: " << missed.size() << std::endl;
+	return (missed.empty() && found.size() == all.size()) ? 0 : 1;
+}
+
+// casts rays from above at many moving skeletons, refitting the tree over their joints and bones every frame
+int pick_benchmark(const bench_args& args)
+{
+	uint skeletons = args.counts[0];
+	kinecontext* context = args.kine_3d;
+	uint joints = context->num_joints();
+	uint dof = context->degrees_of_freedom();
+
+	std::vector<float> base(skeletons * joints * dof);
+	for (uint i = 0; i < base.size(); ++i)
+		base[i] = random_between(0.0f, 360.0f);
+
+	std::vector<float> angles(joints * dof);
+	std::vector<vec3> points(joints);
+
+	context->joint_positions(&base[0], &points[0]);
+	vec3 root = points[0];
+	float reach = 0.0f;
+	for (uint n = 1; n < joints; ++n)
+	{
+		vec3 d = points[n] - points[n - 1];
+		reach += sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+	}
+
+	// skeletons on a grid on the ground, a chain apart
+	uint side = (uint)ceilf(sqrtf((float)skeletons));
+	std::vector<vec3> offsets(skeletons);
+	for (uint k = 0; k < skeletons; ++k)
+		offsets[k] = vec3((k % side) * reach, 0.0f, (k / side) * reach);
+
+	bone_bvh picker;
+	for (uint k = 0; k < skeletons; ++k)
+	{
+		for (uint n = 0; n < joints; ++n)
+			picker.add_joint(k, n, PICK_JOINT_RADIUS);
+		for (uint n = 0; n + 1 < joints; ++n)
+			picker.add_bone(k, n, PICK_BONE_RADIUS);
+	}
+
+	std::vector<vec3> placed(skeletons * joints);	// where the joints are this frame
+
+	frame_timings refit_timings, ray_timings;
+	const uint frames = 100;
+	const uint rays = 100;
+	uint hits = 0, mismatches = 0, nodes = 0, primitives = 0;
+	double exhaustive_ms = 0.0;
+
+	for (uint f = 0; f <= frames; ++f)
+	{
+		for (uint k = 0; k < skeletons; ++k)
+		{
+			for (uint i = 0; i < angles.size(); ++i)
+				angles[i] = base[k * angles.size() + i] + 20.0f * sinf(f * 0.05f + i + k);
+
+			context->joint_positions(&angles[0], &points[0]);
+
+			vec3* p = &placed[k * joints];
+			for (uint n = 0; n < joints; ++n)
+				p[n] = points[n] - root + offsets[k];
+
+			uint first = k * (2 * joints - 1);
+			for (uint n = 0; n < joints; ++n)
+				picker.set_joint(first + n, p[n]);
+			for (uint n = 0; n + 1 < joints; ++n)
+				picker.set_bone(first + joints + n, p[n], p[n + 1]);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		picker.refit();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// the first frame builds the tree
+		if (f == 0)
+		{
+			std::cout << "build: " << ms << " ms" << std::endl;
+			continue;
+		}
+
+		refit_timings.add(ms);
+
+		// slanted rays from above, half of them aimed close to a joint and half anywhere over the grid
+		for (uint r = 0; r < rays; ++r)
+		{
+			float spread = PICK_JOINT_RADIUS * 0.5f;
+			vec3 target = (r % 2 == 0)
+				? placed[rand() % placed.size()] + vec3(random_between(-spread, spread), random_between(-spread, spread), random_between(-spread, spread))
+				: vec3(random_between(0.0f, side * reach), 0.0f, random_between(0.0f, side * reach));
+			vec3 origin = target + vec3(random_between(-reach, reach), reach * 4.0f, random_between(-reach, reach));
+
+			pick_hit hit, expected;
+			start = std::chrono::steady_clock::now();
+			bool found = picker.raycast(origin, target - origin, hit);
+			ray_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+			nodes += picker.last_stats().nodes;
+			primitives += picker.last_stats().primitives;
+
+			if (f % 10 != 0)
+			{
+				hits += found;
+				continue;
+			}
+
+			// every tenth frame the tree is checked against testing every primitive
+			start = std::chrono::steady_clock::now();
+			bool exhaustive = picker.raycast_exhaustive(origin, target - origin, expected);
+			exhaustive_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			hits += found;
+			if (found != exhaustive || (found && fabsf(hit.t - expected.t) > 1e-3f * std::max(1.0f, expected.t)))
+				mismatches++;
+		}
+	}
+
+	refit_timings.report(std::cout, "refit");
+	ray_timings.report(std::cout, "ray");
+	std::cout << picker.size() << " primitives in " << skeletons << " skeletons: " << hits * 100 / (frames * rays) << "% hits, "
+		<< nodes / (frames * rays) << " nodes and " << primitives / (frames * rays) << " primitives per ray, "
+		<< picker.last_stats().rebuilds - 1 << " rebuilds" << std::endl;
+	std::cout << "exhaustive: " << exhaustive_ms * 1000.0 / (frames / 10 * rays) << " us per ray, mismatches: " << mismatches << std::endl;
+
+	return mismatches == 0 ? 0 : 1;
+}
+
+// forward kinematics of a crowd from float angles and from quantized ones, with their storage and their errors
+int quantize_benchmark(const bench_args& args)
+{
+	uint skeletons = args.counts[0];
+	kinecontext* context = args.context();
+	uint joints = context->num_joints();
+	uint dof = context->degrees_of_freedom();
+	uint stride = joints * dof;
+
+	// even skeletons are posed with the arrow keys, in whole turns of ROTATION_ANGLE, odd ones anyhow
+	std::vector<float> angles(skeletons * stride);
+	for (uint k = 0; k < skeletons; ++k)
+	{
+		for (uint i = 0; i < stride; ++i)
+		{
+			float& a = angles[k * stride + i];
+			a = (k % 2 == 0) ? ROTATION_ANGLE * (rand() % 72 - 36) : random_between(-360.0f, 360.0f);
+		}
+	}
+
+	quantized_crowd crowd;
+	crowd.resize(skeletons, stride);
+	for (uint k = 0; k < skeletons; ++k)
+		crowd.encode(k, &angles[k * stride]);
+
+	size_t float_bytes = angles.size() * sizeof(float);
+	size_t pose_bytes = (size_t)skeletons * joints * sizeof(joint_pose3);
+	std::cout << skeletons << " skeletons of " << joints << " joints: " << float_bytes << " bytes as floats, "
+		<< crowd.bytes() << " quantized (" << (double)float_bytes / crowd.bytes() << "x smaller, "
+		<< (double)pose_bytes / crowd.bytes() << "x against the evaluated joints)" << std::endl;
+
+	std::vector<vec3> exact(skeletons * joints), quantized(skeletons * joints);
+	frame_timings float_timings, quantized_timings;
+	const uint frames = 20;
+
+	for (uint f = 0; f < frames; ++f)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (uint k = 0; k < skeletons; ++k)
+			context->joint_positions(&angles[k * stride], &exact[k * joints]);
+		float_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		start = std::chrono::steady_clock::now();
+		for (uint k = 0; k < skeletons; ++k)
+			context->joint_positions_quantized(crowd.skeleton(k), &quantized[k * joints]);
+		quantized_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	float_timings.report(std::cout, "float fk");
+	quantized_timings.report(std::cout, "quantized fk");
+
+	// the trigonometry alone, of every angle of the crowd
+	float sum = 0.0f;
+	auto start = std::chrono::steady_clock::now();
+	for (uint i = 0; i < angles.size(); ++i)
+		sum += sinf(angles[i] * (PI / 180.0f)) + cosf(angles[i] * (PI / 180.0f));
+	double trig_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (uint k = 0; k < skeletons; ++k)
+	{
+		const uint16_t* q = crowd.skeleton(k);
+		for (uint i = 0; i < stride; ++i)
+			sum -= table_sin(q[i]) + table_cos(q[i]);
+	}
+	double table_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "sinf and cosf: " << trig_ms * 1e6 / angles.size() << " ns per angle, table: "
+		<< table_ms * 1e6 / angles.size() << " ns (difference " << sum << ")" << std::endl;
+
+	/*
+	 *	every angle is off by at most half a step e, so the rotation of joint n, a product of n + 1 joints of dof
+	 *	rotations each, is off by at most (n + 1) dof e, and the error of the joint positions adds up as
+	 *
+	 *	|P'[n] - P[n]| <= sum over j <= n of |T[j]| j dof e
+	 *
+	 *	on top of that, both paths round differently, which is allowed for relative to the reach of the rig
+	 */
+	std::vector<float> zero(stride, 0.0f);
+	std::vector<vec3> rest(joints);
+	context->joint_positions(&zero[0], &rest[0]);
+
+	float e = 0.5f / ANGLE_STEPS * (PI / 180.0f);
+	float reach = 0.0f;
+	std::vector<float> bound(joints, 0.0f);
+	for (uint n = 1; n < joints; ++n)
+	{
+		vec3 d = rest[n] - rest[n - 1];
+		float length = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+		reach += length;
+		bound[n] = bound[n - 1] + length * n * dof * e;
+	}
+
+	float rounding = reach * 1e-5f;
+	float worst[2] = { 0.0f, 0.0f };
+	float worst_bound = 0.0f;
+	bool within = true;
+
+	for (uint k = 0; k < skeletons; ++k)
+	{
+		for (uint n = 0; n < joints; ++n)
+		{
+			vec3 d = quantized[k * joints + n] - exact[k * joints + n];
+			float error = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+
+			worst[k % 2] = std::max(worst[k % 2], error);
+			worst_bound = std::max(worst_bound, bound[n]);
+			within = within && error <= (k % 2 == 0 ? 0.0f : bound[n]) + rounding;
+		}
+	}
+
+	std::cout << "largest error: " << worst[0] << " for turns of " << ROTATION_ANGLE << " degrees, " << worst[1]
+		<< " for any angle (bound " << worst_bound << ", reach " << reach << ")" << std::endl;
+
+	return within ? 0 : 1;
+}
+
+// forward kinematics of a crowd by the loop over the joints and by the unrolled chain of the built-in rig
+int fk_benchmark(const bench_args& args)
+{
+	uint skeletons = args.counts[0];
+	bool three_dimensional = args.three_dimensional;
+	kinecontext* context = args.context();
+	uint joints = context->num_joints();
+	uint stride = joints * context->degrees_of_freedom();
+
+	bool fixed = three_dimensional ? args.kine_3d->uses_fixed_fk() : args.kine_2d->uses_fixed_fk();
+	if (!fixed)
+	{
+		std::cerr << "Error: the rig is not the built-in one, which has no unrolled chain" << std::endl;
+		return 1;
+	}
+
+	std::vector<float> angles(skeletons * stride);
+	for (uint i = 0; i < angles.size(); ++i)
+		angles[i] = random_between(-360.0f, 360.0f);
+
+	void (*unrolled)(const float*, vec3*) = three_dimensional ? builtin_chain3::joint_positions : builtin_chain2::joint_positions;
+
+	std::vector<vec3> looped(skeletons * joints), dispatched(skeletons * joints), direct(skeletons * joints);
+	frame_timings loop_timings, context_timings, direct_timings;
+	const uint frames = 20;
+
+	for (uint f = 0; f < frames; ++f)
+	{
+		if (three_dimensional) args.kine_3d->allow_fixed_fk(false); else args.kine_2d->allow_fixed_fk(false);
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint k = 0; k < skeletons; ++k)
+			context->joint_positions(&angles[k * stride], &looped[k * joints]);
+		loop_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		if (three_dimensional) args.kine_3d->allow_fixed_fk(true); else args.kine_2d->allow_fixed_fk(true);
+
+		start = std::chrono::steady_clock::now();
+		for (uint k = 0; k < skeletons; ++k)
+			context->joint_positions(&angles[k * stride], &dispatched[k * joints]);
+		context_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		start = std::chrono::steady_clock::now();
+		for (uint k = 0; k < skeletons; ++k)
+			unrolled(&angles[k * stride], &direct[k * joints]);
+		direct_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	std::cout << skeletons << " skeletons of " << joints << " joints" << std::endl;
+	loop_timings.report(std::cout, "loop fk");
+	context_timings.report(std::cout, "unrolled fk through the context");
+	direct_timings.report(std::cout, "unrolled fk");
+
+	// both paths multiply in another order, which is allowed for relative to the reach of the rig
+	std::vector<float> zero(stride, 0.0f);
+	std::vector<vec3> rest(joints);
+	context->joint_positions(&zero[0], &rest[0]);
+
+	float reach = 0.0f;
+	for (uint n = 1; n < joints; ++n)
+	{
+		vec3 d = rest[n] - rest[n - 1];
+		reach += sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+	}
+
+	float worst = 0.0f;
+	bool same = true;
+	for (uint i = 0; i < looped.size(); ++i)
+	{
+		vec3 d = direct[i] - looped[i];
+		vec3 e = dispatched[i] - direct[i];
+
+		worst = std::max(worst, sqrtf(d.x * d.x + d.y * d.y + d.z * d.z));
+		same = same && e.x == 0.0f && e.y == 0.0f && e.z == 0.0f;
+	}
+
+	std::cout << "largest difference: " << worst << " (reach " << reach << ")" << (same ? "" : ", the context differs") << std::endl;
+
+	return (same && worst <= reach * 1e-5f) ? 0 : 1;
+}
+
+static uint bench_steps = 0;	// work done by the benchmark scripts
+
+// a step that is a script of its own, awaited by the benchmark scripts
+script bench_step(uint ticks)
+{
+	co_await wait_ticks(ticks);
+	bench_steps++;
+}
+
+// sleeps for pseudo-random numbers of ticks, and now and then awaits a nested script or a condition
+script bench_script(uint seed)
+{
+	uint state = seed * 2654435761u + 1;
+
+	for (;;)
+	{
+		state = state * 1664525u + 1013904223u;
+		co_await wait_ticks(1 + (state >> 8) % 240);
+		bench_steps++;
+
+		if ((state >> 20) % 8 == 0)
+			co_await bench_step(1 + (state >> 24) % 16);
+
+		if ((state >> 16) % 64 == 0)
+			co_await wait_until([]() { return bench_steps % 4 == 0; });
+	}
+}
+
+// runs many concurrent scripts, and fails if awaiting allocates once the frame pool is filled
+int script_benchmark(const bench_args& args)
+{
+	uint count = args.counts[0];
+	script_scheduler bench(SCRIPT_TICK);
+
+	// every script awaits a step at a time, so the pool holds a step for each before the first tick
+	{
+		script step = bench_step(0);
+		script::reserve(step.frame_bytes(), count);
+	}
+
+	for (uint i = 0; i < count; ++i)
+		bench.spawn(bench_script(i));
+
+	const uint warmup = 300;
+	const uint ticks = 1000;
+
+	for (uint t = 0; t < warmup; ++t)
+		bench.tick();
+
+	frame_timings tick_timings;
+	uint resumed = 0;
+
+	alloc_tracker::reset();
+
+	for (uint t = 0; t < ticks; ++t)
+	{
+		auto start = std::chrono::steady_clock::now();
+		alloc_tracker::enable(true);
+		bench.tick();
+		alloc_tracker::enable(false);
+		tick_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		resumed += bench.resumed_last_tick();
+	}
+
+	alloc_counters allocated = alloc_tracker::total();
+
+	tick_timings.report(std::cout, "tick");
+	std::cout << count << " scripts: " << resumed / ticks << " resumed per tick, "
+		<< tick_timings.mean() * 1e6 * ticks / std::max(1u, resumed) << " ns per resume, ";
+	if (alloc_tracker::available())
+		std::cout << allocated.allocations << " allocations in " << ticks << " ticks" << std::endl;
+	else
+		std::cout << "allocations not counted (make linux-alloc-check counts them)" << std::endl;
+
+	bench.stop_all();
+	return allocated.allocations == 0 ? 0 : 1;
+}
+
+// a pose of many joints with attachments on every bone
+class history_rig : public editable_pose
+{
+private:
+	std::vector<float> angles;
+	std::vector<std::vector<vec3> > attachments;
+	edit_marks marks;
+
+public:
+	history_rig(uint joints, uint points) : angles(joints * 3, 0.0f), attachments(joints, std::vector<vec3>(points)) {}
+
+	void rotate_joint_about(uint joint, char axis, float degrees)
+	{
+		angles[joint * 3 + (axis - 'x')] += degrees;
+		marks.mark(joint, edit_marks::ANGLES);
+	}
+
+	uint num_joints() { return attachments.size(); }
+	uint degrees_of_freedom() { return 3; }
+	void get_angles(float* out) { std::copy(angles.begin(), angles.end(), out); }
+	void set_angles(const float* in) { std::copy(in, in + angles.size(), angles.begin()); marks.all_angles = true; }
+
+	uint num_attachments(uint joint) { return attachments[joint].size(); }
+	void get_attachments(uint joint, vec3* points) { std::copy(attachments[joint].begin(), attachments[joint].end(), points); }
+	void set_attachments(uint joint, const vec3* points, uint count) { attachments[joint].assign(points, points + count); marks.mark(joint, edit_marks::ATTACHMENTS); }
+
+	edit_marks& edits() { return marks; }
+
+	const std::vector<std::vector<vec3> >& all_attachments() const { return attachments; }
+};
+
+static bool same_points(const std::vector<std::vector<vec3> >& a, const std::vector<std::vector<vec3> >& b)
+{
+	if (a.size() != b.size())
+		return false;
+
+	for (uint j = 0; j < a.size(); ++j)
+	{
+		if (a[j].size() != b[j].size())
+			return false;
+
+		for (uint i = 0; i < a[j].size(); ++i)
+		{
+			if (a[j][i].x != b[j][i].x || a[j][i].y != b[j][i].y || a[j][i].z != b[j][i].z)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// edits a big rig one joint at a time, and reports what a version costs against the whole pose
+int history_benchmark(const bench_args& args)
+{
+	uint joints = args.counts[0];
+	uint edits = args.counts[1];
+	history_rig rig(joints, 8);
+	pose_history history;
+
+	std::vector<float> first(joints * 3);
+	std::vector<float> last(joints * 3);
+	std::vector<float> now(joints * 3);
+	rig.get_angles(&first[0]);
+	std::vector<std::vector<vec3> > first_points = rig.all_attachments();
+
+	frame_timings commit_timings;
+	history.reset(rig);
+	size_t bytes = 0;
+
+	for (uint e = 0; e < edits; ++e)
+	{
+		uint joint = rand() % joints;
+		rig.rotate_joint_about(joint, 'x' + rand() % 3, ROTATION_ANGLE);
+
+		// every fourth edit moves an attachment too
+		if (e % 4 == 0)
+		{
+			vec3 points[8];
+			rig.get_attachments(joint, points);
+			points[rand() % 8].x += 1.0f;
+			rig.set_attachments(joint, points, 8);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		history.commit(rig);
+		commit_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		bytes += history.version_bytes(history.current_version());
+	}
+
+	rig.get_angles(&last[0]);
+	std::vector<std::vector<vec3> > last_points = rig.all_attachments();
+
+	auto start = std::chrono::steady_clock::now();
+	while (history.undo(rig));
+	double undo_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	rig.get_angles(&now[0]);
+	bool restored = now == first && same_points(rig.all_attachments(), first_points);
+
+	start = std::chrono::steady_clock::now();
+	while (history.redo(rig));
+	double redo_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	rig.get_angles(&now[0]);
+	restored = restored && now == last && same_points(rig.all_attachments(), last_points);
+
+	commit_timings.report(std::cout, "commit");
+	std::cout << joints << " joints: the pose takes " << history.version_bytes(0) << " bytes, an edit "
+		<< bytes / std::max(1u, edits) << " bytes on average" << std::endl;
+	std::cout << "undoing " << edits << " edits took " << undo_ms << " ms, redoing them " << redo_ms << " ms, "
+		<< (restored ? "poses and attachments restored" : "FAILED: poses or attachments differ") << std::endl;
+
+	return restored ? 0 : 1;
+}
+
+// binds a generated cloud, compares the time with reading the file alone, and checks that every point is kept
+int cloud_benchmark(const bench_args& args)
+{
+	uint count = args.counts[0];
+	bool half = args.half, text = args.text, three_dimensional = args.three_dimensional;
+	kinecontext* context = args.context();
+	command_buffer buffer;
+	context->resize(1280, 720);
+	context->record(buffer);
+	const pose3& pose = context->current_pose();
+
+	// points around the skeleton
+	aabb around;
+	for (uint n = 0; n < pose.joints.size(); ++n)
+		around.grow(pose.joints[n].position, 20.0f);
+
+	std::vector<vec3> points(count);
+	for (uint i = 0; i < count; ++i)
+		points[i] = vec3(random_between(around.min.x, around.max.x), random_between(around.min.y, around.max.y),
+			three_dimensional ? random_between(around.min.z, around.max.z) : 0.0f);
+
+	std::string path = text ? "/tmp/kine_cloud_bench.txt" : "/tmp/kine_cloud_bench.kpcl";
+	bool written;
+
+	if (text)
+	{
+		std::ofstream file(path.c_str());
+		for (uint i = 0; i < count; ++i)
+			file << points[i].x << " " << points[i].y << " " << points[i].z << "\n";
+		written = file.good();
+	}
+	else
+		written = cloud_loader::write(path, points, three_dimensional ? 3 : 2);
+
+	if (!written)
+	{
+		std::cerr << "Error: could not write " << path << std::endl;
+		return 1;
+	}
+
+	// reading the file alone, the bound for loading it
+	auto start = std::chrono::steady_clock::now();
+	std::ifstream in(path.c_str(), std::ios::binary);
+	std::vector<char> block(1 << 20);
+	size_t bytes = 0;
+	while (in.read(&block[0], block.size()) || in.gcount() > 0)
+		bytes += in.gcount();
+	double read_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::vector<packed_points> clouds;
+	uint threads = std::max(1u, std::thread::hardware_concurrency());
+	cloud_loader loader(threads);
+
+	if (!loader.load(path, pose, clouds, half))
+	{
+		std::cerr << "Error: could not read " << path << std::endl;
+		return 1;
+	}
+
+	const cloud_stats& stats = loader.last_stats();
+
+	// every point, in file order within its bone, back in world coordinates
+	std::vector<uint> cursors(clouds.size(), 0);
+	float tolerance = half ? 0.25f : (text ? 0.05f : 1e-3f);
+	uint lost = 0;
+
+	for (uint i = 0; i < count; ++i)
+	{
+		bool found = false;
+
+		for (uint b = 0; b < clouds.size() && !found; ++b)
+		{
+			if (cursors[b] >= clouds[b].size())
+				continue;
+
+			const float* r = pose.joints[b].rotation;
+			vec3 l = clouds[b].get(cursors[b]);
+			vec3 w = pose.joints[b].position + vec3(r[0] * l.x + r[1] * l.y + r[2] * l.z,
+													r[3] * l.x + r[4] * l.y + r[5] * l.z,
+													r[6] * l.x + r[7] * l.y + r[8] * l.z);
+			vec3 d = w - points[i];
+
+			if (fabsf(d.x) < tolerance && fabsf(d.y) < tolerance && fabsf(d.z) < tolerance)
+			{
+				cursors[b]++;
+				found = true;
+			}
+		}
+
+		if (!found)
+			lost++;
+	}
+
+	std::cout << count << " points, " << bytes / 1e6 << " MB " << (text ? "text" : "binary") << ", " << threads << " thread(s): "
+		<< "reading " << bytes / read_seconds / 1e6 << " MB/s, loading and binding " << stats.file_bytes / stats.seconds / 1e6
+		<< " MB/s (" << stats.seconds << "s), " << stats.stored_bytes / 1e6 << " MB stored" << (half ? " as halves" : "") << std::endl;
+
+	for (uint b = 0; b + 1 < clouds.size(); ++b)
+		std::cout << "  bone " << b << ": " << clouds[b].size() << " points" << std::endl;
+
+	remove(path.c_str());
+
+	if (lost > 0 || stats.points != count)
+	{
+		std::cout << "FAILED: " << lost << " points not kept where they were" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+// retargets random clips both ways, against aiming the bones frame by frame through the contexts
+int retarget_benchmark(const bench_args& args)
+{
+	uint frames = args.counts[0];
+	kinecontext* contexts[2] = { args.kine_2d, args.kine_3d };
+	bool passed = true;
+
+	for (uint c = 0; c < 2; ++c)
+	{
+		kinecontext* from = contexts[c];
+		kinecontext* to = contexts[1 - c];
+		uint in_angles = from->num_joints() * from->degrees_of_freedom();
+		uint out_angles = to->num_joints() * to->degrees_of_freedom();
+
+		// every joint swings with its own amplitude, frequency and phase, as in the match benchmark
+		std::vector<float> clip(frames * in_angles);
+		std::vector<float> amplitude(in_angles), frequency(in_angles), phase(in_angles);
+		for (uint i = 0; i < in_angles; ++i)
+		{
+			amplitude[i] = random_between(10.0f, 90.0f);
+			frequency[i] = random_between(0.01f, 0.1f);
+			phase[i] = random_between(0.0f, 2 * PI);
+		}
+
+		for (uint f = 0; f < frames; ++f)
+			for (uint i = 0; i < in_angles; ++i)
+				clip[f * in_angles + i] = amplitude[i] * sinf(frequency[i] * f + phase[i]);
+
+		retargeter mapping;
+		if (!mapping.prepare(*from, *to))
+			return 1;
+
+		std::vector<float> out(frames * out_angles);
+		mapping.retarget(&clip[0], frames, &out[0]);
+		retarget_stats stats = mapping.last_stats();
+
+		std::cout << (c ? "3D to 2D: " : "2D to 3D: ") << frames / stats.seconds << " frames per second, end effector off by "
+			<< stats.aimed_error << " once aimed, " << stats.mean_error << " after " << stats.iterations
+			<< " FABRIK iterations (at most " << stats.max_error << ")" << std::endl;
+
+		// the end effectors of the retargeted frames, through the forward kinematics of the context, against the
+		// source end effectors scaled by the ratio of the reaches
+		std::vector<float> zero(std::max(in_angles, out_angles), 0.0f);
+		std::vector<vec3> source_rest(from->num_joints()), target_rest(to->num_joints());
+		from->joint_positions(&zero[0], &source_rest[0]);
+		to->joint_positions(&zero[0], &target_rest[0]);
+
+		float source_reach = 0.0f, target_reach = 0.0f;
+		for (uint n = 1; n < source_rest.size(); ++n)
+		{
+			vec3 d = source_rest[n] - source_rest[n - 1];
+			source_reach += sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+		}
+		for (uint n = 1; n < target_rest.size(); ++n)
+		{
+			vec3 d = target_rest[n] - target_rest[n - 1];
+			target_reach += sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+		}
+
+		double error = 0.0;
+		for (uint f = 0; f < frames; ++f)
+		{
+			vec3 goal = from->end_effector(&clip[f * in_angles]) - source_rest[0];
+			goal = target_rest[0] + goal * (target_reach / source_reach);
+			if (c == 1)
+				goal.z = 0.0f;
+
+			vec3 d = to->end_effector(&out[f * out_angles]) - goal;
+			error += sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+		}
+
+		error /= frames;
+		std::cout << "  through the contexts: off by " << error << " on average, with a reach of " << target_reach << std::endl;
+
+		// frame by frame, mapping joint to joint (both rigs have as many joints) and aiming through the contexts
+		std::vector<float> saved(out_angles), angles(out_angles);
+		std::vector<vec3> points(std::max(from->num_joints(), to->num_joints()));
+		to->get_angles(&saved[0]);
+		to->set_angles(&zero[0]);
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint f = 0; f < frames; ++f)
+		{
+			from->joint_positions(&clip[f * in_angles], &points[0]);
+			for (uint n = 0; n < to->num_joints(); ++n)
+				points[n] = target_rest[0] + (points[n] - source_rest[0]) * (target_reach / source_reach);
+			to->aim_bones(&points[0], &angles[0]);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		to->set_angles(&saved[0]);
+		std::cout << "  frame by frame through the contexts, aiming only: " << frames / seconds << " frames per second" << std::endl;
+
+		// FABRIK starts over when it ends further than RETARGET_MAX_ERROR of the reach, so no frame stays far off
+		passed = passed && stats.mean_error <= stats.aimed_error && error < target_reach * 0.01f
+			&& stats.max_error < target_reach * 2 * RETARGET_MAX_ERROR;
+	}
+
+	return passed ? 0 : 1;
+}
+
+// plays long clips on many skeletons from files that are not cached, reading on the frame thread, on threads and
+// through io_uring, and checks the sampled angles against the clips in memory
+int stream_benchmark(const bench_args& args)
+{
+	uint skeletons = args.counts[0];
+	uint frames = args.counts[1];
+	const uint clips = 8;
+	const uint angles = 12;
+	const uint clip_frames = 60 * 600;	// ten minutes at 60 frames per second
+
+	// every angle wanders, as recorded motion would
+	std::vector<std::vector<float> > decoded(clips);
+	std::string paths[clips];
+
+	for (uint c = 0; c < clips; ++c)
+	{
+		std::vector<float> data(clip_frames * angles);
+		std::vector<float> velocity(angles, 0.0f);
+		std::vector<float> angle(angles);
+
+		for (uint i = 0; i < angles; ++i)
+			angle[i] = random_between(0.0f, 360.0f);
+
+		for (uint f = 0; f < clip_frames; ++f)
+		{
+			for (uint i = 0; i < angles; ++i)
+			{
+				velocity[i] = velocity[i] * 0.95f + random_between(-0.5f, 0.5f);
+				angle[i] += velocity[i];
+				angle[i] -= 360.0f * floorf(angle[i] / 360.0f);
+				data[f * angles + i] = angle[i];
+			}
+		}
+
+		paths[c] = "/tmp/kine_stream_bench_" + std::to_string(c) + ".clip";
+		if (!clip_streamer::write(paths[c], &data[0], angles, clip_frames, REPLAY_FRAME_TIME))
+		{
+			std::cerr << "Error: could not write " << paths[c] << std::endl;
+			return 1;
+		}
+
+		// what the pages decode to
+		decoded[c].resize(data.size());
+		for (uint i = 0; i < data.size(); ++i)
+			decoded[c][i] = dequantize_angle(quantize_angle(data[i]));
+	}
+
+	std::vector<float> offsets(skeletons);
+	for (uint s = 0; s < skeletons; ++s)
+		offsets[s] = random_between(0.0f, clip_frames * REPLAY_FRAME_TIME);
+
+	std::cout << skeletons << " skeletons playing " << clips << " clips of " << clip_frames * angles * sizeof(uint16_t) / 1024
+		<< " KB, " << frames << " frames, cache of " << STREAM_CACHE_BYTES / 1024 << " KB" << std::endl;
+
+	const char* labels[3] = { "frame thread", "threads", "io_uring" };
+	std::vector<float> out(angles);
+	std::vector<float> expected(angles);
+	int result = 0;
+
+	for (uint mode = 0; mode < 3; ++mode)
+	{
+		// drops the clips from the page cache, so reads go to the disk
+#ifdef __linux__
+		for (uint c = 0; c < clips; ++c)
+		{
+			int fd = open(paths[c].c_str(), O_RDONLY);
+			if (fd >= 0)
+			{
+				fdatasync(fd);
+				posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+				close(fd);
+			}
+		}
+#endif
+
+		clip_streamer stream(mode == 0 ? 0 : STREAM_THREADS, mode == 2);
+		if (mode == 2 && strcmp(stream.backend(), "io_uring"))
+		{
+			std::cout << "io_uring: not available" << std::endl;
+			continue;
+		}
+
+		std::vector<int> ids(clips);
+		for (uint c = 0; c < clips; ++c)
+			ids[c] = stream.open(paths[c]);
+
+		frame_timings stream_timings;
+		uint mismatches = 0;
+		uint held = 0;
+		uint held_late = 0;	// after the first second, once every player had a chance to read ahead
+
+		for (uint f = 0; f < frames; ++f)
+		{
+			float time = f * REPLAY_FRAME_TIME;
+			auto start = std::chrono::steady_clock::now();
+
+			for (uint s = 0; s < skeletons; ++s)
+				stream.prefetch(ids[s % clips], offsets[s] + time);
+
+			stream.update();
+
+			for (uint s = 0; s < skeletons; ++s)
+			{
+				if (!stream.sample(ids[s % clips], offsets[s] + time, &out[0]))
+				{
+					held++;
+					held_late += time >= 1.0f;
+					continue;
+				}
+
+				// the same curve through the frames in memory
+				const std::vector<float>& d = decoded[s % clips];
+				float position = (offsets[s] + time) / REPLAY_FRAME_TIME;
+				position -= clip_frames * floorf(position / clip_frames);
+				int k = std::min((int)position, (int)clip_frames - 1);
+
+				const float* at[4];
+				for (int i = 0; i < 4; ++i)
+					at[i] = &d[((k - 1 + i + clip_frames) % clip_frames) * angles];
+
+				clip_streamer::interpolate(at[0], at[1], at[2], at[3], position - k, &expected[0], angles);
+
+				for (uint i = 0; i < angles; ++i)
+				{
+					if (fabsf(shortest_arc(out[i], expected[i])) > 1e-3f)
+					{
+						mismatches++;
+						break;
+					}
+				}
+			}
+
+			stream_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+
+		const stream_stats& stats = stream.last_stats();
+		stream_timings.report(std::cout, labels[mode]);
+		std::cout << "  " << stats.reads << " pages read (" << stats.bytes_read / 1024 << " KB), " << stats.misses
+			<< " samples missed, " << held << " held (" << held_late << " after a second), " << stats.evictions << " evictions, " << stats.cached_bytes / 1024
+			<< " KB cached, " << mismatches << " mismatches" << std::endl;
+
+		if (mismatches || stats.failures)
+			result = 1;
+	}
+
+	for (uint c = 0; c < clips; ++c)
+		remove(paths[c].c_str());
+
+	return result;
+}
+
+// the values that frame f of pose_shm_benchmark gives joint j and attachment a
+static float shm_joint_value(uint f, uint j, uint k) { return (float)(f * 13 + j * 16 + k); }
+static float shm_attachment_value(uint f, uint a, uint k) { return (float)(f * 7 + a * 3 + k); }
+
+// publishes frames through shared memory on one thread while a reader takes them on another, and checks that every
+// frame the reader accepts is whole: its joints and attachments all belong to the frame it names
+int pose_shm_benchmark(const bench_args& args)
+{
+	uint frames = args.counts[0];
+	const uint joints = 64;
+	const uint attachments = 4096;
+	const char* name = "/kine_pose_shm_bench";
+
+	// a mapping shorter than the arrays its header claims is refused
+	bool refused = true;
+#ifndef _WIN32
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd >= 0)
+	{
+		pose_shm_header truncated;
+		memset((void*)&truncated, 0, sizeof(truncated));
+		truncated.magic = POSE_SHM_MAGIC;
+		truncated.version = POSE_SHM_VERSION;
+		truncated.max_joints = pose_export::max_joints;
+		truncated.max_attachments = pose_export::max_attachments;
+
+		refused = write(fd, &truncated, sizeof(truncated)) == (ssize_t)sizeof(truncated) && ftruncate(fd, 4096) == 0;
+		::close(fd);
+
+		pose_reader reader;
+		refused = refused && !reader.open(name);
+		shm_unlink(name);
+	}
+#endif
+
+	pose_export exporter;
+	pose_reader reader;
+
+	if (!exporter.open(name) || !reader.open(name))
+	{
+		std::cerr << "Error: could not share poses through " << name << std::endl;
+		return 1;
+	}
+
+	std::atomic<bool> writing(true);
+	uint accepted = 0, retries = 0, torn = 0, last = 0;
+
+	std::thread read_thread([&]()
+	{
+		std::vector<pose_shm_joint> copy(joints);
+		std::vector<float> points(attachments * 3);
+
+		while (writing)
+		{
+			uint32_t seq = reader.begin();
+			uint f = reader.frame();
+			uint num_joints = std::min(reader.num_joints(), joints);
+			uint num_attachments = std::min(reader.num_attachments(), attachments);
+
+			memcpy(&copy[0], reader.joints(), sizeof(pose_shm_joint) * num_joints);
+			memcpy(&points[0], reader.attachment(0), sizeof(float) * 3 * num_attachments);
+
+			if (reader.retry(seq))
+			{
+				retries++;
+				continue;
+			}
+
+			// before the first frame the buffer is empty
+			if (f == 0)
+				continue;
+
+			bool whole = num_joints == joints && num_attachments == attachments && f >= last;
+
+			for (uint j = 0; j < num_joints && whole; ++j)
+			{
+				for (uint k = 0; k < 3; ++k)
+					whole = whole && copy[j].position[k] == shm_joint_value(f, j, k);
+				for (uint k = 0; k < 9; ++k)
+					whole = whole && copy[j].rotation[k] == shm_joint_value(f, j, 3 + k);
+			}
+
+			for (uint i = 0; i < num_attachments * 3 && whole; ++i)
+				whole = points[i] == shm_attachment_value(f, i / 3, i % 3);
+
+			accepted++;
+			last = f;
+			if (!whole)
+				torn++;
+		}
+	});
+
+	pose3 pose;
+	pose.joints.resize(joints);
+	pose.attachments.resize(attachments);
+
+	frame_timings publish_timings;
+
+	for (uint f = 1; f <= frames; ++f)
+	{
+		for (uint j = 0; j < joints; ++j)
+		{
+			joint_pose3& jp = pose.joints[j];
+			jp.position = vec3(shm_joint_value(f, j, 0), shm_joint_value(f, j, 1), shm_joint_value(f, j, 2));
+			for (uint k = 0; k < 9; ++k)
+				jp.rotation[k] = shm_joint_value(f, j, 3 + k);
+		}
+
+		for (uint a = 0; a < attachments; ++a)
+			pose.attachments[a] = vec3(shm_attachment_value(f, a, 0), shm_attachment_value(f, a, 1), shm_attachment_value(f, a, 2));
+
+		auto start = std::chrono::steady_clock::now();
+		exporter.publish(pose, f, 3);
+		publish_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	writing = false;
+	read_thread.join();
+
+	publish_timings.report(std::cout, "publish");
+	std::cout << frames << " frames of " << joints << " joints and " << attachments << " attachments: the reader accepted "
+		<< accepted << " and retried " << retries << " torn reads, " << torn << " accepted frames were not whole, the last was "
+		<< last << ", a truncated mapping was " << (refused ? "refused" : "accepted") << std::endl;
+
+	return (torn == 0 && accepted > 0 && refused) ? 0 : 1;
+}
+
+// publishes frames over the socket to a client that takes every frame and to one that reads now and then, and
+// checks the poses that both decode and the frames that the slow one skipped
+int pose_stream_benchmark(const bench_args& args)
+{
+	uint frames = args.counts[0];
+	const uint joints = 16;
+	const uint slow_every = 10;	// frames between the reads of the slow client
+	std::string path = "/tmp/kine_pose_stream_bench.sock";
+
+	stream_server server;
+	pose_stream_client fast, slow;
+
+	if (!server.start(path) || !fast.connect(path.c_str()) || !slow.connect(path.c_str()))
+	{
+		std::cerr << "Error: could not stream over " << path << std::endl;
+		return 1;
+	}
+
+	// polls a condition for up to a second
+	auto wait_for = [](auto done)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (!done())
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			std::this_thread::sleep_for(std::chrono::microseconds(20));
+		}
+		return true;
+	};
+
+	// frames only count for the clients that the server took in
+	if (!wait_for([&]() { return server.num_subscribers() == 2; }))
+	{
+		std::cerr << "Error: the clients were not accepted" << std::endl;
+		return 1;
+	}
+
+	pose3 pose;
+	pose.joints.resize(joints);
+	std::vector<pose_shm_joint> published((frames + 1) * joints);
+
+	auto decoded = [&](const pose_stream_client& client)
+	{
+		uint f = client.frame();
+		return f >= 1 && f <= frames && client.num_joints() == joints && client.dimensions() == 3
+			&& !memcmp(client.joints(), &published[f * joints], sizeof(pose_shm_joint) * joints);
+	};
+
+	frame_timings delivery_timings;
+	uint wrong = 0, timeouts = 0, slow_frames = 0;
+
+	for (uint f = 1; f <= frames; ++f)
+	{
+		// a few joints move every frame, so most frames are deltas
+		for (uint k = 0; k < 3; ++k)
+		{
+			joint_pose3& j = pose.joints[rand() % joints];
+			j.position = vec3(random_between(-100.0f, 100.0f), random_between(-100.0f, 100.0f), random_between(-100.0f, 100.0f));
+			j.rotation[rand() % 9] = random_between(-1.0f, 1.0f);
+		}
+
+		for (uint n = 0; n < joints; ++n)
+		{
+			pose_shm_joint& p = published[f * joints + n];
+			p.position[0] = pose.joints[n].position.x;
+			p.position[1] = pose.joints[n].position.y;
+			p.position[2] = pose.joints[n].position.z;
+			std::copy(pose.joints[n].rotation, pose.joints[n].rotation + 9, p.rotation);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		server.publish(pose, f, 3);
+
+		// the fast client takes every frame before the next one is published
+		if (!wait_for([&]() { fast.poll(); return fast.frame() == f; }))
+			timeouts++;
+		delivery_timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		if (!decoded(fast))
+			wrong++;
+
+		if (f % slow_every == 0 && slow.poll() > 0)
+		{
+			slow_frames++;
+			if (!decoded(slow))
+				wrong++;
+		}
+	}
+
+	// then the slow client catches up with the last frame
+	if (!wait_for([&]() { if (slow.poll() > 0) slow_frames++; return slow.frame() == frames; }))
+		timeouts++;
+	if (!decoded(slow))
+		wrong++;
+
+	// every frame went to the fast client, and the slow one skipped every frame that it did not get
+	unsigned long long sent = server.sent(), dropped = server.dropped();
+	server.stop();
+
+	delivery_timings.report(std::cout, "delivery");
+	std::cout << frames << " frames of " << joints << " joints: the slow client got " << slow_frames << " and skipped "
+		<< dropped << ", " << sent << " frames sent, " << wrong << " decoded wrong, " << timeouts << " timeouts" << std::endl;
+
+	bool passed = !wrong && !timeouts && sent == frames + slow_frames && dropped == frames - slow_frames
+		&& slow_frames <= frames / slow_every + 2;
+	return passed ? 0 : 1;
+}
+
+// a benchmark, the defaults of its counts, the least each count may be, and the seed of its random numbers
+struct bench_entry
+{
+	const char* option;
+	int (*run)(const bench_args& args);
+	uint defaults[2];
+	uint least[2];
+	uint seed;
+};
+
+static const bench_entry benches[] =
+{
+	{ "--lod-bench", lod_benchmark, { 20000, 600 }, { 1, 2 }, 31 },
+	{ "--match-bench", match_benchmark, { 1000000, 0 }, { 1, 0 }, 7 },
+	{ "--blend-bench", blend_benchmark, { 4096, 32 }, { 1, 1 }, 11 },
+	{ "--spline-bench", spline_benchmark, { 4096, 0 }, { 1, 0 }, 13 },
+	{ "--ragdoll-bench", ragdoll_benchmark, { 512, 0 }, { 1, 0 }, 17 },
+	{ "--collision-bench", collision_benchmark, { 10000, 0 }, { 1, 0 }, 19 },
+	{ "--pick-bench", pick_benchmark, { 4096, 0 }, { 1, 0 }, 23 },
+	{ "--quantize-bench", quantize_benchmark, { 100000, 0 }, { 1, 0 }, 29 },
+	{ "--fk-bench", fk_benchmark, { 100000, 0 }, { 1, 0 }, 31 },
+	{ "--script-bench", script_benchmark, { 50000, 0 }, { 0, 0 }, 1 },
+	{ "--history-bench", history_benchmark, { 100000, 1000 }, { 1, 0 }, 23 },
+	{ "--cloud-bench", cloud_benchmark, { 10000000, 0 }, { 1, 0 }, 29 },
+	{ "--retarget-bench", retarget_benchmark, { 1000000, 0 }, { 1, 0 }, 31 },
+	{ "--stream-bench", stream_benchmark, { 256, 600 }, { 1, 1 }, 37 },
+	{ "--pose-shm-bench", pose_shm_benchmark, { 100000, 0 }, { 1, 0 }, 1 },
+	{ "--pose-stream-bench", pose_stream_benchmark, { 600, 0 }, { 1, 0 }, 41 },
+};
+
+int run_benchmark(int argc, char* argv[], kine2d& kine_2d, kine3d& kine_3d)
+{
+	if (argc < 2)
+		return -1;
+
+	for (const bench_entry& bench : benches)
+	{
+		if (strcmp(argv[1], bench.option))
+			continue;
+
+		bench_args args = { &kine_2d, &kine_3d, { bench.defaults[0], bench.defaults[1] }, false, false, false };
+
+		// counts come first, flags anywhere after the option
+		for (int i = 2, n = 0; i < argc; ++i)
+		{
+			if (argv[i][0] != '-' && n < 2 && i == n + 2)
+				args.counts[n++] = atoi(argv[i]);
+
+			args.three_dimensional = args.three_dimensional || !strcmp(argv[i], "--3d");
+			args.half = args.half || !strcmp(argv[i], "--half");
+			args.text = args.text || !strcmp(argv[i], "--text");
+		}
+
+		for (uint n = 0; n < 2; ++n)
+			args.counts[n] = std::max(args.counts[n], bench.least[n]);
+
+		srand(bench.seed);
+		return bench.run(args);
+	}
+
+	return -1;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "kine2d.h"
+#include "kine3d.h"
+
+// what a benchmark is run with: the contexts that main() created, and its arguments
+struct bench_args
+{
+	kine2d* kine_2d;
+	kine3d* kine_3d;
+	uint counts[2];			// the numbers that follow the option, or the defaults of the benchmark
+	bool three_dimensional;	// --3d
+	bool half;				// --half
+	bool text;				// --text
+
+	kinecontext* context() const { return three_dimensional ? (kinecontext*)kine_3d : (kinecontext*)kine_2d; }
+};
+
+/*
+ *	runs the benchmark that the first argument names, as spline --<name>-bench [count] [count] [flags]
+ *
+ *	benchmarks time one module on a crowd of skeletons without a window, and check its results against a slower
+ *	path that is known to be right. returns what the benchmark does (0 when it passed), or -1 when the first
+ *	argument is not a benchmark.
+ */
+int run_benchmark(int argc, char* argv[], kine2d& kine_2d, kine3d& kine_3d);
@@ -0,0 +1,446 @@
+#include "blend.h"
+#include "simd.h"
+#include <cstring>
+
+/*
+ *	kernels over rows of n values (n is a multiple of 8); out may be the same row as a
+ */
+
+// a + w * (b - a) along the shorter way around the circle, wrapped to [0, 360)
+static void crossfade_angles(const float* a, const float* b, float w, float* out, uint n)
+{
+	for (uint i = 0; i < n; ++i)
+	{
+		float d = b[i] - a[i];
+		d -= 360.0f * floorf(d / 360.0f + 0.5f);
+
+		float r = a[i] + w * d;
+		out[i] = r - 360.0f * floorf(r / 360.0f);
+	}
+}
+
+// base + w * layer, wrapped to [0, 360)
+static void add_angles(const float* base, const float* layer, float w, float* out, uint n)
+{
+	for (uint i = 0; i < n; ++i)
+	{
+		float r = base[i] + w * layer[i];
+		out[i] = r - 360.0f * floorf(r / 360.0f);
+	}
+}
+
+// normalized lerp of a and b, through the shorter of the two arcs
+static void crossfade_quaternions(const float* const* a, const float* const* b, float w, float* const* out, uint n)
+{
+	for (uint i = 0; i < n; ++i)
+	{
+		float dot = a[0][i] * b[0][i] + a[1][i] * b[1][i] + a[2][i] * b[2][i] + a[3][i] * b[3][i];
+		float wb = dot < 0.0f ? -w : w;
+
+		float q[4];
+		for (uint c = 0; c < 4; ++c)
+			q[c] = a[c][i] * (1.0f - w) + b[c][i] * wb;
+
+		float scale = 1.0f / sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		for (uint c = 0; c < 4; ++c)
+			out[c][i] = q[c] * scale;
+	}
+}
+
+// base rotation followed by w of the layer rotation: base * nlerp(identity, layer, w)
+static void add_quaternions(const float* const* base, const float* const* layer, float w, float* const* out, uint n)
+{
+	for (uint i = 0; i < n; ++i)
+	{
+		float wb = layer[3][i] < 0.0f ? -w : w;
+
+		float dx = layer[0][i] * wb;
+		float dy = layer[1][i] * wb;
+		float dz = layer[2][i] * wb;
+		float dw = layer[3][i] * wb + (1.0f - w);
+		float scale = 1.0f / sqrtf(dx * dx + dy * dy + dz * dz + dw * dw);
+		dx *= scale; dy *= scale; dz *= scale; dw *= scale;
+
+		float bx = base[0][i], by = base[1][i], bz = base[2][i], bw = base[3][i];
+		out[0][i] = bw * dx + bx * dw + by * dz - bz * dy;
+		out[1][i] = bw * dy - bx * dz + by * dw + bz * dx;
+		out[2][i] = bw * dz + bx * dy - by * dx + bz * dw;
+		out[3][i] = bw * dw - bx * dx - by * dy - bz * dz;
+	}
+}
+
+typedef void (*angle_kernel)(const float* a, const float* b, float w, float* out, uint n);
+typedef void (*quaternion_kernel)(const float* const* a, const float* const* b, float w, float* const* out, uint n);
+
+#ifdef HAS_AVX2_KERNELS
+TARGET_AVX2
+static inline __m256 wrap_degrees(__m256 r)
+{
+	__m256 turns = _mm256_floor_ps(_mm256_mul_ps(r, _mm256_set1_ps(1.0f / 360.0f)));
+	return _mm256_fnmadd_ps(turns, _mm256_set1_ps(360.0f), r);
+}
+
+TARGET_AVX2
+static void crossfade_angles_avx2(const float* a, const float* b, float w, float* out, uint n)
+{
+	__m256 weight = _mm256_set1_ps(w);
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 turn = _mm256_set1_ps(360.0f);
+	__m256 inverse_turn = _mm256_set1_ps(1.0f / 360.0f);
+
+	for (uint i = 0; i < n; i += 8)
+	{
+		__m256 va = _mm256_loadu_ps(a + i);
+		__m256 d = _mm256_sub_ps(_mm256_loadu_ps(b + i), va);
+		d = _mm256_fnmadd_ps(_mm256_floor_ps(_mm256_fmadd_ps(d, inverse_turn, half)), turn, d);
+		_mm256_storeu_ps(out + i, wrap_degrees(_mm256_fmadd_ps(weight, d, va)));
+	}
+}
+
+TARGET_AVX2
+static void add_angles_avx2(const float* base, const float* layer, float w, float* out, uint n)
+{
+	__m256 weight = _mm256_set1_ps(w);
+
+	for (uint i = 0; i < n; i += 8)
+		_mm256_storeu_ps(out + i, wrap_degrees(_mm256_fmadd_ps(weight, _mm256_loadu_ps(layer + i), _mm256_loadu_ps(base + i))));
+}
+
+TARGET_AVX2
+static inline __m256 reciprocal_length(__m256 x, __m256 y, __m256 z, __m256 w)
+{
+	__m256 sq = _mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_fmadd_ps(z, z, _mm256_mul_ps(w, w))));
+	return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(sq));
+}
+
+TARGET_AVX2
+static void crossfade_quaternions_avx2(const float* const* a, const float* const* b, float w, float* const* out, uint n)
+{
+	__m256 wa = _mm256_set1_ps(1.0f - w);
+	__m256 weight = _mm256_set1_ps(w);
+	__m256 sign = _mm256_set1_ps(-0.0f);
+
+	for (uint i = 0; i < n; i += 8)
+	{
+		__m256 ax = _mm256_loadu_ps(a[0] + i), ay = _mm256_loadu_ps(a[1] + i);
+		__m256 az = _mm256_loadu_ps(a[2] + i), aw = _mm256_loadu_ps(a[3] + i);
+		__m256 bx = _mm256_loadu_ps(b[0] + i), by = _mm256_loadu_ps(b[1] + i);
+		__m256 bz = _mm256_loadu_ps(b[2] + i), bw = _mm256_loadu_ps(b[3] + i);
+
+		// the sign of the dot product flips the weight of b
+		__m256 dot = _mm256_fmadd_ps(ax, bx, _mm256_fmadd_ps(ay, by, _mm256_fmadd_ps(az, bz, _mm256_mul_ps(aw, bw))));
+		__m256 wb = _mm256_xor_ps(weight, _mm256_and_ps(dot, sign));
+
+		__m256 x = _mm256_fmadd_ps(bx, wb, _mm256_mul_ps(ax, wa));
+		__m256 y = _mm256_fmadd_ps(by, wb, _mm256_mul_ps(ay, wa));
+		__m256 z = _mm256_fmadd_ps(bz, wb, _mm256_mul_ps(az, wa));
+		__m256 qw = _mm256_fmadd_ps(bw, wb, _mm256_mul_ps(aw, wa));
+		__m256 scale = reciprocal_length(x, y, z, qw);
+
+		_mm256_storeu_ps(out[0] + i, _mm256_mul_ps(x, scale));
+		_mm256_storeu_ps(out[1] + i, _mm256_mul_ps(y, scale));
+		_mm256_storeu_ps(out[2] + i, _mm256_mul_ps(z, scale));
+		_mm256_storeu_ps(out[3] + i, _mm256_mul_ps(qw, scale));
+	}
+}
+
+TARGET_AVX2
+static void add_quaternions_avx2(const float* const* base, const float* const* layer, float w, float* const* out, uint n)
+{
+	__m256 identity = _mm256_set1_ps(1.0f - w);
+	__m256 weight = _mm256_set1_ps(w);
+	__m256 sign = _mm256_set1_ps(-0.0f);
+
+	for (uint i = 0; i < n; i += 8)
+	{
+		__m256 lw = _mm256_loadu_ps(layer[3] + i);
+		__m256 wb = _mm256_xor_ps(weight, _mm256_and_ps(lw, sign));
+
+		__m256 dx = _mm256_mul_ps(_mm256_loadu_ps(layer[0] + i), wb);
+		__m256 dy = _mm256_mul_ps(_mm256_loadu_ps(layer[1] + i), wb);
+		__m256 dz = _mm256_mul_ps(_mm256_loadu_ps(layer[2] + i), wb);
+		__m256 dw = _mm256_fmadd_ps(lw, wb, identity);
+		__m256 scale = reciprocal_length(dx, dy, dz, dw);
+		dx = _mm256_mul_ps(dx, scale); dy = _mm256_mul_ps(dy, scale);
+		dz = _mm256_mul_ps(dz, scale); dw = _mm256_mul_ps(dw, scale);
+
+		__m256 bx = _mm256_loadu_ps(base[0] + i), by = _mm256_loadu_ps(base[1] + i);
+		__m256 bz = _mm256_loadu_ps(base[2] + i), bw = _mm256_loadu_ps(base[3] + i);
+
+		__m256 x = _mm256_fmadd_ps(bw, dx, _mm256_fmadd_ps(bx, dw, _mm256_fmsub_ps(by, dz, _mm256_mul_ps(bz, dy))));
+		__m256 y = _mm256_fmadd_ps(bw, dy, _mm256_fmadd_ps(by, dw, _mm256_fmsub_ps(bz, dx, _mm256_mul_ps(bx, dz))));
+		__m256 z = _mm256_fmadd_ps(bw, dz, _mm256_fmadd_ps(bz, dw, _mm256_fmsub_ps(bx, dy, _mm256_mul_ps(by, dx))));
+		__m256 qw = _mm256_fmsub_ps(bw, dw, _mm256_fmadd_ps(bx, dx, _mm256_fmadd_ps(by, dy, _mm256_mul_ps(bz, dz))));
+
+		_mm256_storeu_ps(out[0] + i, x);
+		_mm256_storeu_ps(out[1] + i, y);
+		_mm256_storeu_ps(out[2] + i, z);
+		_mm256_storeu_ps(out[3] + i, qw);
+	}
+}
+
+static angle_kernel crossfade_angle_rows = cpu_has_avx2() ? crossfade_angles_avx2 : crossfade_angles;
+static angle_kernel add_angle_rows = cpu_has_avx2() ? add_angles_avx2 : add_angles;
+static quaternion_kernel crossfade_quaternion_rows = cpu_has_avx2() ? crossfade_quaternions_avx2 : crossfade_quaternions;
+static quaternion_kernel add_quaternion_rows = cpu_has_avx2() ? add_quaternions_avx2 : add_quaternions;
+#else
+static angle_kernel crossfade_angle_rows = crossfade_angles;
+static angle_kernel add_angle_rows = add_angles;
+static quaternion_kernel crossfade_quaternion_rows = crossfade_quaternions;
+static quaternion_kernel add_quaternion_rows = add_quaternions;
+#endif
+
+bool blend_tree::select_kernels(bool avx2)
+{
+#ifdef HAS_AVX2_KERNELS
+	avx2 = avx2 && cpu_has_avx2();
+	crossfade_angle_rows = avx2 ? crossfade_angles_avx2 : crossfade_angles;
+	add_angle_rows = avx2 ? add_angles_avx2 : add_angles;
+	crossfade_quaternion_rows = avx2 ? crossfade_quaternions_avx2 : crossfade_quaternions;
+	add_quaternion_rows = avx2 ? add_quaternions_avx2 : add_quaternions;
+	return avx2;
+#else
+	(void)avx2;
+	return false;
+#endif
+}
+
+void pose_batch::resize(uint num_characters, uint num_joints, BlendChannels num_channels)
+{
+	if (num_characters == characters && num_joints == joints && (uint)num_channels == channels)
+		return;
+
+	characters = num_characters;
+	joints = num_joints;
+	channels = num_channels;
+	stride = (characters + 7) & ~7u;
+
+	data.resize(joints * channels * stride);
+	set_identity();
+}
+
+void pose_batch::set_identity()
+{
+	std::fill(data.begin(), data.end(), 0.0f);
+
+	// quaternions are x y z w, so the identity is 1 in the last row of each joint
+	if (channels == BLEND_QUATERNIONS)
+		for (uint j = 0; j < joints; ++j)
+			std::fill(row(j, 3), row(j, 3) + stride, 1.0f);
+}
+
+void pose_batch::set_angles(uint character, const float* angles)
+{
+	if (channels == BLEND_ANGLES)
+	{
+		for (uint j = 0; j < joints; ++j)
+			row(j, 0)[character] = angles[j];
+		return;
+	}
+
+	for (uint j = 0; j < joints; ++j)
+	{
+		/*
+		 *	joint3 rotates by Rx * Ry * Rz, so q = qx * qy * qz (with half angles)
+		 */
+		float hx = angles[j * 3 + 0] * (PI / 360.0f);
+		float hy = angles[j * 3 + 1] * (PI / 360.0f);
+		float hz = angles[j * 3 + 2] * (PI / 360.0f);
+		float sx = sinf(hx), cx = cosf(hx);
+		float sy = sinf(hy), cy = cosf(hy);
+		float sz = sinf(hz), cz = cosf(hz);
+
+		row(j, 0)[character] = sx * cy * cz + cx * sy * sz;
+		row(j, 1)[character] = cx * sy * cz - sx * cy * sz;
+		row(j, 2)[character] = cx * cy * sz + sx * sy * cz;
+		row(j, 3)[character] = cx * cy * cz - sx * sy * sz;
+	}
+}
+
+void pose_batch::get_angles(uint character, float* angles) const
+{
+	if (channels == BLEND_ANGLES)
+	{
+		for (uint j = 0; j < joints; ++j)
+			angles[j] = row(j, 0)[character];
+		return;
+	}
+
+	for (uint j = 0; j < joints; ++j)
+	{
+		float x = row(j, 0)[character];
+		float y = row(j, 1)[character];
+		float z = row(j, 2)[character];
+		float w = row(j, 3)[character];
+
+		/*
+		 *	from the matrix Rx * Ry * Rz:
+		 *		m13 = sin(y), m11 = cos(y)cos(z), m12 = -cos(y)sin(z), m23 = -sin(x)cos(y), m33 = cos(x)cos(y)
+		 */
+		float m13 = std::min(std::max(2.0f * (x * z + y * w), -1.0f), 1.0f);
+
+		angles[j * 3 + 0] = atan2f(-2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y)) * (180.0f / PI);
+		angles[j * 3 + 1] = asinf(m13) * (180.0f / PI);
+		angles[j * 3 + 2] = atan2f(-2.0f * (x * y - z * w), 1.0f - 2.0f * (y * y + z * z)) * (180.0f / PI);
+	}
+}
+
+blend_tree::blend_tree() : characters(0), joints(0), channels(BLEND_ANGLES), nodes_evaluated(0), nodes_skipped(0)
+{
+}
+
+blend_tree::~blend_tree()
+{
+	std::for_each(scratch.begin(), scratch.end(), delete_ptr());
+	scratch.clear();
+}
+
+void blend_tree::reset(uint num_characters, uint num_joints, BlendChannels num_channels)
+{
+	characters = num_characters;
+	joints = num_joints;
+	channels = num_channels;
+	nodes.clear();
+	masks.clear();
+}
+
+uint blend_tree::add_source(const pose_batch* pose)
+{
+	node n = { NODE_SOURCE, pose, 0, 0, 0.0f, -1 };
+	nodes.push_back(n);
+	return nodes.size() - 1;
+}
+
+uint blend_tree::add_crossfade(uint from, uint to, float weight, int mask)
+{
+	node n = { NODE_CROSSFADE, nullptr, from, to, weight, mask };
+	nodes.push_back(n);
+	return nodes.size() - 1;
+}
+
+uint blend_tree::add_additive(uint base, uint layer, float weight, int mask)
+{
+	node n = { NODE_ADDITIVE, nullptr, base, layer, weight, mask };
+	nodes.push_back(n);
+	return nodes.size() - 1;
+}
+
+int blend_tree::add_mask(const float* joint_weights)
+{
+	masks.push_back(std::vector<float>(joint_weights, joint_weights + joints));
+	return masks.size() - 1;
+}
+
+float blend_tree::joint_weight(const node& n, uint joint) const
+{
+	float w = n.mask < 0 ? n.weight : n.weight * masks[n.mask][joint];
+	return std::min(std::max(w, 0.0f), 1.0f);
+}
+
+bool blend_tree::any_weight(const node& n) const
+{
+	for (uint j = 0; j < joints; ++j)
+		if (joint_weight(n, j) > 0.0f)
+			return true;
+	return false;
+}
+
+bool blend_tree::full_weight(const node& n) const
+{
+	for (uint j = 0; j < joints; ++j)
+		if (joint_weight(n, j) < 1.0f)
+			return false;
+	return true;
+}
+
+void blend_tree::evaluate(uint root, pose_batch& out)
+{
+	nodes_evaluated = 0;
+	nodes_skipped = 0;
+
+	out.resize(characters, joints, channels);
+
+	const pose_batch& result = evaluate(root, out, 0);
+	if (&result != &out)
+		out = result;	// the root was a leaf (after skipping); same size, so this reuses the buffer
+}
+
+// returns out, or a leaf when the node passes one through unchanged
+const pose_batch& blend_tree::evaluate(uint id, pose_batch& out, uint depth)
+{
+	const node& n = nodes[id];
+	nodes_evaluated++;
+
+	if (n.type == NODE_SOURCE)
+		return *n.source;
+
+	// without weight the node is its first child, and a crossfade at full weight is its second
+	if (!any_weight(n))
+	{
+		nodes_skipped++;
+		return evaluate(n.a, out, depth + 1);
+	}
+
+	if (n.type == NODE_CROSSFADE && full_weight(n))
+	{
+		nodes_skipped++;
+		return evaluate(n.b, out, depth + 1);
+	}
+
+	// the second child needs a buffer of its own; the first one ends up in out (or is a leaf)
+	while (scratch.size() <= depth)
+		scratch.push_back(new pose_batch());
+
+	pose_batch& temp = *scratch[depth];
+	temp.resize(characters, joints, channels);
+
+	const pose_batch& a = evaluate(n.a, out, depth + 1);
+	const pose_batch& b = evaluate(n.b, temp, depth + 1);
+
+	blend(n, a, b, out);
+	return out;
+}
+
+void blend_tree::blend(const node& n, const pose_batch& a, const pose_batch& b, pose_batch& out)
+{
+	uint count = out.row_size();
+
+	for (uint j = 0; j < joints; ++j)
+	{
+		float w = joint_weight(n, j);
+
+		// masked-out joints take one of the children as is
+		const pose_batch* copy = nullptr;
+		if (w <= 0.0f)
+			copy = &a;
+		else if (w >= 1.0f && n.type == NODE_CROSSFADE)
+			copy = &b;
+
+		if (copy)
+		{
+			if (copy != &out)
+				for (uint c = 0; c < channels; ++c)
+					memcpy(out.row(j, c), copy->row(j, c), sizeof(float) * count);
+			continue;
+		}
+
+		if (channels == BLEND_ANGLES)
+		{
+			if (n.type == NODE_CROSSFADE)
+				crossfade_angle_rows(a.row(j, 0), b.row(j, 0), w, out.row(j, 0), count);
+			else
+				add_angle_rows(a.row(j, 0), b.row(j, 0), w, out.row(j, 0), count);
+		}
+		else
+		{
+			const float* ra[4] = { a.row(j, 0), a.row(j, 1), a.row(j, 2), a.row(j, 3) };
+			const float* rb[4] = { b.row(j, 0), b.row(j, 1), b.row(j, 2), b.row(j, 3) };
+			float* ro[4] = { out.row(j, 0), out.row(j, 1), out.row(j, 2), out.row(j, 3) };
+
+			if (n.type == NODE_CROSSFADE)
+				crossfade_quaternion_rows(ra, rb, w, ro, count);
+			else
+				add_quaternion_rows(ra, rb, w, ro, count);
+		}
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "structures.h"
+
+enum BlendChannels
+{
+	BLEND_ANGLES = 1,		// one angle per joint (joint2::theta), in degrees
+	BLEND_QUATERNIONS = 4	// one rotation per joint (the x, y and z angles of joint3), as x y z w
+};
+
+/*
+ *	poses of many characters that share a skeleton
+ *
+ *	values are stored joint by joint and channel by channel, each a row with one value per character (padded to a
+ *	multiple of 8), so every blend is a straight run over whole rows.
+ */
+class pose_batch
+{
+private:
+	uint characters;
+	uint joints;
+	uint channels;
+	uint stride;				// values per row
+	std::vector<float> data;
+
+public:
+	pose_batch() : characters(0), joints(0), channels(0), stride(0) {}
+
+	void resize(uint num_characters, uint num_joints, BlendChannels num_channels);
+	void set_identity();
+
+	uint num_characters() const { return characters; }
+	uint num_joints() const { return joints; }
+	uint num_channels() const { return channels; }
+	uint row_size() const { return stride; }
+
+	float* row(uint joint, uint channel) { return &data[(joint * channels + channel) * stride]; }
+	const float* row(uint joint, uint channel) const { return &data[(joint * channels + channel) * stride]; }
+
+	// the angles of one character as a kinecontext takes them: one per joint, or x y z per joint for quaternions
+	void set_angles(uint character, const float* angles);
+	void get_angles(uint character, float* angles) const;
+};
+
+/*
+ *	tree of blends over pose batches
+ *
+ *	leaves are pose batches that are filled elsewhere (clips, the pose database, procedural motion). crossfades
+ *	interpolate between two children; additive nodes add a layer of offsets (angles, or rotations applied after the
+ *	base rotation) on top of a base. a mask scales the weight of a node per joint. evaluation is lazy: a child whose
+ *	weight is zero for every joint is never evaluated, and leaves are read in place rather than copied.
+ */
+class blend_tree
+{
+private:
+	enum NodeType
+	{
+		NODE_SOURCE,
+		NODE_CROSSFADE,
+		NODE_ADDITIVE
+	};
+
+	struct node
+	{
+		NodeType type;
+		const pose_batch* source;
+		uint a;				// crossfade: from, additive: base
+		uint b;				// crossfade: to, additive: layer
+		float weight;
+		int mask;			// index in masks, -1 for none
+	};
+
+	std::vector<node> nodes;
+	std::vector<std::vector<float> > masks;		// weight per joint
+	std::vector<pose_batch*> scratch;			// intermediate results, one per depth of the tree
+
+	uint characters;
+	uint joints;
+	BlendChannels channels;
+
+	uint nodes_evaluated;
+	uint nodes_skipped;
+
+private:
+	const pose_batch& evaluate(uint id, pose_batch& out, uint depth);
+	void blend(const node& n, const pose_batch& a, const pose_batch& b, pose_batch& out);
+	float joint_weight(const node& n, uint joint) const;
+	bool any_weight(const node& n) const;
+	bool full_weight(const node& n) const;
+
+public:
+	blend_tree();
+	~blend_tree();
+
+	void reset(uint num_characters, uint num_joints, BlendChannels num_channels);
+
+	uint add_source(const pose_batch* pose);
+	uint add_crossfade(uint from, uint to, float weight, int mask = -1);
+	uint add_additive(uint base, uint layer, float weight, int mask = -1);
+	int add_mask(const float* joint_weights);
+
+	void set_weight(uint id, float weight) { nodes[id].weight = weight; }
+
+	void evaluate(uint root, pose_batch& out);
+
+	// blends through the AVX2 kernels where the processor has them (the default), or through the scalar ones;
+	// returns whether the AVX2 kernels are used
+	static bool select_kernels(bool avx2);
+
+	uint evaluated() const { return nodes_evaluated; }	// nodes of the last evaluation
+	uint skipped() const { return nodes_skipped; }		// subtrees that were not evaluated
+};
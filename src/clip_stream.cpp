@@ -0,0 +1,682 @@
+#include "clip_stream.h"
+#include "quantize.h"
+#include "spline.h"
+#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+static int ring_setup(uint entries, io_uring_params* params)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ring_enter(int ring, uint submit, uint min_complete, uint flags)
+{
+	return (int)syscall(__NR_io_uring_enter, ring, submit, min_complete, flags, nullptr, 0);
+}
+#endif
+
+/*
+ *	the threads read pages of one file at once, so every read names its offset rather than moving a shared position.
+ *	windows has no pread, but a read through an OVERLAPPED offset on the handle of the descriptor does the same
+ */
+static int read_at(int fd, void* buffer, uint bytes, uint64_t offset)
+{
+#ifdef _WIN32
+	OVERLAPPED at;
+	memset(&at, 0, sizeof(at));
+	at.Offset = (DWORD)offset;
+	at.OffsetHigh = (DWORD)(offset >> 32);
+
+	DWORD read;
+	if (!ReadFile((HANDLE)_get_osfhandle(fd), buffer, bytes, &read, &at))
+		return -1;
+
+	return (int)read;
+#else
+	return (int)pread(fd, buffer, bytes, offset);
+#endif
+}
+
+static int open_file(const std::string& path)
+{
+#ifdef _WIN32
+	return _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+	return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+}
+
+static void close_file(int fd)
+{
+#ifdef _WIN32
+	_close(fd);
+#else
+	close(fd);
+#endif
+}
+
+static uint64_t file_bytes(int fd)
+{
+#ifdef _WIN32
+	return std::max<long long>(_filelengthi64(fd), 0);
+#else
+	struct stat info;
+	return fstat(fd, &info) == 0 ? (uint64_t)info.st_size : 0;
+#endif
+}
+
+static uint frames_of(const clip_header& header, uint index)
+{
+	return std::min(STREAM_PAGE_FRAMES, header.frames - index * STREAM_PAGE_FRAMES);
+}
+
+// of a page in the cache, decoded and raw
+static size_t cached_size(uint values)
+{
+	return values * (sizeof(uint16_t) + sizeof(float));
+}
+
+
+
+clip_streamer::clip_streamer(uint threads, bool use_ring, size_t budget_bytes)
+	: newest(-1), oldest(-1), budget(budget_bytes), used(0), in_flight(0), epoch(0), ring(-1), sqes(nullptr), sq_map(nullptr),
+	cq_map(nullptr), quit(false)
+{
+	queued.reserve(STREAM_QUEUE_DEPTH);
+	wishes.reserve(STREAM_QUEUE_DEPTH);
+	jobs.reserve(STREAM_QUEUE_DEPTH);
+	results.reserve(STREAM_QUEUE_DEPTH);
+	taken.reserve(STREAM_QUEUE_DEPTH);
+
+	if (use_ring && threads > 0 && setup_ring())
+		return;
+
+	for (uint i = 0; i < threads; ++i)
+		workers.push_back(std::thread(&clip_streamer::work, this));
+}
+
+clip_streamer::~clip_streamer()
+{
+	// reads in flight write into the pages, so they are waited for
+#ifdef __linux__
+	if (ring >= 0)
+	{
+		update();
+
+		while (in_flight > 0 && ring_enter(ring, 0, 1, IORING_ENTER_GETEVENTS) >= 0)
+			update();
+
+		munmap(sqes, sqes_bytes);
+		if (cq_map != sq_map)
+			munmap(cq_map, cq_map_bytes);
+		munmap(sq_map, sq_map_bytes);
+		close(ring);
+	}
+#endif
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+
+	wake.notify_all();
+
+	for (uint i = 0; i < workers.size(); ++i)
+		workers[i].join();
+
+	for (uint c = 0; c < clips.size(); ++c)
+		close_file(clips[c].fd);
+	for (uint i = 0; i < retired.size(); ++i)
+		close_file(retired[i]);
+}
+
+bool clip_streamer::setup_ring()
+{
+#ifndef __linux__
+	// io_uring is linux only, so the threads read the pages
+	return false;
+#else
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	ring = ring_setup(STREAM_QUEUE_DEPTH, &params);
+	if (ring < 0)
+		return false;
+
+	/*
+	 *	the submission ring holds indices into the array of entries, the completion ring holds the completions
+	 *	themselves. both rings share a mapping on kernels that offer IORING_FEAT_SINGLE_MMAP
+	 */
+	sq_map_bytes = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	cq_map_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+
+	bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single)
+		sq_map_bytes = cq_map_bytes = std::max(sq_map_bytes, cq_map_bytes);
+
+	sq_map = mmap(nullptr, sq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+	cq_map = single ? sq_map : mmap(nullptr, cq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+	void* entries = mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+
+	if (sq_map == MAP_FAILED || cq_map == MAP_FAILED || entries == MAP_FAILED)
+	{
+		if (entries != MAP_FAILED) munmap(entries, sqes_bytes);
+		if (cq_map != MAP_FAILED && cq_map != sq_map) munmap(cq_map, cq_map_bytes);
+		if (sq_map != MAP_FAILED) munmap(sq_map, sq_map_bytes);
+
+		close(ring);
+		ring = -1;
+		return false;
+	}
+
+	char* sq = (char*)sq_map;
+	char* cq = (char*)cq_map;
+
+	sq_head = (uint32_t*)(sq + params.sq_off.head);
+	sq_tail = (uint32_t*)(sq + params.sq_off.tail);
+	sq_mask = (uint32_t*)(sq + params.sq_off.ring_mask);
+	sq_array = (uint32_t*)(sq + params.sq_off.array);
+	sqes = (io_uring_sqe*)entries;
+
+	cq_head = (uint32_t*)(cq + params.cq_off.head);
+	cq_tail = (uint32_t*)(cq + params.cq_off.tail);
+	cq_mask = (uint32_t*)(cq + params.cq_off.ring_mask);
+	cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	return true;
+#endif
+}
+
+void clip_streamer::work()
+{
+	while (true)
+	{
+		read_request job;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quit || !jobs.empty(); });
+
+			if (quit) return;
+
+			// in the order they were prefetched, which is the order they are needed in
+			job = jobs.front();
+			jobs.erase(jobs.begin());
+		}
+
+		read_result result;
+		result.page = job.page;
+		result.bytes = read_at(job.fd, job.buffer, job.bytes, job.offset);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		results.push_back(result);
+	}
+}
+
+int clip_streamer::open(const std::string& path)
+{
+	int fd = open_file(path);
+	if (fd < 0)
+		return -1;
+
+	clip_header header;
+
+	if (read_at(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != CLIP_MAGIC
+		|| header.version != CLIP_VERSION || header.angles == 0 || header.frames == 0 || header.frame_time <= 0.0f
+		|| file_bytes(fd) < sizeof(header) + (uint64_t)header.frames * header.angles * sizeof(uint16_t))
+	{
+		close_file(fd);
+		return -1;
+	}
+
+	uint c = 0;
+	while (c < clips.size() && clips[c].path != path)
+		++c;
+
+	if (c == clips.size())
+	{
+		clips.push_back(clip());
+		clips[c].path = path;
+	}
+	else
+	{
+		// the pages of the old file go; those being read are dropped as they arrive
+		for (uint i = 0; i < clips[c].resident.size(); ++i)
+		{
+			int p = clips[c].resident[i];
+			if (p < 0)
+				continue;
+
+			if (cache[p].loading)
+				cache[p].stale = true;
+			else
+			{
+				unlink(p);
+				release(p);
+			}
+		}
+
+		retired.push_back(clips[c].fd);
+	}
+
+	clip& opened = clips[c];
+	opened.fd = fd;
+	opened.header = header;
+	opened.pages = (header.frames + STREAM_PAGE_FRAMES - 1) / STREAM_PAGE_FRAMES;
+	opened.page_bytes = STREAM_PAGE_FRAMES * header.angles * sizeof(uint16_t);
+	opened.resident.assign(opened.pages, -1);
+
+	return c;
+}
+
+void clip_streamer::unlink(int p)
+{
+	page& pg = cache[p];
+
+	if (pg.newer >= 0) cache[pg.newer].older = pg.older; else if (newest == p) newest = pg.older;
+	if (pg.older >= 0) cache[pg.older].newer = pg.newer; else if (oldest == p) oldest = pg.newer;
+
+	pg.newer = pg.older = -1;
+}
+
+void clip_streamer::touch(int p, bool near)
+{
+	cache[p].used = epoch;
+	if (near)
+		cache[p].needed = epoch;
+
+	if (newest == p)
+		return;
+
+	unlink(p);
+
+	page& pg = cache[p];
+	pg.older = newest;
+	if (newest >= 0) cache[newest].newer = p;
+	newest = p;
+	if (oldest < 0) oldest = p;
+}
+
+void clip_streamer::release(int p)
+{
+	page& pg = cache[p];
+	clip& c = clips[pg.clip];
+
+	if (pg.index < c.resident.size() && c.resident[pg.index] == p)
+		c.resident[pg.index] = -1;
+
+	used -= cached_size(pg.raw.size());
+	stats.cached_bytes = used;
+	free_pages.push_back(p);
+}
+
+int clip_streamer::allocate(uint c, uint index, bool near)
+{
+	size_t bytes = cached_size(frames_of(clips[c].header, index) * clips[c].header.angles);
+
+	/*
+	 *	pages that are being read are not in the order of use, so they are never evicted. pages used since the last
+	 *	update are the newest, so a page that is read ahead stops at the first of them, while a page that a player is
+	 *	at goes on past them to the pages that no player is at
+	 */
+	for (int q = oldest; q >= 0 && used + bytes > budget; )
+	{
+		int next = cache[q].newer;
+
+		if (cache[q].used == epoch && !near)
+			break;
+
+		if (cache[q].needed != epoch)
+		{
+			unlink(q);
+			release(q);
+			stats.evictions++;
+		}
+
+		q = next;
+	}
+
+	if (used + bytes > budget)
+		return -1;
+
+	int p;
+	if (!free_pages.empty())
+	{
+		p = free_pages.back();
+		free_pages.pop_back();
+	}
+	else
+	{
+		p = cache.size();
+		cache.push_back(page());
+	}
+
+	page& pg = cache[p];
+	pg.clip = c;
+	pg.index = index;
+	pg.frames = frames_of(clips[c].header, index);
+	pg.loading = true;
+	pg.stale = false;
+	pg.used = epoch;
+	pg.needed = near ? epoch : epoch - 1;
+	pg.newer = pg.older = -1;
+	pg.raw.resize(pg.frames * clips[c].header.angles);
+	pg.angles.resize(pg.frames * clips[c].header.angles);
+
+	clips[c].resident[index] = p;
+	used += bytes;
+	stats.cached_bytes = used;
+	return p;
+}
+
+bool clip_streamer::request(uint c, uint index, bool near)
+{
+	int p = allocate(c, index, near);
+	if (p < 0)
+		return false;
+
+	read_request r;
+	r.fd = clips[c].fd;
+	r.buffer = &cache[p].raw[0];
+	r.bytes = cache[p].raw.size() * sizeof(uint16_t);
+	r.offset = sizeof(clip_header) + (uint64_t)index * clips[c].page_bytes;
+	r.page = p;
+
+	queued.push_back(r);
+	in_flight++;
+	return true;
+}
+
+void clip_streamer::arrive(uint p, int bytes)
+{
+	page& pg = cache[p];
+	pg.loading = false;
+	in_flight--;
+
+	if (pg.stale || bytes != (int)(pg.raw.size() * sizeof(uint16_t)))
+	{
+		if (!pg.stale)
+			stats.failures++;
+
+		release(p);
+		return;
+	}
+
+	for (uint i = 0; i < pg.raw.size(); ++i)
+		pg.angles[i] = dequantize_angle(pg.raw[i]);
+
+	stats.reads++;
+	stats.bytes_read += bytes;
+	touch(p);
+}
+
+void clip_streamer::read_now(uint c, uint index)
+{
+	int p = allocate(c, index, true);
+	if (p < 0)
+		return;
+
+	page& pg = cache[p];
+	uint64_t offset = sizeof(clip_header) + (uint64_t)index * clips[c].page_bytes;
+
+	in_flight++;
+	arrive(p, read_at(clips[c].fd, &pg.raw[0], pg.raw.size() * sizeof(uint16_t), offset));
+}
+
+void clip_streamer::prefetch(uint c, float time, float ahead)
+{
+	// without threads, nothing is read ahead
+	if (ring < 0 && workers.empty())
+		return;
+
+	const clip& cl = clips[c];
+	float position = time / cl.header.frame_time;
+	int first = (int)floorf(position) - 1;	// the frame before is a neighbour of the curve
+	int last = first + 3 + (int)(ahead / cl.header.frame_time);
+
+	first -= cl.header.frames * (int)floorf((float)first / cl.header.frames);
+	last = first + std::min(last - first, (int)cl.header.frames - 1);
+
+	uint from = first / STREAM_PAGE_FRAMES;
+	uint to = last / STREAM_PAGE_FRAMES;
+	uint count = std::min(to - from + 1, cl.pages);
+	uint near = (first + 3) / STREAM_PAGE_FRAMES - from + 1;	// pages of the frames of the curve
+
+	for (uint i = 0; i < count; ++i)
+	{
+		uint index = (from + i) % cl.pages;
+		if (cl.resident[index] >= 0)
+			continue;
+
+		wish w;
+		w.clip = c;
+		w.index = index;
+		w.rank = i;
+		w.near = i < near;
+		wishes.push_back(w);
+	}
+
+	// the nearest pages are used last, as they are needed soonest
+	for (uint i = count; i-- > 0; )
+	{
+		int p = cl.resident[(from + i) % cl.pages];
+		if (p >= 0 && !cache[p].loading)
+			touch(p, i < near);
+	}
+}
+
+void clip_streamer::update()
+{
+	// every player gets the pages it is at, then its next page before any gets the page after
+	std::sort(wishes.begin(), wishes.end(), [](const wish& a, const wish& b) { return a.near != b.near ? a.near : a.rank < b.rank; });
+
+	for (uint i = 0; i < wishes.size() && in_flight < STREAM_QUEUE_DEPTH; ++i)
+	{
+		const wish& w = wishes[i];
+
+		// once a page that is read ahead finds no room, neither will those that follow it
+		if (clips[w.clip].resident[w.index] < 0 && !request(w.clip, w.index, w.near) && !w.near)
+			break;
+	}
+
+	wishes.clear();
+	epoch++;
+
+#ifdef __linux__
+	if (ring >= 0)
+	{
+		if (!queued.empty())
+		{
+			uint32_t tail = *sq_tail;
+
+			for (uint i = 0; i < queued.size(); ++i)
+			{
+				const read_request& r = queued[i];
+				uint32_t index = tail & *sq_mask;
+
+				io_uring_sqe& sqe = sqes[index];
+				memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = IORING_OP_READ;
+				sqe.fd = r.fd;
+				sqe.addr = (uint64_t)(uintptr_t)r.buffer;
+				sqe.len = r.bytes;
+				sqe.off = r.offset;
+				sqe.user_data = r.page;
+
+				sq_array[index] = index;
+				++tail;
+			}
+
+			// the kernel sees the entries once the tail is published
+			__atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+			if (ring_enter(ring, queued.size(), 0, 0) < 0)
+			{
+				// nothing was taken, so the entries are withdrawn again
+				__atomic_store_n(sq_tail, tail - queued.size(), __ATOMIC_RELEASE);
+
+				for (uint i = 0; i < queued.size(); ++i)
+					arrive(queued[i].page, -1);
+			}
+
+			queued.clear();
+		}
+
+		uint32_t head = *cq_head;
+		uint32_t tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+		for (; head != tail; ++head)
+		{
+			const io_uring_cqe& cqe = cqes[head & *cq_mask];
+			arrive((uint)cqe.user_data, cqe.res);
+		}
+
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+		return;
+	}
+#endif
+
+	if (workers.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.insert(jobs.end(), queued.begin(), queued.end());
+		taken.swap(results);
+	}
+
+	if (!queued.empty())
+		wake.notify_all();
+	queued.clear();
+
+	for (uint i = 0; i < taken.size(); ++i)
+		arrive(taken[i].page, taken[i].bytes);
+	taken.clear();
+}
+
+const float* clip_streamer::frame(uint c, int f)
+{
+	const clip& cl = clips[c];
+	f -= cl.header.frames * (int)floorf((float)f / cl.header.frames);
+
+	int p = cl.resident[f / STREAM_PAGE_FRAMES];
+	if (p < 0 || cache[p].loading)
+		return nullptr;
+
+	touch(p, true);
+	return &cache[p].angles[(f % STREAM_PAGE_FRAMES) * cl.header.angles];
+}
+
+bool clip_streamer::sample(uint c, float time, float* out)
+{
+	const clip& cl = clips[c];
+	float position = time / cl.header.frame_time;
+	position -= cl.header.frames * floorf(position / cl.header.frames);
+
+	int f = std::min((int)position, (int)cl.header.frames - 1);
+	float u = position - f;
+
+	const float* at[4];
+	bool found = true;
+
+	for (int i = 0; i < 4; ++i)
+		found = (at[i] = frame(c, f - 1 + i)) && found;
+
+	if (!found)
+	{
+		stats.misses++;
+
+		if (ring >= 0 || !workers.empty())
+			return false;
+
+		// the frame thread reads the pages itself
+		for (int i = 0; i < 4; ++i)
+		{
+			if (!frame(c, f - 1 + i))
+				read_now(c, ((f - 1 + i + cl.header.frames) % cl.header.frames) / STREAM_PAGE_FRAMES);
+		}
+
+		found = true;
+		for (int i = 0; i < 4; ++i)
+			found = (at[i] = frame(c, f - 1 + i)) && found;
+
+		if (!found)
+			return false;
+	}
+	else
+		stats.hits++;
+
+	interpolate(at[0], at[1], at[2], at[3], u, out, cl.header.angles);
+	return true;
+}
+
+void clip_streamer::interpolate(const float* a, const float* b, const float* c, const float* d, float u, float* out, uint n)
+{
+	/*
+	 *	hermite from b to c with the catmull-rom tangents (c - a) / 2 and (d - b) / 2, per frame:
+	 *
+	 *	h(u) = (2u^3 - 3u^2 + 1) b + (u^3 - 2u^2 + u) m_b + (-2u^3 + 3u^2) c + (u^3 - u^2) m_c
+	 *
+	 *	after unwrapping a, c and d along the shorter arcs from b
+	 */
+	float u2 = u * u, u3 = u2 * u;
+	float h00 = 2.0f * u3 - 3.0f * u2 + 1.0f;
+	float h10 = u3 - 2.0f * u2 + u;
+	float h01 = -2.0f * u3 + 3.0f * u2;
+	float h11 = u3 - u2;
+
+	for (uint i = 0; i < n; ++i)
+	{
+		float p1 = b[i];
+		float p0 = p1 - shortest_arc(a[i], b[i]);
+		float p2 = p1 + shortest_arc(b[i], c[i]);
+		float p3 = p2 + shortest_arc(c[i], d[i]);
+
+		float v = h00 * p1 + h10 * (p2 - p0) * 0.5f + h01 * p2 + h11 * (p3 - p1) * 0.5f;
+		out[i] = v - 360.0f * floorf(v / 360.0f);
+	}
+}
+
+bool clip_streamer::write(const std::string& path, const float* frames, uint angles, uint count, float frame_time)
+{
+	std::ofstream out(path.c_str(), std::ios::binary);
+	if (!out)
+		return false;
+
+	clip_header header;
+	header.magic = CLIP_MAGIC;
+	header.version = CLIP_VERSION;
+	header.angles = angles;
+	header.frames = count;
+	header.frame_time = frame_time;
+	header.reserved = 0;
+	out.write((const char*)&header, sizeof(header));
+
+	std::vector<uint16_t> steps(angles);
+	for (uint f = 0; f < count; ++f)
+	{
+		for (uint i = 0; i < angles; ++i)
+			steps[i] = quantize_angle(frames[f * angles + i]);
+
+		out.write((const char*)&steps[0], angles * sizeof(uint16_t));
+	}
+
+	return (bool)out;
+}
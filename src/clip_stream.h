@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "structures.h"
+
+static const uint32_t CLIP_MAGIC = 0x50494c43; // "CLIP"
+static const uint32_t CLIP_VERSION = 1;
+
+// streamed clip: the header, followed by frames of angles steps each (see quantize.h), in pages of STREAM_PAGE_FRAMES
+struct clip_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t angles;
+	uint32_t frames;
+	float frame_time;	// seconds
+	uint32_t reserved;
+};
+
+struct stream_stats
+{
+	uint hits;			// samples that found their pages in the cache
+	uint misses;		// samples whose pages were not there, which keep the previous pose (or read them on the spot)
+	uint reads;			// pages read
+	uint evictions;
+	uint failures;		// reads that came back short
+	size_t bytes_read;
+	size_t cached_bytes;
+
+	stream_stats() : hits(0), misses(0), reads(0), evictions(0), failures(0), bytes_read(0), cached_bytes(0) {}
+};
+
+/*
+ *	plays long clips from disk without reading them on the frame thread
+ *
+ *	a clip is read a page at a time, and its pages are decoded into angles in degrees as they arrive. players
+ *	prefetch() the pages ahead of their time every frame, update() hands the queued reads to io_uring on linux (or
+ *	to a pool of threads reading at offsets, where io_uring is not available) and takes in those that completed,
+ *	and sample() evaluates a Catmull-Rom curve through the frames around a time, as angle_spline does through keys.
+ *
+ *	decoded pages are kept in a cache bounded by a number of bytes, evicting the least recently used page when a
+ *	read needs room. pages that are being read stay put until they arrive, and so do the pages that players sample
+ *	now. pages that are only read ahead make room for pages that players are at, but not for each other, so when
+ *	the cache is too small for every player to read as far ahead as asked, players read less far ahead rather
+ *	than evicting each other's pages in turn. with no threads the streamer reads what a sample misses on the spot,
+ *	as a clip read on the frame thread would.
+ */
+class clip_streamer
+{
+private:
+	struct clip
+	{
+		int fd;
+		clip_header header;
+		uint pages;
+		uint page_bytes;			// of a full page in the file
+		std::string path;
+		std::vector<int> resident;	// page of the cache holding each page of the clip, -1 when it is not there
+	};
+
+	struct page
+	{
+		uint clip;
+		uint index;					// within the clip
+		uint frames;
+		bool loading;
+		bool stale;					// its clip was opened again while it was read
+		uint used;					// update of the last use
+		uint needed;				// update at which a player was last at the page, which pins it until the next
+		int newer;					// neighbours in the order of use, -1 at the ends
+		int older;
+		std::vector<uint16_t> raw;
+		std::vector<float> angles;	// frames of angles each
+	};
+
+	// a page that a player will need, rank pages after the one it is at
+	struct wish
+	{
+		uint clip;
+		uint index;
+		uint rank;
+		bool near;	// holds the frames that the player samples now
+	};
+
+	struct read_request
+	{
+		int fd;
+		void* buffer;
+		uint bytes;
+		uint64_t offset;
+		uint page;
+	};
+
+	struct read_result
+	{
+		uint page;
+		int bytes;		// or a negative error
+	};
+
+	std::vector<clip> clips;
+	std::vector<page> cache;
+	std::vector<int> free_pages;
+	int newest;
+	int oldest;
+	size_t budget;
+	size_t used;			// bytes of the pages in the cache, including those being read
+	uint in_flight;
+	uint epoch;				// updates so far
+
+	std::vector<wish> wishes;			// by prefetch(), until update()
+	std::vector<read_request> queued;
+	std::vector<int> retired;			// descriptors of clips that were opened again, closed at the end
+
+	// io_uring, mapped from the kernel
+	int ring;
+	uint32_t* sq_head;
+	uint32_t* sq_tail;
+	uint32_t* sq_mask;
+	uint32_t* sq_array;
+	struct io_uring_sqe* sqes;
+	uint32_t* cq_head;
+	uint32_t* cq_tail;
+	uint32_t* cq_mask;
+	struct io_uring_cqe* cqes;
+	void* sq_map;
+	void* cq_map;
+	size_t sq_map_bytes;
+	size_t cq_map_bytes;
+	size_t sqes_bytes;
+
+	// pool of threads reading when there is no ring
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<read_request> jobs;
+	std::vector<read_result> results;
+	std::vector<read_result> taken;
+	bool quit;
+
+	stream_stats stats;
+
+private:
+	bool setup_ring();
+	void work();
+
+	void touch(int p, bool near = false);
+	void unlink(int p);
+	void release(int p);
+	int allocate(uint c, uint index, bool near);
+	bool request(uint c, uint index, bool near);
+	void arrive(uint p, int bytes);
+	void read_now(uint c, uint index);
+	const float* frame(uint c, int f);
+
+public:
+	// threads read in the background when there is no ring, none reads what sample() misses right away
+	clip_streamer(uint threads, bool use_ring = true, size_t budget_bytes = STREAM_CACHE_BYTES);
+	~clip_streamer();
+
+	// the id of the clip, or -1 when it is not a streamed clip; opening a clip again drops its pages
+	int open(const std::string& path);
+
+	uint num_angles(uint c) const { return clips[c].header.angles; }
+	float duration(uint c) const { return clips[c].header.frames * clips[c].header.frame_time; }
+
+	// asks for the pages from the time on, up to ahead seconds later (the clip loops)
+	void prefetch(uint c, float time, float ahead = STREAM_PREFETCH_SECONDS);
+
+	// reads the pages that were asked for, nearest to their players first and as far as the cache has room for
+	// pages that were not used since the last update, and takes in the reads that completed
+	void update();
+
+	// angles at a time, wrapped to [0, 360); false when their pages are not there yet
+	bool sample(uint c, float time, float* out);
+
+	// catmull-rom from frame b (u = 0) to frame c (u = 1) along the shorter arcs, wrapped to [0, 360)
+	static void interpolate(const float* a, const float* b, const float* c, const float* d, float u, float* out, uint n);
+
+	const char* backend() const { return ring >= 0 ? "io_uring" : (workers.empty() ? "frame thread" : "threads"); }
+	const stream_stats& last_stats() const { return stats; }
+	void clear_stats() { size_t bytes = stats.cached_bytes; stats = stream_stats(); stats.cached_bytes = bytes; }
+
+	// writes frames of angles (in degrees) as a streamed clip
+	static bool write(const std::string& path, const float* frames, uint angles, uint count, float frame_time);
+};
@@ -0,0 +1,555 @@
+#include "cloud.h"
+#include "simd.h"
+#include <charconv>
+#include <chrono>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+void packed_points::set_half(bool h)
+{
+	if (h == half)
+		return;
+
+	if (h)
+	{
+		halves.resize(full.size());
+		for (uint i = 0; i < full.size(); ++i)
+			halves[i] = float_to_half(full[i]);
+		std::vector<float>().swap(full);
+	}
+	else
+	{
+		full.resize(halves.size());
+		for (uint i = 0; i < halves.size(); ++i)
+			full[i] = half_to_float(halves[i]);
+		std::vector<uint16_t>().swap(halves);
+	}
+
+	half = h;
+}
+
+void packed_points::copy_to(packed_points& target, uint at) const
+{
+	if (half)
+		std::copy(halves.begin(), halves.end(), target.halves.begin() + at * 3);
+	else
+		std::copy(full.begin(), full.end(), target.full.begin() + at * 3);
+}
+
+
+
+/*
+ *	binds points to the bone whose segment is closest: with o = p - P[n] and d the direction of the bone,
+ *
+ *	t = clamp(o . d / |d|^2, 0, 1),		distance^2 = |o - t d|^2
+ *
+ *	and the point is kept at x = S[n]^T o, as an attachment at x is drawn at P[n] + S[n] x. rows hold count
+ *	points (a multiple of 8)
+ */
+static void bind_points(const float* const* p, uint count, const cloud_bone* bones, uint num_bones, uint* best,
+	float* const* local)
+{
+	for (uint i = 0; i < count; ++i)
+	{
+		float best_distance = 3.4e38f;
+
+		for (uint b = 0; b < num_bones; ++b)
+		{
+			const cloud_bone& bone = bones[b];
+			float o[3] = { p[0][i] - bone.position[0], p[1][i] - bone.position[1], p[2][i] - bone.position[2] };
+			const float* d = bone.direction;
+
+			float t = (o[0] * d[0] + o[1] * d[1] + o[2] * d[2]) * bone.inverse_length;
+			t = std::min(std::max(t, 0.0f), 1.0f);
+
+			float e[3] = { o[0] - t * d[0], o[1] - t * d[1], o[2] - t * d[2] };
+			float distance = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+
+			if (distance < best_distance)
+			{
+				best_distance = distance;
+				best[i] = b;
+
+				const float* r = bone.rotation;
+				local[0][i] = r[0] * o[0] + r[3] * o[1] + r[6] * o[2];
+				local[1][i] = r[1] * o[0] + r[4] * o[1] + r[7] * o[2];
+				local[2][i] = r[2] * o[0] + r[5] * o[1] + r[8] * o[2];
+			}
+		}
+	}
+}
+
+typedef void (*bind_kernel)(const float* const* p, uint count, const cloud_bone* bones, uint num_bones, uint* best,
+	float* const* local);
+
+#ifdef HAS_AVX2_KERNELS
+TARGET_AVX2
+static void bind_points_avx2(const float* const* p, uint count, const cloud_bone* bones, uint num_bones, uint* best,
+	float* const* local)
+{
+	__m256 zero = _mm256_setzero_ps();
+	__m256 one = _mm256_set1_ps(1.0f);
+
+	for (uint i = 0; i < count; i += 8)
+	{
+		__m256 x[3] = { _mm256_loadu_ps(p[0] + i), _mm256_loadu_ps(p[1] + i), _mm256_loadu_ps(p[2] + i) };
+		__m256 best_distance = _mm256_set1_ps(3.4e38f);
+		__m256i best_bone = _mm256_setzero_si256();
+		__m256 l[3] = { zero, zero, zero };
+
+		for (uint b = 0; b < num_bones; ++b)
+		{
+			const cloud_bone& bone = bones[b];
+			__m256 o[3], d[3];
+
+			for (uint c = 0; c < 3; ++c)
+			{
+				o[c] = _mm256_sub_ps(x[c], _mm256_set1_ps(bone.position[c]));
+				d[c] = _mm256_set1_ps(bone.direction[c]);
+			}
+
+			__m256 t = _mm256_fmadd_ps(o[0], d[0], _mm256_fmadd_ps(o[1], d[1], _mm256_mul_ps(o[2], d[2])));
+			t = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(t, _mm256_set1_ps(bone.inverse_length)), zero), one);
+
+			__m256 distance = zero;
+			for (uint c = 0; c < 3; ++c)
+			{
+				__m256 e = _mm256_fnmadd_ps(t, d[c], o[c]);
+				distance = _mm256_fmadd_ps(e, e, distance);
+			}
+
+			__m256 closer = _mm256_cmp_ps(distance, best_distance, _CMP_LT_OQ);
+			best_distance = _mm256_blendv_ps(best_distance, distance, closer);
+			best_bone = _mm256_blendv_epi8(best_bone, _mm256_set1_epi32(b), _mm256_castps_si256(closer));
+
+			const float* r = bone.rotation;
+			for (uint c = 0; c < 3; ++c)
+			{
+				__m256 v = _mm256_fmadd_ps(_mm256_set1_ps(r[c]), o[0],
+					_mm256_fmadd_ps(_mm256_set1_ps(r[3 + c]), o[1], _mm256_mul_ps(_mm256_set1_ps(r[6 + c]), o[2])));
+				l[c] = _mm256_blendv_ps(l[c], v, closer);
+			}
+		}
+
+		_mm256_storeu_si256((__m256i*)(best + i), best_bone);
+		for (uint c = 0; c < 3; ++c)
+			_mm256_storeu_ps(local[c] + i, l[c]);
+	}
+}
+
+static const bind_kernel bind_rows = cpu_has_avx2() ? bind_points_avx2 : bind_points;
+#else
+static const bind_kernel bind_rows = bind_points;
+#endif
+
+
+
+cloud_loader::cloud_loader(uint threads) : clouds(nullptr), copying(false), text(false), dimensions(3), next_slice(0), generation(0), busy(0), quit(false)
+{
+	// the calling thread binds as well, so one thread less is started
+	for (uint i = 1; i < threads; ++i)
+		workers.push_back(std::thread(&cloud_loader::work, this));
+
+	// a few slices per thread, so a slow slice does not hold the others up
+	slices.resize(std::max(threads, 1u) * 4);
+}
+
+cloud_loader::~cloud_loader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+
+	start.notify_all();
+
+	for (uint i = 0; i < workers.size(); ++i)
+		workers[i].join();
+}
+
+void cloud_loader::work()
+{
+	uint seen = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start.wait(lock, [&] { return quit || generation != seen; });
+
+			if (quit) return;
+			seen = generation;
+		}
+
+		run_slices();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0)
+			done.notify_one();
+	}
+}
+
+void cloud_loader::run_slices()
+{
+	for (uint s = next_slice++; s < slices.size(); s = next_slice++)
+	{
+		if (copying)
+			copy(slices[s]);
+		else
+			bind(slices[s]);
+	}
+}
+
+void cloud_loader::copy(slice& s)
+{
+	for (uint b = 0; b < bones.size(); ++b)
+		s.bound[b].copy_to((*clouds)[b], s.offsets[b]);
+}
+
+void cloud_loader::bind_block(slice& s, float* const* block, uint count)
+{
+	uint best[BLOCK];
+	float x[BLOCK], y[BLOCK], z[BLOCK];
+	float* local[3] = { x, y, z };
+
+	// the kernels take whole rows of 8
+	uint padded = (count + 7) & ~7u;
+	for (uint c = 0; c < 3; ++c)
+		std::fill(block[c] + count, block[c] + padded, 0.0f);
+
+	bind_rows(block, padded, &bones[0], bones.size(), best, local);
+
+	// every bone grows once per block, by the points it takes from it
+	for (uint i = 0; i < count; ++i)
+		s.cursors[best[i]]++;
+
+	for (uint b = 0; b < bones.size(); ++b)
+		s.cursors[b] = s.cursors[b] ? s.bound[b].extend(s.cursors[b]) : 0;
+
+	for (uint i = 0; i < count; ++i)
+		s.bound[best[i]].set(s.cursors[best[i]]++, x[i], y[i], z[i]);
+
+	std::fill(s.cursors.begin(), s.cursors.end(), 0);
+}
+
+void cloud_loader::bind(slice& s)
+{
+	float x[BLOCK], y[BLOCK], z[BLOCK];
+	float* block[3] = { x, y, z };
+	uint count = 0;
+
+	if (!text)
+	{
+		const float* values = (const float*)s.begin;
+		uint points = (s.end - s.begin) / (dimensions * sizeof(float));
+
+		for (uint i = 0; i < points; ++i, values += dimensions)
+		{
+			x[count] = values[0];
+			y[count] = values[1];
+			z[count] = dimensions > 2 ? values[2] : 0.0f;
+
+			if (++count == BLOCK)
+			{
+				bind_block(s, block, count);
+				count = 0;
+			}
+		}
+
+		bind_block(s, block, count);
+		return;
+	}
+
+	const char* c = s.begin;
+
+	while (c < s.end)
+	{
+		const char* line_end = (const char*)memchr(c, '\n', s.end - c);
+		if (!line_end)
+			line_end = s.end;
+
+		float v[3] = { 0.0f, 0.0f, 0.0f };
+		uint fields = 0;
+
+		while (c < line_end)
+		{
+			if (*c == ' ' || *c == '\t' || *c == ',' || *c == '\r')
+			{
+				++c;
+				continue;
+			}
+
+			if (*c == '#' || fields == 3)
+				break;
+
+			std::from_chars_result parsed = std::from_chars(c, line_end, v[fields]);
+			if (parsed.ec != std::errc())
+			{
+				fields = 0;
+				break;
+			}
+
+			c = parsed.ptr;
+			fields++;
+		}
+
+		if (fields >= 2)
+		{
+			x[count] = v[0];
+			y[count] = v[1];
+			z[count] = v[2];
+
+			if (++count == BLOCK)
+			{
+				bind_block(s, block, count);
+				count = 0;
+			}
+		}
+		else if (fields == 1 || (c < line_end && *c != '#'))
+			s.skipped++;
+
+		c = line_end + 1;
+	}
+
+	bind_block(s, block, count);
+}
+
+void cloud_loader::run()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		next_slice = 0;
+		busy = workers.size();
+		generation++;
+	}
+
+	start.notify_all();
+	run_slices();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&] { return busy == 0; });
+}
+
+bool cloud_loader::load(const std::string& path, const pose3& pose, std::vector<packed_points>& clouds, bool half)
+{
+	auto started = std::chrono::steady_clock::now();
+	stats = cloud_stats();
+
+	if (pose.joints.size() < 2)
+		return false;
+
+	const char* data;
+	size_t size;
+
+#ifndef _WIN32
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	size = st.st_size;
+	void* mapping = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+	::close(fd);
+	if (mapping == MAP_FAILED) return false;
+
+	madvise(mapping, size, MADV_SEQUENTIAL);
+	data = (const char*)mapping;
+#else
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file) return false;
+
+	std::vector<char> storage((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	size = storage.size();
+	data = storage.empty() ? nullptr : &storage[0];
+#endif
+
+	const char* body = data;
+	const char* end = data + size;
+	text = true;
+	dimensions = 3;
+
+	cloud_header header;
+	if (size >= sizeof(header))
+	{
+		memcpy(&header, data, sizeof(header));
+
+		if (header.magic == CLOUD_MAGIC)
+		{
+			bool valid = header.version == CLOUD_VERSION && (header.dimensions == 2 || header.dimensions == 3) &&
+				size >= sizeof(header) + (size_t)header.count * header.dimensions * sizeof(float);
+
+			if (!valid)
+			{
+				std::cerr << "Error: " << path << " is not a valid point cloud" << std::endl;
+#ifndef _WIN32
+				munmap(mapping, size);
+#endif
+				return false;
+			}
+
+			text = false;
+			dimensions = header.dimensions;
+			body = data + sizeof(header);
+			end = body + (size_t)header.count * dimensions * sizeof(float);
+		}
+	}
+
+	bones.resize(pose.joints.size() - 1);
+	for (uint n = 0; n < bones.size(); ++n)
+	{
+		const vec3& p = pose.joints[n].position;
+		vec3 d = pose.joints[n + 1].position - p;
+		float length = d.x * d.x + d.y * d.y + d.z * d.z;
+
+		cloud_bone& bone = bones[n];
+		bone.position[0] = p.x; bone.position[1] = p.y; bone.position[2] = p.z;
+		bone.direction[0] = d.x; bone.direction[1] = d.y; bone.direction[2] = d.z;
+		bone.inverse_length = length > 0.0f ? 1.0f / length : 0.0f;
+		memcpy(bone.rotation, pose.joints[n].rotation, sizeof(bone.rotation));
+	}
+
+	if (clouds.size() < pose.joints.size())
+		clouds.resize(pose.joints.size());
+
+	uint kept = 0;
+	for (uint n = 0; n < clouds.size(); ++n)
+		kept += clouds[n].size();
+
+	for (uint n = 0; n < clouds.size(); ++n)
+		clouds[n].set_half(half);
+
+	this->clouds = &clouds;
+
+	for (uint s = 0; s < slices.size(); ++s)
+	{
+		slices[s].bound.resize(bones.size());
+		slices[s].cursors.assign(bones.size(), 0);
+		slices[s].offsets.assign(bones.size(), 0);
+		slices[s].skipped = 0;
+
+		for (uint b = 0; b < bones.size(); ++b)
+			slices[s].bound[b].set_half(half);
+	}
+
+	size_t stride = text ? 1 : dimensions * sizeof(float);
+	size_t chunk = std::max((size_t)CLOUD_CHUNK_BYTES / stride, (size_t)1) * stride;
+
+	for (const char* c = body; c < end; )
+	{
+		const char* chunk_end = (size_t)(end - c) > chunk ? c + chunk : end;
+
+		// text chunks end after a line
+		if (text && chunk_end < end)
+		{
+			const char* newline = (const char*)memchr(chunk_end, '\n', end - chunk_end);
+			chunk_end = newline ? newline + 1 : end;
+		}
+
+		// slices of whole points (or lines)
+		size_t units = (chunk_end - c) / stride;
+		const char* from = c;
+
+		for (uint s = 0; s < slices.size(); ++s)
+		{
+			const char* to = (s + 1 == slices.size()) ? chunk_end : c + units * (s + 1) / slices.size() * stride;
+
+			if (text && to < chunk_end)
+			{
+				to = std::max(to, from);
+				const char* newline = (const char*)memchr(to, '\n', chunk_end - to);
+				to = newline ? newline + 1 : chunk_end;
+			}
+
+			slices[s].begin = from;
+			slices[s].end = to;
+			from = to;
+
+			for (uint b = 0; b < bones.size(); ++b)
+				slices[s].bound[b].clear();
+		}
+
+		copying = false;
+		run();
+
+		// the slices take their places in the clouds in file order, and copy their points there in parallel
+		for (uint b = 0; b < bones.size(); ++b)
+		{
+			uint taken = 0;
+			for (uint s = 0; s < slices.size(); ++s)
+				taken += slices[s].bound[b].size();
+
+			// after the first chunk, the clouds make room for as many points of the whole file
+			if (c == body)
+				clouds[b].reserve(clouds[b].size() + (uint)(taken * 1.05 * (end - body) / (chunk_end - c)));
+
+			uint at = clouds[b].extend(taken);
+			for (uint s = 0; s < slices.size(); ++s)
+			{
+				slices[s].offsets[b] = at;
+				at += slices[s].bound[b].size();
+			}
+		}
+
+		copying = true;
+		run();
+
+#ifndef _WIN32
+		// the pages of the chunk are not read again
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t first_page = (c - data) / page * page;
+		size_t last_page = (chunk_end - data) / page * page;
+		if (last_page > first_page)
+			madvise((char*)data + first_page, last_page - first_page, MADV_DONTNEED);
+#endif
+
+		c = chunk_end;
+	}
+
+#ifndef _WIN32
+	if (mapping)
+		munmap(mapping, size);
+#endif
+
+	for (uint s = 0; s < slices.size(); ++s)
+		stats.skipped += slices[s].skipped;
+
+	for (uint n = 0; n < clouds.size(); ++n)
+	{
+		stats.points += clouds[n].size();
+		stats.stored_bytes += clouds[n].bytes();
+	}
+
+	stats.points -= kept;
+
+	stats.file_bytes = size;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	return true;
+}
+
+bool cloud_loader::write(const std::string& path, const std::vector<vec3>& points, uint dimensions)
+{
+	std::ofstream file(path.c_str(), std::ios::binary);
+	if (!file) return false;
+
+	cloud_header header = { CLOUD_MAGIC, CLOUD_VERSION, (uint32_t)points.size(), dimensions };
+	file.write((const char*)&header, sizeof(header));
+
+	for (uint i = 0; i < points.size(); ++i)
+	{
+		const float p[3] = { points[i].x, points[i].y, points[i].z };
+		file.write((const char*)p, dimensions * sizeof(float));
+	}
+
+	return file.good();
+}
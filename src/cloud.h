@@ -0,0 +1,227 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "structures.h"
+
+static const uint32_t CLOUD_MAGIC = 0x4c43504b; // "KPCL"
+static const uint32_t CLOUD_VERSION = 1;
+
+// binary point cloud: the header, followed by count points of dimensions (2 or 3) floats each
+struct cloud_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t dimensions;
+};
+
+// half precision (IEEE 754 binary16), rounding to nearest even; magnitudes beyond 65504 become infinite
+inline uint16_t float_to_half(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, 4);
+
+	uint16_t sign = (x >> 16) & 0x8000;
+	uint32_t magnitude = x & 0x7fffffff;
+
+	if (magnitude >= 0x7f800000)	// infinity and nan
+		return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+	if (magnitude >= 0x477ff000)	// rounds beyond the largest half
+		return sign | 0x7c00;
+	if (magnitude < 0x38800000)		// subnormal halves
+	{
+		float shifted;
+		uint32_t m = magnitude;
+		memcpy(&shifted, &m, 4);
+		shifted += 0.5f;			// aligns the bits of the subnormal to the bottom of the mantissa
+		memcpy(&m, &shifted, 4);
+		return sign | (uint16_t)(m - 0x3f000000);
+	}
+
+	uint32_t rounded = magnitude + 0xfff + ((magnitude >> 13) & 1) - (112u << 23);
+	return sign | (uint16_t)(rounded >> 13);
+}
+
+inline float half_to_float(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t bits = (uint32_t)(h & 0x7fff) << 13;
+	float f;
+
+	if (bits >= 0x0f800000)			// infinity and nan
+		bits += 0x70000000;
+	else if (bits < 0x00800000)		// subnormals scale through a float multiply
+	{
+		uint32_t m = bits + 0x38800000;
+		memcpy(&f, &m, 4);
+		f -= 6.10351562e-05f;		// 2^-14
+		memcpy(&bits, &f, 4);
+	}
+	else
+		bits += 112u << 23;
+
+	bits |= sign;
+	memcpy(&f, &bits, 4);
+	return f;
+}
+
+// points of a bone in the coordinates of its joint, contiguous as full or half floats (x, y, z per point)
+class packed_points
+{
+private:
+	std::vector<float> full;
+	std::vector<uint16_t> halves;
+	bool half;
+
+public:
+	packed_points() : half(false) {}
+
+	bool is_half() const { return half; }
+	uint size() const { return (half ? halves.size() : full.size()) / 3; }
+	size_t bytes() const { return half ? halves.size() * sizeof(uint16_t) : full.size() * sizeof(float); }
+
+	// converts the points that are already kept
+	void set_half(bool h);
+
+	void clear() { full.clear(); halves.clear(); }
+	void reserve(uint points) { if (half) halves.reserve(points * 3); else full.reserve(points * 3); }
+
+	void add(const vec3& p)
+	{
+		if (half)
+		{
+			halves.push_back(float_to_half(p.x));
+			halves.push_back(float_to_half(p.y));
+			halves.push_back(float_to_half(p.z));
+		}
+		else
+		{
+			full.push_back(p.x);
+			full.push_back(p.y);
+			full.push_back(p.z);
+		}
+	}
+
+	// room for more points, returning the index of the first
+	uint extend(uint points)
+	{
+		uint first = size();
+		if (half) halves.resize((first + points) * 3); else full.resize((first + points) * 3);
+		return first;
+	}
+
+	void set(uint i, float x, float y, float z)
+	{
+		if (half)
+		{
+			halves[i * 3] = float_to_half(x);
+			halves[i * 3 + 1] = float_to_half(y);
+			halves[i * 3 + 2] = float_to_half(z);
+		}
+		else
+		{
+			full[i * 3] = x;
+			full[i * 3 + 1] = y;
+			full[i * 3 + 2] = z;
+		}
+	}
+
+	vec3 get(uint i) const
+	{
+		if (half)
+			return vec3(half_to_float(halves[i * 3]), half_to_float(halves[i * 3 + 1]), half_to_float(halves[i * 3 + 2]));
+		return vec3(full[i * 3], full[i * 3 + 1], full[i * 3 + 2]);
+	}
+
+	// copies the points over those of another buffer of the same precision, from point at on
+	void copy_to(packed_points& target, uint at) const;
+};
+
+struct cloud_stats
+{
+	uint points;		// bound by the last load
+	size_t stored_bytes;	// by all bones, including points of earlier loads
+	uint skipped;		// lines of a text file that are not points
+	size_t file_bytes;
+	double seconds;
+
+	cloud_stats() : points(0), stored_bytes(0), skipped(0), file_bytes(0), seconds(0.0) {}
+};
+
+// frame of a bone that points are bound to, which is that of the joint it starts at
+struct cloud_bone
+{
+	float position[3];		// P[n]
+	float direction[3];		// to the next joint
+	float inverse_length;	// 1 / |direction|^2, 0 for a bone without length
+	float rotation[9];		// S[n] (row-major), so local coordinates are its transpose times the offset
+};
+
+/*
+ *	streams a point cloud file through a mapping, chunk by chunk, and binds its points to the bones of a pose
+ *
+ *	a file is either binary (see cloud_header) or text, with the coordinates of a point per line (a missing z is
+ *	0, and lines starting with # are comments). every chunk is split among the threads, which parse their part
+ *	and bind each point to the bone whose segment is closest to it, into buffers per thread and bone. the chunk is
+ *	then appended bone by bone in file order, and its pages are dropped, so memory use is bounded by the chunk
+ *	size rather than the file size.
+ */
+class cloud_loader
+{
+private:
+	static const uint BLOCK = 256;	// points parsed before they are bound together
+
+	// what a thread parses and binds from the current chunk
+	struct slice
+	{
+		const char* begin;
+		const char* end;
+		std::vector<packed_points> bound;	// per bone
+		std::vector<uint> cursors;			// per bone, where the points of a block go
+		std::vector<uint> offsets;			// per bone, where the points of the slice go in its cloud
+		uint skipped;
+	};
+
+	std::vector<cloud_bone> bones;
+	std::vector<slice> slices;
+	std::vector<packed_points>* clouds;	// of the current load
+	bool copying;						// the slices are copied into the clouds rather than bound
+	bool text;
+	uint dimensions;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable done;
+	std::atomic<uint> next_slice;
+	uint generation;
+	uint busy;
+	bool quit;
+
+	cloud_stats stats;
+
+private:
+	void work();
+	void run_slices();
+	void bind(slice& s);
+	void bind_block(slice& s, float* const* block, uint count);
+	void copy(slice& s);
+	void run();
+
+public:
+	cloud_loader(uint threads);
+	~cloud_loader();
+
+	// appends the points of a file to the bones of the pose, clouds[n] holding those of the bone of joint n
+	bool load(const std::string& path, const pose3& pose, std::vector<packed_points>& clouds, bool half);
+
+	const cloud_stats& last_stats() const { return stats; }
+
+	// writes a binary cloud file
+	static bool write(const std::string& path, const std::vector<vec3>& points, uint dimensions);
+};
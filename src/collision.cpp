@@ -0,0 +1,429 @@
+#include "collision.h"
+#include "simd.h"
+
+static const uint BATCH = 8;		// candidate pairs per narrow-phase batch
+static const uint BATCH_ROWS = 12;	// start and end of both segments, x y z each
+
+/*
+ *	closest points of the segments p1 + s d1 and p2 + t d2 for s, t in [0, 1] (see Ericson, Real-Time Collision
+ *	Detection, 5.1.9), without branches:
+ *
+ *	s = clamp((b f - c e) / (a e - b^2)),	t = clamp((b s + f) / e),	s = clamp((b t - c) / a)
+ *
+ *	with r = p1 - p2, a = d1.d1, b = d1.d2, c = d1.r, e = d2.d2 and f = d2.r. parallel segments start at s = 0,
+ *	and the final s follows the clamped t, which is where the clamped t is closest.
+ */
+static float closest_points(const float* p1, const float* q1, const float* p2, const float* q2, float& s, float& t)
+{
+	float d1[3], d2[3], r[3];
+	for (uint c = 0; c < 3; ++c)
+	{
+		d1[c] = q1[c] - p1[c];
+		d2[c] = q2[c] - p2[c];
+		r[c] = p1[c] - p2[c];
+	}
+
+	float a = d1[0] * d1[0] + d1[1] * d1[1] + d1[2] * d1[2];
+	float b = d1[0] * d2[0] + d1[1] * d2[1] + d1[2] * d2[2];
+	float c = d1[0] * r[0] + d1[1] * r[1] + d1[2] * r[2];
+	float e = d2[0] * d2[0] + d2[1] * d2[1] + d2[2] * d2[2];
+	float f = d2[0] * r[0] + d2[1] * r[1] + d2[2] * r[2];
+
+	float denominator = a * e - b * b;
+	s = denominator > 1e-12f ? std::min(std::max((b * f - c * e) / denominator, 0.0f), 1.0f) : 0.0f;
+	t = std::min(std::max((b * s + f) / std::max(e, 1e-12f), 0.0f), 1.0f);
+	s = std::min(std::max((b * t - c) / std::max(a, 1e-12f), 0.0f), 1.0f);
+
+	float distance2 = 0.0f;
+	for (uint k = 0; k < 3; ++k)
+	{
+		float d = r[k] + d1[k] * s - d2[k] * t;
+		distance2 += d * d;
+	}
+
+	return distance2;
+}
+
+// squared distances and closest parameters of a batch: rows p1 x y z, q1 x y z, p2 x y z, q2 x y z of 8 lanes
+static void segment_distances(const float* rows, float* distance2, float* s, float* t)
+{
+	for (uint i = 0; i < BATCH; ++i)
+	{
+		float p1[3], q1[3], p2[3], q2[3];
+		for (uint c = 0; c < 3; ++c)
+		{
+			p1[c] = rows[c * BATCH + i];
+			q1[c] = rows[(3 + c) * BATCH + i];
+			p2[c] = rows[(6 + c) * BATCH + i];
+			q2[c] = rows[(9 + c) * BATCH + i];
+		}
+
+		distance2[i] = closest_points(p1, q1, p2, q2, s[i], t[i]);
+	}
+}
+
+// indices of the bounds among rows y min, y max, z min, z max of count (padded to 8) that overlap box in y and z
+static uint overlapping(const float* rows, uint stride, uint count, const aabb& box, uint* out)
+{
+	const float* y0 = rows;
+	const float* y1 = rows + stride;
+	const float* z0 = rows + 2 * stride;
+	const float* z1 = rows + 3 * stride;
+	uint n = 0;
+
+	for (uint i = 0; i < count; ++i)
+	{
+		if (y1[i] >= box.min.y && y0[i] <= box.max.y && z1[i] >= box.min.z && z0[i] <= box.max.z)
+			out[n++] = i;
+	}
+
+	return n;
+}
+
+typedef void (*distance_kernel)(const float* rows, float* distance2, float* s, float* t);
+typedef uint (*overlap_kernel)(const float* rows, uint stride, uint count, const aabb& box, uint* out);
+
+#ifdef HAS_AVX2_KERNELS
+TARGET_AVX2
+static inline __m256 clamp01(__m256 v)
+{
+	return _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+}
+
+TARGET_AVX2
+static inline __m256 dot3(const __m256* u, const __m256* v)
+{
+	return _mm256_fmadd_ps(u[0], v[0], _mm256_fmadd_ps(u[1], v[1], _mm256_mul_ps(u[2], v[2])));
+}
+
+TARGET_AVX2
+static void segment_distances_avx2(const float* rows, float* distance2, float* s, float* t)
+{
+	__m256 d1[3], d2[3], r[3];
+	for (uint c = 0; c < 3; ++c)
+	{
+		__m256 p1 = _mm256_loadu_ps(rows + c * BATCH);
+		__m256 p2 = _mm256_loadu_ps(rows + (6 + c) * BATCH);
+
+		d1[c] = _mm256_sub_ps(_mm256_loadu_ps(rows + (3 + c) * BATCH), p1);
+		d2[c] = _mm256_sub_ps(_mm256_loadu_ps(rows + (9 + c) * BATCH), p2);
+		r[c] = _mm256_sub_ps(p1, p2);
+	}
+
+	__m256 a = dot3(d1, d1);
+	__m256 b = dot3(d1, d2);
+	__m256 c = dot3(d1, r);
+	__m256 e = dot3(d2, d2);
+	__m256 f = dot3(d2, r);
+	__m256 epsilon = _mm256_set1_ps(1e-12f);
+
+	__m256 denominator = _mm256_fmsub_ps(a, e, _mm256_mul_ps(b, b));
+	__m256 valid = _mm256_cmp_ps(denominator, epsilon, _CMP_GT_OQ);
+	__m256 vs = _mm256_div_ps(_mm256_fmsub_ps(b, f, _mm256_mul_ps(c, e)), _mm256_max_ps(denominator, epsilon));
+	vs = _mm256_and_ps(valid, clamp01(vs));
+
+	__m256 vt = clamp01(_mm256_div_ps(_mm256_fmadd_ps(b, vs, f), _mm256_max_ps(e, epsilon)));
+	vs = clamp01(_mm256_div_ps(_mm256_fmsub_ps(b, vt, c), _mm256_max_ps(a, epsilon)));
+
+	__m256 sum = _mm256_setzero_ps();
+	for (uint k = 0; k < 3; ++k)
+	{
+		__m256 d = _mm256_fnmadd_ps(d2[k], vt, _mm256_fmadd_ps(d1[k], vs, r[k]));
+		sum = _mm256_fmadd_ps(d, d, sum);
+	}
+
+	_mm256_storeu_ps(distance2, sum);
+	_mm256_storeu_ps(s, vs);
+	_mm256_storeu_ps(t, vt);
+}
+
+TARGET_AVX2
+static uint overlapping_avx2(const float* rows, uint stride, uint count, const aabb& box, uint* out)
+{
+	__m256 min_y = _mm256_set1_ps(box.min.y);
+	__m256 max_y = _mm256_set1_ps(box.max.y);
+	__m256 min_z = _mm256_set1_ps(box.min.z);
+	__m256 max_z = _mm256_set1_ps(box.max.z);
+	uint n = 0;
+
+	// the padding holds empty bounds, which never overlap
+	for (uint i = 0; i < count; i += 8)
+	{
+		__m256 y = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(rows + stride + i), min_y, _CMP_GE_OQ),
+								 _mm256_cmp_ps(_mm256_loadu_ps(rows + i), max_y, _CMP_LE_OQ));
+		__m256 z = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(rows + 3 * stride + i), min_z, _CMP_GE_OQ),
+								 _mm256_cmp_ps(_mm256_loadu_ps(rows + 2 * stride + i), max_z, _CMP_LE_OQ));
+
+		uint bits = _mm256_movemask_ps(_mm256_and_ps(y, z));
+		while (bits)
+		{
+			out[n++] = i + __builtin_ctz(bits);
+			bits &= bits - 1;
+		}
+	}
+
+	return n;
+}
+
+static const bool use_avx2 = cpu_has_avx2();
+static const distance_kernel segment_batch = use_avx2 ? segment_distances_avx2 : segment_distances;
+static const overlap_kernel overlap_rows = use_avx2 ? overlapping_avx2 : overlapping;
+#else
+static const distance_kernel segment_batch = segment_distances;
+static const overlap_kernel overlap_rows = overlapping;
+#endif
+
+
+
+bone_collider::bone_collider() : unsorted(false), active_stride(0)
+{
+}
+
+void bone_collider::clear()
+{
+	starts.clear();
+	ends.clear();
+	radii.clear();
+	skeletons.clear();
+	indices.clear();
+	bounds.clear();
+	endpoints.clear();
+	active.clear();
+	slots.clear();
+	pairs.clear();
+	found.clear();
+	unsorted = false;
+	stats = collision_stats();
+}
+
+uint bone_collider::add_bone(uint skeleton, uint index, float radius)
+{
+	uint bone = starts.size();
+
+	starts.push_back(vec3(0, 0, 0));
+	ends.push_back(vec3(0, 0, 0));
+	radii.push_back(radius);
+	skeletons.push_back(skeleton);
+	indices.push_back(index);
+	bounds.push_back(aabb());
+	slots.push_back(0);
+
+	endpoint lo = { 0.0f, bone << 1 };
+	endpoint hi = { 0.0f, (bone << 1) | 1 };
+	endpoints.push_back(lo);
+	endpoints.push_back(hi);
+	unsorted = true;
+
+	return bone;
+}
+
+void bone_collider::set_bone(uint bone, const vec3& start, const vec3& end)
+{
+	starts[bone] = start;
+	ends[bone] = end;
+
+	aabb& box = bounds[bone];
+	box = aabb();
+	box.grow(start, radii[bone]);
+	box.grow(end, radii[bone]);
+}
+
+uint bone_collider::sort_endpoints()
+{
+	for (uint i = 0; i < endpoints.size(); ++i)
+	{
+		const aabb& box = bounds[endpoints[i].id >> 1];
+		endpoints[i].value = (endpoints[i].id & 1) ? box.max.x : box.min.x;
+	}
+
+	// new bones are anywhere, so the first sort after adding them starts from scratch
+	if (unsorted)
+	{
+		std::sort(endpoints.begin(), endpoints.end(), [](const endpoint& a, const endpoint& b) { return a.value < b.value; });
+		unsorted = false;
+		return 0;
+	}
+
+	// the order of the previous frame is nearly right, so each endpoint moves only a few places
+	uint swaps = 0;
+
+	for (uint i = 1; i < endpoints.size(); ++i)
+	{
+		endpoint e = endpoints[i];
+		uint j = i;
+
+		while (j > 0 && endpoints[j - 1].value > e.value)
+		{
+			endpoints[j] = endpoints[j - 1];
+			--j;
+		}
+
+		endpoints[j] = e;
+		swaps += i - j;
+	}
+
+	return swaps;
+}
+
+void bone_collider::sweep()
+{
+	pairs.clear();
+	active.clear();
+
+	// every slot after the active bones holds empty bounds, which is also how a sweep leaves them
+	uint stride = (starts.size() + 7) & ~7u;
+	if (active_stride != stride)
+	{
+		active_stride = stride;
+		active_bounds.resize(4 * stride);
+		hits.resize(stride);
+
+		std::fill(active_bounds.begin(), active_bounds.begin() + stride, FLT_MAX);
+		std::fill(active_bounds.begin() + stride, active_bounds.begin() + 2 * stride, -FLT_MAX);
+		std::fill(active_bounds.begin() + 2 * stride, active_bounds.begin() + 3 * stride, FLT_MAX);
+		std::fill(active_bounds.begin() + 3 * stride, active_bounds.end(), -FLT_MAX);
+	}
+
+	float* y0 = &active_bounds[0];
+	float* y1 = y0 + stride;
+	float* z0 = y0 + 2 * stride;
+	float* z1 = y0 + 3 * stride;
+
+	for (uint i = 0; i < endpoints.size(); ++i)
+	{
+		uint bone = endpoints[i].id >> 1;
+
+		if (endpoints[i].id & 1)
+		{
+			// leaves the sweep: the last active bone takes its slot, and the last slot becomes padding
+			uint slot = slots[bone];
+			uint last = active.size() - 1;
+
+			active[slot] = active[last];
+			slots[active[slot]] = slot;
+			y0[slot] = y0[last]; y1[slot] = y1[last];
+			z0[slot] = z0[last]; z1[slot] = z1[last];
+
+			y0[last] = FLT_MAX; y1[last] = -FLT_MAX;
+			z0[last] = FLT_MAX; z1[last] = -FLT_MAX;
+			active.pop_back();
+			continue;
+		}
+
+		const aabb& box = bounds[bone];
+		uint n = overlap_rows(y0, stride, active.size(), box, &hits[0]);
+
+		for (uint k = 0; k < n; ++k)
+		{
+			uint other = active[hits[k]];
+
+			// neighbours in a skeleton share a joint
+			if (skeletons[bone] == skeletons[other] && (indices[bone] + 1 == indices[other] || indices[other] + 1 == indices[bone]))
+				continue;
+
+			pairs.push_back(std::min(bone, other));
+			pairs.push_back(std::max(bone, other));
+		}
+
+		// enters the sweep
+		uint slot = active.size();
+		slots[bone] = slot;
+		active.push_back(bone);
+
+		y0[slot] = box.min.y; y1[slot] = box.max.y;
+		z0[slot] = box.min.z; z1[slot] = box.max.z;
+	}
+}
+
+void bone_collider::narrow()
+{
+	found.clear();
+	batch.resize(BATCH_ROWS * BATCH + 3 * BATCH);
+
+	float* rows = &batch[0];
+	float* distance2 = rows + BATCH_ROWS * BATCH;
+	float* s = distance2 + BATCH;
+	float* t = s + BATCH;
+
+	uint count = pairs.size() / 2;
+
+	for (uint first = 0; first < count; first += BATCH)
+	{
+		uint lanes = std::min(BATCH, count - first);
+
+		for (uint i = 0; i < BATCH; ++i)
+		{
+			// unused lanes repeat the first pair
+			uint a = pairs[(first + (i < lanes ? i : 0)) * 2];
+			uint b = pairs[(first + (i < lanes ? i : 0)) * 2 + 1];
+
+			const vec3* points[4] = { &starts[a], &ends[a], &starts[b], &ends[b] };
+			for (uint p = 0; p < 4; ++p)
+			{
+				rows[(p * 3 + 0) * BATCH + i] = points[p]->x;
+				rows[(p * 3 + 1) * BATCH + i] = points[p]->y;
+				rows[(p * 3 + 2) * BATCH + i] = points[p]->z;
+			}
+		}
+
+		segment_batch(rows, distance2, s, t);
+
+		for (uint i = 0; i < lanes; ++i)
+		{
+			uint a = pairs[(first + i) * 2];
+			uint b = pairs[(first + i) * 2 + 1];
+			float reach = radii[a] + radii[b];
+
+			if (distance2[i] < reach * reach)
+			{
+				float distance = sqrtf(distance2[i]);
+				bone_contact contact = { a, b, distance, reach - distance, s[i], t[i] };
+				found.push_back(contact);
+			}
+		}
+	}
+}
+
+const std::vector<bone_contact>& bone_collider::detect()
+{
+	stats.bones = starts.size();
+	stats.swaps = sort_endpoints();
+
+	sweep();
+	stats.candidates = pairs.size() / 2;
+
+	narrow();
+	stats.contacts = found.size();
+
+	return found;
+}
+
+void bone_collider::detect_exhaustive(std::vector<bone_contact>& out) const
+{
+	out.clear();
+
+	for (uint a = 0; a < starts.size(); ++a)
+	{
+		for (uint b = a + 1; b < starts.size(); ++b)
+		{
+			if (skeletons[a] == skeletons[b] && (indices[a] + 1 == indices[b] || indices[b] + 1 == indices[a]))
+				continue;
+
+			const float p1[3] = { starts[a].x, starts[a].y, starts[a].z };
+			const float q1[3] = { ends[a].x, ends[a].y, ends[a].z };
+			const float p2[3] = { starts[b].x, starts[b].y, starts[b].z };
+			const float q2[3] = { ends[b].x, ends[b].y, ends[b].z };
+
+			float s, t;
+			float distance2 = closest_points(p1, q1, p2, q2, s, t);
+			float reach = radii[a] + radii[b];
+
+			if (distance2 < reach * reach)
+			{
+				float distance = sqrtf(distance2);
+				bone_contact contact = { a, b, distance, reach - distance, s, t };
+				out.push_back(contact);
+			}
+		}
+	}
+}
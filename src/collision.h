@@ -0,0 +1,85 @@
+#pragma once
+
+#include "structures.h"
+
+// two bones closer than the sum of their radii
+struct bone_contact
+{
+	uint a;
+	uint b;
+	float distance;		// between the closest points of their segments
+	float depth;		// sum of the radii minus the distance
+	float s;			// closest points as parameters along the segments, 0 at the start and 1 at the end
+	float t;
+};
+
+struct collision_stats
+{
+	uint bones;
+	uint swaps;			// endpoint swaps of the incremental sort
+	uint candidates;	// pairs with overlapping bounds
+	uint contacts;
+
+	collision_stats() : bones(0), swaps(0), candidates(0), contacts(0) {}
+};
+
+/*
+ *	contacts between bones, as capsules around their segments (2D bones lie in the z = 0 plane)
+ *
+ *	the broad phase sweeps the bounds of the bones along x and prunes pairs whose bounds miss each other in y or
+ *	z. the endpoints stay sorted between frames and are re-sorted by insertion, which costs little while the bones
+ *	move little per frame. the narrow phase measures the distance between the segments of the candidates, 8
+ *	pairs at a time. bones of one skeleton that share a joint never collide.
+ */
+class bone_collider
+{
+private:
+	struct endpoint
+	{
+		float value;
+		uint id;	// bone << 1, plus 1 for the end of its bounds
+	};
+
+	std::vector<vec3> starts;
+	std::vector<vec3> ends;
+	std::vector<float> radii;
+	std::vector<uint> skeletons;
+	std::vector<uint> indices;		// of the bone within its skeleton
+	std::vector<aabb> bounds;
+
+	std::vector<endpoint> endpoints;	// sorted along x
+	bool unsorted;						// bones were added since the last sort
+	std::vector<uint> active;			// bones whose bounds the sweep is in
+	std::vector<float> active_bounds;	// rows y min, y max, z min, z max of the active bones, padded with empty bounds
+	uint active_stride;
+	std::vector<uint> slots;			// position of each bone in active
+	std::vector<uint> hits;				// active bones that overlap the bone entering the sweep
+
+	std::vector<uint> pairs;			// candidate pairs, two bones each
+	std::vector<float> batch;			// segments of up to 8 candidates, as rows of 8 values
+	std::vector<bone_contact> found;
+
+	collision_stats stats;
+
+private:
+	uint sort_endpoints();
+	void sweep();
+	void narrow();
+
+public:
+	bone_collider();
+
+	void clear();
+	uint add_bone(uint skeleton, uint index, float radius);
+	void set_bone(uint bone, const vec3& start, const vec3& end);
+
+	// contacts between all bones at their current segments
+	const std::vector<bone_contact>& detect();
+
+	const std::vector<bone_contact>& contacts() const { return found; }
+	const collision_stats& last_stats() const { return stats; }
+	uint num_bones() const { return starts.size(); }
+
+	// every pair of bones, for checking the sweep
+	void detect_exhaustive(std::vector<bone_contact>& out) const;
+};
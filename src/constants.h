@@ -7,13 +7,69 @@ typedef unsigned int uint;
 static const float PI = 3.1415926f;
 static const float ROTATION_ANGLE = 10.0f;
 static const uint CIRCLE_PRECISION = 100;
+static const float CURVE_TOLERANCE = 0.25f;	// pixels between a curved bone and its tessellation
+
+// 3D camera (see kine3d::init)
+static const float CAMERA_FOVY = 40.0f;			// vertical field of view in degrees
+static const float CAMERA_DISTANCE = 100.0f;	// distance of the eye to the origin along the z axis
+static const float CAMERA_NEAR = 1.0f;			// of the culling frustum only, the drawn projection keeps its near plane at 0
+static const float CAMERA_FAR = 200.0f;
+
+// level-of-detail scheduling
+static const uint LOD_FRAME_BUDGET = 2000;		// microseconds per frame available for skeleton updates
+static const uint LOD_MAX_DELAY = 30;			// frames past its interval after which a skeleton goes before larger ones
+static const float MATCH_SPEED = 8.0f;			// end-effector speed (units per frame) asked of the pose database
+
+// pose playback
+static const float SPLINE_KEY_INTERVAL = 0.25f;	// seconds between the keys of a played pose file
+static const float REPLAY_FRAME_TIME = 1.0f / 60.0f;	// seconds per frame of playback during a replay
+static const float CLIP_FADE_TIME = 0.5f;		// seconds of crossfade from the playing pose to a reloaded clip
+
+// ragdoll
+static const float RAGDOLL_TICK = 0.001f;			// seconds per solver tick
+static const uint RAGDOLL_ITERATIONS = 8;			// constraint projections per tick
+static const uint RAGDOLL_MAX_TICKS = 50;			// per frame, so one slow frame does not slow down the next
+static const float RAGDOLL_GRAVITY = 10.0f;			// bone lengths per second squared
+static const float RAGDOLL_BEND_LIMIT = 150.0f;		// degrees a joint may bend away from straight
+
+// scripting
+static const float SCRIPT_TICK = 1.0f / 60.0f;		// seconds per tick of the script scheduler
+
+// self-collision
+static const float BONE_RADIUS = 0.1f;				// radius of the capsule around a bone, relative to its length
+
+// point clouds
+static const uint CLOUD_CHUNK_BYTES = 32 << 20;		// of a cloud file, bound before the next is read
+static const uint CLOUD_DRAW_POINTS = 2048;			// per bone, drawn from every cloud evenly spread
+
+// picking
+static const float PICK_JOINT_RADIUS = 1.5f;		// of the sphere that selects a 3D joint
+static const float PICK_BONE_RADIUS = 0.75f;		// of the capsule that takes points inserted onto a 3D bone
+static const float PICK_PIXELS = 8.0f;				// the same, in pixels of the 2D view
+static const float PICK_REFIT_GROWTH = 2.0f;		// area of the root over that at its build, beyond which it is rebuilt
+
+// quantized poses
+static const uint ANGLE_STEPS = 100;				// per degree, so that turns of ROTATION_ANGLE stay exact
+static const uint ANGLE_TURN = 360 * ANGLE_STEPS;	// steps of a full turn, which fit in 16 bits
+
+// retargeting
+static const uint RETARGET_IK_ITERATIONS = 8;			// FABRIK iterations that pull a retargeted end effector onto its goal
+static const float RETARGET_MAX_ERROR = 0.01f;			// of the reach, beyond which FABRIK starts over from an unfolded chain
+
+// clip streaming
+static const uint STREAM_PAGE_FRAMES = 64;			// frames of a streamed clip that are read and cached together
+static const float STREAM_PREFETCH_SECONDS = 2.0f;	// read ahead of every player of a streamed clip
+static const uint STREAM_CACHE_BYTES = 4 << 20;		// of the pages of streamed clips, decoded and raw
+static const uint STREAM_QUEUE_DEPTH = 64;			// reads of pages in flight at once
+static const uint STREAM_THREADS = 2;				// reading pages where io_uring is not available
 
 // enums
 enum MenuOption
 {
 	MENU_KIN2D,
 	MENU_KIN3D,
-	MENU_ADD_PT
+	MENU_ADD_PT,
+	MENU_SPLIT
 };
 
 enum ColorType
@@ -22,7 +78,29 @@ enum ColorType
 	COLOR_WHITE,
 	COLOR_RED,
 	COLOR_GREEN,
-	COLOR_BLUE
+	COLOR_BLUE,
+	COLOR_MAGENTA,
+	NUM_COLORS
+};
+
+// what a view draws over what, as nothing is depth tested; the command buffer sorts its commands only within a layer
+enum DrawLayer
+{
+	LAYER_WORLD,		// world axes
+	LAYER_BONES,
+	LAYER_JOINTS,
+	LAYER_POINTS,		// attachments and samples of clouds
+	LAYER_AXES			// local axes of the joints
+};
+
+// primitive types of the render command buffer, in the order in which they are flushed within a layer
+enum PrimitiveType
+{
+	PRIMITIVE_TRIANGLES,
+	PRIMITIVE_SPHERE,
+	PRIMITIVE_LINES,
+	PRIMITIVE_QUADS,
+	PRIMITIVE_CONE
 };
 
 // functor
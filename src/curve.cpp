@@ -0,0 +1,124 @@
+#include "curve.h"
+
+vec2 bezier2::point(float u) const
+{
+	/*
+	 *	B(u) = (1-u)^3 P0 + 3(1-u)^2 u P1 + 3(1-u) u^2 P2 + u^3 P3
+	 */
+	float v = 1.0f - u;
+	float b0 = v * v * v;
+	float b1 = 3.0f * v * v * u;
+	float b2 = 3.0f * v * u * u;
+	float b3 = u * u * u;
+
+	return vec2(b0 * p[0].x + b1 * p[1].x + b2 * p[2].x + b3 * p[3].x,
+				b0 * p[0].y + b1 * p[1].y + b2 * p[2].y + b3 * p[3].y);
+}
+
+vec2 bezier2::tangent(float u) const
+{
+	/*
+	 *	B'(u) = 3(1-u)^2 (P1 - P0) + 6(1-u) u (P2 - P1) + 3u^2 (P3 - P2)
+	 */
+	float v = 1.0f - u;
+	float d0 = 3.0f * v * v;
+	float d1 = 6.0f * v * u;
+	float d2 = 3.0f * u * u;
+
+	return vec2(d0 * (p[1].x - p[0].x) + d1 * (p[2].x - p[1].x) + d2 * (p[3].x - p[2].x),
+				d0 * (p[1].y - p[0].y) + d1 * (p[2].y - p[1].y) + d2 * (p[3].y - p[2].y));
+}
+
+// distance of q to the line through a and b (or to a, when a and b coincide)
+static float line_distance(const vec2& a, const vec2& b, const vec2& q)
+{
+	vec2 d = b - a;
+	vec2 e = q - a;
+	float length = sqrtf(d.x * d.x + d.y * d.y);
+
+	if (length < 1e-6f)
+		return sqrtf(e.x * e.x + e.y * e.y);
+
+	return fabsf(d.x * e.y - d.y * e.x) / length;
+}
+
+float bezier2::flatness() const
+{
+	return std::max(line_distance(p[0], p[3], p[1]), line_distance(p[0], p[3], p[2]));
+}
+
+void bezier2::split(bezier2& left, bezier2& right) const
+{
+	// de Casteljau at u = 0.5
+	vec2 p01 = (p[0] + p[1]) * 0.5f;
+	vec2 p12 = (p[1] + p[2]) * 0.5f;
+	vec2 p23 = (p[2] + p[3]) * 0.5f;
+	vec2 p012 = (p01 + p12) * 0.5f;
+	vec2 p123 = (p12 + p23) * 0.5f;
+	vec2 mid = (p012 + p123) * 0.5f;
+
+	left.p[0] = p[0]; left.p[1] = p01; left.p[2] = p012; left.p[3] = mid;
+	right.p[0] = mid; right.p[1] = p123; right.p[2] = p23; right.p[3] = p[3];
+}
+
+// subdivides until a piece is flat enough, appending the end point of every flat piece
+static void subdivide(const bezier2& piece, float u0, float u1, float tolerance, uint depth,
+	std::vector<vec2>& points, std::vector<float>& params)
+{
+	if (depth == 0 || piece.flatness() <= tolerance)
+	{
+		points.push_back(piece.p[3]);
+		params.push_back(u1);
+		return;
+	}
+
+	bezier2 left, right;
+	piece.split(left, right);
+
+	float mid = (u0 + u1) * 0.5f;
+	subdivide(left, u0, mid, tolerance, depth - 1, points, params);
+	subdivide(right, mid, u1, tolerance, depth - 1, points, params);
+}
+
+void bezier2::tessellate(float tolerance, std::vector<vec2>& points, std::vector<float>& params, uint max_depth) const
+{
+	subdivide(*this, 0.0f, 1.0f, tolerance, max_depth, points, params);
+}
+
+float bezier2::closest(const std::vector<vec2>& points, const std::vector<float>& params, const vec2& q, float& distance) const
+{
+	float best_u = 0.0f;
+	float best = FLT_MAX;
+	vec2 a = p[0];
+	float ua = 0.0f;
+
+	distance = 0.0f;
+
+	for (uint i = 0; i < points.size(); ++i)
+	{
+		vec2 b = points[i];
+		vec2 d = b - a;
+		vec2 e = q - a;
+
+		float length2 = d.x * d.x + d.y * d.y;
+		float s = length2 > 0.0f ? std::min(std::max((e.x * d.x + e.y * d.y) / length2, 0.0f), 1.0f) : 0.0f;
+
+		vec2 on = a + d * s;
+		vec2 off = q - on;
+		float dist = sqrtf(off.x * off.x + off.y * off.y);
+
+		if (dist < best)
+		{
+			best = dist;
+			best_u = ua + (params[i] - ua) * s;
+
+			// left of the direction of travel is positive
+			distance = (d.x * off.y - d.y * off.x) >= 0.0f ? dist : -dist;
+		}
+
+		a = b;
+		ua = params[i];
+	}
+
+	return best_u;
+}
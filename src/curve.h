@@ -0,0 +1,29 @@
+#pragma once
+
+#include "structures.h"
+
+enum CurveMode
+{
+	CURVE_STRAIGHT,		// bones are lines between joints
+	CURVE_BEZIER,		// tangents follow the x axes of the joints at both ends
+	CURVE_CATMULL_ROM,	// tangents follow the neighbouring joints
+	NUM_CURVE_MODES
+};
+
+// cubic Bezier segment in the plane
+struct bezier2
+{
+	vec2 p[4];
+
+	vec2 point(float u) const;
+	vec2 tangent(float u) const;	// derivative at u, not normalized
+	float flatness() const;			// largest distance of the inner control points to the chord
+	void split(bezier2& left, bezier2& right) const;	// halves at u = 0.5
+
+	// appends the points after p[0] of a polyline that stays within tolerance of the curve, with their parameters;
+	// flat stretches get few points and tight bends many
+	void tessellate(float tolerance, std::vector<vec2>& points, std::vector<float>& params, uint max_depth = 8) const;
+
+	// curve parameter of the polyline point closest to p, with the signed distance to it (positive to the left)
+	float closest(const std::vector<vec2>& points, const std::vector<float>& params, const vec2& p, float& distance) const;
+};
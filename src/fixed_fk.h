@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cmath>
+#include "structures.h"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// rest translation T[n] of a joint that is known at build time
+template <float X, float Y, float Z = 0.0f>
+struct fixed_joint
+{
+	static constexpr float x = X;
+	static constexpr float y = Y;
+	static constexpr float z = Z;
+};
+
+template <typename Joint>
+bool matches_joint(kinecontext& context, uint n)
+{
+	vec3 t = context.joint_offset(n);
+	return t.x == Joint::x && t.y == Joint::y && t.z == Joint::z;
+}
+
+/*
+ *	forward kinematics of a chain whose joints are known at build time, from the root to the end effector
+ *
+ *	every joint is a step of its own, inlined into the next, so the chain is evaluated without a loop, without
+ *	branches and without reading the translations: terms of a translation that are 0 drop out while compiling, so
+ *	a bone along the x axis costs a multiply-add per coordinate. a chain gives the same positions as the contexts
+ *	do with the same joints, and matches() tells whether a context still has them, since rig files can change them.
+ */
+template <typename Root, typename... Joints>
+struct fixed_chain2
+{
+	static constexpr uint joints = 1 + sizeof...(Joints);
+
+	/*
+	 *	rotations in the plane add up, so with s the sum of the angles before joint n
+	 *
+	 *	P[n] = P[n-1] + R(s) T[n]
+	 */
+	template <typename T, typename... Rest>
+	static ALWAYS_INLINE void step(float x, float y, float s, const float* angles, vec3* positions)
+	{
+		float radians = s * (PI / 180.0f);
+		float c = cosf(radians), sn = sinf(radians);
+
+		if constexpr (T::x != 0.0f) { x += c * T::x; y += sn * T::x; }
+		if constexpr (T::y != 0.0f) { x -= sn * T::y; y += c * T::y; }
+
+		*positions = vec3(x, y, 0.0f);
+
+		if constexpr (sizeof...(Rest) > 0)
+			step<Rest...>(x, y, s + *angles, angles + 1, positions + 1);
+	}
+
+	// as kinecontext::joint_positions, with an angle per joint
+	static void joint_positions(const float* angles, vec3* positions)
+	{
+		positions[0] = vec3(Root::x, Root::y, 0.0f);
+
+		if constexpr (sizeof...(Joints) > 0)
+			step<Joints...>(Root::x, Root::y, angles[0], angles + 1, positions + 1);
+	}
+
+	static vec3 end_effector(const float* angles)
+	{
+		vec3 positions[joints];
+		joint_positions(angles, positions);
+		return positions[joints - 1];
+	}
+
+	static bool matches(kinecontext& context)
+	{
+		uint n = 0;
+		return context.num_joints() == joints && matches_joint<Root>(context, n++) && (matches_joint<Joints>(context, n++) && ...);
+	}
+};
+
+template <typename Root, typename... Joints>
+struct fixed_chain3
+{
+	static constexpr uint joints = 1 + sizeof...(Joints);
+
+	// Rx Ry Rz of the angles of a joint (see kine3d::joint_positions_quantized), row-major
+	static ALWAYS_INLINE void rotation(const float* angles, float* R)
+	{
+		float x = angles[0] * (PI / 180.0f), y = angles[1] * (PI / 180.0f), z = angles[2] * (PI / 180.0f);
+		float sx = sinf(x), cx = cosf(x);
+		float sy = sinf(y), cy = cosf(y);
+		float sz = sinf(z), cz = cosf(z);
+
+		R[0] = cy * cz;					R[1] = -cy * sz;				R[2] = sy;
+		R[3] = cx * sz + sx * sy * cz;	R[4] = cx * cz - sx * sy * sz;	R[5] = -sx * cy;
+		R[6] = sx * sz - cx * sy * cz;	R[7] = sx * cz + cx * sy * sz;	R[8] = cx * cy;
+	}
+
+	/*
+	 *	P[n] = P[n-1] + S[n-1] T[n],	S[n] = S[n-1] R[n]
+	 *
+	 *	the columns of S[n-1] that T[n] does not reach are never read
+	 */
+	template <typename T, typename... Rest>
+	static ALWAYS_INLINE void step(vec3 P, const float* S, const float* angles, vec3* positions)
+	{
+		if constexpr (T::x != 0.0f) { P.x += S[0] * T::x; P.y += S[3] * T::x; P.z += S[6] * T::x; }
+		if constexpr (T::y != 0.0f) { P.x += S[1] * T::y; P.y += S[4] * T::y; P.z += S[7] * T::y; }
+		if constexpr (T::z != 0.0f) { P.x += S[2] * T::z; P.y += S[5] * T::z; P.z += S[8] * T::z; }
+
+		*positions = P;
+
+		// the end effector turns nothing that follows it
+		if constexpr (sizeof...(Rest) > 0)
+		{
+			float R[9], next[9];
+			rotation(angles, R);
+
+			next[0] = S[0] * R[0] + S[1] * R[3] + S[2] * R[6];
+			next[1] = S[0] * R[1] + S[1] * R[4] + S[2] * R[7];
+			next[2] = S[0] * R[2] + S[1] * R[5] + S[2] * R[8];
+			next[3] = S[3] * R[0] + S[4] * R[3] + S[5] * R[6];
+			next[4] = S[3] * R[1] + S[4] * R[4] + S[5] * R[7];
+			next[5] = S[3] * R[2] + S[4] * R[5] + S[5] * R[8];
+			next[6] = S[6] * R[0] + S[7] * R[3] + S[8] * R[6];
+			next[7] = S[6] * R[1] + S[7] * R[4] + S[8] * R[7];
+			next[8] = S[6] * R[2] + S[7] * R[5] + S[8] * R[8];
+
+			step<Rest...>(P, next, angles + 3, positions + 1);
+		}
+	}
+
+	// as kinecontext::joint_positions, with three angles per joint
+	static void joint_positions(const float* angles, vec3* positions)
+	{
+		positions[0] = vec3(Root::x, Root::y, Root::z);
+
+		// S[0] is the rotation of the root alone
+		if constexpr (sizeof...(Joints) > 0)
+		{
+			float S[9];
+			rotation(angles, S);
+			step<Joints...>(positions[0], S, angles + 3, positions + 1);
+		}
+	}
+
+	static vec3 end_effector(const float* angles)
+	{
+		vec3 positions[joints];
+		joint_positions(angles, positions);
+		return positions[joints - 1];
+	}
+
+	static bool matches(kinecontext& context)
+	{
+		uint n = 0;
+		return context.num_joints() == joints && matches_joint<Root>(context, n++) && (matches_joint<Joints>(context, n++) && ...);
+	}
+};
+
+// the chains that kine2d::create_joints and kine3d::create_joints build
+typedef fixed_chain2<fixed_joint<150.0f, 150.0f>, fixed_joint<100.0f, 0.0f>, fixed_joint<100.0f, 0.0f>, fixed_joint<100.0f, 0.0f> > builtin_chain2;
+typedef fixed_chain3<fixed_joint<10.0f, 10.0f, 10.0f>, fixed_joint<20.0f, 0.0f, 0.0f>, fixed_joint<20.0f, 0.0f, 0.0f>, fixed_joint<20.0f, 0.0f, 0.0f> > builtin_chain3;
+
+// either kind of chain, where a context can take it in place of its own loop
+struct fixed_fk
+{
+	void (*joint_positions)(const float* angles, vec3* positions);
+	vec3 (*end_effector)(const float* angles);
+
+	fixed_fk() : joint_positions(nullptr), end_effector(nullptr) {}
+
+	template <typename Chain>
+	static fixed_fk of() { fixed_fk fk; fk.joint_positions = Chain::joint_positions; fk.end_effector = Chain::end_effector; return fk; }
+};
@@ -0,0 +1,76 @@
+#include "frustum.h"
+#include "render.h"
+
+frustum::frustum()
+{
+	// accept everything until the first extraction
+	for (uint i = 0; i < 6; ++i)
+	{
+		planes[i][0] = planes[i][1] = planes[i][2] = 0.0f;
+		planes[i][3] = 1.0f;
+	}
+}
+
+void frustum::extract(const float* p, const float* m)
+{
+	/*
+	 *	Gribb & Hartmann: the planes are sums and differences of the rows of the clip matrix C = P * M
+	 *
+	 *		left	= row4 + row1		right	= row4 - row1
+	 *		bottom	= row4 + row2		top		= row4 - row2
+	 *		near	= row4 + row3		far		= row4 - row3
+	 *
+	 *	both matrices are column-major: element (row r, column c) is stored at [c * 4 + r]
+	 */
+
+	float c[16];
+	multiply_matrix(c, p, m);
+
+	for (uint i = 0; i < 6; ++i)
+	{
+		uint row = i / 2;
+		float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+
+		for (uint col = 0; col < 4; ++col)
+			planes[i][col] = c[col * 4 + 3] + sign * c[col * 4 + row];
+
+		// normalize, so that sphere tests can compare against the radius
+		float len = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+		if (len > 0.0f)
+			for (uint col = 0; col < 4; ++col)
+				planes[i][col] /= len;
+	}
+}
+
+bool frustum::contains(const vec3& center, float radius) const
+{
+	for (uint i = 0; i < 6; ++i)
+	{
+		const float* pl = planes[i];
+		if (pl[0] * center.x + pl[1] * center.y + pl[2] * center.z + pl[3] < -radius)
+			return false;
+	}
+
+	return true;
+}
+
+bool frustum::contains(const aabb& box) const
+{
+	if (box.empty())
+		return false;
+
+	for (uint i = 0; i < 6; ++i)
+	{
+		const float* pl = planes[i];
+
+		// corner of the box that lies furthest along the plane normal
+		float x = pl[0] >= 0.0f ? box.max.x : box.min.x;
+		float y = pl[1] >= 0.0f ? box.max.y : box.min.y;
+		float z = pl[2] >= 0.0f ? box.max.z : box.min.z;
+
+		if (pl[0] * x + pl[1] * y + pl[2] * z + pl[3] < 0.0f)
+			return false;
+	}
+
+	return true;
+}
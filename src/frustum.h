@@ -0,0 +1,28 @@
+#pragma once
+
+#include "structures.h"
+
+// primitive counters of the last drawn frame
+struct cull_stats
+{
+	uint drawn;				// joint spheres, bone lines, axis lines and attachments that were submitted
+	uint culled;			// primitives that were rejected by the frustum
+	uint skeletons_culled;	// skeletons that were neither evaluated nor drawn
+
+	cull_stats() : drawn(0), culled(0), skeletons_culled(0) {}
+};
+
+// view frustum in world space, extracted from the OpenGL projection and modelview matrices
+class frustum
+{
+private:
+	float planes[6][4]; // a*x + b*y + c*z + d >= 0 for points inside
+
+public:
+	frustum();
+
+	void extract(const float* projection, const float* modelview);
+
+	bool contains(const vec3& center, float radius) const;
+	bool contains(const aabb& box) const;
+};
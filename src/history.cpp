@@ -0,0 +1,338 @@
+#include "history.h"
+#include <cstring>
+
+pose_history::pose_history() : current(0), joints(0), dof(0), levels(0), taking(nullptr), building(nullptr)
+{
+}
+
+uint pose_history::joints_below(uint level) const
+{
+	uint n = FANOUT;
+	for (uint l = 0; l < level; ++l)
+		n *= FANOUT;
+	return n;
+}
+
+pose_history::attachment_list pose_history::read_attachments(editable_pose& pose, uint joint)
+{
+	uint count = pose.num_attachments(joint);
+	if (count == 0)
+		return attachment_list();
+
+	points.resize(std::max((uint)points.size(), count));
+	pose.get_attachments(joint, &points[0]);
+
+	building->bytes += sizeof(std::vector<vec3>) + count * sizeof(vec3);
+	return std::make_shared<const std::vector<vec3> >(points.begin(), points.begin() + count);
+}
+
+bool pose_history::same_attachments(editable_pose& pose, uint joint, const attachment_list& list)
+{
+	uint count = pose.num_attachments(joint);
+	if (!list)
+		return count == 0;
+	if (list->size() != count)
+		return false;
+
+	points.resize(std::max((uint)points.size(), count));
+	pose.get_attachments(joint, &points[0]);
+
+	for (uint i = 0; i < count; ++i)
+	{
+		const vec3& a = (*list)[i];
+		if (a.x != points[i].x || a.y != points[i].y || a.z != points[i].z)
+			return false;
+	}
+
+	return true;
+}
+
+pose_history::subtree pose_history::build(editable_pose& pose, uint level, uint first)
+{
+	if (level == 0)
+	{
+		std::shared_ptr<block> b = std::make_shared<block>();
+		memset(b->angles, 0, sizeof(b->angles));
+
+		for (uint i = 0; i < FANOUT && first + i < joints; ++i)
+		{
+			memcpy(b->angles + i * 3, &angles[(first + i) * dof], dof * sizeof(float));
+			b->attachments[i] = read_attachments(pose, first + i);
+		}
+
+		building->blocks++;
+		building->bytes += sizeof(block);
+		return b;
+	}
+
+	std::shared_ptr<node> n = std::make_shared<node>();
+	uint span = joints_below(level - 1);
+
+	for (uint i = 0; i < FANOUT && first + i * span < joints; ++i)
+		n->children[i] = build(pose, level - 1, first + i * span);
+
+	building->nodes++;
+	building->bytes += sizeof(node);
+	return n;
+}
+
+pose_history::subtree pose_history::update(editable_pose& pose, const subtree& old, uint level, uint first, uint from, uint to)
+{
+	// marked[from, to) are the edited joints below this subtree; without any, it stays shared
+	if (from == to && !taking->all_angles)
+		return old;
+
+	if (level == 0)
+	{
+		const block* b = (const block*)old.get();
+		std::shared_ptr<block> copy;
+
+		// every joint of the block once every angle was set, otherwise the edited ones
+		uint visits = taking->all_angles ? std::min(FANOUT, joints - first) : to - from;
+
+		for (uint k = 0; k < visits; ++k)
+		{
+			uint i = taking->all_angles ? k : marked[from + k] - first;
+			uint8_t kind = first + i < taking->kinds.size() ? taking->kinds[first + i] : 0;
+
+			const float* now = &angles[(first + i) * dof];
+			bool moved = (taking->all_angles || (kind & edit_marks::ANGLES)) && memcmp(b->angles + i * 3, now, dof * sizeof(float)) != 0;
+			bool attached = (kind & edit_marks::ATTACHMENTS) && !same_attachments(pose, first + i, b->attachments[i]);
+
+			if (!moved && !attached)
+				continue;
+
+			// the first change copies the block, unchanged attachment lists stay shared
+			if (!copy)
+			{
+				copy = std::make_shared<block>(*b);
+				building->blocks++;
+				building->bytes += sizeof(block);
+			}
+
+			memcpy(copy->angles + i * 3, now, dof * sizeof(float));
+
+			if (attached)
+				copy->attachments[i] = read_attachments(pose, first + i);
+		}
+
+		return copy ? subtree(copy) : old;
+	}
+
+	const node* n = (const node*)old.get();
+	std::shared_ptr<node> copy;
+	uint span = joints_below(level - 1);
+
+	for (uint i = 0; i < FANOUT && first + i * span < joints; ++i)
+	{
+		// the edited joints of this child follow those of the children before it
+		uint end = from;
+		while (end < to && marked[end] < first + (i + 1) * span)
+			++end;
+
+		subtree child = update(pose, n->children[i], level - 1, first + i * span, from, end);
+		from = end;
+
+		if (child == n->children[i])
+			continue;
+
+		if (!copy)
+		{
+			copy = std::make_shared<node>(*n);
+			building->nodes++;
+			building->bytes += sizeof(node);
+		}
+
+		copy->children[i] = child;
+	}
+
+	return copy ? subtree(copy) : old;
+}
+
+void pose_history::apply(editable_pose& pose, const subtree& from, const subtree& to, uint level, uint first)
+{
+	// shared subtrees are the same in both versions
+	if (from == to)
+		return;
+
+	if (level == 0)
+	{
+		const block* a = (const block*)from.get();
+		const block* b = (const block*)to.get();
+
+		for (uint i = 0; i < FANOUT && first + i < joints; ++i)
+		{
+			memcpy(&angles[(first + i) * dof], b->angles + i * 3, dof * sizeof(float));
+
+			if (a->attachments[i] != b->attachments[i])
+			{
+				const attachment_list& list = b->attachments[i];
+				pose.set_attachments(first + i, list ? &(*list)[0] : nullptr, list ? list->size() : 0);
+			}
+		}
+
+		return;
+	}
+
+	const node* a = (const node*)from.get();
+	const node* b = (const node*)to.get();
+	uint span = joints_below(level - 1);
+
+	for (uint i = 0; i < FANOUT && first + i * span < joints; ++i)
+		apply(pose, a->children[i], b->children[i], level - 1, first + i * span);
+}
+
+void pose_history::reset(editable_pose& pose)
+{
+	joints = pose.num_joints();
+	dof = joints ? pose.degrees_of_freedom() : 1;
+
+	levels = 0;
+	while (joints_below(levels) < joints)
+		levels++;
+
+	angles.resize(joints * dof);
+	if (joints)
+		pose.get_angles(&angles[0]);
+
+	version v = { subtree(), -1, -1, 0, 0, 0 };
+	building = &v;
+	v.root = build(pose, levels, 0);
+	building = nullptr;
+	pose.edits().clear();
+
+	versions.clear();
+	versions.push_back(v);
+	current = 0;
+}
+
+uint pose_history::commit(editable_pose& pose)
+{
+	if (versions.empty() || pose.num_joints() != joints)
+	{
+		reset(pose);
+		return current;
+	}
+
+	if (joints)
+		pose.get_angles(&angles[0]);
+
+	edit_marks& edits = pose.edits();
+	marked.clear();
+	for (uint i = 0; i < edits.joints.size(); ++i)
+	{
+		if (edits.joints[i] < joints)
+			marked.push_back(edits.joints[i]);
+	}
+	std::sort(marked.begin(), marked.end());
+
+	version v = { subtree(), (int)current, -1, 0, 0, 0 };
+	building = &v;
+	taking = &edits;
+	v.root = update(pose, versions[current].root, levels, 0, 0, marked.size());
+	taking = nullptr;
+	building = nullptr;
+	edits.clear();
+
+	if (v.root == versions[current].root)
+		return current;
+
+	versions[current].redo = versions.size();
+	versions.push_back(v);
+	current = versions.size() - 1;
+
+	return current;
+}
+
+void pose_history::go_to(editable_pose& pose, uint target)
+{
+	if (target == current)
+		return;
+
+	// the angles of the current version are still at hand from its commit or from applying it, so only those of
+	// differing subtrees are replaced before the whole pose is set
+	apply(pose, versions[current].root, versions[target].root, levels, 0);
+
+	if (joints)
+		pose.set_angles(&angles[0]);
+
+	// the pose is the version now, so what it marked while applying is no edit
+	pose.edits().clear();
+
+	if (versions[target].parent >= 0)
+		versions[versions[target].parent].redo = target;
+
+	current = target;
+}
+
+bool pose_history::undo(editable_pose& pose)
+{
+	if (versions[current].parent < 0)
+		return false;
+
+	go_to(pose, versions[current].parent);
+	return true;
+}
+
+bool pose_history::redo(editable_pose& pose)
+{
+	if (versions[current].redo < 0)
+		return false;
+
+	go_to(pose, versions[current].redo);
+	return true;
+}
+
+bool pose_history::next_branch(editable_pose& pose)
+{
+	int parent = versions[current].parent;
+	if (parent < 0)
+		return false;
+
+	// siblings in the order they were committed, wrapping around
+	for (uint k = 1; k < versions.size(); ++k)
+	{
+		uint i = (current + k) % versions.size();
+
+		if (versions[i].parent == parent)
+		{
+			go_to(pose, i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool pose_history::checkout(editable_pose& pose, uint target)
+{
+	if (target >= versions.size())
+		return false;
+
+	go_to(pose, target);
+	return true;
+}
+
+void pose_history::print_stats() const
+{
+	if (versions.empty())
+		return;
+
+	uint branches = 0;
+	size_t bytes = 0;
+
+	for (uint i = 0; i < versions.size(); ++i)
+	{
+		bytes += versions[i].bytes;
+
+		// a version with more than one child forks
+		if (i > 0 && versions[versions[i].parent].redo != (int)i)
+			branches++;
+	}
+
+	const version& v = versions[current];
+
+	std::cout << "pose history: version " << current << " of " << versions.size() << ", " << branches << " alternative(s), "
+		<< bytes << " bytes in all (the first version takes " << versions[0].bytes << ")" << std::endl;
+	std::cout << "  current version copied " << v.blocks << " block(s) and " << v.nodes << " node(s), " << v.bytes << " bytes" << std::endl;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include "structures.h"
+
+/*
+ *	versions of the pose of a context, for undo, redo and alternative edits
+ *
+ *	a version is a tree of blocks of FANOUT joints (their angles, and a list of the attachments of each
+ *	bone) under nodes of FANOUT children. versions never change: a commit copies only the blocks whose
+ *	joints changed and the nodes on their way to the root, and shares everything else with the version it
+ *	follows. a commit visits only the subtrees of the joints that the pose marked as edited (see edit_marks), and
+ *	applying a version visits only the subtrees that differ from the applied one.
+ *
+ *	versions form a tree too. editing after an undo starts an alternative next to the undone version, and both
+ *	stay reachable through redo() and next_branch().
+ */
+class pose_history
+{
+public:
+	static const uint FANOUT = 16;
+
+private:
+	typedef std::shared_ptr<const std::vector<vec3> > attachment_list;
+	typedef std::shared_ptr<const void> subtree;
+
+	struct block
+	{
+		float angles[FANOUT * 3];
+		attachment_list attachments[FANOUT];
+	};
+
+	struct node
+	{
+		subtree children[FANOUT];	// nodes, or blocks on the level above the blocks
+	};
+
+	struct version
+	{
+		subtree root;
+		int parent;
+		int redo;				// child that redo() goes to, the last one committed or visited
+		uint blocks;			// created by its commit
+		uint nodes;
+		size_t bytes;
+	};
+
+	std::vector<version> versions;
+	uint current;
+	uint joints;
+	uint dof;
+	uint levels;				// of nodes above the blocks
+
+	std::vector<float> angles;	// of the current version
+	std::vector<vec3> points;	// attachments of a joint while committing
+	std::vector<uint> marked;	// edited joints in order, while committing
+	const edit_marks* taking;	// while committing
+	version* building;			// while committing
+
+private:
+	subtree build(editable_pose& pose, uint level, uint first);
+	subtree update(editable_pose& pose, const subtree& old, uint level, uint first, uint from, uint to);
+	void apply(editable_pose& pose, const subtree& from, const subtree& to, uint level, uint first);
+	bool same_attachments(editable_pose& pose, uint joint, const attachment_list& list);
+	attachment_list read_attachments(editable_pose& pose, uint joint);
+	uint joints_below(uint level) const;
+	void go_to(editable_pose& pose, uint target);
+
+public:
+	pose_history();
+
+	// starts over with the current pose as the only version
+	void reset(editable_pose& pose);
+
+	// adds the pose as a version after the current one, unless its edited joints did not change; returns the
+	// current version
+	uint commit(editable_pose& pose);
+
+	// edits that were not committed are overwritten
+	bool undo(editable_pose& pose);
+	bool redo(editable_pose& pose);
+	bool next_branch(editable_pose& pose);		// the next alternative to the current version
+	bool checkout(editable_pose& pose, uint target);
+
+	uint size() const { return versions.size(); }
+	uint current_version() const { return current; }
+	bool ready() const { return !versions.empty(); }
+	size_t version_bytes(uint v) const { return versions[v].bytes; }	// copied by its commit, the whole pose for the first
+
+	void print_stats() const;
+};
@@ -0,0 +1,53 @@
+#include "input.h"
+#include <sstream>
+
+bool input_log::open(const std::string& path)
+{
+	out.open(path.c_str());
+	return out.good();
+}
+
+void input_log::record(uint tick, InputType type, int a0, int a1, int a2, int a3)
+{
+	if (!out.is_open())
+		return;
+
+	// flushed right away, so that a recording survives exiting with escape
+	out << tick << " " << (int)type << " " << a0 << " " << a1 << " " << a2 << " " << a3 << std::endl;
+}
+
+bool input_log::load(const std::string& path)
+{
+	std::ifstream in(path.c_str());
+	if (!in) return false;
+
+	events.clear();
+	cursor = 0;
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		input_event e;
+		int type;
+
+		if (!(fields >> e.tick >> type >> e.args[0] >> e.args[1] >> e.args[2] >> e.args[3]))
+			continue;
+
+		e.type = (InputType)type;
+		events.push_back(e);
+	}
+
+	// replaying relies on the events being in tick order
+	std::stable_sort(events.begin(), events.end(), [](const input_event& a, const input_event& b) { return a.tick < b.tick; });
+	return true;
+}
+
+bool input_log::next(uint tick, input_event& event)
+{
+	if (cursor >= events.size() || events[cursor].tick > tick)
+		return false;
+
+	event = events[cursor++];
+	return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <fstream>
+#include "structures.h"
+
+// input callbacks of main.cpp (named after the functions that handle them)
+enum InputType
+{
+	INPUT_SPECIAL,		// character keys: key, x, y
+	INPUT_KEYBOARD,		// arrow keys: key, x, y
+	INPUT_MOUSE,		// button, state, x, y
+	INPUT_MOTION,		// x, y
+	INPUT_PASSIVE,		// x, y
+	INPUT_MENU,			// option
+	INPUT_RESHAPE		// width, height
+};
+
+struct input_event
+{
+	uint tick;			// frame in which the event arrived
+	InputType type;
+	int args[4];
+};
+
+// text file of input events, one per line: "tick type arg0 arg1 arg2 arg3"
+class input_log
+{
+private:
+	std::ofstream out;
+	std::vector<input_event> events;
+	uint cursor;		// next event to replay
+
+public:
+	input_log() : cursor(0) {}
+
+	bool open(const std::string& path);
+	void record(uint tick, InputType type, int a0 = 0, int a1 = 0, int a2 = 0, int a3 = 0);
+
+	bool load(const std::string& path);
+	bool next(uint tick, input_event& event);	// events of the given tick, in recorded order
+	bool done() const { return cursor >= events.size(); }
+	uint size() const { return events.size(); }
+};
@@ -1,10 +1,16 @@
 #include "kine2d.h"
+#include "quantize.h"
 #include <cmath>
 
 kine2d::kine2d()
 {
 	active_joint = nullptr;
+	curve_mode = CURVE_STRAIGHT;
+	pixel_scale = 1.0f;
+	curves_tessellated = 0;
+	fixed_allowed = true;
 	create_joints(150, 150, 100);
+	identity_matrix(projection);
 }
 
 kine2d::~kine2d()
@@ -44,6 +50,24 @@ void kine2d::create_joints(float start_x, float start_y, float dist)
 	joints.push_back(p3);
 
 	active_joint = joints[0];
+	match_fixed();
+}
+
+void kine2d::match_fixed()
+{
+	// rig files may change the joints into any chain, which then takes the loop
+	fixed = (fixed_allowed && builtin_chain2::matches(*this)) ? fixed_fk::of<builtin_chain2>() : fixed_fk();
+}
+
+uint kine2d::index_of(const joint2* joint) const
+{
+	return std::find(joints.begin(), joints.end(), joint) - joints.begin();
+}
+
+void kine2d::allow_fixed_fk(bool allowed)
+{
+	fixed_allowed = allowed;
+	match_fixed();
 }
 
 matrix kine2d::rotation_matrix(float angle)
@@ -91,102 +115,224 @@ vec2 kine2d::convert_to_world(vec2* Pn_1, matrix& Sn_1, vec2* Tn, matrix& Rn, ve
 	return g;
 }
 
-void kine2d::draw_world_axis()
+void kine2d::draw_world_axis(command_buffer& buffer)
 {
-	glLineWidth(3.0f);
-
 	// x-axis (red)
-	glColor3f(1,0,0);
-	glBegin(GL_LINES);
-		glVertex2f(0.0f, 0.0f);
-		glVertex2f(500.0f, 0.0f);
-	glEnd();
-	glBegin(GL_QUADS); // arrow
-		glVertex2f(495.0f, 5.0f);
-		glVertex2f(505.0f, 0.0f);
-		glVertex2f(505.0f, 0.0f);
-		glVertex2f(495.0f, -5.0f);
-	glEnd();
+	buffer.line(vec3(0.0f, 0.0f, 0.0f), vec3(500.0f, 0.0f, 0.0f), 3.0f, COLOR_RED);
+	buffer.quad(vec3(495.0f, 5.0f, 0.0f), vec3(505.0f, 0.0f, 0.0f), vec3(505.0f, 0.0f, 0.0f), vec3(495.0f, -5.0f, 0.0f), COLOR_RED); // arrow
 
 	// y-axis (blue)
-	glColor3f(0,0,1);
-	glBegin(GL_LINES);
-		glVertex2f(0.0f, 0.0f);
-		glVertex2f(0.0f, 500.0f);
-	glEnd();
-	glBegin(GL_QUADS); // arrow
-		glVertex2f(0.0f, 505.0f);
-		glVertex2f(0.0f, 505.0f);
-		glVertex2f(5.0f, 495.0f);
-		glVertex2f(-5.0f, 495.0f);
-	glEnd();
+	buffer.line(vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 500.0f, 0.0f), 3.0f, COLOR_BLUE);
+	buffer.quad(vec3(0.0f, 505.0f, 0.0f), vec3(0.0f, 505.0f, 0.0f), vec3(5.0f, 495.0f, 0.0f), vec3(-5.0f, 495.0f, 0.0f), COLOR_BLUE); // arrow
 }
 
 // visualize joints with small circles
-void kine2d::draw_vertex(vec2* v, uint radius, bool highlight)
+void kine2d::draw_vertex(command_buffer& buffer, vec2* v, uint radius, bool highlight)
+{
+	buffer.disc(vec3(v->x, v->y, 0.0f), (float)radius, highlight ? COLOR_MAGENTA : COLOR_BLACK);
+}
+
+void kine2d::draw_line(command_buffer& buffer, vec2* start, vec2* end, float thickness, ColorType color)
+{
+	buffer.line(vec3(start->x, start->y, 0.0f), vec3(end->x, end->y, 0.0f), thickness, color);
+}
+
+void kine2d::resize(int w, int h)
+{
+	ortho_matrix(projection, -20.0f, (float)w, -20.0f, (float)h); // as gluOrtho2D(-20, w, -20, h)
+
+	// the tolerance of curved bones is in pixels, so they are tessellated again for another window size
+	float scale = w / (w + 20.0f);
+	if (scale != pixel_scale)
+	{
+		pixel_scale = scale;
+		for (uint n = 0; n < curves.size(); ++n)
+			curves[n].valid = false;
+	}
+}
+
+void kine2d::update_curves()
 {
-	if (highlight)
-		glColor3f(1,0,1);
-	else
-		glColor3f(0,0,0);
+	curves.resize(joints.size());
+	curves_tessellated = 0;
 
-	glBegin(GL_POLYGON);
+	for (uint n = 0; n + 1 < joints.size(); ++n)
 	{
-		for (uint i = 0; i < CIRCLE_PRECISION; i++)
+		joint2* joint = joints[n];
+		joint2* child = joints[n + 1];
+		bone_curve& curve = curves[n];
+
+		// in the frame of the joint its bone only changes with the angle of the child (and with its own angle,
+		// for catmull-rom, as the tangent at the joint points away from the parent)
+		if (curve.valid && !child->dirty && !(curve_mode == CURVE_CATMULL_ROM && joint->dirty))
+			continue;
+
+		vec2 end = *child->t;
+		matrix Rc = rotation_matrix(child->theta);
+
+		bezier2& b = curve.shape;
+		b.p[0] = vec2(0,0);
+		b.p[3] = end;
+
+		if (curve_mode == CURVE_BEZIER)
+		{
+			// leave along the x axis of the joint and arrive along the x axis of the child
+			float third = sqrtf(end.x * end.x + end.y * end.y) / 3.0f;
+			vec2 arrive = (Rc * vec2(1,0)).to_vec2();
+
+			b.p[1] = vec2(third, 0.0f);
+			b.p[2] = end - arrive * third;
+		}
+		else
 		{
-			float angle = i*2*PI/CIRCLE_PRECISION;
-			glVertex2f(cos(angle)*radius + v->x, sin(angle)*radius + v->y);
+			/*
+			 *	catmull-rom through P[n-1], P[n], P[n+1], P[n+2], as a Bezier segment:
+			 *	B1 = P[n] + (P[n+1] - P[n-1]) / 6,  B2 = P[n+1] - (P[n+2] - P[n]) / 6
+			 *
+			 *	the neighbours of the ends of the chain are mirrored
+			 */
+			vec2 prev = end * -1.0f;
+			vec2 next = end * 2.0f;
+
+			if (n > 0)
+			{
+				matrix Rj = rotation_matrix(-joint->theta);
+				prev = (Rj * *joint->t).to_vec2() * -1.0f;
+			}
+
+			if (n + 2 < joints.size())
+				next = end + (Rc * *joints[n + 2]->t).to_vec2();
+
+			b.p[1] = (end - prev) * (1.0f / 6.0f);
+			b.p[2] = end - next * (1.0f / 6.0f);
 		}
+
+		curve.points.clear();
+		curve.params.clear();
+		b.tessellate(CURVE_TOLERANCE / pixel_scale, curve.points, curve.params);
+		curve.valid = true;
+
+		curves_tessellated++;
 	}
-	glEnd();
+
+	for (uint n = 0; n < joints.size(); ++n)
+		joints[n]->dirty = false;
+}
+
+// maps a point in the frame of joint n, given as if its bone were straight, onto the curved bone
+vec2 kine2d::curve_local(uint n, const vec2& local)
+{
+	const bezier2& b = curves[n].shape;
+	vec2 chord = b.p[3];
+	float length = sqrtf(chord.x * chord.x + chord.y * chord.y);
+
+	if (length <= 0.0f)
+		return local;
+
+	// position along the straight bone, and distance to it
+	float along = (local.x * chord.x + local.y * chord.y) / length;
+	float across = (chord.x * local.y - chord.y * local.x) / length;
+
+	float u = std::min(std::max(along / length, 0.0f), 1.0f);
+	float beyond = along - u * length;	// past the ends, points continue along the tangent
+
+	vec2 tangent = b.tangent(u);
+	float t = sqrtf(tangent.x * tangent.x + tangent.y * tangent.y);
+	tangent = t > 0.0f ? tangent * (1.0f / t) : chord * (1.0f / length);
+
+	vec2 normal(-tangent.y, tangent.x);
+	return b.point(u) + tangent * beyond + normal * across;
 }
 
-void kine2d::draw_line(vec2* start, vec2* end, float thickness, ColorType color)
+// attaches a world position to the closest curved bone, by its curve parameter and its distance to the curve
+void kine2d::attach_to_curve(vec2* point)
 {
-	switch(color)
+	int best = -1;
+	float best_distance = FLT_MAX;
+	float best_u = 0.0f;
+	float best_offset = 0.0f;
+
+	for (uint n = 0; n + 1 < joints.size(); ++n)
 	{
-	case COLOR_RED:
-		glColor3f(1,0,0);
-	break;
-
-	case COLOR_BLUE:
-		glColor3f(0,0,1);
-	break;
-
-	case COLOR_BLACK:
-	default:
-		glColor3f(0,0,0);
-	break;
+		if (!joints[n]->bone || !curves[n].valid)
+			continue;
+
+		// into the frame of the joint: S[n]^T (p - P[n])
+		const joint_pose3& jp = world_pose.joints[n];
+		float dx = point->x - jp.position.x;
+		float dy = point->y - jp.position.y;
+		vec2 local(jp.rotation[0] * dx + jp.rotation[3] * dy, jp.rotation[1] * dx + jp.rotation[4] * dy);
+
+		float offset;
+		float u = curves[n].shape.closest(curves[n].points, curves[n].params, local, offset);
+
+		if (fabsf(offset) < best_distance)
+		{
+			best = n;
+			best_distance = fabsf(offset);
+			best_u = u;
+			best_offset = offset;
+		}
 	}
 
-	glLineWidth(thickness);
-	glBegin(GL_LINES);
+	if (best < 0)
 	{
-		glVertex2f(start->x, start->y);
-		glVertex2f(end->x, end->y);
+		delete point;
+		return;
 	}
-	glEnd();
+
+	// stored as on a straight bone, which curve_local maps back onto the curve
+	vec2 chord = curves[best].shape.p[3];
+	float length = sqrtf(chord.x * chord.x + chord.y * chord.y);
+	vec2 direction = chord * (1.0f / length);
+	vec2 normal(-direction.y, direction.x);
+
+	*point = direction * (best_u * length) + normal * best_offset;
+	joints[best]->bone->attach(point);
+	marks.mark(best, edit_marks::ATTACHMENTS);
+}
+
+void kine2d::cycle_curve_mode()
+{
+	curve_mode = (CurveMode)((curve_mode + 1) % NUM_CURVE_MODES);
+
+	for (uint n = 0; n < curves.size(); ++n)
+		curves[n].valid = false;
 }
 
 void kine2d::init(int w, int h)
 {
-	// init a 2d glut configuration
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
+	// the OpenGL state of the view is set as it is drawn, since the window is shared with the 3D view
+	resize(w, h);
+}
 
-	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+void kine2d::draw()
+{
 	glClearColor(0.85f, 0.85f, 0.80f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
 
-	gluOrtho2D(-20.0, w, -20.0, h);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(projection);
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
+
+	commands.clear();
+	record(commands);
+	backend.flush(commands, render);
+
+	glutPostRedisplay();
 }
 
-void kine2d::draw()
+void kine2d::record(command_buffer& buffer)
 {
-	glClear(GL_COLOR_BUFFER_BIT);
+	float modelview[16];
+	identity_matrix(modelview);
+
+	buffer.set_view(projection, modelview);
+	buffer.set_background(0.85f, 0.85f, 0.80f);
 
-	draw_world_axis();
+	buffer.set_layer(LAYER_WORLD);
+	draw_world_axis(buffer);
 
 	// total rotation matrix
 	matrix Sn_1(2,2);
@@ -200,9 +346,15 @@ void kine2d::draw()
 	vec2 axisY(0,50);
 
 	// list of bone positions in global coordinates
-	std::vector<std::pair<vec2, link2*> > globalPosLinks;
+	globalPosLinks.clear();
 
-	while (joint)
+	world_pose.joints.resize(joints.size());
+	world_pose.attachments.clear();
+
+	if (curve_mode != CURVE_STRAIGHT)
+		update_curves();
+
+	for (uint n = 0; joint; ++n)
 	{
 		// make a rotation matrix
 		matrix Rn = rotation_matrix(joint->theta);
@@ -214,22 +366,64 @@ void kine2d::draw()
 		vec2 x = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &axisX);
 		vec2 y = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &axisY);
 
+		joint_pose3& jp = world_pose.joints[n];
+		jp.position = vec3(Pn.x, Pn.y, 0.0f);
+		jp.axis_x = vec3(x.x, x.y, 0.0f);
+		jp.axis_y = vec3(y.x, y.y, 0.0f);
+		jp.axis_z = jp.position;
+		jp.visible = true;
+		jp.first_attachment = world_pose.attachments.size();
+
 		// draw joint (pink if selected, black otherwise)
-		draw_vertex(&Pn, 5, joint == active_joint);
+		buffer.set_layer(LAYER_JOINTS);
+		draw_vertex(buffer, &Pn, 5, joint == active_joint);
 
 		// draw link
-		if (!(Pn_1.x == 0 && Pn_1.y == 0)) // prevent drawing from origin to first joint
-			draw_line(&Pn_1, &Pn, 2, COLOR_BLACK);
+		buffer.set_layer(LAYER_BONES);
+		if (curve_mode == CURVE_STRAIGHT && !(Pn_1.x == 0 && Pn_1.y == 0)) // prevent drawing from origin to first joint
+			draw_line(buffer, &Pn_1, &Pn, 2, COLOR_BLACK);
 
 		// draw vertices
 		link2* bone = joint->bone;
 
+		// a curved bone is drawn from its own joint, as its tessellation is in the frame of that joint
+		if (curve_mode != CURVE_STRAIGHT && bone && joint->child)
+		{
+			vec2 start = Pn;
+			for (uint i = 0; i < curves[n].points.size(); ++i)
+			{
+				vec2 end = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &curves[n].points[i]);
+				draw_line(buffer, &start, &end, 2, COLOR_BLACK);
+				start = end;
+			}
+		}
+
 		if (bone)
 		{
+			buffer.set_layer(LAYER_POINTS);
 			for (uint i = 0; i < bone->attachments.size(); ++i)
 			{
-				vec2 boneGlobalPos = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, bone->attachments.at(i));
-				draw_vertex(&boneGlobalPos, 2, false);
+				// on a curved bone, attachments keep their place along the curve and their distance to it
+				vec2 local = (curve_mode != CURVE_STRAIGHT && joint->child) ? curve_local(n, *bone->attachments.at(i)) : *bone->attachments.at(i);
+				vec2 boneGlobalPos = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &local);
+				draw_vertex(buffer, &boneGlobalPos, 2, false);
+				world_pose.attachments.push_back(vec3(boneGlobalPos.x, boneGlobalPos.y, 0.0f));
+			}
+
+			// of a cloud, a sample spread evenly over it
+			const packed_points* cloud = n < bone_clouds.size() ? &bone_clouds[n] : nullptr;
+			uint step = cloud ? cloud->size() / CLOUD_DRAW_POINTS + 1 : 1;
+
+			for (uint i = 0; cloud && i < cloud->size(); i += step)
+			{
+				vec3 p = cloud->get(i);
+				vec2 local = vec2(p.x, p.y);
+				if (curve_mode != CURVE_STRAIGHT && joint->child)
+					local = curve_local(n, local);
+
+				vec2 cloudGlobalPos = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &local);
+				draw_vertex(buffer, &cloudGlobalPos, 1, false);
+				world_pose.attachments.push_back(vec3(cloudGlobalPos.x, cloudGlobalPos.y, 0.0f));
 			}
 
 			if (!dangling_points.empty())
@@ -241,13 +435,20 @@ void kine2d::draw()
 		}
 
 		// draw local axes
-		draw_line(&Pn, &x, 3, COLOR_RED);
-		draw_line(&Pn, &y, 3, COLOR_BLUE);
+		buffer.set_layer(LAYER_AXES);
+		draw_line(buffer, &Pn, &x, 3, COLOR_RED);
+		draw_line(buffer, &Pn, &y, 3, COLOR_BLUE);
 
 		// setup next iteration
 		Sn_1 = Sn_1 * Rn; 	// set to S[n], which is S[n-1] for the next iteration
 		Pn_1 = Pn;			// set to P[n], which is P[n-1] for the next iteration
 
+		// the 2D rotation, embedded in the xy plane
+		jp.num_attachments = world_pose.attachments.size() - jp.first_attachment;
+		jp.rotation[0] = Sn_1(1,1); jp.rotation[1] = Sn_1(1,2); jp.rotation[2] = 0.0f;
+		jp.rotation[3] = Sn_1(2,1); jp.rotation[4] = Sn_1(2,2); jp.rotation[5] = 0.0f;
+		jp.rotation[6] = 0.0f;      jp.rotation[7] = 0.0f;      jp.rotation[8] = 1.0f;
+
 		joint = joint->child;
 	}
 
@@ -255,6 +456,14 @@ void kine2d::draw()
 	for (uint i = 0; i < dangling_points.size(); ++i)
 	{
 		vec2* pointToAttach = dangling_points.top();
+
+		if (curve_mode != CURVE_STRAIGHT)
+		{
+			attach_to_curve(pointToAttach);
+			dangling_points.pop();
+			continue;
+		}
+
 		vec2 closestCenter(999, 999);
 		link2* associatedBone = nullptr;
 
@@ -281,10 +490,9 @@ void kine2d::draw()
 		pointToAttach->y += associatedBone->center->y;
 
 		associatedBone->attach(pointToAttach);
+		marks.mark(index_of(associatedBone->connection.first), edit_marks::ATTACHMENTS);
 		dangling_points.pop();
 	}
-
-	glutPostRedisplay();
 }
 
 void kine2d::prev_joint()
@@ -306,11 +514,309 @@ void kine2d::next_joint()
 
 void kine2d::rotate_joint(float degrees)
 {
-	if (active_joint)
-		active_joint->rotate(degrees);
+	if (!active_joint)
+		return;
+
+	active_joint->rotate(degrees);
+	marks.mark(index_of(active_joint), edit_marks::ANGLES);
+}
+
+void kine2d::rotate_joint_about(uint joint, char axis, float degrees)
+{
+	(void)axis;		// 2D joints only turn about z
+
+	if (joint >= joints.size())
+		return;
+
+	joints[joint]->rotate(degrees);
+	marks.mark(joint, edit_marks::ANGLES);
 }
 
 void kine2d::insert_point(float x, float y)
 {
 	dangling_points.push(new vec2(x,y)); // vec2 ptr will be deleted by the bone it gets attached to
 }
+
+bool kine2d::select_joint_at(float x, float y)
+{
+	const pose3& pose = world_pose;
+	if (pose.joints.size() < 2)
+		return false;
+
+	// the view looks down the z axis, at joints and bones as wide as the pointer is forgiving
+	if (picker.size() != pose.joints.size() * 2 - 1)
+	{
+		picker.clear();
+		for (uint n = 0; n < pose.joints.size(); ++n)
+			picker.add_joint(0, n, PICK_PIXELS);
+		for (uint n = 0; n + 1 < pose.joints.size(); ++n)
+			picker.add_bone(0, n, PICK_PIXELS * 0.5f);
+	}
+
+	for (uint n = 0; n < pose.joints.size(); ++n)
+		picker.set_joint(n, pose.joints[n].position);
+	for (uint n = 0; n + 1 < pose.joints.size(); ++n)
+		picker.set_bone(pose.joints.size() + n, pose.joints[n].position, pose.joints[n + 1].position);
+
+	picker.refit();
+
+	pick_hit hit;
+	if (!picker.raycast(vec3(x, y, PICK_PIXELS * 2.0f), vec3(0.0f, 0.0f, -1.0f), hit))
+		return false;
+
+	// a bone selects the joint it is closer to
+	uint n = (hit.bone && hit.along > 0.5f) ? hit.index + 1 : hit.index;
+	active_joint = joints[n];
+	return true;
+}
+
+void kine2d::get_angles(float* angles)
+{
+	for (uint i = 0; i < joints.size(); ++i)
+		angles[i] = joints[i]->theta;
+}
+
+void kine2d::set_angles(const float* angles)
+{
+	for (uint i = 0; i < joints.size(); ++i)
+	{
+		joints[i]->theta = 0.0f;
+		joints[i]->rotate(angles[i]);
+	}
+
+	marks.all_angles = true;
+}
+
+vec3 kine2d::end_effector(const float* angles)
+{
+	if (fixed.end_effector)
+		return fixed.end_effector(angles);
+
+	matrix Sn_1(2,2);
+	vec2 Pn(0,0);
+	vec2 zero(0,0);
+
+	for (uint n = 0; n < joints.size(); ++n)
+	{
+		matrix Rn = rotation_matrix(angles[n]);
+		Pn = convert_to_world(&Pn, Sn_1, joints[n]->t, Rn, &zero);
+		Sn_1 = Sn_1 * Rn;
+	}
+
+	return vec3(Pn.x, Pn.y, 0.0f);
+}
+
+void kine2d::joint_positions(const float* angles, vec3* positions)
+{
+	if (fixed.joint_positions)
+	{
+		fixed.joint_positions(angles, positions);
+		return;
+	}
+
+	matrix Sn_1(2,2);
+	vec2 Pn(0,0);
+	vec2 zero(0,0);
+
+	for (uint n = 0; n < joints.size(); ++n)
+	{
+		matrix Rn = rotation_matrix(angles[n]);
+		Pn = convert_to_world(&Pn, Sn_1, joints[n]->t, Rn, &zero);
+		Sn_1 = Sn_1 * Rn;
+
+		positions[n] = vec3(Pn.x, Pn.y, 0.0f);
+	}
+}
+
+void kine2d::joint_positions_quantized(const uint16_t* angles, vec3* positions)
+{
+	/*
+	 *	P[n] = P[n-1] + S[n-1] T[n] as in joint_positions(), with the total rotation S[n] kept as the sum of the
+	 *	angles: rotations in the plane add up, and steps wrap around by themselves in 16 bits modulo a turn
+	 */
+	uint total = 0;
+	float x = 0.0f, y = 0.0f;
+
+	for (uint n = 0; n < joints.size(); ++n)
+	{
+		float c = table_cos(total), s = table_sin(total);
+		const vec2* t = joints[n]->t;
+
+		x += c * t->x - s * t->y;
+		y += s * t->x + c * t->y;
+
+		total += angles[n];
+		if (total >= ANGLE_TURN)
+			total -= ANGLE_TURN;
+
+		positions[n] = vec3(x, y, 0.0f);
+	}
+}
+
+void kine2d::aim_bones(const vec3* positions, float* angles)
+{
+	/*
+	 *	the bone from joint n to n + 1 points along S[n] T[n+1], so with s[n] the total rotation of S[n] and
+	 *	a[n] the world angle of that bone:
+	 *
+	 *	s[n] = a[n] - angle(T[n+1]),	theta[n] = s[n] - s[n-1]
+	 *
+	 *	the end effector has no bone to aim and keeps its angle
+	 */
+	float previous = 0.0f;
+
+	for (uint n = 0; n + 1 < joints.size(); ++n)
+	{
+		vec3 d = positions[n + 1] - positions[n];
+		vec2* t = joints[n + 1]->t;
+
+		float total = (atan2f(d.y, d.x) - atan2f(t->y, t->x)) * 180.0f / PI;
+		float theta = total - previous;
+
+		angles[n] = theta - 360.0f * floorf(theta / 360.0f);
+		previous = total;
+	}
+
+	if (!joints.empty())
+		angles[joints.size() - 1] = joints.back()->theta;
+}
+
+uint kine2d::num_attachments(uint joint)
+{
+	return (joint < joints.size() && joints[joint]->bone) ? joints[joint]->bone->attachments.size() : 0;
+}
+
+void kine2d::get_attachments(uint joint, vec3* points)
+{
+	for (uint i = 0; i < num_attachments(joint); ++i)
+	{
+		vec2* v = joints[joint]->bone->attachments[i];
+		points[i] = vec3(v->x, v->y, 0.0f);
+	}
+}
+
+void kine2d::set_attachments(uint joint, const vec3* points, uint count)
+{
+	if (joint >= joints.size() || !joints[joint]->bone)
+		return;
+
+	std::vector<vec2*>& attachments = joints[joint]->bone->attachments;
+	std::for_each(attachments.begin(), attachments.end(), delete_ptr());
+	attachments.clear();
+
+	for (uint i = 0; i < count; ++i)
+		attachments.push_back(new vec2(points[i].x, points[i].y));
+
+	marks.mark(joint, edit_marks::ATTACHMENTS);
+}
+
+vec3 kine2d::joint_offset(uint joint)
+{
+	if (joint >= joints.size())
+		return vec3(0, 0, 0);
+
+	return vec3(joints[joint]->t->x, joints[joint]->t->y, 0.0f);
+}
+
+void kine2d::set_joint_offset(uint joint, const vec3& offset)
+{
+	if (joint >= joints.size())
+		return;
+
+	joint2* j = joints[joint];
+	*j->t = vec2(offset.x, offset.y);
+	j->dirty = true;
+
+	// the bone that ends at the joint
+	if (j->parent && j->parent->bone)
+	{
+		link2* bone = j->parent->bone;
+		bone->length = sqrtf(offset.x * offset.x + offset.y * offset.y);
+		*bone->center = vec2(offset.x / 2, offset.y / 2);
+	}
+
+	// the curved bone of joint n depends on T[n] up to T[n+2] (see update_curves)
+	for (uint n = joint >= 2 ? joint - 2 : 0; n <= joint && n < curves.size(); ++n)
+		curves[n].valid = false;
+
+	match_fixed();
+}
+
+void kine2d::set_num_joints(uint count)
+{
+	count = std::max(count, 2u);
+	if (count == joints.size())
+		return;
+
+	uint kept = std::min((uint)joints.size(), count);
+
+	while (joints.size() > count)
+	{
+		joint2* last = joints.back();
+		joints.pop_back();
+
+		// the new end effector loses its bone, with the points attached to it
+		joint2* end = joints.back();
+		delete end->bone;
+		end->bone = nullptr;
+		end->child = nullptr;
+		end->dirty = true;
+
+		if (active_joint == last)
+			active_joint = end;
+
+		delete last;
+	}
+
+	while (joints.size() < count)
+	{
+		joint2* end = joints.back();
+		float dist = sqrtf(end->t->x * end->t->x + end->t->y * end->t->y);
+
+		joint2* p = new joint2(dist);
+		p->parent = end;
+		end->child = p;
+		end->bone = new link2(std::make_pair(end, p), dist);
+
+		joints.push_back(p);
+	}
+
+	if (bone_clouds.size() > count)
+		bone_clouds.resize(count);
+
+	// the curved bones from the one before the last kept joint on see other neighbours now
+	if (curves.size() > count)
+		curves.resize(count);
+	for (uint n = kept - 2; n < curves.size(); ++n)
+		curves[n].valid = false;
+
+	// the last kept joint gained or lost its bone
+	for (uint n = kept - 1; n < count; ++n)
+		marks.mark(n, edit_marks::ANGLES | edit_marks::ATTACHMENTS);
+
+	match_fixed();
+}
+
+void kine2d::get_chain(std::vector<vec2>& offsets)
+{
+	offsets.clear();
+	for (uint i = 0; i < joints.size(); ++i)
+		offsets.push_back(*joints[i]->t);
+}
+
+void kine2d::print_stats()
+{
+	std::cout << "commands: " << render.commands
+		<< ", draw calls: " << render.draw_calls_unsorted << " -> " << render.draw_calls
+		<< ", state changes: " << render.state_changes_unsorted << " -> " << render.state_changes
+		<< std::endl;
+
+	if (curve_mode != CURVE_STRAIGHT)
+	{
+		uint points = 0;
+		for (uint n = 0; n < curves.size(); ++n)
+			points += curves[n].points.size();
+
+		std::cout << "curved bones: " << curves_tessellated << " tessellated this frame, " << points << " points" << std::endl;
+	}
+}
@@ -2,36 +2,107 @@
 
 #include "structures.h"
 #include "matrix.h"
+#include "render.h"
+#include "curve.h"
+#include "cloud.h"
+#include "pick.h"
+#include "fixed_fk.h"
 
 class kine2d : public kinecontext
 {
 private:
 	std::stack<vec2*> dangling_points; // points that have yet to be attached to a bone
+	std::vector<packed_points> bone_clouds;	// bulk attachments of the bone of each joint
+	bone_bvh picker;		// joints and bones of the last recorded frame, refitted when a joint is selected
 	std::vector<joint2*> joints;
 	joint2* active_joint;
+	float projection[16];
+
+	std::vector<std::pair<vec2, link2*> > globalPosLinks;	// bone centers in global coordinates, kept to reuse its capacity
+	pose3 world_pose;	// joints and attachments of the last recorded frame (in the z = 0 plane)
+
+	command_buffer commands;	// primitives of the current frame
+	gl_backend backend;
+	render_stats render;
+
+	// tessellated bone of each joint, in the frame of that joint so it only changes with the joint angles
+	struct bone_curve
+	{
+		bezier2 shape;
+		std::vector<vec2> points;	// polyline after shape.p[0]
+		std::vector<float> params;	// curve parameter of each point
+		bool valid;
+
+		bone_curve() : valid(false) {}
+	};
+
+	CurveMode curve_mode;
+	std::vector<bone_curve> curves;
+	float pixel_scale;			// pixels per unit, which sets the tolerance of the tessellation
+	uint curves_tessellated;	// in the last frame
+
+	fixed_fk fixed;				// unrolled forward kinematics while the joints are those of the built-in chain
+	bool fixed_allowed;
+
+	edit_marks marks;			// of the joints edited since the pose history took them
 
 private:
 	void create_joints(float start_x, float start_y, float dist);
+	void match_fixed();
+	uint index_of(const joint2* joint) const;
 
 	matrix rotation_matrix(float rotation);
 
 	vec2 convert_to_world(vec2* Pn_1, matrix& Sn_1, vec2* Tn, matrix& Rn, vec2* localCoordinates);
 
-	void draw_world_axis();
-	void draw_vertex(vec2* v, uint radius, bool highlight = false);
-	void draw_line(vec2* start, vec2* end, float thickness = 1.0f, ColorType color = COLOR_BLACK);
+	void update_curves();
+	vec2 curve_local(uint n, const vec2& local);
+	void attach_to_curve(vec2* point);
+
+	void draw_world_axis(command_buffer& buffer);
+	void draw_vertex(command_buffer& buffer, vec2* v, uint radius, bool highlight = false);
+	void draw_line(command_buffer& buffer, vec2* start, vec2* end, float thickness = 1.0f, ColorType color = COLOR_BLACK);
 
 public:
 	kine2d();
 	~kine2d();
 
 	void init(int w, int h);
+	void resize(int w, int h);
 	void draw();
+	void record(command_buffer& buffer);
 
 	void prev_joint();
 	void next_joint();
 
 	void rotate_joint(float degrees);
+	void rotate_joint_about(uint joint, char axis, float degrees);
 	void insert_point(float x, float y);
+	bool select_joint_at(float x, float y);
 	void switch_rotation_axis(char axis) {};
+
+	uint num_joints() { return joints.size(); }
+	uint degrees_of_freedom() { return 1; }
+	void get_angles(float* angles);
+	void set_angles(const float* angles);
+	vec3 end_effector(const float* angles);
+	void joint_positions(const float* angles, vec3* positions);
+	void joint_positions_quantized(const uint16_t* angles, vec3* positions);
+	void aim_bones(const vec3* positions, float* angles);
+	uint num_attachments(uint joint);
+	void get_attachments(uint joint, vec3* points);
+	void set_attachments(uint joint, const vec3* points, uint count);
+	edit_marks& edits() { return marks; }
+	vec3 joint_offset(uint joint);
+	void set_joint_offset(uint joint, const vec3& offset);
+	void set_num_joints(uint count);
+	std::vector<packed_points>& clouds() { return bone_clouds; }
+	void get_chain(std::vector<vec2>& offsets);	// joint translations T[n], root first
+	void allow_fixed_fk(bool allowed);	// or always take the loop over the joints
+	bool uses_fixed_fk() const { return fixed.joint_positions != nullptr; }
+
+	void cycle_curve_mode();
+
+	void print_stats();
+	const pose3& current_pose() { return world_pose; }
 };
@@ -1,12 +1,25 @@
 ﻿#include "kine3d.h"
+#include "quantize.h"
 #include <cmath>
 
+static const float AXIS_LENGTH = 10.0f;		// length of the local axes
+static const float JOINT_RADIUS = 1.0f;		// radius of the joint spheres
+static const float POINT_RADIUS = 0.4f;		// radius of the attachment spheres
 
 kine3d::kine3d()
 {
 	active_axis = 'z';
 	active_joint = nullptr;
+	fixed_allowed = true;
 	create_joints(10, 10, 10, 20);
+
+	lod_id = lod.add_instance();
+
+	identity_matrix(projection);
+	identity_matrix(cull_projection);
+	identity_matrix(modelview);
+	identity_matrix(camera);
+	view_width = view_height = 1;
 }
 
 kine3d::~kine3d()
@@ -44,6 +57,36 @@ void kine3d::create_joints(float start_x, float start_y, float start_z, float di
 	joints.push_back(p3);
 
 	active_joint = joints.at(0);
+	update_reach();
+	match_fixed();
+}
+
+void kine3d::update_reach()
+{
+	// no matter how the joints are rotated, the chain stays within its total length of the root
+	reach_radius = AXIS_LENGTH + JOINT_RADIUS;
+	for (uint i = 1; i < joints.size(); ++i)
+	{
+		vec3* t = joints[i]->t;
+		reach_radius += sqrtf(t->x * t->x + t->y * t->y + t->z * t->z);
+	}
+}
+
+void kine3d::match_fixed()
+{
+	// rig files may change the joints into any chain, which then takes the loop
+	fixed = (fixed_allowed && builtin_chain3::matches(*this)) ? fixed_fk::of<builtin_chain3>() : fixed_fk();
+}
+
+uint kine3d::index_of(const joint3* joint) const
+{
+	return std::find(joints.begin(), joints.end(), joint) - joints.begin();
+}
+
+void kine3d::allow_fixed_fk(bool allowed)
+{
+	fixed_allowed = allowed;
+	match_fixed();
 }
 
 matrix kine3d::rotation_matrix(float angle_x, float angle_y, float angle_z)
@@ -150,120 +193,59 @@ vec3 kine3d::convert_to_world(vec3* Pn_1, matrix& Sn_1, vec3* Tn, matrix& Rn, ve
 	return *Pn_1 + (Sn_1 * f).to_vec3();
 }
 
-void kine3d::draw_world_axis()
+void kine3d::draw_world_axis(command_buffer& buffer)
 {
-	glLineWidth(5.0f);
-
 	// x-axis (red)
-	glColor3f(1,0,0);
-	glBegin(GL_LINES);
-		glVertex3f(0.0f, 0.0f, 0.0f);
-		glVertex3f(20.0f, 0.0f, 0.0f);
-	glEnd();
-
-	glPushMatrix();
-		glTranslatef(20,0,0);
-		glRotatef(90,0,1,0);
-		glutSolidCone(1,2,15,10);
-	glPopMatrix();
+	buffer.line(vec3(0.0f, 0.0f, 0.0f), vec3(20.0f, 0.0f, 0.0f), 5.0f, COLOR_RED);
+	buffer.cone(vec3(20.0f, 0.0f, 0.0f), vec3(22.0f, 0.0f, 0.0f), 1.0f, COLOR_RED);
 
 	// y-axis (blue)
-	glColor3f(0,0,1);
-	glBegin(GL_LINES);
-		glVertex3f(0.0f, 0.0f, 0.0f);
-		glVertex3f(0.0f, 20.0f, 0.0f);
-	glEnd();
-
-	glPushMatrix();
-		glTranslatef(0,20,0);
-		glRotatef(90,-1,0,0);
-		glutSolidCone(1,2,15,10);
-	glPopMatrix();
+	buffer.line(vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 20.0f, 0.0f), 5.0f, COLOR_BLUE);
+	buffer.cone(vec3(0.0f, 20.0f, 0.0f), vec3(0.0f, 22.0f, 0.0f), 1.0f, COLOR_BLUE);
 
 	// z-axis (green)
-	glColor3f(0,1,0);
-	glBegin(GL_LINES);
-		glVertex3f(0.0f, 0.0f, 0.0f);
-		glVertex3f(0.0f, 0.0f, 20.0f);
-	glEnd();
-
-	glPushMatrix();
-		glTranslatef(0,0,20);
-		glRotatef(90,0,0,1);
-		glutSolidCone(1,2,15,10);
-	glPopMatrix();
+	buffer.line(vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 0.0f, 20.0f), 5.0f, COLOR_GREEN);
+	buffer.cone(vec3(0.0f, 0.0f, 20.0f), vec3(0.0f, 0.0f, 22.0f), 1.0f, COLOR_GREEN);
 }
 
-void kine3d::draw_vertex(vec3* v, uint radius, bool highlight)
+void kine3d::draw_vertex(command_buffer& buffer, const vec3* v, uint radius, bool highlight)
 {
-	if (highlight)
-			glColor3f(1,0,1);
-		else
-			glColor3f(1,1,1);
-
-	glPushMatrix();
-	glTranslatef(v->x, v->y, v->z);
-	glutSolidSphere(1.0f, 15, 10);
-	glPopMatrix();
+	buffer.sphere(*v, radius * 0.2f, highlight ? COLOR_MAGENTA : COLOR_WHITE);
 }
 
-void kine3d::draw_line(vec3* start, vec3* end, float thickness, ColorType color)
+void kine3d::draw_line(command_buffer& buffer, const vec3* start, const vec3* end, float thickness, ColorType color)
 {
-	switch(color)
-	{
-		case COLOR_RED:
-			glColor3f(1,0,0);
-		break;
+	buffer.line(*start, *end, thickness, color);
+}
 
-		case COLOR_BLUE:
-			glColor3f(0,0,1);
-		break;
+void kine3d::resize(int w, int h)
+{
+	// the camera of the view, before any mouse rotation
+	float perspective[16];
+	perspective_matrix(perspective, CAMERA_FOVY, (float)w / h, 0.0f, CAMERA_FAR);
+	look_at_matrix(camera, vec3(0.0f, 0.0f, CAMERA_DISTANCE), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+	multiply_matrix(projection, perspective, camera);
 
-		case COLOR_GREEN:
-			glColor3f(0,1,0);
-		break;
+	// a near plane at 0 makes the far plane of the extracted frustum degenerate, so culling uses its own projection
+	perspective_matrix(perspective, CAMERA_FOVY, (float)w / h, CAMERA_NEAR, CAMERA_FAR);
+	multiply_matrix(cull_projection, perspective, camera);
 
-		case COLOR_WHITE:
-			glColor3f(1,1,1);
-		break;
+	view_width = w;
+	view_height = h;
 
-		case COLOR_BLACK:
-		default:
-			glColor3f(0,0,0);
-		break;
-	}
+	translate_matrix(modelview, -35.0f, -25.0f, 0.0f);
 
-	glLineWidth(thickness);
-	glBegin(GL_LINES);
-	{
-		glVertex3f(start->x, start->y, start->z);
-		glVertex3f(end->x, end->y, end->z);
-	}
-	glEnd();
+	lod.set_viewport(h);
 }
 
 void kine3d::init(int w, int h)
 {
-	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
-	glClearColor(0.0f, 0.0f, 0.1f, 1.0f);
-
-	// init a 3D glut configuration
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-
-	gluPerspective(40.0, (GLdouble)w/h, 0.0, 200.0);
-	gluLookAt(0.0, 0.0, 100.0,    0.0, 0.0, 0.0,    0.0, 1.0, 0.0);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	glTranslatef(-35.0f, -25.0f, 0.0f);
+	// the OpenGL state of the view is set as it is drawn, since the window is shared with the 2D view
+	resize(w, h);
 }
 
-void kine3d::draw()
+void kine3d::evaluate(const lod_level& level, pose3& out)
 {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	draw_world_axis();
-
 	matrix Sn_1(3,3);	// S[n-1]
 
 	joint3* joint = joints[0];
@@ -271,44 +253,252 @@ void kine3d::draw()
 	vec3 Pn(0,0,0);		// P[n]
 
 	vec3 zero(0,0,0);
-	vec3 axisX(10.0f,0,0);
-	vec3 axisY(0,10.0f,0);
-	vec3 axisZ(0,0,10.0f);
+	vec3 axisX(AXIS_LENGTH,0,0);
+	vec3 axisY(0,AXIS_LENGTH,0);
+	vec3 axisZ(0,0,AXIS_LENGTH);
 
-	while (joint)
+	out.joints.resize(joints.size());
+	out.attachments.clear();
+
+	for (uint n = 0; joint; ++n)
 	{
 		matrix Rn = rotation_matrix(joint->theta_x, joint->theta_y, joint->theta_z);
 
 		// convert the position of the child to global coordinates
 		Pn = convert_to_world(&Pn, Sn_1, joint->t, Rn, &zero);
 
-		// get end-points of local axis lines (note that it is based on Pn_1)
-		vec3 x = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &axisX);
-		vec3 y = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &axisY);
-		vec3 z = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &axisZ);
+		joint_pose3& jp = out.joints[n];
+		jp.position = Pn;
+		jp.visible = (n % level.joint_stride == 0) || !joint->child; // the end effector is never collapsed
+
+		// get end-points of local axis lines (note that it is based on Pn_1); collapsed joints have no axes
+		if (jp.visible)
+		{
+			jp.axis_x = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &axisX);
+			jp.axis_y = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &axisY);
+			jp.axis_z = convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &axisZ);
+		}
 
-		// draw joint (pink if selected, white otherwise)
-		draw_vertex(&Pn, 5, joint == active_joint);
+		// transform the attachments with the frame of their bone
+		jp.first_attachment = out.attachments.size();
 
-		// draw link
-		if (!(Pn_1.x == 0 && Pn_1.y == 0 && Pn_1.z == 0)) // prevent drawing from origin to first joint
-			draw_line(&Pn_1, &Pn, 2, COLOR_WHITE);
+		if (level.skin_attachments && joint->bone)
+		{
+			for (uint i = 0; i < joint->bone->attachments.size(); ++i)
+				out.attachments.push_back(convert_to_world(&Pn_1, Sn_1, joint->t, Rn, joint->bone->attachments.at(i)));
+
+			// of a cloud, a sample spread evenly over it
+			const packed_points* cloud = n < bone_clouds.size() ? &bone_clouds[n] : nullptr;
+			uint step = cloud ? cloud->size() / CLOUD_DRAW_POINTS + 1 : 1;
+
+			for (uint i = 0; cloud && i < cloud->size(); i += step)
+			{
+				vec3 local = cloud->get(i);
+				out.attachments.push_back(convert_to_world(&Pn_1, Sn_1, joint->t, Rn, &local));
+			}
+		}
 
-		// draw local axes
-		draw_line(&Pn, &x, 3, COLOR_RED);
-		draw_line(&Pn, &y, 3, COLOR_BLUE);
-		draw_line(&Pn, &z, 3, COLOR_GREEN);
+		jp.num_attachments = out.attachments.size() - jp.first_attachment;
 
 		// setup next iteration
 		Sn_1 = Sn_1 * Rn; 	// set to S[n], which is S[n-1] for the next iteration
 		Pn_1 = Pn;			// set to P[n], which is P[n-1] for the next iteration
 
+		for (uint k = 0; k < 9; ++k)
+			jp.rotation[k] = Sn_1(k / 3 + 1, k % 3 + 1);
+
 		joint = joint->child;
 	}
 
+	// bounding sphere, used to select the level of detail
+	vec3 sum(0,0,0);
+	for (uint i = 0; i < out.joints.size(); ++i)
+		sum = sum + out.joints[i].position;
+
+	out.center = sum * (1.0f / out.joints.size());
+	out.radius = 0.0f;
+
+	for (uint i = 0; i < out.joints.size(); ++i)
+	{
+		vec3 d = out.joints[i].position - out.center;
+		out.radius = std::max(out.radius, sqrtf(d.x * d.x + d.y * d.y + d.z * d.z));
+	}
+
+	update_bounds(out);
+}
+
+void kine3d::update_bounds(pose3& pose)
+{
+	uint n = pose.joints.size();
+
+	for (uint i = 0; i < n; ++i)
+	{
+		joint_pose3& jp = pose.joints[i];
+
+		jp.bounds = aabb();
+		jp.bounds.grow(jp.position, JOINT_RADIUS);
+
+		if (jp.visible)
+		{
+			jp.bounds.grow(jp.axis_x);
+			jp.bounds.grow(jp.axis_y);
+			jp.bounds.grow(jp.axis_z);
+		}
+
+		if (i + 1 < n) // bone to the child
+			jp.bounds.grow(pose.joints[i + 1].position);
+
+		for (uint a = 0; a < jp.num_attachments; ++a)
+			jp.bounds.grow(pose.attachments[jp.first_attachment + a], POINT_RADIUS);
+	}
+
+	// subtrees, from the end effector up to the root
+	for (uint i = n; i-- > 0; )
+	{
+		joint_pose3& jp = pose.joints[i];
+		jp.subtree = jp.bounds;
+
+		if (i + 1 < n)
+			jp.subtree.grow(pose.joints[i + 1].subtree);
+	}
+
+	pose.bounds = n > 0 ? pose.joints[0].subtree : aabb();
+}
+
+uint kine3d::count_primitives(const pose3& pose, uint from)
+{
+	uint count = 0;
+
+	for (uint i = from; i < pose.joints.size(); ++i)
+	{
+		const joint_pose3& jp = pose.joints[i];
+		count += jp.num_attachments;
+
+		if (jp.visible)
+			count += (i > from) ? 5 : 4; // sphere, axes and the bone from its parent
+	}
+
+	return count;
+}
+
+void kine3d::draw()
+{
+	glClearColor(0.0f, 0.0f, 0.1f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// the camera is kept here rather than in OpenGL, so it can be replayed and rendered without a window
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(projection);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadMatrixf(modelview);
+
+	commands.clear();
+	record(commands);
+	backend.flush(commands, render);
+
 	glutPostRedisplay();
 }
 
+void kine3d::record(command_buffer& buffer)
+{
+	buffer.set_view(projection, modelview);
+	buffer.set_background(0.0f, 0.0f, 0.1f);
+
+	buffer.set_layer(LAYER_WORLD);
+	draw_world_axis(buffer);
+
+	view.extract(cull_projection, modelview);
+
+	stats = cull_stats();
+
+	// skeletons that cannot reach into the view are neither evaluated nor drawn
+	bool visible = view.contains(*joints[0]->t, reach_radius);
+	lod.set_visible(lod_id, visible);
+
+	// evaluate the skeletons that are due this frame, within the frame budget
+	lod.begin_frame(modelview);
+
+	for (uint id = lod.next_due(); id != lod_scheduler::none; id = lod.next_due())
+	{
+		pose3& target = lod.begin_update(id);
+		evaluate(lod.level(id), target);
+		lod.end_update(id);
+	}
+
+	if (!visible)
+	{
+		stats.skeletons_culled++;
+		stats.culled += count_primitives(display_pose, 0);
+		return;
+	}
+
+	lod.interpolate(lod_id, display_pose);
+
+	const joint_pose3* parent = nullptr;
+
+	for (uint i = 0; i < display_pose.joints.size(); ++i)
+	{
+		const joint_pose3& jp = display_pose.joints[i];
+
+		// draw link (collapsed joints are skipped, the bone spans the whole sub-chain)
+		if (jp.visible && parent)
+		{
+			aabb bone;
+			bone.grow(parent->position);
+			bone.grow(jp.position);
+
+			if (view.contains(bone))
+			{
+				buffer.set_layer(LAYER_BONES);
+				draw_line(buffer, &parent->position, &jp.position, 2, COLOR_WHITE);
+				stats.drawn++;
+			}
+			else
+			{
+				stats.culled++;
+			}
+		}
+
+		// nothing further down the chain is in view
+		if (!view.contains(jp.subtree))
+		{
+			stats.culled += count_primitives(display_pose, i);
+			break;
+		}
+
+		uint primitives = jp.num_attachments + (jp.visible ? 4 : 0);
+
+		if (!view.contains(jp.bounds))
+		{
+			stats.culled += primitives;
+		}
+		else
+		{
+			if (jp.visible)
+			{
+				// draw joint (pink if selected, white otherwise)
+				buffer.set_layer(LAYER_JOINTS);
+				draw_vertex(buffer, &jp.position, 5, joints[i] == active_joint);
+
+				// draw local axes
+				buffer.set_layer(LAYER_AXES);
+				draw_line(buffer, &jp.position, &jp.axis_x, 3, COLOR_RED);
+				draw_line(buffer, &jp.position, &jp.axis_y, 3, COLOR_BLUE);
+				draw_line(buffer, &jp.position, &jp.axis_z, 3, COLOR_GREEN);
+			}
+
+			buffer.set_layer(LAYER_POINTS);
+			for (uint a = 0; a < jp.num_attachments; ++a)
+				draw_vertex(buffer, &display_pose.attachments[jp.first_attachment + a], 2);
+
+			stats.drawn += primitives;
+		}
+
+		if (jp.visible)
+			parent = &jp;
+	}
+}
+
 void kine3d::prev_joint()
 {
 	if (active_joint)
@@ -342,9 +532,35 @@ void kine3d::rotate_joint(float degrees)
 			active_joint->rotate_z(degrees);
 		break;
 		}
+
+		marks.mark(index_of(active_joint), edit_marks::ANGLES);
 	}
 }
 
+void kine3d::rotate_joint_about(uint joint, char axis, float degrees)
+{
+	if (joint >= joints.size())
+		return;
+
+	switch (axis)
+	{
+	case 'x':
+		joints[joint]->rotate_x(degrees);
+	break;
+
+	case 'y':
+		joints[joint]->rotate_y(degrees);
+	break;
+
+	case 'z':
+	default:
+		joints[joint]->rotate_z(degrees);
+	break;
+	}
+
+	marks.mark(joint, edit_marks::ANGLES);
+}
+
 void kine3d::switch_rotation_axis(char axis)
 {
 	if (axis == 'x' || axis == 'y' || axis == 'z')
@@ -352,3 +568,375 @@ void kine3d::switch_rotation_axis(char axis)
 	else
 		active_axis = 'z';
 }
+
+void kine3d::rotate_view(float degrees, float x, float y, float z)
+{
+	// same as glRotatef on the modelview matrix
+	float rotation[16];
+	rotate_matrix(rotation, degrees, x, y, z);
+	multiply_matrix(modelview, modelview, rotation);
+}
+
+bool kine3d::cast(float x, float y, pick_hit& hit)
+{
+	const pose3& pose = display_pose;
+	if (pose.joints.size() < 2)
+		return false;
+
+	// joint spheres and bone capsules of the drawn pose, refitted as the pose changes
+	if (picker.size() != pose.joints.size() * 2 - 1)
+	{
+		picker.clear();
+		for (uint n = 0; n < pose.joints.size(); ++n)
+			picker.add_joint(0, n, PICK_JOINT_RADIUS);
+		for (uint n = 0; n + 1 < pose.joints.size(); ++n)
+			picker.add_bone(0, n, PICK_BONE_RADIUS);
+	}
+
+	for (uint n = 0; n < pose.joints.size(); ++n)
+		picker.set_joint(n, pose.joints[n].position);
+	for (uint n = 0; n + 1 < pose.joints.size(); ++n)
+		picker.set_bone(pose.joints.size() + n, pose.joints[n].position, pose.joints[n + 1].position);
+
+	picker.refit();
+
+	/*
+	 *	the ray through the window position, in eye coordinates (the near plane is at 0, so the projection cannot be
+	 *	inverted), then in world coordinates through the inverse of the rigid transform M = camera * modelview:
+	 *
+	 *	origin = -R^T t,	direction = R^T (x_ndc tan(fovy / 2) aspect, y_ndc tan(fovy / 2), -1)
+	 */
+	float m[16];
+	multiply_matrix(m, camera, modelview);
+
+	float slope = tanf(CAMERA_FOVY * 0.5f * (PI / 180.0f));
+	float eye[3] = { (2.0f * x / view_width - 1.0f) * slope * view_width / view_height,
+					 (1.0f - 2.0f * y / view_height) * slope,
+					 -1.0f };
+
+	vec3 origin(0, 0, 0), direction(0, 0, 0);
+	float* o[3] = { &origin.x, &origin.y, &origin.z };
+	float* d[3] = { &direction.x, &direction.y, &direction.z };
+
+	for (uint i = 0; i < 3; ++i)
+	{
+		for (uint r = 0; r < 3; ++r)
+		{
+			*o[i] -= m[i * 4 + r] * m[12 + r];
+			*d[i] += m[i * 4 + r] * eye[r];
+		}
+	}
+
+	return picker.raycast(origin, direction, hit);
+}
+
+bool kine3d::select_joint_at(float x, float y)
+{
+	pick_hit hit;
+	if (!cast(x, y, hit))
+		return false;
+
+	// a bone selects the joint it is closer to
+	uint n = (hit.bone && hit.along > 0.5f) ? hit.index + 1 : hit.index;
+	active_joint = joints[n];
+	return true;
+}
+
+void kine3d::insert_point(float x, float y)
+{
+	pick_hit hit;
+	if (!cast(x, y, hit))
+		return;
+
+	// a joint takes the point onto its own bone, the end effector onto the last bone
+	uint n = std::min(hit.index, (uint)joints.size() - 2);
+	if (!joints[n]->bone)
+		return;
+
+	// an attachment at x is drawn at P[n] + S[n] x, so x = S[n]^T (p - P[n])
+	const joint_pose3& jp = display_pose.joints[n];
+	vec3 o = hit.point - jp.position;
+	const float* r = jp.rotation;
+
+	joints[n]->bone->attach(new vec3(r[0] * o.x + r[3] * o.y + r[6] * o.z,
+									 r[1] * o.x + r[4] * o.y + r[7] * o.z,
+									 r[2] * o.x + r[5] * o.y + r[8] * o.z));
+	marks.mark(n, edit_marks::ATTACHMENTS);
+}
+
+void kine3d::get_angles(float* angles)
+{
+	for (uint i = 0; i < joints.size(); ++i)
+	{
+		angles[i * 3 + 0] = joints[i]->theta_x;
+		angles[i * 3 + 1] = joints[i]->theta_y;
+		angles[i * 3 + 2] = joints[i]->theta_z;
+	}
+}
+
+void kine3d::set_angles(const float* angles)
+{
+	for (uint i = 0; i < joints.size(); ++i)
+	{
+		joints[i]->theta_x = joints[i]->theta_y = joints[i]->theta_z = 0.0f;
+		joints[i]->rotate_x(angles[i * 3 + 0]);
+		joints[i]->rotate_y(angles[i * 3 + 1]);
+		joints[i]->rotate_z(angles[i * 3 + 2]);
+	}
+
+	marks.all_angles = true;
+}
+
+vec3 kine3d::end_effector(const float* angles)
+{
+	if (fixed.end_effector)
+		return fixed.end_effector(angles);
+
+	matrix Sn_1(3,3);
+	vec3 Pn(0,0,0);
+	vec3 zero(0,0,0);
+
+	for (uint n = 0; n < joints.size(); ++n)
+	{
+		matrix Rn = rotation_matrix(angles[n * 3 + 0], angles[n * 3 + 1], angles[n * 3 + 2]);
+		Pn = convert_to_world(&Pn, Sn_1, joints[n]->t, Rn, &zero);
+		Sn_1 = Sn_1 * Rn;
+	}
+
+	return Pn;
+}
+
+void kine3d::joint_positions(const float* angles, vec3* positions)
+{
+	if (fixed.joint_positions)
+	{
+		fixed.joint_positions(angles, positions);
+		return;
+	}
+
+	matrix Sn_1(3,3);
+	vec3 Pn(0,0,0);
+	vec3 zero(0,0,0);
+
+	for (uint n = 0; n < joints.size(); ++n)
+	{
+		matrix Rn = rotation_matrix(angles[n * 3 + 0], angles[n * 3 + 1], angles[n * 3 + 2]);
+		Pn = convert_to_world(&Pn, Sn_1, joints[n]->t, Rn, &zero);
+		Sn_1 = Sn_1 * Rn;
+
+		positions[n] = Pn;
+	}
+}
+
+void kine3d::joint_positions_quantized(const uint16_t* angles, vec3* positions)
+{
+	/*
+	 *	P[n] = P[n-1] + S[n-1] T[n] and S[n] = S[n-1] Rx Ry Rz as in joint_positions(), with the rotations
+	 *	written out from the table rather than multiplied as matrices:
+	 *
+	 *				[  cy cz            -cy sz             sy    ]
+	 *	Rx Ry Rz =	[  cx sz + sx sy cz  cx cz - sx sy sz  -sx cy ]
+	 *				[  sx sz - cx sy cz  sx cz + cx sy sz   cx cy ]
+	 */
+	float S[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+	vec3 P(0, 0, 0);
+
+	for (uint n = 0; n < joints.size(); ++n)
+	{
+		const vec3* t = joints[n]->t;
+		P = vec3(P.x + S[0] * t->x + S[1] * t->y + S[2] * t->z,
+				 P.y + S[3] * t->x + S[4] * t->y + S[5] * t->z,
+				 P.z + S[6] * t->x + S[7] * t->y + S[8] * t->z);
+		positions[n] = P;
+
+		const uint16_t* a = angles + n * 3;
+		float sx = table_sin(a[0]), cx = table_cos(a[0]);
+		float sy = table_sin(a[1]), cy = table_cos(a[1]);
+		float sz = table_sin(a[2]), cz = table_cos(a[2]);
+
+		float R[9] = { cy * cz, -cy * sz, sy,
+					   cx * sz + sx * sy * cz, cx * cz - sx * sy * sz, -sx * cy,
+					   sx * sz - cx * sy * cz, sx * cz + cx * sy * sz, cx * cy };
+
+		float next[9];
+		for (uint r = 0; r < 3; ++r)
+			for (uint c = 0; c < 3; ++c)
+				next[r * 3 + c] = S[r * 3] * R[c] + S[r * 3 + 1] * R[3 + c] + S[r * 3 + 2] * R[6 + c];
+
+		std::copy(next, next + 9, S);
+	}
+}
+
+void kine3d::aim_bones(const vec3* positions, float* angles)
+{
+	/*
+	 *	bones lie on the x axis of their parent, so the bone from joint n to n + 1 points along the first column
+	 *	of S[n] = S[n-1] Rx Ry Rz. keeping the twist x of joint n, the bone in the frame of S[n-1] Rx is
+	 *
+	 *	d = Ry Rz (1,0,0) = (cos(y) cos(z), sin(z), -sin(y) cos(z))
+	 *
+	 *	so z = asin(d.y) and y = atan2(-d.z, d.x). the end effector has no bone to aim and keeps its angles
+	 */
+	matrix Sn_1(3,3);
+
+	for (uint n = 0; n < joints.size(); ++n)
+	{
+		joint3* joint = joints[n];
+		float x = joint->theta_x;
+		float y = joint->theta_y;
+		float z = joint->theta_z;
+
+		if (n + 1 < joints.size())
+		{
+			vec3 w = positions[n + 1] - positions[n];
+
+			// into the frame of the parent: S[n-1]^T w
+			vec3 d(Sn_1(1,1) * w.x + Sn_1(2,1) * w.y + Sn_1(3,1) * w.z,
+				   Sn_1(1,2) * w.x + Sn_1(2,2) * w.y + Sn_1(3,2) * w.z,
+				   Sn_1(1,3) * w.x + Sn_1(2,3) * w.y + Sn_1(3,3) * w.z);
+
+			// undo the twist: Rx^T d
+			float c = cosf(x * PI / 180.0f);
+			float s = sinf(x * PI / 180.0f);
+			vec3 e(d.x, c * d.y + s * d.z, -s * d.y + c * d.z);
+
+			float length = sqrtf(e.x * e.x + e.y * e.y + e.z * e.z);
+			if (length > 1e-6f)
+			{
+				z = asinf(std::min(std::max(e.y / length, -1.0f), 1.0f)) * 180.0f / PI;
+				y = atan2f(-e.z, e.x) * 180.0f / PI;
+			}
+		}
+
+		angles[n * 3 + 0] = x;
+		angles[n * 3 + 1] = y - 360.0f * floorf(y / 360.0f);
+		angles[n * 3 + 2] = z - 360.0f * floorf(z / 360.0f);
+
+		matrix Rn = rotation_matrix(angles[n * 3 + 0], angles[n * 3 + 1], angles[n * 3 + 2]);
+		Sn_1 = Sn_1 * Rn;
+	}
+}
+
+uint kine3d::num_attachments(uint joint)
+{
+	return (joint < joints.size() && joints[joint]->bone) ? joints[joint]->bone->attachments.size() : 0;
+}
+
+void kine3d::get_attachments(uint joint, vec3* points)
+{
+	for (uint i = 0; i < num_attachments(joint); ++i)
+		points[i] = *joints[joint]->bone->attachments[i];
+}
+
+void kine3d::set_attachments(uint joint, const vec3* points, uint count)
+{
+	if (joint >= joints.size() || !joints[joint]->bone)
+		return;
+
+	std::vector<vec3*>& attachments = joints[joint]->bone->attachments;
+	std::for_each(attachments.begin(), attachments.end(), delete_ptr());
+	attachments.clear();
+
+	for (uint i = 0; i < count; ++i)
+		attachments.push_back(new vec3(points[i]));
+
+	marks.mark(joint, edit_marks::ATTACHMENTS);
+}
+
+vec3 kine3d::joint_offset(uint joint)
+{
+	return joint < joints.size() ? *joints[joint]->t : vec3(0, 0, 0);
+}
+
+void kine3d::set_joint_offset(uint joint, const vec3& offset)
+{
+	if (joint >= joints.size())
+		return;
+
+	joint3* j = joints[joint];
+	*j->t = offset;
+
+	// the bone that ends at the joint
+	if (j->parent && j->parent->bone)
+	{
+		link3* bone = j->parent->bone;
+		bone->length = sqrtf(offset.x * offset.x + offset.y * offset.y + offset.z * offset.z);
+		*bone->center = offset * 0.5f;
+	}
+
+	update_reach();
+	match_fixed();
+
+	// the pose that is interpolated towards was evaluated with the old offset
+	lod.invalidate(lod_id);
+}
+
+void kine3d::set_num_joints(uint count)
+{
+	count = std::max(count, 2u);
+	if (count == joints.size())
+		return;
+
+	uint kept = std::min((uint)joints.size(), count);
+
+	while (joints.size() > count)
+	{
+		joint3* last = joints.back();
+		joints.pop_back();
+
+		// the new end effector loses its bone, with the points attached to it
+		joint3* end = joints.back();
+		delete end->bone;
+		end->bone = nullptr;
+		end->child = nullptr;
+
+		if (active_joint == last)
+			active_joint = end;
+
+		delete last;
+	}
+
+	while (joints.size() < count)
+	{
+		joint3* end = joints.back();
+		float dist = sqrtf(end->t->x * end->t->x + end->t->y * end->t->y + end->t->z * end->t->z);
+
+		joint3* p = new joint3(dist);
+		p->parent = end;
+		end->child = p;
+		end->bone = new link3(std::make_pair(end, p), dist);
+
+		joints.push_back(p);
+	}
+
+	if (bone_clouds.size() > count)
+		bone_clouds.resize(count);
+
+	// the last kept joint gained or lost its bone
+	for (uint n = kept - 1; n < count; ++n)
+		marks.mark(n, edit_marks::ANGLES | edit_marks::ATTACHMENTS);
+
+	update_reach();
+	match_fixed();
+	lod.invalidate(lod_id);
+}
+
+void kine3d::print_stats()
+{
+	std::cout << "primitives drawn: " << stats.drawn << ", culled: " << stats.culled
+		<< ", skeletons culled: " << stats.skeletons_culled
+		<< ", update time: " << lod.spent_us() << " us"
+		<< ", projected size: " << lod.pixels(lod_id) << " px"
+		<< std::endl;
+
+	std::cout << "commands: " << render.commands
+		<< ", draw calls: " << render.draw_calls_unsorted << " -> " << render.draw_calls
+		<< ", state changes: " << render.state_changes_unsorted << " -> " << render.state_changes
+		<< std::endl;
+
+	if (picker.size() > 0)
+	{
+		std::cout << "last pick: " << picker.last_stats().nodes << " nodes, " << picker.last_stats().primitives
+			<< " primitives tested, " << picker.last_stats().rebuilds << " builds" << std::endl;
+	}
+}
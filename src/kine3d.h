@@ -2,6 +2,12 @@
 
 #include "structures.h"
 #include "matrix.h"
+#include "lod.h"
+#include "frustum.h"
+#include "render.h"
+#include "cloud.h"
+#include "pick.h"
+#include "fixed_fk.h"
 
 class kine3d : public kinecontext
 {
@@ -9,9 +15,37 @@ private:
 	char active_axis;				// axis to rotate about
 	std::vector<joint3*> joints;	// joints of the model
 	joint3* active_joint;			// selected joint
+	std::vector<packed_points> bone_clouds;	// bulk attachments of the bone of each joint
+
+	lod_scheduler lod;				// decides when (and how detailed) the skeleton is evaluated
+	uint lod_id;
+	pose3 display_pose;				// interpolated pose that is drawn
+	float reach_radius;				// bounds every pose of the skeleton around its root
+
+	float projection[16];			// camera matrices of the current frame
+	float modelview[16];
+	float camera[16];				// the look-at part of the projection
+	float cull_projection[16];		// the projection with a near plane in front of the eye, whose frustum has six planes
+	uint view_width;
+	uint view_height;
+	bone_bvh picker;				// joints and bones of the drawn pose, refitted when a ray is cast
+	frustum view;					// culls skeletons and limbs outside of the view
+	cull_stats stats;
+
+	command_buffer commands;		// primitives of the current frame
+	gl_backend backend;
+	render_stats render;
+
+	fixed_fk fixed;					// unrolled forward kinematics while the joints are those of the built-in chain
+	bool fixed_allowed;
+
+	edit_marks marks;				// of the joints edited since the pose history took them
 
 private:
 	void create_joints(float start_x, float start_y, float start_z, float dist);
+	void update_reach();
+	void match_fixed();
+	uint index_of(const joint3* joint) const;
 
 	matrix rotation_matrix(float angle_x, float angle_y, float angle_z);
 	matrix rotation_matrix_x(float angle_x);
@@ -20,21 +54,53 @@ private:
 
 	vec3 convert_to_world(vec3* Pn_1, matrix& Sn_1, vec3* Tn, matrix& Rn, vec3* local);
 
-	void draw_world_axis();
-	void draw_vertex(vec3* v, uint radius, bool highlight = false);
-	void draw_line(vec3* start, vec3* end, float thickness = 1.0f, ColorType color = COLOR_BLACK);
+	void evaluate(const lod_level& level, pose3& out);
+	void update_bounds(pose3& pose);
+	uint count_primitives(const pose3& pose, uint from);
+	bool cast(float x, float y, pick_hit& hit);
+
+	void draw_world_axis(command_buffer& buffer);
+	void draw_vertex(command_buffer& buffer, const vec3* v, uint radius, bool highlight = false);
+	void draw_line(command_buffer& buffer, const vec3* start, const vec3* end, float thickness = 1.0f, ColorType color = COLOR_BLACK);
 
 public:
 	kine3d();
 	virtual ~kine3d();
 
 	void init(int w, int h);
+	void resize(int w, int h);
 	void draw();
+	void record(command_buffer& buffer);
 
 	void prev_joint();
 	void next_joint();
 
 	void rotate_joint(float degrees);
-	void insert_point(float x, float y) {};
+	void rotate_joint_about(uint joint, char axis, float degrees);
+	void insert_point(float x, float y);	// onto the bone under the window position
+	bool select_joint_at(float x, float y);
 	void switch_rotation_axis(char axis);
+	void rotate_view(float degrees, float x, float y, float z);
+
+	uint num_joints() { return joints.size(); }
+	uint degrees_of_freedom() { return 3; }
+	void get_angles(float* angles);
+	void set_angles(const float* angles);
+	vec3 end_effector(const float* angles);
+	void joint_positions(const float* angles, vec3* positions);
+	void joint_positions_quantized(const uint16_t* angles, vec3* positions);
+	void aim_bones(const vec3* positions, float* angles);
+	uint num_attachments(uint joint);
+	void get_attachments(uint joint, vec3* points);
+	void set_attachments(uint joint, const vec3* points, uint count);
+	edit_marks& edits() { return marks; }
+	vec3 joint_offset(uint joint);
+	void set_joint_offset(uint joint, const vec3& offset);
+	void set_num_joints(uint count);
+	std::vector<packed_points>& clouds() { return bone_clouds; }
+	void allow_fixed_fk(bool allowed);	// or always take the loop over the joints
+	bool uses_fixed_fk() const { return fixed.joint_positions != nullptr; }
+
+	void print_stats();
+	const pose3& current_pose() { return display_pose; }
 };
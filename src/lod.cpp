@@ -0,0 +1,184 @@
+#include "lod.h"
+
+lod_scheduler::lod_scheduler() : frame(0), due_index(0), budget(LOD_FRAME_BUDGET), spent(0), viewport_height(720)
+{
+	//                  pixels  interval  stride  attachments
+	levels.push_back({ 40.0f,   1,        1,      true  });
+	levels.push_back({ 15.0f,   2,        1,      false });
+	levels.push_back({  5.0f,   4,        2,      false });
+	levels.push_back({  0.0f,   8,        4,      false });
+
+	for (uint i = 0; i < 16; ++i)
+		modelview[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+lod_scheduler::~lod_scheduler()
+{
+	std::for_each(instances.begin(), instances.end(), delete_ptr());
+	instances.clear();
+}
+
+uint lod_scheduler::add_instance()
+{
+	instance* inst = new instance();
+	inst->level = 0;
+	inst->last_update = 0;
+	inst->pixels = 0;
+	inst->priority = 0;
+	inst->evaluated = false;
+	inst->visible = true;
+
+	instances.push_back(inst);
+	return instances.size() - 1;
+}
+
+float lod_scheduler::projected_size(const vec3& c, float radius) const
+{
+	// the modelview matrix is column-major; the camera (gluLookAt in the projection) sits on the z axis
+	float z = modelview[2] * c.x + modelview[6] * c.y + modelview[10] * c.z + modelview[14];
+	float depth = CAMERA_DISTANCE - z;
+
+	if (depth <= 0.0f) // behind the eye
+		return 0.0f;
+
+	float half_fovy = CAMERA_FOVY * 0.5f * (PI / 180.0f);
+	return radius / (depth * tanf(half_fovy)) * (viewport_height * 0.5f);
+}
+
+void lod_scheduler::begin_frame(const float* modelview_matrix)
+{
+	++frame;
+	spent = 0;
+	due_index = 0;
+	due.clear();
+
+	for (uint i = 0; i < 16; ++i)
+		modelview[i] = modelview_matrix[i];
+
+	for (uint i = 0; i < instances.size(); ++i)
+	{
+		instance* inst = instances[i];
+
+		// select a level based on the bounds of the most recent evaluation
+		inst->pixels = projected_size(inst->current.center, inst->current.radius);
+		inst->level = inst->evaluated ? levels.size() - 1 : 0; // no bounds are known before the first evaluation
+
+		for (uint l = 0; inst->evaluated && l < levels.size(); ++l)
+		{
+			if (inst->pixels >= levels[l].min_pixels)
+			{
+				inst->level = l;
+				break;
+			}
+		}
+
+		uint age = frame - inst->last_update;
+
+		if (!inst->visible)
+			continue;
+		else if (!inst->evaluated)
+			inst->priority = 1e30f;
+		else if (age >= levels[inst->level].update_interval + LOD_MAX_DELAY)
+			inst->priority = 1e20f * (float)age; // when the budget falls short, small instances would wait for good; the oldest go first
+		else if (age >= levels[inst->level].update_interval)
+			inst->priority = (inst->pixels + 1.0f) * (float)(age - levels[inst->level].update_interval + 1); // overdue instances rise
+		else
+			continue;
+
+		due.push_back(i);
+	}
+
+	std::sort(due.begin(), due.end(), [this](uint a, uint b) { return instances[a]->priority > instances[b]->priority; });
+}
+
+uint lod_scheduler::next_due()
+{
+	if (due_index >= due.size())
+		return none;
+
+	uint id = due[due_index];
+
+	// always make progress on at least one instance; never postpone the first evaluation
+	if (due_index > 0 && spent >= budget && instances[id]->evaluated)
+		return none;
+
+	++due_index;
+	return id;
+}
+
+pose3& lod_scheduler::begin_update(uint id)
+{
+	instance* inst = instances[id];
+	std::swap(inst->previous, inst->current);
+
+	update_start = std::chrono::steady_clock::now();
+	return inst->current;
+}
+
+void lod_scheduler::end_update(uint id)
+{
+	instance* inst = instances[id];
+
+	if (!inst->evaluated)
+	{
+		inst->previous = inst->current;
+		inst->evaluated = true;
+	}
+
+	inst->last_update = frame;
+	spent += std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - update_start).count();
+}
+
+void lod_scheduler::interpolate(uint id, pose3& out) const
+{
+	const instance* inst = instances[id];
+	const pose3& a = inst->previous;
+	const pose3& b = inst->current;
+
+	// t reaches 1 on the last frame before the next update
+	float t = (float)(frame - inst->last_update + 1) / levels[inst->level].update_interval;
+	if (t > 1.0f) t = 1.0f;
+
+	out.joints.resize(b.joints.size());
+	out.attachments.resize(b.attachments.size());
+
+	bool same_layout = a.joints.size() == b.joints.size() && a.attachments.size() == b.attachments.size();
+
+	for (uint i = 0; i < b.joints.size(); ++i)
+	{
+		const joint_pose3& jb = b.joints[i];
+		joint_pose3& jo = out.joints[i];
+
+		if (same_layout && a.joints[i].visible == jb.visible)
+		{
+			const joint_pose3& ja = a.joints[i];
+			jo.position = vec3::lerp(ja.position, jb.position, t);
+			jo.axis_x = vec3::lerp(ja.axis_x, jb.axis_x, t);
+			jo.axis_y = vec3::lerp(ja.axis_y, jb.axis_y, t);
+			jo.axis_z = vec3::lerp(ja.axis_z, jb.axis_z, t);
+			for (uint k = 0; k < 9; ++k) // not renormalized, the steps in between updates are small
+				jo.rotation[k] = ja.rotation[k] + (jb.rotation[k] - ja.rotation[k]) * t;
+			jo.visible = jb.visible;
+			jo.first_attachment = jb.first_attachment;
+			jo.num_attachments = jb.num_attachments;
+
+			// the interpolated joint lies within both evaluations
+			jo.bounds = ja.bounds;
+			jo.bounds.grow(jb.bounds);
+			jo.subtree = ja.subtree;
+			jo.subtree.grow(jb.subtree);
+		}
+		else
+		{
+			jo = jb;
+		}
+	}
+
+	for (uint i = 0; i < b.attachments.size(); ++i)
+		out.attachments[i] = same_layout ? vec3::lerp(a.attachments[i], b.attachments[i], t) : b.attachments[i];
+
+	out.center = vec3::lerp(a.center, b.center, t);
+	out.radius = a.radius + (b.radius - a.radius) * t;
+	out.bounds = a.bounds;
+	out.bounds.grow(b.bounds);
+}
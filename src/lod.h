@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include "structures.h"
+
+// detail settings for a skeleton, selected by its projected size on screen
+struct lod_level
+{
+	float min_pixels;		// minimum projected radius (in pixels) for this level to be selected
+	uint update_interval;	// evaluate every Nth frame and interpolate in between
+	uint joint_stride;		// keep every Nth joint (and the end effector), collapsing the rest into their parent
+	bool skin_attachments;	// transform the attachments of the bones
+};
+
+class lod_scheduler
+{
+public:
+	static const uint none = ~0u;
+
+private:
+	struct instance
+	{
+		uint level;				// index into levels
+		uint last_update;		// frame of the last evaluation
+		float pixels;			// projected radius in pixels
+		float priority;			// larger (and more overdue) instances are updated first
+		bool evaluated;			// false until the first evaluation
+		bool visible;			// culled instances are not updated until they are visible again
+		pose3 previous;			// the two most recent evaluations, interpolated in between updates
+		pose3 current;
+	};
+
+	std::vector<lod_level> levels;		// sorted from most to least detailed
+	std::vector<instance*> instances;
+	std::vector<uint> due;				// instances to update this frame, sorted by priority
+
+	uint frame;
+	uint due_index;
+	uint budget;						// microseconds per frame
+	float spent;						// microseconds spent on updates this frame
+	float modelview[16];
+	float viewport_height;
+
+	std::chrono::steady_clock::time_point update_start;
+
+private:
+	float projected_size(const vec3& center, float radius) const;
+
+public:
+	lod_scheduler();
+	~lod_scheduler();
+
+	uint add_instance();
+
+	void set_viewport(int h) { viewport_height = (float)h; }
+	void set_budget(uint microseconds) { budget = microseconds; }
+	void set_visible(uint id, bool visible) { instances[id]->visible = visible; }
+	void invalidate(uint id) { instances[id]->evaluated = false; }	// evaluated again next frame, without interpolating from before
+
+	void begin_frame(const float* modelview_matrix);
+	uint next_due();
+	pose3& begin_update(uint id);
+	void end_update(uint id);
+
+	void interpolate(uint id, pose3& out) const;
+
+	const lod_level& level(uint id) const { return levels[instances[id]->level]; }
+	uint level_index(uint id) const { return instances[id]->level; }
+	uint num_levels() const { return levels.size(); }
+	float pixels(uint id) const { return instances[id]->pixels; }
+	float spent_us() const { return spent; }
+};
@@ -1,9 +1,35 @@
 #include "kine2d.h"
 #include "kine3d.h"
+#include "raster.h"
+#include "input.h"
+#include "timing.h"
+#include "alloc.h"
+#include "pose_export.h"
+#include "stream_server.h"
+#include "reach.h"
+#include "match.h"
+#include "spline.h"
+#include "blend.h"
+#include "ragdoll.h"
+#include "collision.h"
+#include "script.h"
+#include "history.h"
+#include "cloud.h"
+#include "retarget.h"
+#include "rig.h"
+#include "clip_stream.h"
+#include "watch.h"
+#include "bench.h"
 #include "constants.h"
 #include "structures.h"
 
 #include <memory>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
 #include <GL/freeglut.h>
 
 static vec2 mpos = vec2(0, 0);
@@ -17,46 +43,686 @@ static bool initialized = false;
 static bool three_d = false;
 static bool mouse_down = false;
 
+// the window is created once and shared by both views, which keep their cameras between switches
+struct view_size
+{
+	uint width;
+	uint height;
+};
+
+static view_size fitted[2] = { { 0, 0 }, { 0, 0 } };	// what the 2D and 3D contexts were last resized to
+static bool split_view = false;	// 2D on the left and 3D on the right, the other following the current context
+static retargeter mirror[2];	// from the 2D rig to the 3D rig, and back
+static bool mirror_ready[2] = { false, false };
+static std::vector<float> mirror_angles[2];
+static bool following[2] = { false, false };	// whether the 2D or the 3D view is posed as the other
+static std::vector<float> own_angles[2];	// the pose of a following view, given back when it stops following
+
+// input capture and replay
+static input_log input;
+static frame_timings timings;
+static uint tick = 0;			// frames since start, the clock of recorded input
+static bool recording = false;
+static bool replaying = false;
+static bool injecting = false;	// a recorded event is being replayed
+static bool headless = false;	// replaying without a window
+static std::string timings_path;	// per-frame timings of a replay, as CSV
+
+static pose_export exporter;	// shares the pose of every frame with other processes
+static stream_server streamer;	// pushes the pose of every frame to socket subscribers
+
+static reach_map reach;			// reachable positions of the 2D chain, to seed it towards the mouse
+static std::string reach_path;	// where the reach map is kept between runs
+
+static pose_db poses;			// frames to match against, for the context with as many angles
+static bool matching = false;	// the current context follows the best matching frame
+static std::vector<float> match_angles;
+static std::ofstream pose_log;	// angles of every frame, as read by pose_db::load_frames
+
+static angle_spline clip;		// keyed poses to play, for the context with as many angles
+static bool playing = false;	// the current context follows the clip
+static uint play_tick = 0;		// when playback started, the clock of replays
+static std::chrono::steady_clock::time_point play_start;
+static std::vector<float> play_angles;
+static std::unique_ptr<clip_streamer> streamer_clips;	// clips too long to keep, read a page at a time as they play
+static int streamed_clip = -1;	// played instead of clip, when it is not -1
+static blend_tree clip_fade;		// from the pose when the clip was reloaded to the reloaded clip
+static pose_batch fade_from, fade_to, fade_pose;
+static uint fade_root = 0;
+static float fade_start = -1.0f;	// play_seconds() of the reload, -1 when not fading
+
+static ragdoll physics;			// the chain of the current context under gravity, dragged by the mouse in 2D
+static kinecontext* physics_context = nullptr;	// the context that is falling, if any
+static float physics_time = 0.0f;	// seconds not yet simulated
+static std::chrono::steady_clock::time_point physics_clock;
+static std::vector<vec3> physics_points;
+static std::vector<float> physics_angles;
+
+static script_scheduler scripts(SCRIPT_TICK);	// animation scripts, ticked with the frames
+static float script_time = 0.0f;	// seconds not yet ticked
+static std::chrono::steady_clock::time_point script_clock = std::chrono::steady_clock::now();
+
+static bone_collider collider;	// contacts between the bones of the current context
+static kinecontext* collider_context = nullptr;
+
+static pose_history history_2d;	// versions of the edited poses of each context, for undo and redo
+static pose_history history_3d;
+static bool edited = false;		// a joint was turned or a point inserted since the last version
+
+static file_watcher watcher;	// rig and clip files, reloaded when they change
+static std::vector<uint> changed_files;
+static rig_file rigs[2];		// what the 2D and 3D contexts were last patched to
+static std::string rig_paths[2];
+static int rig_watches[2] = { -1, -1 };
+static std::string clip_path;
+static int clip_watch = -1;
+
+void menu_select(int option);
+void reload_changed();
+
+// records live input, and returns false for live input that is ignored during a replay
+bool capture(InputType type, int a0 = 0, int a1 = 0, int a2 = 0, int a3 = 0)
+{
+	if (replaying)
+		return injecting;
+
+	if (recording)
+		input.record(tick, type, a0, a1, a2, a3);
+
+	return true;
+}
+
+// maps the reach map of the 2D chain from reach_path if it was kept for the chain, or samples it (and saves it there)
+void prepare_reach_map()
+{
+	std::vector<vec2> offsets;
+	kine_2d->get_chain(offsets);
+
+	if (!reach_path.empty() && reach.load(reach_path, offsets))
+		return;
+
+	const uint resolution = 256;
+	auto start = std::chrono::steady_clock::now();
+
+	if (!reach.build(offsets, REACH_SAMPLES, resolution, std::max(1u, std::thread::hardware_concurrency())))
+	{
+		std::cerr << "Error: the reach map takes chains of at most " << REACH_MAX_JOINTS << " joints, not "
+			<< offsets.size() << std::endl;
+		return;
+	}
+
+	std::cout << "Reach map: " << reach.reached() << " of " << resolution * resolution << " cells reached in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+
+	if (!reach_path.empty() && !reach.save(reach_path))
+		std::cerr << "Error: could not write " << reach_path << std::endl;
+}
+
+// plays the frame that follows the best match for the current pose; in 2D the end effector heads for the mouse
+void match_step()
+{
+	if (!current_context || poses.size() == 0)
+		return;
+
+	uint count = current_context->num_joints() * current_context->degrees_of_freedom();
+	if (count != poses.angles_per_frame())
+		return;
+
+	match_angles.resize(count);
+	current_context->get_angles(&match_angles[0]);
+
+	vec3 velocity(0,0,0);
+
+	if (!three_d)
+	{
+		vec3 end = current_context->end_effector(&match_angles[0]);
+		vec3 target(mpos.x - 20.0f, -mpos.y + window_height - 20.0f, 0.0f);
+		velocity = target - end;
+
+		float length = sqrtf(velocity.x * velocity.x + velocity.y * velocity.y);
+		if (length > MATCH_SPEED)
+			velocity = velocity * (MATCH_SPEED / length);
+	}
+
+	match_result best = poses.search(&match_angles[0], velocity);
+	current_context->set_angles(poses.frame(best.next));
+}
+
+float play_seconds()
+{
+	return replaying
+		? (tick - play_tick) * REPLAY_FRAME_TIME
+		: std::chrono::duration<float>(std::chrono::steady_clock::now() - play_start).count();
+}
+
+// starts a crossfade from the pose of the current context to the clip that was reloaded while it played
+void start_clip_fade()
+{
+	uint joints = current_context->num_joints();
+	BlendChannels channels = three_d ? BLEND_QUATERNIONS : BLEND_ANGLES;
+
+	fade_from.resize(1, joints, channels);
+	fade_to.resize(1, joints, channels);
+	fade_pose.resize(1, joints, channels);
+
+	play_angles.resize(joints * current_context->degrees_of_freedom());
+	current_context->get_angles(&play_angles[0]);
+	fade_from.set_angles(0, &play_angles[0]);
+
+	clip_fade.reset(1, joints, channels);
+	fade_root = clip_fade.add_crossfade(clip_fade.add_source(&fade_from), clip_fade.add_source(&fade_to), 0.0f);
+	fade_start = play_seconds();
+}
+
+// blends the angles of the clip at this time with the pose it was reloaded from, until the crossfade is over
+void fade_clip(float* angles, float seconds)
+{
+	if (fade_start < 0.0f)
+		return;
+
+	float weight = (seconds - fade_start) / CLIP_FADE_TIME;
+	BlendChannels channels = three_d ? BLEND_QUATERNIONS : BLEND_ANGLES;
+
+	if (weight >= 1.0f || fade_from.num_joints() != current_context->num_joints() || fade_from.num_channels() != channels)
+	{
+		fade_start = -1.0f;
+		return;
+	}
+
+	fade_to.set_angles(0, angles);
+	clip_fade.set_weight(fade_root, weight);
+	clip_fade.evaluate(fade_root, fade_pose);
+	fade_pose.get_angles(0, angles);
+}
+
+// plays the streamed clip, reading ahead of the time; the pose stays where it was while its pages are read
+void stream_step()
+{
+	uint angles = streamer_clips->num_angles(streamed_clip);
+	if (!current_context || current_context->num_joints() * current_context->degrees_of_freedom() != angles)
+		return;
+
+	float seconds = play_seconds();
+
+	streamer_clips->prefetch(streamed_clip, seconds);
+	streamer_clips->update();
+
+	play_angles.resize(angles);
+	if (streamer_clips->sample(streamed_clip, seconds, &play_angles[0]))
+	{
+		fade_clip(&play_angles[0], seconds);
+		current_context->set_angles(&play_angles[0]);
+	}
+}
+
+// poses the current context at the time since playback started; replays advance by a fixed step per frame
+void play_step()
+{
+	if (streamed_clip >= 0)
+	{
+		stream_step();
+		return;
+	}
+
+	if (!current_context || clip.num_segments() == 0)
+		return;
+
+	if (current_context->num_joints() * current_context->degrees_of_freedom() != clip.num_angles())
+		return;
+
+	float seconds = play_seconds();
+
+	play_angles.resize(clip.row_size());
+	clip.evaluate(clip.start() + seconds, &play_angles[0]);
+	fade_clip(&play_angles[0], seconds);
+	current_context->set_angles(&play_angles[0]);
+}
+
+// places the chain of the current context in the ragdoll, with its root pinned
+void start_ragdoll()
+{
+	uint joints = current_context->num_joints();
+
+	physics_points.resize(joints);
+	physics_angles.resize(joints * current_context->degrees_of_freedom());
+	current_context->get_angles(&physics_angles[0]);
+	current_context->joint_positions(&physics_angles[0], &physics_points[0]);
+
+	float length = 0.0f;
+	for (uint n = 1; n < joints; ++n)
+	{
+		vec3 d = physics_points[n] - physics_points[n - 1];
+		length += sqrtf(d.x * d.x + d.y * d.y + d.z * d.z) / (joints - 1);
+	}
+
+	physics.reset(1, joints);
+	physics.set_gravity(vec3(0.0f, -RAGDOLL_GRAVITY * length, 0.0f));
+	physics.set_bend_limit(RAGDOLL_BEND_LIMIT);
+	physics.set_chain(0, &physics_points[0]);
+	physics.pin(0, 0, physics_points[0]);
+
+	physics_context = current_context;
+	physics_time = 0.0f;
+	physics_clock = std::chrono::steady_clock::now();
+}
+
+// runs the ticks of the ragdoll that are due and poses the chain after it; replays advance by a fixed step per frame
+void ragdoll_step()
+{
+	if (physics_context != current_context)
+	{
+		physics_context = nullptr;
+		return;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	physics_time += replaying ? REPLAY_FRAME_TIME : std::chrono::duration<float>(now - physics_clock).count();
+	physics_clock = now;
+
+	uint ticks = (uint)(physics_time / RAGDOLL_TICK);
+	physics_time -= ticks * RAGDOLL_TICK;
+
+	if (ticks > RAGDOLL_MAX_TICKS)
+	{
+		ticks = RAGDOLL_MAX_TICKS;
+		physics_time = 0.0f;
+	}
+
+	// in 2D the mouse holds the end effector while the button is down
+	uint end = physics.num_particles() - 1;
+
+	if (!three_d && mouse_down)
+		physics.pin(0, end, vec3(mpos.x - 20.0f, -mpos.y + window_height - 20.0f, 0.0f));
+	else
+		physics.release(0, end);
+
+	physics.step(RAGDOLL_TICK, ticks, RAGDOLL_ITERATIONS);
+	physics.get_chain(0, &physics_points[0]);
+
+	current_context->aim_bones(&physics_points[0], &physics_angles[0]);
+	current_context->set_angles(&physics_angles[0]);
+}
+
+// turns two joints one after the other, waits for the mouse button, then reaches for the mouse (in 2D) or for a
+// point in front of the chain (in 3D)
+script demo_script(kinecontext& context, bool three_dimensional)
+{
+	co_await rotate_over(context, 1, 'z', 45.0f, 0.5f);
+	co_await wait_seconds(0.25f);
+	co_await rotate_over(context, 2, three_dimensional ? 'y' : 'z', -90.0f, 1.0f);
+	co_await wait_until([]() { return mouse_down; });
+
+	vec3 target = three_dimensional ? vec3(30.0f, 40.0f, 30.0f) : vec3(mpos.x - 20.0f, -mpos.y + window_height - 20.0f, 0.0f);
+	co_await reach_for(context, target, 90.0f, 1.0f);
+}
+
+// runs the script ticks that are due; replays run one per frame
+void script_step()
+{
+	auto now = std::chrono::steady_clock::now();
+	script_time += replaying ? SCRIPT_TICK : std::chrono::duration<float>(now - script_clock).count();
+	script_clock = now;
+
+	for (uint i = 0; script_time >= SCRIPT_TICK && i < RAGDOLL_MAX_TICKS; ++i)
+	{
+		scripts.tick();
+		script_time -= SCRIPT_TICK;
+	}
+
+	script_time = std::min(script_time, SCRIPT_TICK);
+}
+
+// finds the contacts between the bones of the pose that was just recorded
+void collide_bones()
+{
+	const pose3& pose = current_context->current_pose();
+	uint bones = pose.joints.empty() ? 0 : pose.joints.size() - 1;
+
+	if (collider_context != current_context || collider.num_bones() != bones)
+	{
+		collider.clear();
+		collider_context = current_context;
+
+		for (uint n = 0; n < bones; ++n)
+		{
+			vec3 d = pose.joints[n + 1].position - pose.joints[n].position;
+			collider.add_bone(0, n, BONE_RADIUS * sqrtf(d.x * d.x + d.y * d.y + d.z * d.z));
+		}
+	}
+
+	for (uint n = 0; n < bones; ++n)
+		collider.set_bone(n, pose.joints[n].position, pose.joints[n + 1].position);
+
+	collider.detect();
+}
+
+// keeps the edits of the frame that was just recorded, as a version of the current context
+void remember_edit()
+{
+	if (!edited)
+		return;
+
+	alloc_scope scope("history");	// versions are kept, so their blocks are the allocations a frame is expected to make
+	(three_d ? history_3d : history_2d).commit(*current_context);
+	edited = false;
+}
+
+// appends the angles of the current frame to the pose log
+void log_pose()
+{
+	match_angles.resize(current_context->num_joints() * current_context->degrees_of_freedom());
+	current_context->get_angles(&match_angles[0]);
+
+	for (uint i = 0; i < match_angles.size(); ++i)
+		pose_log << (i ? " " : "") << match_angles[i];
+	pose_log << "\n";
+}
+
+// moves the current context by the systems that are on, before the frame is drawn
+void step_systems()
+{
+	if (matching)
+		match_step();
+
+	if (playing)
+		play_step();
+
+	if (physics_context)
+		ragdoll_step();
+
+	script_step();
+}
+
+// what follows drawing the current context: its contacts, its edits, and its pose for other processes
+void finish_frame()
+{
+	collide_bones();
+	remember_edit();
+
+	exporter.publish(current_context->current_pose(), tick, three_d ? 3 : 2);
+	streamer.publish(current_context->current_pose(), tick, three_d ? 3 : 2);
+
+	if (pose_log.is_open())
+		log_pose();
+}
+
+void display();
+void reshape(int w, int h);
+void special(unsigned char c, int x, int y);
+void keyboard(int key, int x, int y);
+void mouse_click(int button, int state, int x, int y);
+void mouse_motion(int x, int y);
+void mouse_passive(int x, int y);
+void select_context(kinecontext* const context);
+
+// feeds the recorded events of the current tick through the regular callbacks
+void inject_events()
+{
+	input_event e;
+	injecting = true;
+
+	while (input.next(tick, e))
+	{
+		int* a = e.args;
+
+		switch (e.type)
+		{
+			case INPUT_SPECIAL:		special((unsigned char)a[0], a[1], a[2]); break;
+			case INPUT_KEYBOARD:	keyboard(a[0], a[1], a[2]); break;
+			case INPUT_MOUSE:		mouse_click(a[0], a[1], a[2], a[3]); break;
+			case INPUT_MOTION:		mouse_motion(a[0], a[1]); break;
+			case INPUT_PASSIVE:		mouse_passive(a[0], a[1]); break;
+			case INPUT_MENU:		menu_select(a[0]); break;
+			case INPUT_RESHAPE:		if (headless) reshape(a[0], a[1]); break; // a window follows its own size
+		}
+	}
+
+	injecting = false;
+}
+
+// resizes a context only when its view changed size, so switching views keeps the camera (and mouse rotation)
+void fit_context(kinecontext* context, uint w, uint h)
+{
+	view_size& size = fitted[context == kine_3d.get()];
+	if (size.width == w && size.height == h)
+		return;
+
+	size.width = w;
+	size.height = h;
+	context->resize(w, h);
+}
+
+void fit_views()
+{
+	if (split_view)
+	{
+		fit_context(kine_2d.get(), window_width / 2, window_height);
+		fit_context(kine_3d.get(), window_width - window_width / 2, window_height);
+	}
+	else if (current_context)
+		fit_context(current_context, window_width, window_height);
+}
+
+// left edge of the view of the current context in the window
+uint view_left()
+{
+	return (split_view && three_d) ? window_width / 2 : 0;
+}
+
+// gives a view that followed the current context its own pose back, once the split view or the current context changes
+void stop_following()
+{
+	kinecontext* views[2] = { kine_2d.get(), kine_3d.get() };
+
+	for (uint v = 0; v < 2; ++v)
+	{
+		if (following[v])
+			views[v]->set_angles(&own_angles[v][0]);
+		following[v] = false;
+	}
+}
+
+// both views side by side, the other context posed as the current one through the retargeting of its rig
+void draw_split()
+{
+	kinecontext* views[2] = { kine_2d.get(), kine_3d.get() };
+	uint from = three_d ? 1 : 0;
+	kinecontext* other = views[1 - from];
+
+	if (!mirror_ready[from])
+	{
+		mirror_ready[from] = mirror[from].prepare(*current_context, *other);
+		mirror_angles[from].resize(mirror[from].source_angles() + mirror[from].target_angles());
+	}
+
+	if (mirror_ready[from])
+	{
+		if (!following[1 - from])
+		{
+			own_angles[1 - from].resize(other->num_joints() * other->degrees_of_freedom());
+			other->get_angles(&own_angles[1 - from][0]);
+			following[1 - from] = true;
+		}
+
+		std::vector<float>& angles = mirror_angles[from];
+		current_context->get_angles(&angles[0]);
+		mirror[from].retarget(&angles[0], 1, &angles[mirror[from].source_angles()]);
+		other->set_angles(&angles[mirror[from].source_angles()]);
+	}
+
+	// each view clears and draws only its own half
+	glEnable(GL_SCISSOR_TEST);
+
+	for (uint v = 0; v < 2; ++v)
+	{
+		uint left = v ? window_width / 2 : 0;
+		uint width = v ? window_width - window_width / 2 : window_width / 2;
+
+		glViewport(left, 0, width, window_height);
+		glScissor(left, 0, width, window_height);
+		views[v]->draw();
+	}
+
+	glDisable(GL_SCISSOR_TEST);
+	glViewport(0, 0, window_width, window_height);
+}
+
 void display()
 {
+	if (replaying)
+		inject_events();
+	else
+		reload_changed();
+
+	auto start = std::chrono::steady_clock::now();
+
+	step_systems();
+
 	// draw procedures
-	if (current_context)
+	if (split_view)
+		draw_split();
+	else if (current_context)
 		current_context->draw();
 
 	glutSwapBuffers();
+
+	if (current_context)
+		finish_frame();
+
+	timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	++tick;
+
+	if (replaying && input.done())
+	{
+		timings.report(std::cout, "replay");
+
+		if (!timings_path.empty())
+			timings.write_csv(timings_path);
+
+		exit(0);
+	}
 }
 
 void reshape(int w, int h)
 {
+	// a window always follows its own size, recorded sizes are only replayed without a window
+	if (recording && !replaying)
+		input.record(tick, INPUT_RESHAPE, w, h);
+
 	window_width = w;
 	window_height = h;
 
-	glViewport(0, 0, w, h);
+	fit_views();
 
+	if (!headless)
+		glViewport(0, 0, w, h);
+}
+
+// what the current context and the systems working on it did lately, for the 'i' key
+void print_stats()
+{
 	if (current_context)
-		current_context->init(w, h);
+	{
+		current_context->print_stats();
+		(three_d ? history_3d : history_2d).print_stats();
+	}
+
+	if (scripts.size() > 0)
+		std::cout << "scripts: " << scripts.size() << " running, " << scripts.resumed_last_tick() << " resumed in the last tick" << std::endl;
+
+	if (streamer.is_running())
+		streamer.print_stats();
+
+	if (current_context && collider_context == current_context)
+	{
+		const std::vector<bone_contact>& contacts = collider.contacts();
+		std::cout << "bone contacts: " << contacts.size() << std::endl;
+
+		for (uint i = 0; i < contacts.size(); ++i)
+			std::cout << "  bones " << contacts[i].a << " and " << contacts[i].b << ", depth " << contacts[i].depth << std::endl;
+	}
 }
 
 void special(unsigned char c, int x, int y)
 {
+	if (!capture(INPUT_SPECIAL, c, x, y)) return;
+
 	if (three_d && (c == 'x' || c == 'y' || c == 'z'))
 		current_context->switch_rotation_axis(c);
 
+	if (c == 'i')
+		print_stats();
+
+	// jump to the sampled configuration that ends closest to the mouse
+	if (c == 'r' && !three_d)
+	{
+		if (!reach.ready())
+			prepare_reach_map();
+
+		float angles[REACH_MAX_JOINTS];
+		float wx = mpos.x - 20.0f;
+		float wy = -mpos.y + window_height - 20.0f;
+
+		if (reach.num_joints() == kine_2d->num_joints() && reach.seed(wx, wy, angles) >= 0.0f)
+			kine_2d->set_angles(angles);
+	}
+
+	if (c == 'm')
+		matching = !matching;
+
+	if (c == 'g' && current_context)
+	{
+		if (physics_context)
+			physics_context = nullptr;
+		else
+			start_ragdoll();
+	}
+
+	if (c == 's' && current_context)
+		scripts.spawn(demo_script(*current_context, three_d));
+
+	if (c == 'p')
+	{
+		playing = !playing;
+		play_tick = tick;
+		fade_start = -1.0f;
+		play_start = std::chrono::steady_clock::now();
+	}
+
+	if ((c == 'u' || c == 'U' || c == 'b') && current_context)
+	{
+		pose_history& history = three_d ? history_3d : history_2d;
+		remember_edit();
+
+		if (c == 'u')
+			history.undo(*current_context);
+		else if (c == 'U')
+			history.redo(*current_context);
+		else
+			history.next_branch(*current_context);
+	}
+
+	if (c == 'c' && !three_d)
+		kine_2d->cycle_curve_mode();
+
 	if (c == 27) exit(0);
 }
 
 void keyboard(int key, int x, int y)
 {
+	if (!capture(INPUT_KEYBOARD, key, x, y)) return;
 	if (!current_context) return;
 
 	switch (key)
 	{
 		case GLUT_KEY_UP:
 			current_context->rotate_joint(ROTATION_ANGLE);
+			edited = true;
 			break;
 
 		case GLUT_KEY_DOWN:
 			current_context->rotate_joint(-ROTATION_ANGLE);
+			edited = true;
 			break;
 
 		case GLUT_KEY_LEFT:
@@ -68,22 +734,49 @@ void keyboard(int key, int x, int y)
 			break;
 	}
 
-	glutPostRedisplay();
+	if (!headless)
+		glutPostRedisplay();
 }
 
 void mouse_click(int button, int state, int x, int y)
 {
+	if (!capture(INPUT_MOUSE, button, state, x, y)) return;
+
 	if (state == GLUT_DOWN && button == GLUT_LEFT_BUTTON)
+	{
 		mouse_down = true;
 
+		// a click on a joint or bone selects it, elsewhere it starts turning the view
+		mpos.x = (float)x;
+		mpos.y = (float)y;
+
+		// side by side, the view under the pointer becomes the current one, as if it was picked from the menu
+		bool right_half = x >= (int)(window_width / 2);
+		if (split_view && right_half != three_d)
+		{
+			select_context(right_half ? (kinecontext*)kine_3d.get() : kine_2d.get());
+			three_d = right_half;
+		}
+
+		if (three_d)
+			current_context->select_joint_at(mpos.x - view_left(), mpos.y);
+		else
+			current_context->select_joint_at(mpos.x - view_left() - 20.0f, -mpos.y + window_height - 20.0f);
+
+		if (!headless)
+			glutPostRedisplay();
+	}
+
 	if (state == GLUT_UP && button == GLUT_LEFT_BUTTON)
 		mouse_down = false;
 }
 
 void mouse_motion(int x, int y)
 {
+	if (!capture(INPUT_MOTION, x, y)) return;
+
 	if (three_d && mouse_down)
-		glRotated(1.0f, y - mpos.y, x - mpos.x, 0.0);
+		current_context->rotate_view(1.0f, y - mpos.y, x - mpos.x, 0.0f);
 
 	mpos.x = (float)x;
 	mpos.y = (float)y;
@@ -91,6 +784,8 @@ void mouse_motion(int x, int y)
 
 void mouse_passive(int x, int y)
 {
+	if (!capture(INPUT_PASSIVE, x, y)) return;
+
 	mpos.x = (float)x;
 	mpos.y = (float)y;
 }
@@ -99,17 +794,18 @@ void mouse_passive(int x, int y)
 
 void make_window(uint w, uint h, kinecontext* const context)
 {
-	if (win_handle != 0) glutDestroyWindow(win_handle);
-
+	// with a depth buffer for the 3D view, so that either view can be shown in it
+	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
 	glutInitWindowSize(w, h);
 	glutInitWindowPosition(200, 200);
 
 	window_width = w;
 	window_height = h;
 	current_context = context;
-	current_context->init(w, h);
 
 	win_handle = glutCreateWindow("spline");
+	current_context->init(w, h);
+	fitted[context == kine_3d.get()] = { w, h };
 
 	// call-backs
 	glutDisplayFunc(display);
@@ -121,28 +817,47 @@ void make_window(uint w, uint h, kinecontext* const context)
 	glutPassiveMotionFunc(mouse_passive);
 
 	// menu
-	void menu_select(int option);
 	glutCreateMenu(menu_select);
 	glutAddMenuEntry("Switch to 2D", MENU_KIN2D);
 	glutAddMenuEntry("Switch to 3D", MENU_KIN3D);
 	glutAddMenuEntry("Add vertex", MENU_ADD_PT);
+	glutAddMenuEntry("Side by side", MENU_SPLIT);
 	glutAttachMenu(GLUT_RIGHT_BUTTON);
 }
 
+// switching views only swaps the context that is drawn and takes the input, the window and its state stay
+void select_context(kinecontext* const context)
+{
+	stop_following();
+	current_context = context;
+	fit_views();
+
+	if (!headless)
+		glutPostRedisplay();
+}
+
 void menu_select(int option)
 {
+	if (!capture(INPUT_MENU, option)) return;
+
 	switch (option)
 	{
 		case MENU_KIN2D:
-			make_window(window_width, window_height, kine_2d.get());
+			select_context(kine_2d.get());
 			three_d = false;
 			break;
 
 		case MENU_KIN3D:
-			make_window(window_width, window_height, kine_3d.get());
+			select_context(kine_3d.get());
 			three_d = true;
 			break;
 
+		case MENU_SPLIT:
+			split_view = !split_view;
+			stop_following();
+			fit_views();
+			break;
+
 		case MENU_ADD_PT:
 			if (!three_d)
 			{
@@ -150,6 +865,13 @@ void menu_select(int option)
 				float x = mpos.x - 20.0f;
 				float y = -mpos.y + window_height - 20.0f;
 				current_context->insert_point(x, y);
+				edited = true;	// kept once the point is attached, when the frame is recorded
+			}
+			else
+			{
+				// onto the bone under the pointer
+				current_context->insert_point(mpos.x - view_left(), mpos.y);
+				edited = true;
 			}
 
 			break;
@@ -158,15 +880,669 @@ void menu_select(int option)
 
 
 
-int main(int argc, char* argv[])
+// renders a sequence of poses to image files with the software rasterizer, without a window or OpenGL
+int render_headless(int argc, char* argv[])
 {
-	glutInit(&argc, argv);
-	initialized = true;
+	std::string directory = argv[2];
+	uint frames = 100;
+	uint width = 320;
+	uint height = 180;
+	uint threads = std::max(1u, std::thread::hardware_concurrency());
+	bool png = false;
+	bool use_3d = false;
+
+	for (int i = 3; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--size") && i + 1 < argc)
+			sscanf(argv[++i], "%ux%u", &width, &height);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			threads = std::max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "--png"))
+			png = true;
+		else if (!strcmp(argv[i], "--3d"))
+			use_3d = true;
+		else if (!strcmp(argv[i], "--curves"))
+			kine_2d->cycle_curve_mode();	// once for Bezier bones, twice for Catmull-Rom
+	}
+
+	kinecontext* context = use_3d ? (kinecontext*)kine_3d.get() : (kinecontext*)kine_2d.get();
+	context->resize(width, height);
+
+	command_buffer buffer;
+	framebuffer fb(width, height);
+	raster_backend backend(threads);
+	render_stats stats;
+
+	uint dof = context->degrees_of_freedom();
+	std::vector<float> angles(context->num_joints() * dof);
+
+	double raster_seconds = 0.0;
+	auto start = std::chrono::steady_clock::now();
+
+	for (uint f = 0; f < frames; ++f)
+	{
+		// every joint swings back and forth with its own phase
+		for (uint i = 0; i < angles.size(); ++i)
+			angles[i] = 45.0f * sinf(2 * PI * f / 60.0f + i * 0.7f);
+		context->set_angles(&angles[0]);
+
+		auto raster_start = std::chrono::steady_clock::now();
+
+		buffer.clear();
+		context->record(buffer);
+		backend.flush(buffer, fb, stats);
+
+		raster_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - raster_start).count();
+
+		char name[32];
+		snprintf(name, sizeof(name), "/frame_%05u.%s", f, png ? "png" : "ppm");
+		std::string path = directory + name;
+
+		if (!(png ? fb.write_png(path) : fb.write_ppm(path)))
+		{
+			std::cerr << "Error: could not write " << path << std::endl;
+			return 1;
+		}
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << frames << " frames of " << width << "x" << height << " with " << threads << " thread(s): "
+		<< frames / seconds << " fps (" << frames / raster_seconds << " fps without writing)" << std::endl;
+
+	return 0;
+}
+
+// replays recorded input as fast as possible without a window, reporting the time spent per frame
+int replay_headless(bool rasterize)
+{
+	headless = true;
+	window_width = 1280;
+	window_height = 720;
+	current_context = kine_2d.get();
+	fit_views();
+
+	command_buffer buffer;
+	framebuffer* fb = nullptr;
+	raster_backend backend(std::max(1u, std::thread::hardware_concurrency()));
+	render_stats stats;
+
+	for (tick = 0; !input.done(); ++tick)
+	{
+		inject_events();
+
+		auto start = std::chrono::steady_clock::now();
+
+		step_systems();
+
+		buffer.clear();
+		current_context->record(buffer);
+
+		if (rasterize)
+		{
+			if (!fb || fb->get_width() != window_width || fb->get_height() != window_height)
+			{
+				delete fb;
+				fb = new framebuffer(window_width, window_height);
+			}
+
+			backend.flush(buffer, *fb, stats);
+		}
+
+		finish_frame();
+
+		timings.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	delete fb;
+
+	timings.report(std::cout, rasterize ? "headless replay (rasterized)" : "headless replay");
+
+	if (!timings_path.empty() && !timings.write_csv(timings_path))
+	{
+		std::cerr << "Error: could not write " << timings_path << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ *	runs the frames of each context without a window, as replay_headless runs them, and fails if the steady state
+ *	allocates
+ *
+ *	every system of a frame is on: the context matches against a database and plays a clip of poses that sweep its
+ *	angles, falls as a ragdoll, runs the demo script, collides its bones, and shares its pose through shared memory
+ *	and a socket where those are available. an arrow key edit every quarter second is kept as a version, whose
+ *	blocks are counted under "history" and not held against the frame.
+ */
+int check_allocations(uint frames, bool rasterize)
+{
+	const uint warmup = 120; // in which buffers grow to their final capacity and the script settles into its wait
+	const uint keys = 60;
+
+	if (!alloc_tracker::available())
+	{
+		std::cerr << "Error: allocations are only counted in a build with ALLOC_CHECK defined (make linux-alloc-check)" << std::endl;
+		return 1;
+	}
+
+	kinecontext* contexts[2] = { kine_2d.get(), kine_3d.get() };
+	const char* tags[2] = { "record 2d", "record 3d" };
+
+	headless = true;
+	replaying = true;	// fixed steps, as a replay takes them
+	window_width = 320;
+	window_height = 180;
+	fit_views();
+
+	command_buffer buffer;
+	framebuffer fb(window_width, window_height);
+	raster_backend backend(std::max(1u, std::thread::hardware_concurrency()));
+	render_stats stats;
+	std::vector<float> sweep;
+
+	// attachments, so that their skinning is part of the steady state
+	kine_2d->insert_point(200, 160);
+	kine_2d->insert_point(300, 260);
+
+	bool shared = exporter.open("/spline-alloc-check");
+	bool streamed = streamer.start("/tmp/spline-alloc-check.sock");
+
+	alloc_tracker::reset();
+	uint history = alloc_tracker::find_tag("history");
+	uint failed_frames = 0;
+
+	for (uint c = 0; c < 2; ++c)
+	{
+		current_context = contexts[c];
+		three_d = c == 1;
+
+		uint count = current_context->num_joints() * current_context->degrees_of_freedom();
+		sweep.resize(keys * count);
+		for (uint k = 0; k < keys; ++k)
+			for (uint i = 0; i < count; ++i)
+				sweep[k * count + i] = 45.0f * sinf(2 * PI * k / keys + i * 0.7f);
+
+		poses.reset(count);
+		poses.add_clip(*current_context, &sweep[0], keys);
+		poses.finish();
+		matching = true;
+
+		clip.reset(count);
+		for (uint k = 0; k < keys; ++k)
+			clip.add_key(k * SPLINE_KEY_INTERVAL, &sweep[k * count]);
+		clip.finish(true);
+		playing = true;
+		play_tick = tick;
+
+		start_ragdoll();
+		scripts.spawn(demo_script(*current_context, three_d));
+		(three_d ? history_3d : history_2d).reset(*current_context);
+
+		for (uint f = 0; f < frames + warmup; ++f, ++tick)
+		{
+			alloc_tracker::enable(f >= warmup);
+			alloc_counters before = alloc_tracker::total();
+			alloc_counters kept = alloc_tracker::counters(history);
+
+			if (f % 15 == 0)
+			{
+				current_context->rotate_joint(ROTATION_ANGLE);
+				edited = true;
+			}
+
+			{
+				alloc_scope scope("systems");
+				step_systems();
+			}
+
+			{
+				alloc_scope scope(tags[c]);
+				buffer.clear();
+				current_context->record(buffer);
+			}
+
+			if (rasterize)
+			{
+				alloc_scope scope("raster");
+				backend.flush(buffer, fb, stats);
+			}
+
+			{
+				alloc_scope scope("finish");
+				finish_frame();
+			}
+
+			alloc_counters after = alloc_tracker::total();
+			unsigned long long allocations = (after.allocations - before.allocations)
+				- (alloc_tracker::counters(history).allocations - kept.allocations);
+
+			if (f >= warmup && allocations > 0)
+			{
+				if (failed_frames == 0)
+					std::cout << "frame " << f << " of the " << (three_d ? "3D" : "2D") << " context allocated "
+						<< allocations << " time(s)" << std::endl;
+				failed_frames++;
+			}
+		}
+
+		alloc_tracker::enable(false);
+		scripts.stop_all();
+		physics_context = nullptr;
+	}
+
+	std::cout << "steady state over " << frames << " frames of each context"
+		<< (shared ? ", exported" : "") << (streamed ? ", streamed" : "") << ":" << std::endl;
+	for (uint t = 0; t < alloc_tracker::tags(); ++t)
+	{
+		alloc_counters c = alloc_tracker::counters(t);
+		std::cout << "  " << alloc_tracker::tag_name(t) << ": " << c.allocations << " allocations, "
+			<< c.bytes << " bytes, " << c.frees << " frees (" << c.freed_bytes << " bytes)" << std::endl;
+	}
+
+	exporter.close();
+	streamer.stop();
+
+	if (failed_frames > 0)
+	{
+		std::cout << "FAILED: " << failed_frames << " of " << 2 * frames << " frames allocated" << std::endl;
+		return 1;
+	}
+
+	std::cout << "OK: no allocations per frame" << std::endl;
+	return 0;
+}
+
+// fills the pose database from a frame file, for whichever context has as many angles per frame as the file
+bool load_pose_db(const std::string& path)
+{
+	kinecontext* contexts[2] = { kine_2d.get(), kine_3d.get() };
+	std::vector<float> frames;
+
+	for (uint c = 0; c < 2; ++c)
+	{
+		uint count = contexts[c]->num_joints() * contexts[c]->degrees_of_freedom();
+		if (!pose_db::load_frames(path, count, frames))
+			continue;
+
+		poses.reset(count);
+		poses.add_clip(*contexts[c], &frames[0], frames.size() / count);
+		poses.finish();
+
+		std::cout << "Pose database: " << poses.size() << " frames of " << count << " angles" << std::endl;
+		return true;
+	}
+
+	return false;
+}
+
+// keys the frames of a frame file as a looping clip, for whichever context has as many angles per frame as the file;
+// streamed clips (see clip_streamer) are opened to be read as they play
+bool load_clip(const std::string& path)
+{
+	kinecontext* contexts[2] = { kine_2d.get(), kine_3d.get() };
+	std::vector<float> frames;
+
+	if (!streamer_clips)
+		streamer_clips.reset(new clip_streamer(STREAM_THREADS));
+
+	int streamed = streamer_clips->open(path);
+	if (streamed >= 0)
+	{
+		streamed_clip = streamed;
+
+		// the first pages are on their way before playback starts
+		streamer_clips->prefetch(streamed_clip, 0.0f);
+		streamer_clips->update();
+
+		std::cout << "Clip: streamed, " << streamer_clips->num_angles(streamed_clip) << " angles, "
+			<< streamer_clips->duration(streamed_clip) << "s, read through " << streamer_clips->backend() << std::endl;
+		return true;
+	}
+
+	streamed_clip = -1;
+
+	for (uint c = 0; c < 2; ++c)
+	{
+		uint count = contexts[c]->num_joints() * contexts[c]->degrees_of_freedom();
+		if (!pose_db::load_frames(path, count, frames))
+			continue;
+
+		uint keys = frames.size() / count;
+
+		clip.reset(count);
+		for (uint k = 0; k < keys; ++k)
+			clip.add_key(k * SPLINE_KEY_INTERVAL, &frames[k * count]);
+		clip.finish(true);
+
+		std::cout << "Clip: " << keys << " keys of " << count << " angles, " << clip.duration() << "s" << std::endl;
+		return true;
+	}
+
+	return false;
+}
+
+// patches a context to its rig file, changing only what differs from the rig it was last patched to
+bool load_rig(uint c)
+{
+	kinecontext* context = c ? (kinecontext*)kine_3d.get() : (kinecontext*)kine_2d.get();
+
+	rig_file next;
+	if (!next.load(rig_paths[c]))
+		return false;
+
+	// the rig changes the pose of the view itself, not the one it follows
+	stop_following();
+
+	auto start = std::chrono::steady_clock::now();
+	rig_changes changes = rigs[c].patch(*context, next);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Rig: " << next.size() << " joints, " << changes.offsets << " moved, " << changes.attachments
+		<< " bones with new points";
+	if (changes.joints)
+		std::cout << ", " << (changes.joints > 0 ? "+" : "") << changes.joints << " joints";
+	std::cout << " in " << ms << " ms" << std::endl;
+
+	if (!changes.any())
+		return true;
+
+	// what was derived from the proportions of the rig
+	mirror_ready[0] = mirror_ready[1] = false;
+
+	if (context == collider_context)
+		collider_context = nullptr;
 
+	// a map of the old chain would seed configurations that end elsewhere; without a file it is sampled again at the
+	// next 'r', with one it is mapped again if it was kept for the new chain
+	if (c == 0 && (changes.offsets || changes.joints))
+	{
+		reach.close();
+		if (!reach_path.empty())
+			prepare_reach_map();
+	}
+
+	if (context == physics_context)
+		start_ragdoll();
+
+	// the new rig is the first version, as older versions would put back the old points
+	(c ? history_3d : history_2d).reset(*context);
+	return true;
+}
+
+// reloads the rig and clip files that changed since the last frame
+void reload_changed()
+{
+	watcher.poll(changed_files);
+
+	for (uint i = 0; i < changed_files.size(); ++i)
+	{
+		int id = changed_files[i];
+
+		for (uint c = 0; c < 2; ++c)
+		{
+			if (id == rig_watches[c])
+				load_rig(c);
+		}
+
+		if (id != clip_watch)
+			continue;
+
+		if (!load_clip(clip_path))
+			std::cerr << "Error: could not read frames from " << clip_path << std::endl;
+		else if (playing && current_context)
+			start_clip_fade();
+	}
+}
+
+// binds the points of a cloud file to the bones of a context, in the pose it starts in
+bool load_cloud(kinecontext* context, const std::string& path, bool half)
+{
+	command_buffer buffer;
+	context->resize(1280, 720);
+	context->record(buffer);
+
+	cloud_loader loader(std::max(1u, std::thread::hardware_concurrency()));
+	if (!loader.load(path, context->current_pose(), context->clouds(), half))
+		return false;
+
+	const cloud_stats& stats = loader.last_stats();
+	std::cout << "Cloud: " << stats.points << " points in " << stats.seconds << "s (" << stats.file_bytes / stats.seconds / 1e6
+		<< " MB/s), " << stats.stored_bytes << " bytes stored";
+	if (stats.skipped)
+		std::cout << ", " << stats.skipped << " lines skipped";
+	std::cout << std::endl;
+
+	return true;
+}
+
+// writes the rig that a context starts with, to edit and load with --rig or --rig-3d
+int save_rig(const std::string& path, bool three_dimensional)
+{
+	kine2d context_2d;
+	kine3d context_3d;
+
+	rig_file rig;
+	rig.capture(three_dimensional ? (kinecontext&)context_3d : (kinecontext&)context_2d);
+
+	if (!rig.save(path))
+	{
+		std::cerr << "Error: could not write " << path << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+// retargets the frames of a frame file from the rig that has as many angles per frame onto the other rig
+int retarget_file(const std::string& in, const std::string& out)
+{
+	kinecontext* contexts[2] = { kine_2d.get(), kine_3d.get() };
+	std::vector<float> frames;
+
+	for (uint c = 0; c < 2; ++c)
+	{
+		uint count = contexts[c]->num_joints() * contexts[c]->degrees_of_freedom();
+		if (!pose_db::load_frames(in, count, frames))
+			continue;
+
+		retargeter mapping;
+		if (!mapping.prepare(*contexts[c], *contexts[1 - c]))
+			return 1;
+
+		uint length = frames.size() / count;
+		std::vector<float> retargeted(length * mapping.target_angles());
+		mapping.retarget(&frames[0], length, &retargeted[0]);
+
+		std::ofstream file(out.c_str());
+		if (!file)
+		{
+			std::cerr << "Error: could not create " << out << std::endl;
+			return 1;
+		}
+
+		for (uint f = 0; f < length; ++f)
+		{
+			for (uint i = 0; i < mapping.target_angles(); ++i)
+				file << (i ? " " : "") << retargeted[f * mapping.target_angles() + i];
+			file << std::endl;
+		}
+
+		const retarget_stats& stats = mapping.last_stats();
+		std::cout << "Retargeted " << length << " frames from " << (c ? "3D" : "2D") << " to " << (c ? "2D" : "3D") << " in "
+			<< stats.seconds << "s, end effector off by " << stats.mean_error << " on average" << std::endl;
+		return 0;
+	}
+
+	std::cerr << "Error: could not read frames from " << in << std::endl;
+	return 1;
+}
+
+// writes the frames of a frame file as a streamed clip, a key interval apart as --play keys them
+int pack_clip(const std::string& in, const std::string& out)
+{
+	kinecontext* contexts[2] = { kine_2d.get(), kine_3d.get() };
+	std::vector<float> frames;
+
+	for (uint c = 0; c < 2; ++c)
+	{
+		uint count = contexts[c]->num_joints() * contexts[c]->degrees_of_freedom();
+		if (!pose_db::load_frames(in, count, frames))
+			continue;
+
+		if (!clip_streamer::write(out, &frames[0], count, frames.size() / count, SPLINE_KEY_INTERVAL))
+		{
+			std::cerr << "Error: could not write " << out << std::endl;
+			return 1;
+		}
+
+		std::cout << "Clip: " << frames.size() / count << " frames of " << count << " angles" << std::endl;
+		return 0;
+	}
+
+	std::cerr << "Error: could not read frames from " << in << std::endl;
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
 	kine_2d.reset(new kine2d());
 	kine_3d.reset(new kine3d());
 
-	win_handle = 0;
+	if (argc > 2 && !strcmp(argv[1], "--render"))
+		return render_headless(argc, argv);
+
+	if (argc > 3 && !strcmp(argv[1], "--retarget"))
+		return retarget_file(argv[2], argv[3]);
+
+	if (argc > 2 && !strcmp(argv[1], "--save-rig"))
+		return save_rig(argv[2], !strcmp(argv[argc - 1], "--3d"));
+
+	if (argc > 3 && !strcmp(argv[1], "--pack-clip"))
+		return pack_clip(argv[2], argv[3]);
+
+	int benchmark = run_benchmark(argc, argv, *kine_2d, *kine_3d);
+	if (benchmark >= 0)
+		return benchmark;
+
+	if (argc > 1 && !strcmp(argv[1], "--alloc-check"))
+	{
+		uint frames = (argc > 2 && argv[2][0] != '-') ? atoi(argv[2]) : 1000;
+		bool rasterize = argc > 2 && !strcmp(argv[argc - 1], "--raster");
+		return check_allocations(frames, rasterize);
+	}
+
+	bool run_headless = false;
+	bool rasterize = false;
+	bool export_attachments = true;
+	std::string export_name;
+	std::string stream_path;
+	std::string pose_db_path;
+	std::string cloud_paths[2];		// for the 2D and the 3D view
+	bool cloud_half = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--record") && i + 1 < argc)
+		{
+			recording = input.open(argv[++i]);
+			if (!recording) std::cerr << "Error: could not open " << argv[i] << std::endl;
+		}
+		else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+		{
+			replaying = input.load(argv[++i]);
+			if (!replaying) std::cerr << "Error: could not read " << argv[i] << std::endl;
+		}
+		else if (!strcmp(argv[i], "--headless"))
+			run_headless = true;
+		else if (!strcmp(argv[i], "--raster"))
+			rasterize = true;
+		else if (!strcmp(argv[i], "--timings") && i + 1 < argc)
+			timings_path = argv[++i];
+		else if (!strcmp(argv[i], "--export") && i + 1 < argc)
+			export_name = argv[++i];
+		else if (!strcmp(argv[i], "--stream") && i + 1 < argc)
+			stream_path = argv[++i];
+		else if (!strcmp(argv[i], "--reach-map") && i + 1 < argc)
+			reach_path = argv[++i];
+		else if (!strcmp(argv[i], "--pose-db") && i + 1 < argc)
+			pose_db_path = argv[++i];
+		else if (!strcmp(argv[i], "--play") && i + 1 < argc)
+			clip_path = argv[++i];
+		else if (!strcmp(argv[i], "--rig") && i + 1 < argc)
+			rig_paths[0] = argv[++i];
+		else if (!strcmp(argv[i], "--rig-3d") && i + 1 < argc)
+			rig_paths[1] = argv[++i];
+		else if (!strcmp(argv[i], "--record-poses") && i + 1 < argc)
+		{
+			pose_log.open(argv[++i]);
+			if (!pose_log) std::cerr << "Error: could not open " << argv[i] << std::endl;
+		}
+		else if (!strcmp(argv[i], "--cloud") && i + 1 < argc)
+			cloud_paths[0] = argv[++i];
+		else if (!strcmp(argv[i], "--cloud-3d") && i + 1 < argc)
+			cloud_paths[1] = argv[++i];
+		else if (!strcmp(argv[i], "--half"))
+			cloud_half = true;
+		else if (!strcmp(argv[i], "--no-attachments"))
+			export_attachments = false;
+	}
+
+	if (!export_name.empty() && !exporter.open(export_name, export_attachments))
+		std::cerr << "Error: could not create shared memory " << export_name << std::endl;
+
+	if (!stream_path.empty() && !streamer.start(stream_path))
+		std::cerr << "Error: could not listen on " << stream_path << std::endl;
+
+	// rigs come first, as everything else is laid onto their joints
+	kinecontext* rig_contexts[2] = { kine_2d.get(), kine_3d.get() };
+	for (uint c = 0; c < 2; ++c)
+	{
+		rigs[c].capture(*rig_contexts[c]);
+
+		if (rig_paths[c].empty())
+			continue;
+
+		load_rig(c);
+
+		if ((rig_watches[c] = watcher.add(rig_paths[c])) < 0)
+			std::cerr << "Error: could not watch " << rig_paths[c] << std::endl;
+	}
+
+	if (!reach_path.empty())
+		prepare_reach_map();
+
+	if (!pose_db_path.empty() && !load_pose_db(pose_db_path))
+		std::cerr << "Error: could not read frames from " << pose_db_path << std::endl;
+
+	if (!clip_path.empty())
+	{
+		if (!load_clip(clip_path))
+			std::cerr << "Error: could not read frames from " << clip_path << std::endl;
+
+		if ((clip_watch = watcher.add(clip_path)) < 0)
+			std::cerr << "Error: could not watch " << clip_path << std::endl;
+	}
+
+	kinecontext* cloud_contexts[2] = { kine_2d.get(), kine_3d.get() };
+	for (uint c = 0; c < 2; ++c)
+	{
+		if (!cloud_paths[c].empty() && !load_cloud(cloud_contexts[c], cloud_paths[c], cloud_half))
+			std::cerr << "Error: could not read points from " << cloud_paths[c] << std::endl;
+	}
+
+	// the starting poses are the first versions, edits follow them
+	history_2d.reset(*kine_2d);
+	history_3d.reset(*kine_3d);
+
+	if (replaying && run_headless)
+		return replay_headless(rasterize);
+
+	glutInit(&argc, argv);
+	initialized = true;
 
 	make_window(1280, 720, kine_2d.get());
 
@@ -0,0 +1,329 @@
+#include "match.h"
+#include "simd.h"
+#include <fstream>
+#include <sstream>
+
+static const uint MAX_ANGLES = 128;
+static const uint MAX_DIMS = MAX_ANGLES * 2 + 3;
+
+// squared distances of the block_size frames of a block to the query
+static void block_distances(const float* block, const float* query, uint dims, float* out)
+{
+	for (uint lane = 0; lane < pose_db::block_size; ++lane)
+		out[lane] = 0.0f;
+
+	for (uint d = 0; d < dims; ++d)
+	{
+		const float* column = block + d * pose_db::block_size;
+
+		for (uint lane = 0; lane < pose_db::block_size; ++lane)
+		{
+			float diff = column[lane] - query[d];
+			out[lane] += diff * diff;
+		}
+	}
+}
+
+// squared distances from the query to the closest points of a batch of boxes
+static void box_distances(const float* boxes, const float* query, uint dims, float* out)
+{
+	for (uint lane = 0; lane < pose_db::block_size; ++lane)
+		out[lane] = 0.0f;
+
+	for (uint d = 0; d < dims; ++d)
+	{
+		const float* lo = boxes + d * pose_db::block_size * 2;
+		const float* hi = lo + pose_db::block_size;
+
+		for (uint lane = 0; lane < pose_db::block_size; ++lane)
+		{
+			float outside = std::max(std::max(lo[lane] - query[d], query[d] - hi[lane]), 0.0f);
+			out[lane] += outside * outside;
+		}
+	}
+}
+
+typedef void (*distance_kernel)(const float* data, const float* query, uint dims, float* out);
+
+#ifdef HAS_AVX2_KERNELS
+// the same with one 8-wide register per batch
+TARGET_AVX2
+static void block_distances_avx2(const float* block, const float* query, uint dims, float* out)
+{
+	__m256 sum = _mm256_setzero_ps();
+
+	for (uint d = 0; d < dims; ++d)
+	{
+		__m256 diff = _mm256_sub_ps(_mm256_loadu_ps(block + d * 8), _mm256_set1_ps(query[d]));
+		sum = _mm256_fmadd_ps(diff, diff, sum);
+	}
+
+	_mm256_storeu_ps(out, sum);
+}
+
+TARGET_AVX2
+static void box_distances_avx2(const float* boxes, const float* query, uint dims, float* out)
+{
+	__m256 sum = _mm256_setzero_ps();
+	__m256 zero = _mm256_setzero_ps();
+
+	for (uint d = 0; d < dims; ++d)
+	{
+		__m256 q = _mm256_set1_ps(query[d]);
+		__m256 below = _mm256_sub_ps(_mm256_loadu_ps(boxes + d * 16), q);
+		__m256 above = _mm256_sub_ps(q, _mm256_loadu_ps(boxes + d * 16 + 8));
+		__m256 outside = _mm256_max_ps(_mm256_max_ps(below, above), zero);
+		sum = _mm256_fmadd_ps(outside, outside, sum);
+	}
+
+	_mm256_storeu_ps(out, sum);
+}
+
+static const bool use_avx2 = pose_db::block_size == 8 && cpu_has_avx2();
+static const distance_kernel compare_block = use_avx2 ? block_distances_avx2 : block_distances;
+static const distance_kernel compare_boxes = use_avx2 ? box_distances_avx2 : box_distances;
+#else
+static const distance_kernel compare_block = block_distances;
+static const distance_kernel compare_boxes = box_distances;
+#endif
+
+pose_db::pose_db() : num_angles(0), dims(0), num_frames(0), pose_weight(1.0f), velocity_weight(0.1f)
+{
+}
+
+void pose_db::reset(uint angles_per_frame, float pose_w, float velocity_w)
+{
+	if (angles_per_frame > MAX_ANGLES)
+	{
+		std::cout << "Warning: frames of more than " << MAX_ANGLES << " angles are cut off" << std::endl;
+		angles_per_frame = MAX_ANGLES;
+	}
+
+	num_angles = angles_per_frame;
+	dims = num_angles * 2 + 3;
+	num_frames = 0;
+	pose_weight = pose_w;
+	velocity_weight = velocity_w;
+
+	angles.clear();
+	next.clear();
+	rows.clear();
+	blocks.clear();
+	block_bounds.clear();
+	group_bounds.clear();
+}
+
+void pose_db::features(const float* frame_angles, const vec3& velocity, float* out) const
+{
+	for (uint i = 0; i < num_angles; ++i)
+	{
+		float a = frame_angles[i] * (PI / 180.0f);
+		out[i * 2 + 0] = sinf(a) * pose_weight;
+		out[i * 2 + 1] = cosf(a) * pose_weight;
+	}
+
+	out[num_angles * 2 + 0] = velocity.x * velocity_weight;
+	out[num_angles * 2 + 1] = velocity.y * velocity_weight;
+	out[num_angles * 2 + 2] = velocity.z * velocity_weight;
+}
+
+void pose_db::add_clip(kinecontext& context, const float* frames, uint count)
+{
+	if (count == 0 || dims == 0) return;
+
+	uint first = num_frames;
+	uint stride = context.num_joints() * context.degrees_of_freedom();
+
+	if (stride != num_angles)
+	{
+		std::cout << "Warning: clip of " << stride << " angles per frame does not fit a database of " << num_angles << std::endl;
+		return;
+	}
+
+	std::vector<vec3> ends(count);
+	for (uint i = 0; i < count; ++i)
+		ends[i] = context.end_effector(frames + i * num_angles);
+
+	angles.insert(angles.end(), frames, frames + count * num_angles);
+	rows.resize((first + count) * dims);
+	next.resize(first + count);
+
+	for (uint i = 0; i < count; ++i)
+	{
+		// the last frame of a clip keeps the velocity of the one before it
+		vec3 velocity(0,0,0);
+		if (count > 1)
+			velocity = (i + 1 < count) ? ends[i + 1] - ends[i] : ends[i] - ends[i - 1];
+
+		features(frames + i * num_angles, velocity, &rows[(first + i) * dims]);
+		next[first + i] = (i + 1 < count) ? first + i + 1 : first + i;
+	}
+
+	num_frames += count;
+}
+
+// grows box lane of a batch of boxes by a feature vector
+static void grow_box(float* boxes, uint lane, const float* row, uint dims)
+{
+	for (uint d = 0; d < dims; ++d)
+	{
+		float* lo = boxes + d * pose_db::block_size * 2;
+		float* hi = lo + pose_db::block_size;
+		lo[lane] = std::min(lo[lane], row[d]);
+		hi[lane] = std::max(hi[lane], row[d]);
+	}
+}
+
+// batches of empty boxes, which are infinitely far from any query
+static void empty_boxes(std::vector<float>& boxes, uint batches, uint dims)
+{
+	boxes.resize(batches * dims * pose_db::block_size * 2);
+
+	for (uint i = 0; i < boxes.size(); i += pose_db::block_size * 2)
+	{
+		std::fill(&boxes[i], &boxes[i] + pose_db::block_size, FLT_MAX);
+		std::fill(&boxes[i] + pose_db::block_size, &boxes[i] + pose_db::block_size * 2, -FLT_MAX);
+	}
+}
+
+void pose_db::finish()
+{
+	uint num_blocks = (num_frames + block_size - 1) / block_size;
+	uint num_groups = (num_blocks + group_size - 1) / group_size;
+	uint batch = dims * block_size * 2;
+
+	blocks.resize(num_blocks * dims * block_size);
+	empty_boxes(block_bounds, num_groups, dims);
+	empty_boxes(group_bounds, (num_groups + block_size - 1) / block_size, dims);
+
+	for (uint b = 0; b < num_blocks; ++b)
+	{
+		uint g = b / group_size;
+		float* block = &blocks[b * dims * block_size];
+
+		for (uint lane = 0; lane < block_size; ++lane)
+		{
+			// the lanes past the last frame repeat it, so they never widen the boxes
+			uint i = std::min(b * block_size + lane, num_frames - 1);
+			const float* row = &rows[i * dims];
+
+			for (uint d = 0; d < dims; ++d)
+				block[d * block_size + lane] = row[d];
+
+			grow_box(&block_bounds[g * batch], b % group_size, row, dims);
+			grow_box(&group_bounds[(g / block_size) * batch], g % block_size, row, dims);
+		}
+	}
+}
+
+match_result pose_db::search(const float* current, const vec3& velocity) const
+{
+	match_result result;
+	result.frame = result.next = 0;
+	result.distance = FLT_MAX;
+	result.frames_tested = 0;
+
+	if (num_frames == 0 || blocks.empty())
+		return result;
+
+	float query[MAX_DIMS];
+	features(current, velocity, query);
+
+	uint num_blocks = (num_frames + block_size - 1) / block_size;
+	uint num_groups = (num_blocks + group_size - 1) / group_size;
+	uint batch = dims * block_size * 2;
+
+	float group_distances[block_size];
+	float block_box_distances[block_size];
+	float distances[block_size];
+
+	for (uint first_group = 0; first_group < num_groups; first_group += block_size)
+	{
+		compare_boxes(&group_bounds[(first_group / block_size) * batch], query, dims, group_distances);
+
+		for (uint g = first_group; g < std::min(first_group + block_size, num_groups); ++g)
+		{
+			if (group_distances[g - first_group] >= result.distance)
+				continue;
+
+			compare_boxes(&block_bounds[g * batch], query, dims, block_box_distances);
+
+			for (uint b = g * group_size; b < std::min((g + 1) * group_size, num_blocks); ++b)
+			{
+				if (block_box_distances[b - g * group_size] >= result.distance)
+					continue;
+
+				compare_block(&blocks[b * dims * block_size], query, dims, distances);
+				result.frames_tested += block_size;
+
+				for (uint lane = 0; lane < block_size; ++lane)
+				{
+					if (distances[lane] < result.distance && b * block_size + lane < num_frames)
+					{
+						result.distance = distances[lane];
+						result.frame = b * block_size + lane;
+					}
+				}
+			}
+		}
+	}
+
+	result.next = next[result.frame];
+	return result;
+}
+
+match_result pose_db::search_exhaustive(const float* current, const vec3& velocity) const
+{
+	match_result result;
+	result.frame = result.next = 0;
+	result.distance = FLT_MAX;
+	result.frames_tested = num_frames;
+
+	float query[MAX_DIMS];
+	features(current, velocity, query);
+
+	for (uint i = 0; i < num_frames; ++i)
+	{
+		const float* row = &rows[i * dims];
+		float sum = 0.0f;
+
+		for (uint d = 0; d < dims; ++d)
+			sum += (row[d] - query[d]) * (row[d] - query[d]);
+
+		if (sum < result.distance)
+		{
+			result.distance = sum;
+			result.frame = i;
+		}
+	}
+
+	if (num_frames > 0)
+		result.next = next[result.frame];
+
+	return result;
+}
+
+bool pose_db::load_frames(const std::string& path, uint angles_per_frame, std::vector<float>& frames)
+{
+	std::ifstream in(path.c_str());
+	if (!in) return false;
+
+	frames.clear();
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		uint start = frames.size();
+		float a;
+
+		while (fields >> a)
+			frames.push_back(a);
+
+		// lines of the wrong length (comments, other rigs) are skipped
+		if (frames.size() - start != angles_per_frame)
+			frames.resize(start);
+	}
+
+	return !frames.empty();
+}
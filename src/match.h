@@ -0,0 +1,67 @@
+#pragma once
+
+#include "structures.h"
+
+// result of a pose_db search
+struct match_result
+{
+	uint frame;				// best matching frame
+	uint next;				// frame that follows it in its clip, the one to play
+	float distance;			// squared feature distance
+	uint frames_tested;		// frames whose features were compared, the rest was pruned by their boxes
+};
+
+/*
+ *	motion-matching database of joint-angle frames
+ *
+ *	every frame has a feature vector: the sine and cosine of each angle (so that angles wrap around) and the velocity
+ *	of the end effector towards the next frame, both scaled by their weight. features are stored in blocks of
+ *	block_size frames, dimension by dimension, so that a block is compared to the query with a few wide loads.
+ *	each block and each group of blocks has a bounding box in feature space, stored the same way; a search skips
+ *	every box that is farther away than the best frame so far, which prunes most of the database because
+ *	neighbouring frames of a clip are close together.
+ */
+class pose_db
+{
+private:
+	uint num_angles;
+	uint dims;						// features per frame
+	uint num_frames;
+	float pose_weight;
+	float velocity_weight;
+
+	std::vector<float> angles;		// num_angles per frame, the output of a search
+	std::vector<uint> next;			// following frame in the same clip (or the frame itself at the end of a clip)
+	std::vector<float> rows;		// features frame by frame, until finish() blocks them
+
+	// boxes are stored like frames: for every dimension the minimum of 8 boxes, then their maximum
+	std::vector<float> blocks;			// dims * block_size per block, dimension-major within the block
+	std::vector<float> block_bounds;	// boxes of the blocks of each group
+	std::vector<float> group_bounds;	// boxes of the groups, 8 groups at a time
+
+private:
+	void features(const float* frame_angles, const vec3& velocity, float* out) const;
+
+public:
+	static const uint block_size = 8;	// frames per block, and boxes per batch (one AVX register wide)
+	static const uint group_size = 8;	// blocks per group
+
+	pose_db();
+
+	void reset(uint angles_per_frame, float pose_weight = 1.0f, float velocity_weight = 0.1f);
+
+	// appends a clip of consecutive frames; the context computes the end effector of each frame
+	void add_clip(kinecontext& context, const float* frames, uint count);
+	void finish();
+
+	uint size() const { return num_frames; }
+	uint angles_per_frame() const { return num_angles; }
+	const float* frame(uint i) const { return &angles[i * num_angles]; }
+
+	// frame closest to the current angles and the desired velocity of the end effector
+	match_result search(const float* current, const vec3& velocity) const;
+	match_result search_exhaustive(const float* current, const vec3& velocity) const;	// reference without pruning
+
+	// text file with one frame per line, angles separated by spaces
+	static bool load_frames(const std::string& path, uint angles_per_frame, std::vector<float>& frames);
+};
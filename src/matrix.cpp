@@ -7,25 +7,29 @@ matrix::matrix() : nrows(0), ncols(0), nil(0.0f)
 
 matrix::matrix(uint nr, uint nc) : nrows(nr), ncols(nc), nil(0.0)
 {
+	if (nrows * ncols > max_size)
+	{
+		std::cout << "Warning: Matrix dimensions exceed " << max_size << " elements" << std::endl;
+		nrows = ncols = 0;
+	}
+
 	reset();
 }
 
 matrix::~matrix(void)
 {
-	m.clear();
 }
 
 void matrix::reset()
 {
-	for (uint i = 0; i < ncols * nrows; ++i)
-	{
-		if (i == m.size()) m.push_back(0.0f);
-		else m.at(i) = 0.0f;
-	}
+	uint size = nrows * ncols;
+
+	for (uint i = 0; i < size; ++i)
+		m[i] = 0.0f;
 
 	// diagonal
-	for (uint i = 0; i < m.size(); i += ncols + 1)
-		m.at(i) = 1.0f;
+	for (uint i = 0; i < size; i += ncols + 1)
+		m[i] = 1.0f;
 }
 
 matrix matrix::product(matrix mat)
@@ -59,8 +63,8 @@ float& matrix::get(uint r, uint c)
 {
 	nil = 0.0f;
 	uint i = ((--r * num_cols()) + c) - 1;
-	if (i >= m.size()) return nil;
-	return m.at(i);
+	if (i >= nrows * ncols) return nil;
+	return m[i];
 }
 
 vec2 matrix::to_vec2()
@@ -81,8 +85,8 @@ float& matrix::operator()(uint iRow, uint iColumn)
 
 void matrix::operator*(float scalar)
 {
-	for (uint i = 0; i < m.size(); ++i)
-		m.at(i) *= scalar;
+	for (uint i = 0; i < nrows * ncols; ++i)
+		m[i] *= scalar;
 }
 
 matrix matrix::operator*(matrix matrix)
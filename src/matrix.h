@@ -5,8 +5,11 @@
 
 class matrix
 {
+public:
+	static const uint max_size = 16; // up to 4x4; fixed storage keeps temporaries off the heap
+
 private:
-	std::vector<float> m;
+	float m[max_size];
 	uint nrows;
 	uint ncols;
 	mutable float nil; // returned in dGet() when requested field doesn't exist
@@ -0,0 +1,367 @@
+#include "pick.h"
+#include <algorithm>
+
+static const uint LEAF_SIZE = 4;
+static const uint MAX_DEPTH = 64;
+
+static float area(const aabb& box)
+{
+	if (box.empty())
+		return 0.0f;
+
+	vec3 d = box.max - box.min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// distance along the ray at which it enters the box, or a negative value when it misses
+static float enter(const aabb& box, const vec3& origin, const vec3& inverse, float limit)
+{
+	float t0 = (box.min.x - origin.x) * inverse.x, t1 = (box.max.x - origin.x) * inverse.x;
+	float near = std::min(t0, t1), far = std::max(t0, t1);
+
+	t0 = (box.min.y - origin.y) * inverse.y; t1 = (box.max.y - origin.y) * inverse.y;
+	near = std::max(near, std::min(t0, t1)); far = std::min(far, std::max(t0, t1));
+
+	t0 = (box.min.z - origin.z) * inverse.z; t1 = (box.max.z - origin.z) * inverse.z;
+	near = std::max(near, std::min(t0, t1)); far = std::min(far, std::max(t0, t1));
+
+	near = std::max(near, 0.0f);
+	return (near <= far && near < limit) ? near : -1.0f;
+}
+
+static float dot(const vec3& u, const vec3& v)
+{
+	return u.x * v.x + u.y * v.y + u.z * v.z;
+}
+
+
+
+bone_bvh::bone_bvh() : built(false), built_area(0.0f)
+{
+	stats = pick_stats();
+}
+
+void bone_bvh::clear()
+{
+	a.clear();
+	b.clear();
+	radii.clear();
+	skeletons.clear();
+	indices.clear();
+	bones.clear();
+	nodes.clear();
+	order.clear();
+	built = false;
+}
+
+uint bone_bvh::add_joint(uint skeleton, uint index, float radius)
+{
+	a.push_back(vec3(0, 0, 0));
+	b.push_back(vec3(0, 0, 0));
+	radii.push_back(radius);
+	skeletons.push_back(skeleton);
+	indices.push_back(index);
+	bones.push_back(false);
+	built = false;
+	return a.size() - 1;
+}
+
+uint bone_bvh::add_bone(uint skeleton, uint index, float radius)
+{
+	uint primitive = add_joint(skeleton, index, radius);
+	bones[primitive] = true;
+	return primitive;
+}
+
+void bone_bvh::set_joint(uint primitive, const vec3& position)
+{
+	a[primitive] = b[primitive] = position;
+}
+
+void bone_bvh::set_bone(uint primitive, const vec3& start, const vec3& end)
+{
+	a[primitive] = start;
+	b[primitive] = end;
+}
+
+aabb bone_bvh::bounds_of(uint primitive) const
+{
+	aabb box;
+	box.grow(a[primitive], radii[primitive]);
+	box.grow(b[primitive], radii[primitive]);
+	return box;
+}
+
+void bone_bvh::build_node(uint index, uint first, uint count)
+{
+	aabb bounds, middle;
+	for (uint i = first; i < first + count; ++i)
+	{
+		bounds.grow(bounds_of(order[i]));
+		middle.grow(centers[order[i]]);
+	}
+
+	nodes[index].bounds = bounds;
+
+	if (count <= LEAF_SIZE)
+	{
+		nodes[index].first = first;
+		nodes[index].count = count;
+		return;
+	}
+
+	// split at the median of the centers along their longest axis
+	vec3 extent = middle.max - middle.min;
+	uint axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+	uint half = count / 2;
+
+	std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+		[&](uint p, uint q)
+		{
+			const vec3& u = centers[p];
+			const vec3& v = centers[q];
+			return axis == 0 ? u.x < v.x : (axis == 1 ? u.y < v.y : u.z < v.z);
+		});
+
+	// children follow each other, so the left child is enough to find both
+	uint left = nodes.size();
+	nodes.resize(left + 2);
+	nodes[index].first = left;
+	nodes[index].count = 0;
+
+	build_node(left, first, half);
+	build_node(left + 1, first + half, count - half);
+}
+
+void bone_bvh::build()
+{
+	nodes.clear();
+	order.resize(a.size());
+	centers.resize(a.size());
+
+	for (uint i = 0; i < a.size(); ++i)
+	{
+		order[i] = i;
+		centers[i] = (a[i] + b[i]) * 0.5f;
+	}
+
+	if (!a.empty())
+	{
+		nodes.resize(1);
+		build_node(0, 0, a.size());
+	}
+
+	built = true;
+	built_area = nodes.empty() ? 0.0f : area(nodes[0].bounds);
+	stats.rebuilds++;
+}
+
+void bone_bvh::refit()
+{
+	if (!built)
+	{
+		build();
+		return;
+	}
+
+	// children come after their parents
+	for (uint n = nodes.size(); n-- > 0; )
+	{
+		node& current = nodes[n];
+		current.bounds = aabb();
+
+		if (current.count > 0)
+		{
+			for (uint i = current.first; i < current.first + current.count; ++i)
+				current.bounds.grow(bounds_of(order[i]));
+		}
+		else
+		{
+			current.bounds.grow(nodes[current.first].bounds);
+			current.bounds.grow(nodes[current.first + 1].bounds);
+		}
+	}
+
+	if (!nodes.empty() && area(nodes[0].bounds) > PICK_REFIT_GROWTH * built_area)
+		build();
+}
+
+bool bone_bvh::intersect(uint primitive, const vec3& origin, const vec3& direction, float& t, float& along) const
+{
+	float r2 = radii[primitive] * radii[primitive];
+	vec3 ba = b[primitive] - a[primitive];
+	vec3 oa = origin - a[primitive];
+
+	float baba = dot(ba, ba);
+	along = 0.0f;
+
+	/*
+	 *	the side of a capsule is the infinite cylinder |(o + t d - a) x ba|^2 = r^2 |ba|^2 within 0 < y < |ba|^2,
+	 *	with y = ba . (o + t d - a). with |d| = 1 that is the quadratic A t^2 + 2 B t + C = 0 of
+	 *
+	 *	A = |ba|^2 - (ba . d)^2,	B = |ba|^2 (d . oa) - (ba . oa)(ba . d),	C = |ba|^2 |oa|^2 - (ba . oa)^2 - r^2 |ba|^2
+	 */
+	if (baba > 0.0f)
+	{
+		float bard = dot(ba, direction);
+		float baoa = dot(ba, oa);
+		float rdoa = dot(direction, oa);
+
+		float A = baba - bard * bard;
+		float B = baba * rdoa - baoa * bard;
+		float C = baba * dot(oa, oa) - baoa * baoa - r2 * baba;
+		float h = B * B - A * C;
+
+		if (h < 0.0f)
+			return false;
+
+		float y = baoa;
+		if (A > 1e-9f)
+		{
+			t = (-B - sqrtf(h)) / A;
+			y = baoa + t * bard;
+
+			if (t >= 0.0f && y > 0.0f && y < baba)
+			{
+				along = y / baba;
+				return true;
+			}
+		}
+
+		// the cap on the side that the cylinder was hit beyond
+		if (y > 0.0f)
+		{
+			oa = origin - b[primitive];
+			along = 1.0f;
+		}
+	}
+
+	// a sphere: t^2 + 2 (d . oa) t + |oa|^2 - r^2 = 0
+	float B = dot(direction, oa);
+	float h = B * B - (dot(oa, oa) - r2);
+
+	if (h < 0.0f)
+		return false;
+
+	t = -B - sqrtf(h);
+	return t >= 0.0f;
+}
+
+bool bone_bvh::raycast(const vec3& origin, const vec3& ray, pick_hit& hit) const
+{
+	stats.nodes = 0;
+	stats.primitives = 0;
+
+	if (nodes.empty())
+		return false;
+
+	float length = sqrtf(dot(ray, ray));
+	if (length <= 0.0f)
+		return false;
+
+	vec3 direction = ray * (1.0f / length);
+	vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	float best = 3.4e38f;
+	uint best_primitive = 0;
+	float best_along = 0.0f;
+
+	uint stack[MAX_DEPTH];
+	float entries[MAX_DEPTH];	// where the ray enters the nodes on the stack
+	uint depth = 0;
+
+	float root = enter(nodes[0].bounds, origin, inverse, best);
+	if (root >= 0.0f)
+	{
+		stack[depth] = 0;
+		entries[depth++] = root;
+	}
+
+	while (depth > 0)
+	{
+		--depth;
+
+		// a closer hit was found since the node was pushed
+		if (entries[depth] >= best)
+			continue;
+
+		const node& current = nodes[stack[depth]];
+		stats.nodes++;
+
+		if (current.count > 0)
+		{
+			for (uint i = current.first; i < current.first + current.count; ++i)
+			{
+				float t, along;
+				stats.primitives++;
+
+				if (intersect(order[i], origin, direction, t, along) && t < best)
+				{
+					best = t;
+					best_primitive = order[i];
+					best_along = along;
+				}
+			}
+
+			continue;
+		}
+
+		// the nearer child goes on top of the stack
+		float left = enter(nodes[current.first].bounds, origin, inverse, best);
+		float right = enter(nodes[current.first + 1].bounds, origin, inverse, best);
+		bool left_first = left >= 0.0f && (right < 0.0f || left <= right);
+
+		if (depth + 2 > MAX_DEPTH)
+			continue;
+
+		if (left_first)
+		{
+			if (right >= 0.0f) { stack[depth] = current.first + 1; entries[depth++] = right; }
+			stack[depth] = current.first; entries[depth++] = left;
+		}
+		else
+		{
+			if (left >= 0.0f) { stack[depth] = current.first; entries[depth++] = left; }
+			if (right >= 0.0f) { stack[depth] = current.first + 1; entries[depth++] = right; }
+		}
+	}
+
+	if (best == 3.4e38f)
+		return false;
+
+	hit.t = best;
+	hit.point = origin + direction * best;
+	hit.skeleton = skeletons[best_primitive];
+	hit.index = indices[best_primitive];
+	hit.bone = bones[best_primitive];
+	hit.along = best_along;
+	return true;
+}
+
+bool bone_bvh::raycast_exhaustive(const vec3& origin, const vec3& ray, pick_hit& hit) const
+{
+	float length = sqrtf(dot(ray, ray));
+	if (length <= 0.0f)
+		return false;
+
+	vec3 direction = ray * (1.0f / length);
+	bool found = false;
+
+	for (uint p = 0; p < a.size(); ++p)
+	{
+		float t, along;
+
+		if (intersect(p, origin, direction, t, along) && (!found || t < hit.t))
+		{
+			found = true;
+			hit.t = t;
+			hit.point = origin + direction * t;
+			hit.skeleton = skeletons[p];
+			hit.index = indices[p];
+			hit.bone = bones[p];
+			hit.along = along;
+		}
+	}
+
+	return found;
+}
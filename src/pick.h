@@ -0,0 +1,84 @@
+#pragma once
+
+#include "structures.h"
+
+// the closest primitive along a ray
+struct pick_hit
+{
+	float t;			// distance from the origin of the ray
+	vec3 point;
+	uint skeleton;
+	uint index;			// of the joint, or of the joint that the bone starts at
+	bool bone;
+	float along;		// on a bone, 0 at its start and 1 at its end
+};
+
+struct pick_stats
+{
+	uint nodes;			// visited by the last ray
+	uint primitives;	// tested by the last ray
+	uint rebuilds;		// since the bounds of the last build were outgrown
+};
+
+/*
+ *	bounding volume hierarchy over joint spheres and bone capsules, for casting rays at skeletons
+ *
+ *	the tree is built once over the primitives as they are, split at the median of the longest axis of the
+ *	centers. when the skeletons move, refit() only recomputes the bounds of the nodes, bottom up, and keeps the
+ *	tree: skeletons move together with their own joints, so the tree stays tight unless they move far relative to
+ *	each other. the tree is rebuilt when the root has grown beyond PICK_REFIT_GROWTH times its area at the build.
+ *	rays visit the nearer child first and skip nodes beyond the closest hit so far.
+ */
+class bone_bvh
+{
+private:
+	struct node
+	{
+		aabb bounds;
+		uint first;		// leaf: first of order, inner: the left child (the right one follows it)
+		uint count;		// primitives of a leaf, 0 for inner nodes
+	};
+
+	// primitives as segments from a to b, spheres have a = b
+	std::vector<vec3> a;
+	std::vector<vec3> b;
+	std::vector<float> radii;
+	std::vector<uint> skeletons;
+	std::vector<uint> indices;
+	std::vector<bool> bones;
+
+	std::vector<node> nodes;
+	std::vector<uint> order;		// primitives by leaf
+	std::vector<vec3> centers;		// used while building
+	bool built;
+	float built_area;				// of the root, when it was built
+
+	mutable pick_stats stats;
+
+private:
+	aabb bounds_of(uint primitive) const;
+	void build_node(uint index, uint first, uint count);
+	bool intersect(uint primitive, const vec3& origin, const vec3& direction, float& t, float& along) const;
+
+public:
+	bone_bvh();
+
+	void clear();
+	uint add_joint(uint skeleton, uint index, float radius);
+	uint add_bone(uint skeleton, uint index, float radius);
+	void set_joint(uint primitive, const vec3& position);
+	void set_bone(uint primitive, const vec3& start, const vec3& end);
+
+	void build();
+
+	// bounds after the primitives moved, building the tree if there is none or it grew too loose
+	void refit();
+
+	bool raycast(const vec3& origin, const vec3& direction, pick_hit& hit) const;
+
+	// tests every primitive, for checking the tree
+	bool raycast_exhaustive(const vec3& origin, const vec3& direction, pick_hit& hit) const;
+
+	uint size() const { return a.size(); }
+	const pick_stats& last_stats() const { return stats; }
+};
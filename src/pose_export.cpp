@@ -0,0 +1,115 @@
+#include "pose_export.h"
+#include <new>
+
+pose_export::pose_export() : header(nullptr), size(0), export_attachments(true)
+{
+}
+
+pose_export::~pose_export()
+{
+	close();
+}
+
+bool pose_export::open(const std::string& shm_name, bool attachments)
+{
+#ifndef _WIN32
+	close();
+
+	size = pose_shm_size(max_joints, max_attachments);
+
+	int fd = shm_open(shm_name.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd < 0) return false;
+
+	if (ftruncate(fd, size) != 0)
+	{
+		::close(fd);
+		shm_unlink(shm_name.c_str());
+		return false;
+	}
+
+	void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (p == MAP_FAILED)
+	{
+		shm_unlink(shm_name.c_str());
+		return false;
+	}
+
+	name = shm_name;
+	export_attachments = attachments;
+
+	header = new (p) pose_shm_header();
+	header->max_joints = max_joints;
+	header->max_attachments = max_attachments;
+	header->sequence.store(0, std::memory_order_relaxed);
+	header->frame = 0;
+	header->dimensions = 0;
+	header->num_joints = 0;
+	header->num_attachments = 0;
+	header->version = POSE_SHM_VERSION;
+
+	// readers identify a complete header by its magic
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = POSE_SHM_MAGIC;
+
+	return true;
+#else
+	(void)shm_name;
+	(void)attachments;
+	return false;
+#endif
+}
+
+void pose_export::close()
+{
+#ifndef _WIN32
+	if (!header) return;
+
+	munmap(header, size);
+	shm_unlink(name.c_str());
+#endif
+	header = nullptr;
+}
+
+void pose_export::publish(const pose3& pose, uint frame, uint dimensions)
+{
+	if (!header) return;
+
+	uint num_joints = std::min((uint)pose.joints.size(), max_joints);
+	uint num_attachments = export_attachments ? std::min((uint)pose.attachments.size(), max_attachments) : 0;
+
+	// seqlock: odd while writing
+	uint32_t seq = header->sequence.load(std::memory_order_relaxed);
+	header->sequence.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	pose_shm_joint* joints = (pose_shm_joint*)(header + 1);
+
+	for (uint i = 0; i < num_joints; ++i)
+	{
+		const joint_pose3& jp = pose.joints[i];
+		joints[i].position[0] = jp.position.x;
+		joints[i].position[1] = jp.position.y;
+		joints[i].position[2] = jp.position.z;
+
+		for (uint k = 0; k < 9; ++k)
+			joints[i].rotation[k] = jp.rotation[k];
+	}
+
+	float* attachments = (float*)(joints + max_joints);
+
+	for (uint i = 0; i < num_attachments; ++i)
+	{
+		attachments[i * 3 + 0] = pose.attachments[i].x;
+		attachments[i * 3 + 1] = pose.attachments[i].y;
+		attachments[i * 3 + 2] = pose.attachments[i].z;
+	}
+
+	header->frame = frame;
+	header->dimensions = dimensions;
+	header->num_joints = num_joints;
+	header->num_attachments = num_attachments;
+
+	header->sequence.store(seq + 2, std::memory_order_release);
+}
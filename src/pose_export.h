@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include "structures.h"
+#include "pose_shm.h"
+
+// publishes the current pose into a POSIX shared-memory region (see pose_shm.h for the layout and a reader)
+class pose_export
+{
+private:
+	std::string name;
+	pose_shm_header* header;
+	size_t size;
+	bool export_attachments;
+
+public:
+	static const uint max_joints = 256;
+	static const uint max_attachments = 65536;
+
+	pose_export();
+	~pose_export();
+
+	bool open(const std::string& shm_name, bool attachments = true);
+	void close();
+
+	void publish(const pose3& pose, uint frame, uint dimensions);
+};
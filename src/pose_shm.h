@@ -0,0 +1,150 @@
+#pragma once
+
+/*
+ *	layout of the shared-memory pose buffer, and a reader for it
+ *
+ *	this header has no dependencies on the rest of the application, so other processes can include it on its own.
+ *	the writer (pose_export) bumps the sequence to an odd number, updates the frame and bumps it to the next
+ *	even number; readers use the data in place and check afterwards that the sequence did not change:
+ *
+ *		pose_reader reader;
+ *		reader.open("/kine_pose");
+ *
+ *		uint32_t seq;
+ *		do
+ *		{
+ *			seq = reader.begin();
+ *			... use reader.joints(), reader.attachment(i) ...
+ *		} while (reader.retry(seq));
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const uint32_t POSE_SHM_MAGIC = 0x454e494b; // "KINE"
+static const uint32_t POSE_SHM_VERSION = 1;
+
+struct pose_shm_joint
+{
+	float position[3];	// world position
+	float rotation[9];	// world orientation (row-major rotation matrix)
+};
+
+struct pose_shm_header
+{
+	uint32_t magic;
+	uint32_t version;				// layout version, readers reject versions they do not know
+	uint32_t max_joints;			// capacity of the arrays that follow the header
+	uint32_t max_attachments;
+
+	std::atomic<uint32_t> sequence;	// odd while the writer is updating the frame
+	uint32_t frame;					// tick of the application
+	uint32_t dimensions;			// 2 or 3
+	uint32_t num_joints;
+	uint32_t num_attachments;
+	uint32_t padding[7];			// keeps the arrays on a 64-byte boundary
+
+	// followed by pose_shm_joint[max_joints] and float[max_attachments][3]
+};
+
+inline size_t pose_shm_size(uint32_t max_joints, uint32_t max_attachments)
+{
+	return sizeof(pose_shm_header) + max_joints * sizeof(pose_shm_joint) + max_attachments * 3 * sizeof(float);
+}
+
+class pose_reader
+{
+private:
+	const pose_shm_header* header;
+	size_t size;
+
+public:
+	pose_reader() : header(nullptr), size(0) {}
+	~pose_reader() { close(); }
+
+	bool open(const char* name)
+	{
+#ifndef _WIN32
+		int fd = shm_open(name, O_RDONLY, 0);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(pose_shm_header))
+		{
+			::close(fd);
+			return false;
+		}
+
+		void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+
+		if (p == MAP_FAILED) return false;
+
+		header = (const pose_shm_header*)p;
+		size = st.st_size;
+
+		// the arrays that the header claims have to be in the mapping, or joints() and attachment() read past it
+		if (header->magic != POSE_SHM_MAGIC || header->version != POSE_SHM_VERSION
+			|| size < pose_shm_size(header->max_joints, header->max_attachments))
+		{
+			close();
+			return false;
+		}
+
+		return true;
+#else
+		(void)name;
+		return false;
+#endif
+	}
+
+	void close()
+	{
+#ifndef _WIN32
+		if (header) munmap((void*)header, size);
+#endif
+		header = nullptr;
+		size = 0;
+	}
+
+	bool is_open() const { return header != nullptr; }
+
+	// waits for the writer to finish the current frame, and returns its sequence number
+	uint32_t begin() const
+	{
+		uint32_t seq;
+		while ((seq = header->sequence.load(std::memory_order_acquire)) & 1)
+			;
+		return seq;
+	}
+
+	// true if the frame was overwritten while it was being read
+	bool retry(uint32_t seq) const
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return header->sequence.load(std::memory_order_relaxed) != seq;
+	}
+
+	uint32_t frame() const { return header->frame; }
+	uint32_t dimensions() const { return header->dimensions; }
+	uint32_t num_joints() const { return header->num_joints; }
+	uint32_t num_attachments() const { return header->num_attachments; }
+
+	const pose_shm_joint* joints() const
+	{
+		return (const pose_shm_joint*)(header + 1);
+	}
+
+	const float* attachment(uint32_t i) const
+	{
+		return (const float*)(joints() + header->max_joints) + i * 3;
+	}
+};
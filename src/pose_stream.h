@@ -0,0 +1,239 @@
+#pragma once
+
+/*
+ *	wire format of the pose stream (see stream_server), and a client for it
+ *
+ *	like pose_shm.h this header stands on its own. the server sends frames, each encoded against the
+ *	last frame the client acknowledged; the client answers every frame it applied with its number, and the
+ *	server sends no other frame until that answer arrived, only the latest one after it:
+ *
+ *		server -> client	stream_frame_header, changed-joint bitmask (padded to 4 bytes), changed joints
+ *		client -> server	uint32_t frame number (STREAM_RESYNC to ask for a full frame)
+ *
+ *	usage:
+ *
+ *		pose_stream_client client;
+ *		client.connect("/tmp/kine.sock");
+ *
+ *		while (...)
+ *			if (client.poll() > 0)
+ *				... use client.joints() ...
+ */
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "pose_shm.h"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+static const uint32_t STREAM_MAGIC = 0x5254534b;		// "KSTR"
+static const uint32_t STREAM_KEYFRAME = 0xffffffffu;	// base of a frame that is not a delta
+static const uint32_t STREAM_RESYNC = 0xffffffffu;		// acknowledgement that asks for a key frame
+static const uint32_t STREAM_MAX_JOINTS = 256;
+static const uint32_t STREAM_HISTORY = 64;				// frames kept to encode deltas against (server) and decode them (client)
+
+struct stream_frame_header
+{
+	uint32_t magic;
+	uint32_t size;			// bytes of the whole message, including this header
+	uint32_t frame;
+	uint32_t base_frame;	// frame the delta applies to, or STREAM_KEYFRAME
+	uint16_t dimensions;
+	uint16_t num_joints;
+	uint16_t num_changed;	// joints that follow the bitmask
+	uint16_t padding;
+};
+
+inline uint32_t stream_mask_size(uint32_t num_joints)
+{
+	return ((num_joints + 31) / 32) * 4;
+}
+
+class pose_stream_client
+{
+private:
+	struct decoded_frame
+	{
+		uint32_t number;
+		uint16_t dimensions;
+		uint16_t num_joints;
+		pose_shm_joint joints[STREAM_MAX_JOINTS];
+	};
+
+	int fd;
+	std::vector<unsigned char> in;
+	std::vector<decoded_frame> history;	// ring of recently applied frames
+	uint32_t current;					// slot of the latest frame
+	bool valid;
+
+private:
+	decoded_frame* find(uint32_t number)
+	{
+		for (uint32_t i = 0; i < history.size(); ++i)
+			if (history[i].number == number)
+				return &history[i];
+		return nullptr;
+	}
+
+	void send_ack(uint32_t number)
+	{
+#ifdef __linux__
+		send(fd, &number, sizeof(number), MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+	}
+
+	// decodes one message, returns false if it could not be applied or does not hold what its header claims
+	bool apply(const unsigned char* msg)
+	{
+		const stream_frame_header* h = (const stream_frame_header*)msg;
+		if (h->magic != STREAM_MAGIC || h->num_joints > STREAM_MAX_JOINTS)
+			return false;
+
+		// the joints that the mask names have to be the ones that follow it, all of them in a key frame, and the
+		// message has to hold them
+		uint32_t mask_size = stream_mask_size(h->num_joints);
+		if (h->size < sizeof(stream_frame_header) + mask_size + h->num_changed * sizeof(pose_shm_joint))
+			return false;
+
+		const uint32_t* mask = (const uint32_t*)(msg + sizeof(stream_frame_header));
+		uint32_t marked = 0;
+		for (uint32_t i = 0; i < h->num_joints; ++i)
+			marked += (mask[i / 32] >> (i % 32)) & 1;
+
+		if (marked != h->num_changed || (h->base_frame == STREAM_KEYFRAME && marked != h->num_joints))
+			return false;
+
+		const decoded_frame* base = nullptr;
+		if (h->base_frame != STREAM_KEYFRAME)
+		{
+			base = find(h->base_frame);
+			if (!base || base->num_joints != h->num_joints)
+				return false;
+		}
+
+		uint32_t slot = valid ? (current + 1) % STREAM_HISTORY : 0;
+		decoded_frame& f = history[slot];
+
+		if (base && base != &f)
+			memcpy(f.joints, base->joints, sizeof(pose_shm_joint) * h->num_joints);
+
+		const pose_shm_joint* changed = (const pose_shm_joint*)(msg + sizeof(stream_frame_header) + mask_size);
+
+		for (uint32_t i = 0, c = 0; i < h->num_joints; ++i)
+			if (!base || (mask[i / 32] >> (i % 32)) & 1)
+				f.joints[i] = changed[c++];
+
+		f.number = h->frame;
+		f.dimensions = h->dimensions;
+		f.num_joints = h->num_joints;
+
+		current = slot;
+		valid = true;
+		return true;
+	}
+
+public:
+	pose_stream_client() : fd(-1), history(STREAM_HISTORY), current(0), valid(false)
+	{
+		for (uint32_t i = 0; i < STREAM_HISTORY; ++i)
+			history[i].number = STREAM_KEYFRAME;
+	}
+
+	~pose_stream_client() { disconnect(); }
+
+	bool connect(const char* path)
+	{
+#ifdef __linux__
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		if (fd < 0) return false;
+
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+		if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			disconnect();
+			return false;
+		}
+
+		return true;
+#else
+		(void)path;
+		return false;
+#endif
+	}
+
+	void disconnect()
+	{
+#ifdef __linux__
+		if (fd >= 0) close(fd);
+#endif
+		fd = -1;
+	}
+
+	bool is_connected() const { return fd >= 0; }
+
+	// reads whatever has arrived without blocking; returns the number of frames applied, or -1 once disconnected
+	int poll()
+	{
+#ifdef __linux__
+		if (fd < 0) return -1;
+
+		unsigned char chunk[16384];
+		ssize_t n;
+
+		while ((n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT)) > 0)
+			in.insert(in.end(), chunk, chunk + n);
+
+		if (n == 0)
+		{
+			disconnect();
+			return -1;
+		}
+
+		int applied = 0;
+		size_t offset = 0;
+
+		while (in.size() - offset >= sizeof(stream_frame_header))
+		{
+			const stream_frame_header* h = (const stream_frame_header*)&in[offset];
+			if (h->magic != STREAM_MAGIC || h->size < sizeof(stream_frame_header))
+			{
+				disconnect();
+				return -1;
+			}
+
+			if (in.size() - offset < h->size)
+				break;
+
+			if (apply(&in[offset]))
+			{
+				send_ack(h->frame);
+				applied++;
+			}
+			else
+			{
+				send_ack(STREAM_RESYNC);
+			}
+
+			offset += h->size;
+		}
+
+		in.erase(in.begin(), in.begin() + offset);
+		return applied;
+#else
+		return -1;
+#endif
+	}
+
+	uint32_t frame() const { return valid ? history[current].number : 0; }
+	uint32_t dimensions() const { return valid ? history[current].dimensions : 0; }
+	uint32_t num_joints() const { return valid ? history[current].num_joints : 0; }
+	const pose_shm_joint* joints() const { return history[current].joints; }
+};
@@ -0,0 +1,30 @@
+#include "quantize.h"
+
+const sine_table SINES;
+
+sine_table::sine_table()
+{
+	// in double precision, so every entry is the float nearest to the sine of its step
+	for (uint i = 0; i < ANGLE_TURN + ANGLE_TURN / 4; ++i)
+		values[i] = (float)sin(i * (3.14159265358979323846 / (180.0 * ANGLE_STEPS)));
+}
+
+void quantized_crowd::resize(uint skeletons, uint angles_per_skeleton)
+{
+	stride = angles_per_skeleton;
+	angles.assign(skeletons * stride, 0);
+}
+
+void quantized_crowd::encode(uint skeleton, const float* in)
+{
+	uint16_t* out = &angles[skeleton * stride];
+	for (uint i = 0; i < stride; ++i)
+		out[i] = quantize_angle(in[i]);
+}
+
+void quantized_crowd::decode(uint skeleton, float* out) const
+{
+	const uint16_t* in = &angles[skeleton * stride];
+	for (uint i = 0; i < stride; ++i)
+		out[i] = dequantize_angle(in[i]);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include "structures.h"
+
+/*
+ *	angles as 16-bit steps of 1 / ANGLE_STEPS degree in [0, ANGLE_TURN), with their sines and cosines in a table
+ *
+ *	the arrow keys turn joints by multiples of ROTATION_ANGLE, which are whole steps, so quantizing the poses they
+ *	make is exact. any other angle is off by at most half a step (0.005 degrees, 8.7e-5 radians). the table holds
+ *	the sine of every step, correctly rounded, followed by a quarter turn more so that the cosine is the sine a
+ *	quarter turn on without wrapping around.
+ */
+struct sine_table
+{
+	float values[ANGLE_TURN + ANGLE_TURN / 4];
+
+	sine_table();
+};
+
+extern const sine_table SINES;
+
+inline uint16_t quantize_angle(float degrees)
+{
+	long step = lrintf(degrees * ANGLE_STEPS) % (long)ANGLE_TURN;
+	return (uint16_t)(step < 0 ? step + ANGLE_TURN : step);
+}
+
+inline float dequantize_angle(uint16_t angle)
+{
+	return angle * (1.0f / ANGLE_STEPS);
+}
+
+inline float table_sin(uint16_t angle)
+{
+	return SINES.values[angle];
+}
+
+inline float table_cos(uint16_t angle)
+{
+	return SINES.values[angle + ANGLE_TURN / 4];
+}
+
+// the angles of many skeletons of one rig, one after the other, skeleton k starting at k times the angles of one
+class quantized_crowd
+{
+private:
+	std::vector<uint16_t> angles;
+	uint stride;	// angles per skeleton
+
+public:
+	quantized_crowd() : stride(0) {}
+
+	void resize(uint skeletons, uint angles_per_skeleton);
+
+	void encode(uint skeleton, const float* in);
+	void decode(uint skeleton, float* out) const;
+
+	const uint16_t* skeleton(uint k) const { return &angles[k * stride]; }
+	uint16_t* skeleton(uint k) { return &angles[k * stride]; }
+
+	uint size() const { return stride ? angles.size() / stride : 0; }
+	size_t bytes() const { return angles.size() * sizeof(uint16_t); }
+};
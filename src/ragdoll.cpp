@@ -0,0 +1,318 @@
+#include "ragdoll.h"
+#include "simd.h"
+#include <thread>
+
+/*
+ *	kernels over the lanes [begin, end) of rows (begin and end are multiples of 8)
+ */
+
+// x' = x + (x - x_prev) damping + g dt^2 for free particles; x_prev' = x
+static void integrate(float* const* x, float* const* prev, const float* w, const float* step, float damping, uint begin, uint end)
+{
+	for (uint i = begin; i < end; ++i)
+	{
+		float moving = w[i] > 0.0f ? 1.0f : 0.0f;
+
+		for (uint c = 0; c < 3; ++c)
+		{
+			float v = (x[c][i] - prev[c][i]) * damping + step[c];
+			prev[c][i] = x[c][i];
+			x[c][i] += moving * v;
+		}
+	}
+}
+
+/*
+ *	moves a and b along their difference until |b - a| = rest, in proportion to their inverse masses:
+ *
+ *	s = (|d| - rest) / (|d| (w_a + w_b)),	a' = a + w_a s d,	b' = b - w_b s d
+ *
+ *	a lower bound only pushes a and b apart
+ */
+static void project(float* const* a, float* const* b, const float* wa, const float* wb, const float* rest,
+	bool lower_bound, uint begin, uint end)
+{
+	for (uint i = begin; i < end; ++i)
+	{
+		float d[3] = { b[0][i] - a[0][i], b[1][i] - a[1][i], b[2][i] - a[2][i] };
+		float length = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+		float error = length - rest[i];
+
+		if (lower_bound)
+			error = std::min(error, 0.0f);
+
+		float denominator = length * (wa[i] + wb[i]);
+		float s = denominator > 1e-9f ? error / denominator : 0.0f;
+
+		for (uint c = 0; c < 3; ++c)
+		{
+			a[c][i] += wa[i] * s * d[c];
+			b[c][i] -= wb[i] * s * d[c];
+		}
+	}
+}
+
+typedef void (*integrate_kernel)(float* const* x, float* const* prev, const float* w, const float* step, float damping, uint begin, uint end);
+typedef void (*project_kernel)(float* const* a, float* const* b, const float* wa, const float* wb, const float* rest,
+	bool lower_bound, uint begin, uint end);
+
+#ifdef HAS_AVX2_KERNELS
+TARGET_AVX2
+static void integrate_avx2(float* const* x, float* const* prev, const float* w, const float* step, float damping, uint begin, uint end)
+{
+	__m256 zero = _mm256_setzero_ps();
+	__m256 vdamping = _mm256_set1_ps(damping);
+
+	for (uint i = begin; i < end; i += 8)
+	{
+		__m256 moving = _mm256_cmp_ps(_mm256_loadu_ps(w + i), zero, _CMP_GT_OQ);
+
+		for (uint c = 0; c < 3; ++c)
+		{
+			__m256 xc = _mm256_loadu_ps(x[c] + i);
+			__m256 v = _mm256_fmadd_ps(_mm256_sub_ps(xc, _mm256_loadu_ps(prev[c] + i)), vdamping, _mm256_set1_ps(step[c]));
+
+			_mm256_storeu_ps(prev[c] + i, xc);
+			_mm256_storeu_ps(x[c] + i, _mm256_add_ps(xc, _mm256_and_ps(moving, v)));
+		}
+	}
+}
+
+TARGET_AVX2
+static void project_avx2(float* const* a, float* const* b, const float* wa, const float* wb, const float* rest,
+	bool lower_bound, uint begin, uint end)
+{
+	__m256 zero = _mm256_setzero_ps();
+	__m256 epsilon = _mm256_set1_ps(1e-9f);
+
+	for (uint i = begin; i < end; i += 8)
+	{
+		__m256 d[3];
+		for (uint c = 0; c < 3; ++c)
+			d[c] = _mm256_sub_ps(_mm256_loadu_ps(b[c] + i), _mm256_loadu_ps(a[c] + i));
+
+		__m256 length = _mm256_sqrt_ps(_mm256_fmadd_ps(d[0], d[0], _mm256_fmadd_ps(d[1], d[1], _mm256_mul_ps(d[2], d[2]))));
+		__m256 error = _mm256_sub_ps(length, _mm256_loadu_ps(rest + i));
+
+		if (lower_bound)
+			error = _mm256_min_ps(error, zero);
+
+		__m256 vwa = _mm256_loadu_ps(wa + i);
+		__m256 vwb = _mm256_loadu_ps(wb + i);
+		__m256 denominator = _mm256_mul_ps(length, _mm256_add_ps(vwa, vwb));
+		__m256 valid = _mm256_cmp_ps(denominator, epsilon, _CMP_GT_OQ);
+		__m256 s = _mm256_and_ps(valid, _mm256_div_ps(error, _mm256_max_ps(denominator, epsilon)));
+
+		__m256 sa = _mm256_mul_ps(vwa, s);
+		__m256 sb = _mm256_mul_ps(vwb, s);
+
+		for (uint c = 0; c < 3; ++c)
+		{
+			_mm256_storeu_ps(a[c] + i, _mm256_fmadd_ps(sa, d[c], _mm256_loadu_ps(a[c] + i)));
+			_mm256_storeu_ps(b[c] + i, _mm256_fnmadd_ps(sb, d[c], _mm256_loadu_ps(b[c] + i)));
+		}
+	}
+}
+
+static const bool use_avx2 = cpu_has_avx2();
+static const integrate_kernel integrate_lanes = use_avx2 ? integrate_avx2 : integrate;
+static const project_kernel project_lanes = use_avx2 ? project_avx2 : project;
+#else
+static const integrate_kernel integrate_lanes = integrate;
+static const project_kernel project_lanes = project;
+#endif
+
+
+
+ragdoll::ragdoll() : chains(0), particles(0), stride(0), gravity(0.0f, 0.0f, 0.0f), damping(0.999f), bend_limit(180.0f)
+{
+}
+
+void ragdoll::reset(uint num_chains, uint num_particles)
+{
+	chains = num_chains;
+	particles = num_particles;
+	stride = (num_chains + 7) & ~7u;
+
+	current.assign(particles * 3 * stride, 0.0f);
+	previous.assign(particles * 3 * stride, 0.0f);
+	inverse_mass.assign(particles * stride, 0.0f);		// padding lanes never move
+	lengths.assign(std::max(particles, 1u) * stride, 0.0f);
+	spans.assign(std::max(particles, 1u) * stride, 0.0f);
+}
+
+void ragdoll::set_bend_limit(float degrees)
+{
+	bend_limit = degrees;
+
+	/*
+	 *	a joint bent by at most b keeps the particles on either side at least
+	 *
+	 *	sqrt(l0^2 + l1^2 + 2 l0 l1 cos(b))
+	 *
+	 *	apart, where l0 and l1 are the lengths of its links
+	 */
+	float c = cosf(std::min(std::max(degrees, 0.0f), 180.0f) * PI / 180.0f);
+
+	for (uint j = 1; j + 1 < particles; ++j)
+	{
+		for (uint i = 0; i < chains; ++i)
+		{
+			float l0 = lengths[(j - 1) * stride + i];
+			float l1 = lengths[j * stride + i];
+			spans[j * stride + i] = sqrtf(std::max(l0 * l0 + l1 * l1 + 2.0f * l0 * l1 * c, 0.0f));
+		}
+	}
+}
+
+void ragdoll::set_chain(uint chain, const vec3* points)
+{
+	for (uint p = 0; p < particles; ++p)
+	{
+		const float position[3] = { points[p].x, points[p].y, points[p].z };
+
+		for (uint c = 0; c < 3; ++c)
+			current[(p * 3 + c) * stride + chain] = previous[(p * 3 + c) * stride + chain] = position[c];
+
+		inverse_mass[p * stride + chain] = 1.0f;
+
+		if (p + 1 < particles)
+		{
+			vec3 d = points[p + 1] - points[p];
+			lengths[p * stride + chain] = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+		}
+	}
+
+	set_bend_limit(bend_limit);
+}
+
+void ragdoll::get_chain(uint chain, vec3* points) const
+{
+	for (uint p = 0; p < particles; ++p)
+	{
+		points[p] = vec3(current[(p * 3 + 0) * stride + chain],
+						 current[(p * 3 + 1) * stride + chain],
+						 current[(p * 3 + 2) * stride + chain]);
+	}
+}
+
+void ragdoll::pin(uint chain, uint particle, const vec3& position)
+{
+	const float at[3] = { position.x, position.y, position.z };
+
+	for (uint c = 0; c < 3; ++c)
+		current[(particle * 3 + c) * stride + chain] = previous[(particle * 3 + c) * stride + chain] = at[c];
+
+	inverse_mass[particle * stride + chain] = 0.0f;
+}
+
+void ragdoll::release(uint chain, uint particle)
+{
+	inverse_mass[particle * stride + chain] = 1.0f;
+}
+
+void ragdoll::advance(uint begin, uint end, float dt, uint ticks, uint iterations)
+{
+	const float step[3] = { gravity.x * dt * dt, gravity.y * dt * dt, gravity.z * dt * dt };
+
+	float* x[3];
+	float* prev[3];
+	float* a[3];
+	float* b[3];
+
+	for (uint t = 0; t < ticks; ++t)
+	{
+		for (uint p = 0; p < particles; ++p)
+		{
+			for (uint c = 0; c < 3; ++c)
+			{
+				x[c] = row(p, c);
+				prev[c] = &previous[(p * 3 + c) * stride];
+			}
+
+			integrate_lanes(x, prev, &inverse_mass[p * stride], step, damping, begin, end);
+		}
+
+		for (uint k = 0; k < iterations; ++k)
+		{
+			// links l and l + 1 share a particle, so even links go first and odd links second
+			for (uint color = 0; color < 2; ++color)
+			{
+				for (uint l = color; l + 1 < particles; l += 2)
+				{
+					for (uint c = 0; c < 3; ++c)
+					{
+						a[c] = row(l, c);
+						b[c] = row(l + 1, c);
+					}
+
+					project_lanes(a, b, &inverse_mass[l * stride], &inverse_mass[(l + 1) * stride],
+						&lengths[l * stride], false, begin, end);
+				}
+			}
+
+			// the bend of joint j spans j - 1 to j + 1, which only meets the spans of j - 2 and j + 2: pairs of
+			// joints alternate between the two colors
+			for (uint color = 0; color < 2; ++color)
+			{
+				for (uint j = 1; j + 1 < particles; ++j)
+				{
+					if (((j - 1) / 2) % 2 != color)
+						continue;
+
+					for (uint c = 0; c < 3; ++c)
+					{
+						a[c] = row(j - 1, c);
+						b[c] = row(j + 1, c);
+					}
+
+					project_lanes(a, b, &inverse_mass[(j - 1) * stride], &inverse_mass[(j + 1) * stride],
+						&spans[j * stride], true, begin, end);
+				}
+			}
+		}
+	}
+}
+
+void ragdoll::step(float dt, uint ticks, uint iterations, uint threads)
+{
+	if (chains == 0 || ticks == 0)
+		return;
+
+	// every thread takes whole blocks of 8 chains
+	uint blocks = stride / 8;
+	threads = std::min(std::max(threads, 1u), blocks);
+
+	if (threads == 1)
+	{
+		advance(0, stride, dt, ticks, iterations);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+
+	for (uint t = 0; t < threads; ++t)
+		workers.push_back(std::thread(&ragdoll::advance, this, blocks * t / threads * 8, blocks * (t + 1) / threads * 8,
+			dt, ticks, iterations));
+
+	for (uint t = 0; t < threads; ++t)
+		workers[t].join();
+}
+
+float ragdoll::stretch(uint chain) const
+{
+	float worst = 0.0f;
+
+	for (uint l = 0; l + 1 < particles; ++l)
+	{
+		float d[3];
+		for (uint c = 0; c < 3; ++c)
+			d[c] = current[((l + 1) * 3 + c) * stride + chain] - current[(l * 3 + c) * stride + chain];
+
+		float rest = lengths[l * stride + chain];
+		if (rest > 0.0f)
+			worst = std::max(worst, fabsf(sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) - rest) / rest);
+	}
+
+	return worst;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "structures.h"
+
+/*
+ *	position-based dynamics of many chains of particles
+ *
+ *	every tick moves the particles by Verlet integration under gravity, then projects the constraints a number of
+ *	times: the distance between neighbours stays the length of their link, and the distance between the particles
+ *	on either side of a joint stays above the span of its bend limit. pinned particles (an inverse mass of 0) stay
+ *	where they are put, which holds the roots and drags whatever the mouse holds.
+ *
+ *	particles are stored particle by particle and axis by axis, each a row with one value per chain (padded to a
+ *	multiple of 8), so a constraint is projected for all chains at once. the constraints of a chain are colored so
+ *	that constraints of one color share no particle. chains are independent, so ticks spread over threads by chains.
+ */
+class ragdoll
+{
+private:
+	uint chains;
+	uint particles;				// per chain
+	uint stride;				// values per row
+
+	std::vector<float> current;		// rows (particle, axis)
+	std::vector<float> previous;
+	std::vector<float> inverse_mass;	// rows per particle
+	std::vector<float> lengths;			// rows per link, between particles l and l + 1
+	std::vector<float> spans;			// rows per joint, least distance between particles j - 1 and j + 1
+
+	vec3 gravity;
+	float damping;				// fraction of the velocity kept per tick
+	float bend_limit;			// degrees a joint may bend away from straight
+
+private:
+	float* row(uint particle, uint axis) { return &current[(particle * 3 + axis) * stride]; }
+	void advance(uint begin, uint end, float dt, uint ticks, uint iterations);
+
+public:
+	ragdoll();
+
+	void reset(uint num_chains, uint num_particles);
+	void set_gravity(const vec3& g) { gravity = g; }
+	void set_damping(float fraction) { damping = fraction; }
+	void set_bend_limit(float degrees);
+
+	// places a chain at rest; the distances between its points become the lengths of its links
+	void set_chain(uint chain, const vec3* points);
+	void get_chain(uint chain, vec3* points) const;
+
+	// holds a particle at a position until released
+	void pin(uint chain, uint particle, const vec3& position);
+	void release(uint chain, uint particle);
+
+	// advances ticks of dt seconds, projecting the constraints iterations times per tick
+	void step(float dt, uint ticks, uint iterations, uint threads = 1);
+
+	uint num_chains() const { return chains; }
+	uint num_particles() const { return particles; }
+
+	// largest relative difference between a link of the chain and its length
+	float stretch(uint chain) const;
+};
@@ -0,0 +1,490 @@
+#include "raster.h"
+#include <fstream>
+
+framebuffer::framebuffer(uint w, uint h) : width(w), height(h), pixels(w * h * 3, 0)
+{
+}
+
+void framebuffer::clear(const float* rgb)
+{
+	unsigned char c[3];
+	for (uint i = 0; i < 3; ++i)
+		c[i] = (unsigned char)(std::max(0.0f, std::min(1.0f, rgb[i])) * 255.0f + 0.5f);
+
+	for (uint i = 0; i < pixels.size(); i += 3)
+	{
+		pixels[i + 0] = c[0];
+		pixels[i + 1] = c[1];
+		pixels[i + 2] = c[2];
+	}
+}
+
+bool framebuffer::write_ppm(const std::string& path) const
+{
+	std::ofstream file(path.c_str(), std::ios::binary);
+	if (!file) return false;
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write((const char*)&pixels[0], pixels.size());
+
+	return file.good();
+}
+
+static unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0)
+{
+	static unsigned int table[256];
+	static bool table_ready = false;
+
+	if (!table_ready)
+	{
+		for (unsigned int n = 0; n < 256; ++n)
+		{
+			unsigned int c = n;
+			for (uint k = 0; k < 8; ++k)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+
+		table_ready = true;
+	}
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static void put_u32(std::vector<unsigned char>& out, unsigned int v)
+{
+	out.push_back((v >> 24) & 0xff);
+	out.push_back((v >> 16) & 0xff);
+	out.push_back((v >> 8) & 0xff);
+	out.push_back(v & 0xff);
+}
+
+static void write_chunk(std::ofstream& file, const char* type, const std::vector<unsigned char>& data)
+{
+	std::vector<unsigned char> chunk;
+	put_u32(chunk, data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	put_u32(chunk, crc32(&chunk[4], chunk.size() - 4));
+
+	file.write((const char*)&chunk[0], chunk.size());
+}
+
+bool framebuffer::write_png(const std::string& path) const
+{
+	/*
+	 *	uncompressed PNG: the image data is a zlib stream of 'stored' deflate blocks,
+	 *	which trades file size for not depending on zlib and not spending time on compression
+	 */
+
+	std::ofstream file(path.c_str(), std::ios::binary);
+	if (!file) return false;
+
+	static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+	file.write((const char*)signature, 8);
+
+	std::vector<unsigned char> header;
+	put_u32(header, width);
+	put_u32(header, height);
+	header.push_back(8);	// bit depth
+	header.push_back(2);	// color type: RGB
+	header.push_back(0);	// compression
+	header.push_back(0);	// filter
+	header.push_back(0);	// no interlacing
+	write_chunk(file, "IHDR", header);
+
+	// scanlines, each prefixed with filter type 0
+	std::vector<unsigned char> raw;
+	raw.reserve(height * (width * 3 + 1));
+	for (uint y = 0; y < height; ++y)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), pixels.begin() + y * width * 3, pixels.begin() + (y + 1) * width * 3);
+	}
+
+	std::vector<unsigned char> data;
+	data.push_back(0x78); // zlib header: deflate, 32K window, no preset dictionary
+	data.push_back(0x01);
+
+	size_t offset = 0;
+	do
+	{
+		size_t size = std::min<size_t>(raw.size() - offset, 65535);
+		bool last = offset + size == raw.size();
+
+		data.push_back(last ? 1 : 0);
+		data.push_back(size & 0xff);
+		data.push_back((size >> 8) & 0xff);
+		data.push_back(~size & 0xff);
+		data.push_back((~size >> 8) & 0xff);
+		data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+
+		offset += size;
+	} while (offset < raw.size());
+
+	unsigned int a = 1, b = 0; // adler-32 of the uncompressed data
+	for (size_t i = 0; i < raw.size(); ++i)
+	{
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	put_u32(data, (b << 16) | a);
+
+	write_chunk(file, "IDAT", data);
+	write_chunk(file, "IEND", std::vector<unsigned char>());
+
+	return file.good();
+}
+
+
+raster_backend::raster_backend(uint threads) : tiles_x(0), tiles_y(0), target(nullptr), next_tile(0), generation(0), busy(0), quit(false)
+{
+	// the calling thread rasterizes as well, so one thread less is started
+	for (uint i = 1; i < threads; ++i)
+		workers.push_back(std::thread(&raster_backend::work, this));
+}
+
+raster_backend::~raster_backend()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+
+	start.notify_all();
+
+	for (uint i = 0; i < workers.size(); ++i)
+		workers[i].join();
+}
+
+void raster_backend::work()
+{
+	uint seen = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start.wait(lock, [&] { return quit || generation != seen; });
+
+			if (quit) return;
+			seen = generation;
+		}
+
+		rasterize_tiles();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0)
+			done.notify_one();
+	}
+}
+
+bool raster_backend::project(const float* c, const vec3& v, float& sx, float& sy, float& w) const
+{
+	float x = c[0] * v.x + c[4] * v.y + c[8] * v.z + c[12];
+	float y = c[1] * v.x + c[5] * v.y + c[9] * v.z + c[13];
+	w = c[3] * v.x + c[7] * v.y + c[11] * v.z + c[15];
+
+	if (w <= 1e-5f) // behind the eye
+		return false;
+
+	sx = (x / w * 0.5f + 0.5f) * target->get_width();
+	sy = (0.5f - y / w * 0.5f) * target->get_height();
+	return true;
+}
+
+void raster_backend::add_triangle(float x0, float y0, float x1, float y1, float x2, float y2, const unsigned char* rgb)
+{
+	primitive p;
+	p.circle = false;
+	p.v[0] = x0; p.v[1] = y0;
+	p.v[2] = x1; p.v[3] = y1;
+	p.v[4] = x2; p.v[5] = y2;
+	p.rgb[0] = rgb[0]; p.rgb[1] = rgb[1]; p.rgb[2] = rgb[2];
+	primitives.push_back(p);
+}
+
+void raster_backend::add_line(float x0, float y0, float x1, float y1, float width, const unsigned char* rgb)
+{
+	float dx = x1 - x0;
+	float dy = y1 - y0;
+	float len = sqrtf(dx * dx + dy * dy);
+	if (len <= 0.0f) return;
+
+	// offset perpendicular to the line by half its width in pixels
+	float h = std::max(width, 1.0f) * 0.5f;
+	float nx = -dy / len * h;
+	float ny = dx / len * h;
+
+	add_triangle(x0 + nx, y0 + ny, x1 + nx, y1 + ny, x1 - nx, y1 - ny, rgb);
+	add_triangle(x0 + nx, y0 + ny, x1 - nx, y1 - ny, x0 - nx, y0 - ny, rgb);
+}
+
+void raster_backend::add_circle(float cx, float cy, float r, const unsigned char* rgb)
+{
+	primitive p;
+	p.circle = true;
+	p.v[0] = cx; p.v[1] = cy; p.v[2] = r;
+	p.rgb[0] = rgb[0]; p.rgb[1] = rgb[1]; p.rgb[2] = rgb[2];
+	primitives.push_back(p);
+}
+
+void raster_backend::flush(command_buffer& buffer, framebuffer& fb, render_stats& stats)
+{
+	target = &fb;
+	fb.clear(buffer.get_background());
+
+	stats.commands = buffer.get_commands().size();
+	buffer.sort(); // same drawing order as gl_backend
+
+	float clip[16];
+	multiply_matrix(clip, buffer.get_projection(), buffer.get_modelview());
+
+	// pixels per world unit at w = 1, for spheres and cones
+	float scale = sqrtf(clip[1] * clip[1] + clip[5] * clip[5] + clip[9] * clip[9]) * fb.get_height() * 0.5f;
+
+	const std::vector<render_command>& commands = buffer.get_commands();
+	const std::vector<vec3>& vertices = buffer.get_vertices();
+
+	primitives.clear();
+
+	for (uint i = 0; i < commands.size(); ++i)
+	{
+		const render_command& c = commands[i];
+		PrimitiveType type = command_buffer::key_type(c.key);
+
+		float color[3];
+		unsigned char rgb[3];
+		color_rgb(command_buffer::key_color(c.key), color);
+		for (uint k = 0; k < 3; ++k)
+			rgb[k] = (unsigned char)(color[k] * 255.0f);
+
+		float x[4], y[4], w[4];
+		bool ok = true;
+		uint n = std::min<uint>(c.count, type == PRIMITIVE_QUADS ? 4 : 2);
+
+		switch (type)
+		{
+		case PRIMITIVE_LINES:
+			for (uint v = 0; v + 1 < c.count; v += 2)
+				if (project(clip, vertices[c.first + v], x[0], y[0], w[0]) && project(clip, vertices[c.first + v + 1], x[1], y[1], w[1]))
+					add_line(x[0], y[0], x[1], y[1], command_buffer::key_width(c.key), rgb);
+		break;
+
+		case PRIMITIVE_TRIANGLES:
+			for (uint v = 0; v + 2 < c.count; v += 3)
+			{
+				ok = true;
+				for (uint k = 0; k < 3; ++k)
+					ok = ok && project(clip, vertices[c.first + v + k], x[k], y[k], w[k]);
+
+				if (ok)
+					add_triangle(x[0], y[0], x[1], y[1], x[2], y[2], rgb);
+			}
+		break;
+
+		case PRIMITIVE_QUADS:
+			for (uint k = 0; k < n; ++k)
+				ok = ok && project(clip, vertices[c.first + k], x[k], y[k], w[k]);
+
+			if (ok && n == 4)
+			{
+				add_triangle(x[0], y[0], x[1], y[1], x[2], y[2], rgb);
+				add_triangle(x[0], y[0], x[2], y[2], x[3], y[3], rgb);
+			}
+		break;
+
+		case PRIMITIVE_SPHERE:
+			// flat shaded, so the silhouette is all there is to draw
+			if (project(clip, vertices[c.first], x[0], y[0], w[0]))
+				add_circle(x[0], y[0], c.size * scale / w[0], rgb);
+		break;
+
+		case PRIMITIVE_CONE:
+			// silhouette approximated by the base disc and the triangle to the tip
+			if (project(clip, vertices[c.first], x[0], y[0], w[0]) && project(clip, vertices[c.first + 1], x[1], y[1], w[1]))
+			{
+				float r = c.size * scale / w[0];
+				float dx = x[1] - x[0];
+				float dy = y[1] - y[0];
+				float len = sqrtf(dx * dx + dy * dy);
+
+				add_circle(x[0], y[0], r, rgb);
+
+				if (len > 0.0f)
+				{
+					float nx = -dy / len * r;
+					float ny = dx / len * r;
+					add_triangle(x[0] + nx, y[0] + ny, x[1], y[1], x[0] - nx, y[0] - ny, rgb);
+				}
+			}
+		break;
+		}
+	}
+
+	// bin the primitives into tiles by their bounding rectangles
+	tiles_x = (fb.get_width() + tile_size - 1) / tile_size;
+	tiles_y = (fb.get_height() + tile_size - 1) / tile_size;
+	uint tiles = tiles_x * tiles_y;
+
+	bin_offsets.assign(tiles + 1, 0);
+
+	for (uint i = 0; i < primitives.size(); ++i)
+	{
+		primitive& p = primitives[i];
+		float min_x, min_y, max_x, max_y;
+
+		if (p.circle)
+		{
+			min_x = p.v[0] - p.v[2]; max_x = p.v[0] + p.v[2];
+			min_y = p.v[1] - p.v[2]; max_y = p.v[1] + p.v[2];
+		}
+		else
+		{
+			min_x = std::min(p.v[0], std::min(p.v[2], p.v[4])); max_x = std::max(p.v[0], std::max(p.v[2], p.v[4]));
+			min_y = std::min(p.v[1], std::min(p.v[3], p.v[5])); max_y = std::max(p.v[1], std::max(p.v[3], p.v[5]));
+		}
+
+		p.on_screen = !(max_x < 0 || max_y < 0 || min_x >= fb.get_width() || min_y >= fb.get_height());
+		if (!p.on_screen)
+			continue;
+
+		p.tx0 = (uint)std::max(0.0f, min_x) / tile_size;
+		p.ty0 = (uint)std::max(0.0f, min_y) / tile_size;
+		p.tx1 = std::min((uint)max_x / tile_size, tiles_x - 1);
+		p.ty1 = std::min((uint)max_y / tile_size, tiles_y - 1);
+
+		for (uint ty = p.ty0; ty <= p.ty1; ++ty)
+			for (uint tx = p.tx0; tx <= p.tx1; ++tx)
+				bin_offsets[ty * tiles_x + tx + 1]++;
+	}
+
+	for (uint t = 0; t < tiles; ++t)
+		bin_offsets[t + 1] += bin_offsets[t];
+
+	bin_cursors.assign(bin_offsets.begin(), bin_offsets.end() - 1);
+	bin_entries.resize(bin_offsets[tiles]);
+
+	for (uint i = 0; i < primitives.size(); ++i)
+	{
+		const primitive& p = primitives[i];
+		if (!p.on_screen) continue;
+
+		for (uint ty = p.ty0; ty <= p.ty1; ++ty)
+			for (uint tx = p.tx0; tx <= p.tx1; ++tx)
+				bin_entries[bin_cursors[ty * tiles_x + tx]++] = i;
+	}
+
+	stats.draw_calls = primitives.size();
+	stats.state_changes = 0;
+
+	// hand the tiles to the workers and help out
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		next_tile = 0;
+		busy = workers.size();
+		++generation;
+	}
+
+	start.notify_all();
+	rasterize_tiles();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return busy == 0; });
+}
+
+void raster_backend::rasterize_tiles()
+{
+	uint count = tiles_x * tiles_y;
+
+	for (uint t = next_tile++; t < count; t = next_tile++)
+	{
+		uint x0 = (t % tiles_x) * tile_size;
+		uint y0 = (t / tiles_x) * tile_size;
+		uint x1 = std::min(x0 + tile_size, target->get_width());
+		uint y1 = std::min(y0 + tile_size, target->get_height());
+
+		for (uint i = bin_offsets[t]; i < bin_offsets[t + 1]; ++i)
+			rasterize(primitives[bin_entries[i]], x0, y0, x1, y1);
+	}
+}
+
+void raster_backend::rasterize(const primitive& p, uint tx0, uint ty0, uint tx1, uint ty1)
+{
+	if (p.circle)
+	{
+		float cx = p.v[0], cy = p.v[1], r = p.v[2];
+
+		uint x0 = (uint)std::max((float)tx0, floorf(cx - r));
+		uint y0 = (uint)std::max((float)ty0, floorf(cy - r));
+		uint x1 = (uint)std::min((float)tx1, ceilf(cx + r));
+		uint y1 = (uint)std::min((float)ty1, ceilf(cy + r));
+
+		for (uint y = y0; y < y1; ++y)
+		{
+			unsigned char* row = target->row(y);
+			float dy = y + 0.5f - cy;
+
+			for (uint x = x0; x < x1; ++x)
+			{
+				float dx = x + 0.5f - cx;
+				if (dx * dx + dy * dy <= r * r)
+				{
+					row[x * 3 + 0] = p.rgb[0];
+					row[x * 3 + 1] = p.rgb[1];
+					row[x * 3 + 2] = p.rgb[2];
+				}
+			}
+		}
+
+		return;
+	}
+
+	const float* v = p.v;
+	float area = (v[2] - v[0]) * (v[5] - v[1]) - (v[3] - v[1]) * (v[4] - v[0]);
+	if (fabsf(area) < 1e-6f) return;
+
+	// make the winding counter-clockwise (in pixel coordinates), so all edge functions are positive inside
+	float ax = v[0], ay = v[1];
+	float bx = area > 0 ? v[2] : v[4], by = area > 0 ? v[3] : v[5];
+	float cx = area > 0 ? v[4] : v[2], cy = area > 0 ? v[5] : v[3];
+
+	uint x0 = (uint)std::max((float)tx0, floorf(std::min(ax, std::min(bx, cx))));
+	uint y0 = (uint)std::max((float)ty0, floorf(std::min(ay, std::min(by, cy))));
+	uint x1 = (uint)std::min((float)tx1, ceilf(std::max(ax, std::max(bx, cx))));
+	uint y1 = (uint)std::min((float)ty1, ceilf(std::max(ay, std::max(by, cy))));
+
+	// edge functions are linear, so they are stepped per pixel instead of evaluated
+	float e0_dx = -(cy - by);
+	float e1_dx = -(ay - cy);
+	float e2_dx = -(by - ay);
+
+	for (uint y = y0; y < y1; ++y)
+	{
+		unsigned char* row = target->row(y);
+		float px = x0 + 0.5f;
+		float py = y + 0.5f;
+
+		float e0 = (cx - bx) * (py - by) - (cy - by) * (px - bx);
+		float e1 = (ax - cx) * (py - cy) - (ay - cy) * (px - cx);
+		float e2 = (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+
+		for (uint x = x0; x < x1; ++x)
+		{
+			if (e0 >= 0 && e1 >= 0 && e2 >= 0)
+			{
+				row[x * 3 + 0] = p.rgb[0];
+				row[x * 3 + 1] = p.rgb[1];
+				row[x * 3 + 2] = p.rgb[2];
+			}
+
+			e0 += e0_dx;
+			e1 += e1_dx;
+			e2 += e2_dx;
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include "render.h"
+
+// 8-bit RGB image in memory, row 0 at the top
+class framebuffer
+{
+private:
+	uint width;
+	uint height;
+	std::vector<unsigned char> pixels;
+
+public:
+	framebuffer(uint w, uint h);
+
+	void clear(const float* rgb);
+
+	inline uint get_width() const { return width; }
+	inline uint get_height() const { return height; }
+	inline unsigned char* row(uint y) { return &pixels[y * width * 3]; }
+
+	bool write_ppm(const std::string& path) const;
+	bool write_png(const std::string& path) const;
+};
+
+// renders command buffers on the CPU, without OpenGL or a window
+class raster_backend
+{
+private:
+	// screen-space primitive, everything is flattened to triangles and circles
+	struct primitive
+	{
+		bool circle;
+		float v[6];					// triangle: x0 y0 x1 y1 x2 y2, circle: cx cy r
+		unsigned char rgb[3];
+		bool on_screen;
+		uint tx0, ty0, tx1, ty1;	// range of tiles covered by the bounding rectangle
+	};
+
+	std::vector<primitive> primitives;
+	std::vector<uint> bin_offsets;		// per tile, range in bin_entries (counting sort, so no per-tile arrays)
+	std::vector<uint> bin_cursors;
+	std::vector<uint> bin_entries;		// primitive indices grouped by tile, in submission order
+	uint tiles_x;
+	uint tiles_y;
+
+	framebuffer* target;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable done;
+	std::atomic<uint> next_tile;
+	uint generation;					// incremented for every frame that the workers pick up
+	uint busy;							// workers that have not finished the current frame
+	bool quit;
+
+private:
+	bool project(const float* clip, const vec3& v, float& sx, float& sy, float& w) const;
+	void add_triangle(float x0, float y0, float x1, float y1, float x2, float y2, const unsigned char* rgb);
+	void add_line(float x0, float y0, float x1, float y1, float width, const unsigned char* rgb);
+	void add_circle(float cx, float cy, float r, const unsigned char* rgb);
+
+	void rasterize_tiles();
+	void rasterize(const primitive& p, uint x0, uint y0, uint x1, uint y1);
+	void work();
+
+public:
+	static const uint tile_size = 32;
+
+	raster_backend(uint threads);
+	~raster_backend();
+
+	void flush(command_buffer& buffer, framebuffer& fb, render_stats& stats);
+};
@@ -0,0 +1,323 @@
+#include "reach.h"
+#include <thread>
+#include <fstream>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+reach_map::reach_map() : header(nullptr), cells(nullptr), mapping(nullptr), mapping_size(0)
+{
+	memset(&built, 0, sizeof(built));
+}
+
+reach_map::~reach_map()
+{
+	close();
+}
+
+// samples [first, last) of the joint space into a private grid
+static void sample_range(const std::vector<vec2>& offsets, uint steps, const reach_header& grid,
+	uint64_t first, uint64_t last, std::vector<reach_cell>& out)
+{
+	uint num_joints = offsets.size();
+	uint free_joints = num_joints - 1;
+	float step = 360.0f / steps;
+
+	float angles[REACH_MAX_JOINTS] = {};
+
+	for (uint64_t s = first; s < last; ++s)
+	{
+		// mixed-radix digits of the sample are the steps of each joint
+		uint64_t rest = s;
+		for (uint n = 0; n < free_joints; ++n)
+		{
+			angles[n] = (rest % steps) * step;
+			rest /= steps;
+		}
+
+		/*
+		 *	P[n] = P[n-1] + S[n-1]T[n], and in the plane S[n-1] is a rotation by the sum of the angles up to n-1
+		 */
+		float x = offsets[0].x;
+		float y = offsets[0].y;
+		float phi = 0.0f;
+
+		for (uint n = 1; n < num_joints; ++n)
+		{
+			phi += angles[n - 1] * (PI / 180.0f);
+			float c = cosf(phi);
+			float si = sinf(phi);
+			x += c * offsets[n].x - si * offsets[n].y;
+			y += si * offsets[n].x + c * offsets[n].y;
+		}
+
+		int cx = (int)((x - grid.origin[0]) / grid.cell_size);
+		int cy = (int)((y - grid.origin[1]) / grid.cell_size);
+		if (cx < 0 || cy < 0 || cx >= (int)grid.resolution || cy >= (int)grid.resolution)
+			continue;
+
+		float dx = x - (grid.origin[0] + (cx + 0.5f) * grid.cell_size);
+		float dy = y - (grid.origin[1] + (cy + 0.5f) * grid.cell_size);
+		float error = sqrtf(dx * dx + dy * dy);
+
+		// the representative is the sample that ends closest to the cell center
+		reach_cell& cell = out[cy * grid.resolution + cx];
+		if (error < cell.error)
+		{
+			cell.error = error;
+			cell.end[0] = x;
+			cell.end[1] = y;
+			memcpy(cell.angles, angles, sizeof(angles));
+		}
+	}
+}
+
+bool reach_map::build(const std::vector<vec2>& offsets, uint64_t samples, uint resolution, uint threads)
+{
+	close();
+
+	uint num_joints = offsets.size();
+	if (num_joints == 0 || num_joints > REACH_MAX_JOINTS || samples == 0 || resolution == 0)
+		return false;
+
+	// the same steps for every free joint, steps^(joints - 1) <= samples, but at least a half turn apart
+	uint free_joints = num_joints - 1;
+	uint steps = free_joints ? std::max(2u, (uint)(pow((double)samples, 1.0 / free_joints) + 1e-6)) : 1;
+
+	std::vector<vec2> chain(offsets);
+
+	float reach = 0.0f;
+	for (uint n = 1; n < num_joints; ++n)
+		reach += sqrtf(chain[n].x * chain[n].x + chain[n].y * chain[n].y);
+
+	// the grid covers the disc of full extension, with a little margin so that it is never empty
+	float extent = reach + 1.0f;
+
+	built.magic = REACH_MAGIC;
+	built.version = REACH_VERSION;
+	built.num_joints = num_joints;
+	built.resolution = resolution;
+	built.origin[0] = chain[0].x - extent;
+	built.origin[1] = chain[0].y - extent;
+	built.cell_size = 2.0f * extent / resolution;
+	built.reached = 0;
+
+	memset(built.offsets, 0, sizeof(built.offsets));
+	for (uint n = 0; n < num_joints; ++n)
+	{
+		built.offsets[n][0] = chain[n].x;
+		built.offsets[n][1] = chain[n].y;
+	}
+
+	reach_cell empty;
+	memset(&empty, 0, sizeof(empty));
+	empty.error = FLT_MAX;
+
+	uint64_t total = 1;
+	for (uint n = 1; n < num_joints; ++n)
+		total *= steps;
+
+	threads = std::max(1u, threads);
+	std::vector<std::vector<reach_cell> > partial(threads, std::vector<reach_cell>(resolution * resolution, empty));
+	std::vector<std::thread> workers;
+
+	for (uint t = 0; t < threads; ++t)
+		workers.push_back(std::thread(sample_range, std::cref(chain), steps, std::cref(built),
+			total * t / threads, total * (t + 1) / threads, std::ref(partial[t])));
+
+	for (uint t = 0; t < threads; ++t)
+		workers[t].join();
+
+	// merge, keeping the best representative of each cell
+	storage.swap(partial[0]);
+
+	for (uint t = 1; t < threads; ++t)
+		for (uint i = 0; i < storage.size(); ++i)
+			if (partial[t][i].error < storage[i].error)
+				storage[i] = partial[t][i];
+
+	for (uint i = 0; i < storage.size(); ++i)
+		if (storage[i].error != FLT_MAX)
+			built.reached++;
+
+	header = &built;
+	cells = &storage[0];
+
+	fill_nearest();
+	return true;
+}
+
+// breadth-first search from all reached cells, so that seeds are a single lookup
+void reach_map::fill_nearest()
+{
+	uint res = built.resolution;
+	std::vector<uint> queue;
+	queue.reserve(storage.size());
+
+	for (uint i = 0; i < storage.size(); ++i)
+	{
+		storage[i].nearest = UINT32_MAX;
+		if (storage[i].error != FLT_MAX)
+		{
+			storage[i].nearest = i;
+			queue.push_back(i);
+		}
+	}
+
+	for (uint head = 0; head < queue.size(); ++head)
+	{
+		uint i = queue[head];
+		uint x = i % res;
+		uint y = i / res;
+
+		uint neighbors[4] = { i - 1, i + 1, i - res, i + res };
+		bool valid[4] = { x > 0, x + 1 < res, y > 0, y + 1 < res };
+
+		for (uint k = 0; k < 4; ++k)
+		{
+			if (!valid[k] || storage[neighbors[k]].nearest != UINT32_MAX)
+				continue;
+
+			storage[neighbors[k]].nearest = storage[i].nearest;
+			queue.push_back(neighbors[k]);
+		}
+	}
+}
+
+bool reach_map::save(const std::string& path) const
+{
+	if (!header) return false;
+
+	std::ofstream file(path.c_str(), std::ios::binary);
+	if (!file) return false;
+
+	uint count = header->resolution * header->resolution;
+	file.write((const char*)header, sizeof(reach_header));
+	file.write((const char*)cells, sizeof(reach_cell) * count);
+	return file.good();
+}
+
+bool reach_map::matches(const std::vector<vec2>& offsets) const
+{
+	if (!header || offsets.size() != header->num_joints)
+		return false;
+
+	for (uint n = 0; n < offsets.size(); ++n)
+	{
+		if (offsets[n].x != header->offsets[n][0] || offsets[n].y != header->offsets[n][1])
+			return false;
+	}
+
+	return true;
+}
+
+bool reach_map::load(const std::string& path, const std::vector<vec2>& offsets)
+{
+	close();
+
+#ifndef _WIN32
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(reach_header))
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) return false;
+
+	const reach_header* h = (const reach_header*)p;
+	size_t expected = sizeof(reach_header) + sizeof(reach_cell) * (size_t)h->resolution * h->resolution;
+
+	if (h->magic != REACH_MAGIC || h->version != REACH_VERSION || (size_t)st.st_size != expected)
+	{
+		munmap(p, st.st_size);
+		return false;
+	}
+
+	mapping = p;
+	mapping_size = st.st_size;
+	header = h;
+	cells = (const reach_cell*)(h + 1);
+#else
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file || !file.read((char*)&built, sizeof(built)) || built.magic != REACH_MAGIC || built.version != REACH_VERSION)
+		return false;
+
+	storage.resize(built.resolution * built.resolution);
+	if (!file.read((char*)&storage[0], sizeof(reach_cell) * storage.size()))
+		return false;
+
+	header = &built;
+	cells = &storage[0];
+#endif
+
+	// a map of another chain would seed configurations that end somewhere else
+	if (!matches(offsets))
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void reach_map::close()
+{
+#ifndef _WIN32
+	if (mapping)
+		munmap(mapping, mapping_size);
+#endif
+
+	mapping = nullptr;
+	mapping_size = 0;
+	header = nullptr;
+	cells = nullptr;
+	storage.clear();
+}
+
+int reach_map::cell_index(float x, float y) const
+{
+	int cx = (int)floorf((x - header->origin[0]) / header->cell_size);
+	int cy = (int)floorf((y - header->origin[1]) / header->cell_size);
+	int res = header->resolution;
+
+	if (cx < 0 || cy < 0 || cx >= res || cy >= res)
+		return -1;
+
+	return cy * res + cx;
+}
+
+bool reach_map::reachable(float x, float y) const
+{
+	if (!header) return false;
+
+	int i = cell_index(x, y);
+	return i >= 0 && cells[i].error != FLT_MAX;
+}
+
+float reach_map::seed(float x, float y, float* angles) const
+{
+	if (!header || header->reached == 0) return -1.0f;
+
+	// targets outside of the grid start from the border cell in their direction
+	float max = header->origin[0] + header->cell_size * header->resolution - 0.001f;
+	float may = header->origin[1] + header->cell_size * header->resolution - 0.001f;
+	int i = cell_index(std::min(std::max(x, header->origin[0]), max), std::min(std::max(y, header->origin[1]), may));
+
+	const reach_cell& cell = cells[cells[i].nearest];
+	memcpy(angles, cell.angles, sizeof(float) * header->num_joints);
+
+	float dx = cell.end[0] - x;
+	float dy = cell.end[1] - y;
+	return sqrtf(dx * dx + dy * dy);
+}
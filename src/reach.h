@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include "structures.h"
+
+static const uint32_t REACH_MAGIC = 0x4843524b; // "KRCH"
+static const uint32_t REACH_VERSION = 2;
+static const uint32_t REACH_MAX_JOINTS = 16;
+static const uint64_t REACH_SAMPLES = 1 << 21;	// configurations per map, 128 steps per joint of the built-in chain
+
+// file header, followed by resolution * resolution cells (row by row, starting at the origin)
+struct reach_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_joints;
+	uint32_t resolution;	// cells along each axis
+	float origin[2];		// world position of the corner of cell 0
+	float cell_size;
+	uint32_t reached;		// cells that at least one sample ended in
+	float offsets[REACH_MAX_JOINTS][2];	// the chain that was sampled, T[n] of the first num_joints joints
+};
+
+struct reach_cell
+{
+	float error;						// distance from the representative end effector to the cell center, FLT_MAX if unreached
+	uint32_t nearest;					// closest reached cell (the cell itself once reached)
+	float end[2];						// end effector of the representative configuration
+	float angles[REACH_MAX_JOINTS];		// representative configuration, degrees
+};
+
+// end-effector positions of a planar chain over its joint space, binned into a grid of representative configurations
+class reach_map
+{
+private:
+	reach_header built;
+	std::vector<reach_cell> storage;	// cells of a map built in memory
+
+	const reach_header* header;			// either &built or the start of the mapped file
+	const reach_cell* cells;
+	void* mapping;
+	size_t mapping_size;
+
+private:
+	int cell_index(float x, float y) const;
+	void fill_nearest();
+
+public:
+	reach_map();
+	~reach_map();
+
+	// samples every joint (except the last, which does not move the end effector) in as many steps as at most
+	// samples configurations allow, spread over threads; offsets are the joint translations T[n] in parent
+	// coordinates, as in kine2d. returns false for chains of more than REACH_MAX_JOINTS joints
+	bool build(const std::vector<vec2>& offsets, uint64_t samples, uint resolution, uint threads);
+
+	bool save(const std::string& path) const;
+	bool load(const std::string& path, const std::vector<vec2>& offsets);	// maps the file read-only, if it was built for the chain
+	void close();
+
+	bool ready() const { return header != nullptr; }
+	bool matches(const std::vector<vec2>& offsets) const;	// built for this chain
+	uint num_joints() const { return header ? header->num_joints : 0; }
+	uint resolution() const { return header ? header->resolution : 0; }
+	uint reached() const { return header ? header->reached : 0; }
+
+	// whether some sampled configuration ends in the cell of (x, y)
+	bool reachable(float x, float y) const;
+
+	// configuration that ends closest to (x, y) as far as the grid knows; returns the distance of its end effector
+	// to the target, or -1 without a map
+	float seed(float x, float y, float* angles) const;
+};
@@ -0,0 +1,391 @@
+#include "render.h"
+
+void color_rgb(ColorType color, float* rgb)
+{
+	static const float colors[NUM_COLORS][3] =
+	{
+		{ 0, 0, 0 },	// COLOR_BLACK
+		{ 1, 1, 1 },	// COLOR_WHITE
+		{ 1, 0, 0 },	// COLOR_RED
+		{ 0, 1, 0 },	// COLOR_GREEN
+		{ 0, 0, 1 },	// COLOR_BLUE
+		{ 1, 0, 1 }		// COLOR_MAGENTA
+	};
+
+	if (color >= NUM_COLORS)
+		color = COLOR_BLACK;
+
+	rgb[0] = colors[color][0];
+	rgb[1] = colors[color][1];
+	rgb[2] = colors[color][2];
+}
+
+void identity_matrix(float* m)
+{
+	for (uint i = 0; i < 16; ++i)
+		m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+void multiply_matrix(float* out, const float* a, const float* b)
+{
+	// out = a * b; element (row r, column c) is stored at [c * 4 + r]
+	float result[16];
+
+	for (uint c = 0; c < 4; ++c)
+	{
+		for (uint r = 0; r < 4; ++r)
+		{
+			float sum = 0.0f;
+			for (uint k = 0; k < 4; ++k)
+				sum += a[k * 4 + r] * b[c * 4 + k];
+			result[c * 4 + r] = sum;
+		}
+	}
+
+	for (uint i = 0; i < 16; ++i)
+		out[i] = result[i];
+}
+
+void ortho_matrix(float* m, float left, float right, float bottom, float top)
+{
+	// gluOrtho2D (near = -1, far = 1)
+	identity_matrix(m);
+	m[0] = 2.0f / (right - left);
+	m[5] = 2.0f / (top - bottom);
+	m[10] = -1.0f;
+	m[12] = -(right + left) / (right - left);
+	m[13] = -(top + bottom) / (top - bottom);
+}
+
+void perspective_matrix(float* m, float fovy, float aspect, float z_near, float z_far)
+{
+	// gluPerspective
+	float f = 1.0f / tanf(fovy * 0.5f * (PI / 180.0f));
+
+	for (uint i = 0; i < 16; ++i)
+		m[i] = 0.0f;
+
+	m[0] = f / aspect;
+	m[5] = f;
+	m[10] = (z_far + z_near) / (z_near - z_far);
+	m[11] = -1.0f;
+	m[14] = (2.0f * z_far * z_near) / (z_near - z_far);
+}
+
+void look_at_matrix(float* m, const vec3& eye, const vec3& center, const vec3& up)
+{
+	// gluLookAt
+	vec3 f(center.x - eye.x, center.y - eye.y, center.z - eye.z);
+	f = f * (1.0f / sqrtf(f.x * f.x + f.y * f.y + f.z * f.z));
+
+	vec3 s(f.y * up.z - f.z * up.y, f.z * up.x - f.x * up.z, f.x * up.y - f.y * up.x); // f x up
+	s = s * (1.0f / sqrtf(s.x * s.x + s.y * s.y + s.z * s.z));
+
+	vec3 u(s.y * f.z - s.z * f.y, s.z * f.x - s.x * f.z, s.x * f.y - s.y * f.x); // s x f
+
+	identity_matrix(m);
+	m[0] = s.x;  m[4] = s.y;  m[8] = s.z;
+	m[1] = u.x;  m[5] = u.y;  m[9] = u.z;
+	m[2] = -f.x; m[6] = -f.y; m[10] = -f.z;
+
+	float t[16];
+	translate_matrix(t, -eye.x, -eye.y, -eye.z);
+	multiply_matrix(m, m, t);
+}
+
+void translate_matrix(float* m, float x, float y, float z)
+{
+	identity_matrix(m);
+	m[12] = x;
+	m[13] = y;
+	m[14] = z;
+}
+
+void rotate_matrix(float* m, float degrees, float x, float y, float z)
+{
+	// glRotatef
+	identity_matrix(m);
+
+	float len = sqrtf(x * x + y * y + z * z);
+	if (len <= 0.0f) return;
+
+	x /= len; y /= len; z /= len;
+
+	float a = degrees * (PI / 180.0f);
+	float c = cosf(a);
+	float s = sinf(a);
+	float t = 1.0f - c;
+
+	m[0] = x * x * t + c;		m[4] = x * y * t - z * s;	m[8] = x * z * t + y * s;
+	m[1] = y * x * t + z * s;	m[5] = y * y * t + c;		m[9] = y * z * t - x * s;
+	m[2] = x * z * t - y * s;	m[6] = y * z * t + x * s;	m[10] = z * z * t + c;
+}
+
+command_buffer::command_buffer() : layer(LAYER_WORLD)
+{
+	identity_matrix(projection);
+	identity_matrix(modelview);
+	set_background(0.0f, 0.0f, 0.0f);
+}
+
+void command_buffer::set_view(const float* projection_matrix, const float* modelview_matrix)
+{
+	for (uint i = 0; i < 16; ++i)
+	{
+		projection[i] = projection_matrix[i];
+		modelview[i] = modelview_matrix[i];
+	}
+}
+
+void command_buffer::set_background(float r, float g, float b)
+{
+	background[0] = r;
+	background[1] = g;
+	background[2] = b;
+}
+
+uint command_buffer::make_key(DrawLayer layer, PrimitiveType type, ColorType color, float width)
+{
+	/*	key layout (most significant first):
+	 *
+	 *		[ layer : 8 ][ type : 8 ][ width * 4 : 8 ][ color : 8 ]
+	 *
+	 *	sorting by key keeps every layer over the ones below it, and groups the commands of a layer by type and
+	 *	then by the state each type depends on
+	 */
+
+	uint w = (uint)(width * 4.0f + 0.5f);
+	if (w > 0xff) w = 0xff;
+
+	return ((uint)layer << 24) | (((uint)type & 0xff) << 16) | (w << 8) | ((uint)color & 0xff);
+}
+
+void command_buffer::clear()
+{
+	// keeps the capacity of both arrays, so steady-state recording does not allocate
+	commands.clear();
+	vertices.clear();
+	layer = LAYER_WORLD;
+}
+
+void command_buffer::push(PrimitiveType type, ColorType color, float width, uint count, float size)
+{
+	render_command c;
+	c.key = make_key(layer, type, color, width);
+	c.first = vertices.size() - count;
+	c.count = count;
+	c.size = size;
+	commands.push_back(c);
+}
+
+void command_buffer::line(const vec3& start, const vec3& end, float width, ColorType color)
+{
+	vertices.push_back(start);
+	vertices.push_back(end);
+	push(PRIMITIVE_LINES, color, width, 2);
+}
+
+void command_buffer::quad(const vec3& a, const vec3& b, const vec3& c, const vec3& d, ColorType color)
+{
+	vertices.push_back(a);
+	vertices.push_back(b);
+	vertices.push_back(c);
+	vertices.push_back(d);
+	push(PRIMITIVE_QUADS, color, 0.0f, 4);
+}
+
+void command_buffer::disc(const vec3& center, float radius, ColorType color)
+{
+	// triangle fan around the center, as separate triangles so that discs can be batched
+	for (uint i = 0; i < CIRCLE_PRECISION; i++)
+	{
+		float a0 = i * 2 * PI / CIRCLE_PRECISION;
+		float a1 = (i + 1) * 2 * PI / CIRCLE_PRECISION;
+
+		vertices.push_back(center);
+		vertices.push_back(vec3(center.x + cosf(a0) * radius, center.y + sinf(a0) * radius, center.z));
+		vertices.push_back(vec3(center.x + cosf(a1) * radius, center.y + sinf(a1) * radius, center.z));
+	}
+
+	push(PRIMITIVE_TRIANGLES, color, 0.0f, CIRCLE_PRECISION * 3);
+}
+
+void command_buffer::sphere(const vec3& center, float radius, ColorType color)
+{
+	vertices.push_back(center);
+	push(PRIMITIVE_SPHERE, color, 0.0f, 1, radius);
+}
+
+void command_buffer::cone(const vec3& base, const vec3& tip, float radius, ColorType color)
+{
+	vertices.push_back(base);
+	vertices.push_back(tip);
+	push(PRIMITIVE_CONE, color, 0.0f, 2, radius);
+}
+
+void command_buffer::sort()
+{
+	// vertices are appended in recording order, so ties on the key are broken by it (std::stable_sort allocates)
+	std::sort(commands.begin(), commands.end(),
+		[](const render_command& a, const render_command& b) { return a.key < b.key || (a.key == b.key && a.first < b.first); });
+}
+
+
+gl_backend::gl_backend() : sphere_list(0), cone_list(0)
+{
+}
+
+void gl_backend::compile_lists()
+{
+	// compiled on the first flush that draws solids; the window and its context live as long as the program
+	if (sphere_list != 0)
+		return;
+
+	sphere_list = glGenLists(2);
+	cone_list = sphere_list + 1;
+
+	glNewList(sphere_list, GL_COMPILE);
+		glutSolidSphere(1.0f, 15, 10);
+	glEndList();
+
+	glNewList(cone_list, GL_COMPILE);
+		glutSolidCone(1, 2, 15, 10);
+	glEndList();
+}
+
+void gl_backend::flush(command_buffer& buffer, render_stats& stats)
+{
+	// the same submission in recording order, counted without drawing, is what sorting saves
+	stats.commands = buffer.get_commands().size();
+	submit(buffer, stats.draw_calls_unsorted, stats.state_changes_unsorted, false);
+
+	buffer.sort();
+	submit(buffer, stats.draw_calls, stats.state_changes, true);
+}
+
+void gl_backend::submit(const command_buffer& buffer, uint& draw_calls, uint& state_changes, bool issue)
+{
+	draw_calls = 0;
+	state_changes = 0;
+
+	const std::vector<render_command>& commands = buffer.get_commands();
+	const std::vector<vec3>& vertices = buffer.get_vertices();
+
+	bool has_solids = false;
+	for (uint i = 0; i < commands.size() && !has_solids; ++i)
+	{
+		PrimitiveType type = command_buffer::key_type(commands[i].key);
+		has_solids = (type == PRIMITIVE_SPHERE || type == PRIMITIVE_CONE);
+	}
+
+	if (has_solids && issue)
+		compile_lists();
+
+	int color = -1;
+	float width = -1.0f;
+
+	for (uint i = 0; i < commands.size(); )
+	{
+		uint key = commands[i].key;
+		PrimitiveType type = command_buffer::key_type(key);
+
+		// run of commands that share the same state
+		uint end = i + 1;
+		while (end < commands.size() && commands[end].key == key)
+			++end;
+
+		if ((int)command_buffer::key_color(key) != color)
+		{
+			color = command_buffer::key_color(key);
+			state_changes++;
+
+			if (issue)
+			{
+				float rgb[3];
+				color_rgb((ColorType)color, rgb);
+				glColor3fv(rgb);
+			}
+		}
+
+		if (type == PRIMITIVE_LINES && command_buffer::key_width(key) != width)
+		{
+			width = command_buffer::key_width(key);
+			state_changes++;
+
+			if (issue)
+				glLineWidth(width);
+		}
+
+		switch (type)
+		{
+		case PRIMITIVE_LINES:
+		case PRIMITIVE_QUADS:
+		case PRIMITIVE_TRIANGLES:
+		{
+			draw_calls++;
+			if (!issue)
+				break;
+
+			GLenum mode = (type == PRIMITIVE_LINES) ? GL_LINES : (type == PRIMITIVE_QUADS) ? GL_QUADS : GL_TRIANGLES;
+
+			glBegin(mode);
+			for (uint c = i; c < end; ++c)
+				for (uint v = 0; v < commands[c].count; ++v)
+					glVertex3f(vertices[commands[c].first + v].x, vertices[commands[c].first + v].y, vertices[commands[c].first + v].z);
+			glEnd();
+		}
+		break;
+
+		case PRIMITIVE_SPHERE:
+			for (uint c = i; c < end; ++c)
+			{
+				draw_calls++;
+				if (!issue)
+					continue;
+
+				const vec3& p = vertices[commands[c].first];
+				float r = commands[c].size;
+
+				glPushMatrix();
+				glTranslatef(p.x, p.y, p.z);
+				glScalef(r, r, r);
+				glCallList(sphere_list);
+				glPopMatrix();
+			}
+		break;
+
+		case PRIMITIVE_CONE:
+			for (uint c = i; c < end; ++c)
+			{
+				const vec3& base = vertices[commands[c].first];
+				const vec3& tip = vertices[commands[c].first + 1];
+				float r = commands[c].size;
+
+				// the unit cone points along +z with height 2; rotate it onto the base-tip direction
+				vec3 d(tip.x - base.x, tip.y - base.y, tip.z - base.z);
+				float len = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+				if (len <= 0.0f) continue;
+
+				draw_calls++;
+				if (!issue)
+					continue;
+
+				d = d * (1.0f / len);
+				float angle = acosf(std::max(-1.0f, std::min(1.0f, d.z))) * 180.0f / PI;
+
+				glPushMatrix();
+				glTranslatef(base.x, base.y, base.z);
+				if (fabsf(d.x) > 1e-6f || fabsf(d.y) > 1e-6f)
+					glRotatef(angle, -d.y, d.x, 0.0f); // axis = z x d
+				else if (d.z < 0.0f)
+					glRotatef(180.0f, 1.0f, 0.0f, 0.0f);
+				glScalef(r, r, len / 2.0f);
+				glCallList(cone_list);
+				glPopMatrix();
+			}
+		break;
+		}
+
+		i = end;
+	}
+}
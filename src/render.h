@@ -0,0 +1,97 @@
+#pragma once
+
+#include "structures.h"
+
+// a single recorded primitive (or a run of them, once batched)
+struct render_command
+{
+	uint key;		// sort key: layer, primitive type, line width and color (see make_key)
+	uint first;		// first vertex in command_buffer::vertices
+	uint count;		// number of vertices
+	float size;		// radius of spheres and cones
+};
+
+// draw calls and state changes (color and line width) of a frame
+struct render_stats
+{
+	uint commands;
+
+	uint draw_calls_unsorted;		// as the backend would submit the commands in recording order
+	uint state_changes_unsorted;
+	uint draw_calls;				// as the backend submitted them after sorting
+	uint state_changes;
+
+	render_stats() : commands(0), draw_calls_unsorted(0), state_changes_unsorted(0), draw_calls(0), state_changes(0) {}
+};
+
+// list of primitives recorded by a context, which a backend submits to OpenGL or rasterizes
+class command_buffer
+{
+private:
+	std::vector<render_command> commands;
+	std::vector<vec3> vertices;
+	DrawLayer layer;		// of the commands recorded next
+
+	float projection[16];	// camera of the recorded frame, for backends that do their own transformation
+	float modelview[16];
+	float background[3];
+
+private:
+	void push(PrimitiveType type, ColorType color, float width, uint count, float size = 0.0f);
+
+public:
+	static uint make_key(DrawLayer layer, PrimitiveType type, ColorType color, float width);
+	static DrawLayer key_layer(uint key) { return (DrawLayer)(key >> 24); }
+	static PrimitiveType key_type(uint key) { return (PrimitiveType)((key >> 16) & 0xff); }
+	static float key_width(uint key) { return ((key >> 8) & 0xff) / 4.0f; }
+	static ColorType key_color(uint key) { return (ColorType)(key & 0xff); }
+
+	command_buffer();
+
+	void clear();
+	void set_view(const float* projection_matrix, const float* modelview_matrix);
+	void set_background(float r, float g, float b);
+	void set_layer(DrawLayer draw_layer) { layer = draw_layer; }
+
+	void line(const vec3& start, const vec3& end, float width, ColorType color);
+	void quad(const vec3& a, const vec3& b, const vec3& c, const vec3& d, ColorType color);
+	void disc(const vec3& center, float radius, ColorType color);
+	void sphere(const vec3& center, float radius, ColorType color);
+	void cone(const vec3& base, const vec3& tip, float radius, ColorType color);
+
+	void sort();
+
+	const std::vector<render_command>& get_commands() const { return commands; }
+	const std::vector<vec3>& get_vertices() const { return vertices; }
+	const float* get_projection() const { return projection; }
+	const float* get_modelview() const { return modelview; }
+	const float* get_background() const { return background; }
+};
+
+// submits command buffers to OpenGL, batching runs of commands that share their state
+class gl_backend
+{
+private:
+	uint sphere_list;	// display lists of the unit sphere and cone
+	uint cone_list;
+
+private:
+	void compile_lists();
+	void submit(const command_buffer& buffer, uint& draw_calls, uint& state_changes, bool issue);
+
+public:
+	gl_backend();
+
+	void flush(command_buffer& buffer, render_stats& stats);
+};
+
+void color_rgb(ColorType color, float* rgb);
+
+// column-major 4x4 matrices, laid out as OpenGL expects them
+void identity_matrix(float* m);
+void multiply_matrix(float* out, const float* a, const float* b);
+void ortho_matrix(float* m, float left, float right, float bottom, float top);
+void perspective_matrix(float* m, float fovy, float aspect, float z_near, float z_far);
+void look_at_matrix(float* m, const vec3& eye, const vec3& center, const vec3& up);
+void translate_matrix(float* m, float x, float y, float z);
+void rotate_matrix(float* m, float degrees, float x, float y, float z);
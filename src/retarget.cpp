@@ -0,0 +1,520 @@
+#include "retarget.h"
+#include "quantize.h"
+#include "simd.h"
+#include <chrono>
+
+static const uint LANES = retargeter::LANES;
+
+/*
+ *	forward kinematics of the source for a block of frames: rows holds the angles of the block, a row of LANES per
+ *	angle, and out gets the joint positions, rows x y z of LANES per joint. as in joint_positions_quantized(),
+ *
+ *	P[n] = P[n-1] + S[n-1] T[n],	S[n] = S[n-1] R[n]
+ *
+ *	with the sines and cosines of the angles from the table
+ */
+typedef void (*chain_kernel)(const float* rows, const float* offsets, uint joints, float* out);
+
+static void chain_2d(const float* rows, const float* offsets, uint joints, float* out)
+{
+	for (uint l = 0; l < LANES; ++l)
+	{
+		// rotations in the plane add up
+		float x = 0.0f, y = 0.0f, total = 0.0f;
+
+		for (uint n = 0; n < joints; ++n)
+		{
+			uint16_t q = quantize_angle(total);
+			float c = table_cos(q), s = table_sin(q);
+			const float* t = offsets + n * 3;
+
+			x += c * t[0] - s * t[1];
+			y += s * t[0] + c * t[1];
+
+			out[(n * 3) * LANES + l] = x;
+			out[(n * 3 + 1) * LANES + l] = y;
+			out[(n * 3 + 2) * LANES + l] = 0.0f;
+
+			total += rows[n * LANES + l];
+		}
+	}
+}
+
+static void chain_3d(const float* rows, const float* offsets, uint joints, float* out)
+{
+	for (uint l = 0; l < LANES; ++l)
+	{
+		float S[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+		float P[3] = { 0, 0, 0 };
+
+		for (uint n = 0; n < joints; ++n)
+		{
+			const float* t = offsets + n * 3;
+			for (uint r = 0; r < 3; ++r)
+			{
+				P[r] += S[r * 3] * t[0] + S[r * 3 + 1] * t[1] + S[r * 3 + 2] * t[2];
+				out[(n * 3 + r) * LANES + l] = P[r];
+			}
+
+			uint16_t qx = quantize_angle(rows[(n * 3) * LANES + l]);
+			uint16_t qy = quantize_angle(rows[(n * 3 + 1) * LANES + l]);
+			uint16_t qz = quantize_angle(rows[(n * 3 + 2) * LANES + l]);
+			float sx = table_sin(qx), cx = table_cos(qx);
+			float sy = table_sin(qy), cy = table_cos(qy);
+			float sz = table_sin(qz), cz = table_cos(qz);
+
+			// Rx Ry Rz, see kine3d::joint_positions_quantized
+			float R[9] = { cy * cz, -cy * sz, sy,
+						   cx * sz + sx * sy * cz, cx * cz - sx * sy * sz, -sx * cy,
+						   sx * sz - cx * sy * cz, sx * cz + cx * sy * sz, cx * cy };
+
+			float next[9];
+			for (uint r = 0; r < 3; ++r)
+				for (uint c = 0; c < 3; ++c)
+					next[r * 3 + c] = S[r * 3] * R[c] + S[r * 3 + 1] * R[3 + c] + S[r * 3 + 2] * R[6 + c];
+
+			std::copy(next, next + 9, S);
+		}
+	}
+}
+
+#ifdef HAS_AVX2_KERNELS
+// the steps of quantize_angle(), as indices into the table
+TARGET_AVX2
+static inline __m256i steps(__m256 degrees)
+{
+	const __m256 turn = _mm256_set1_ps((float)ANGLE_TURN);
+	__m256 q = _mm256_round_ps(_mm256_mul_ps(degrees, _mm256_set1_ps((float)ANGLE_STEPS)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	q = _mm256_fnmadd_ps(_mm256_floor_ps(_mm256_mul_ps(q, _mm256_set1_ps(1.0f / ANGLE_TURN))), turn, q);
+
+	// the division may round across a whole turn
+	__m256i i = _mm256_cvtps_epi32(q);
+	__m256i whole = _mm256_set1_epi32(ANGLE_TURN);
+	i = _mm256_sub_epi32(i, _mm256_and_si256(_mm256_cmpgt_epi32(i, _mm256_set1_epi32(ANGLE_TURN - 1)), whole));
+	i = _mm256_add_epi32(i, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), i), whole));
+	return i;
+}
+
+TARGET_AVX2
+static inline void sine_cosine(__m256 degrees, __m256& s, __m256& c)
+{
+	__m256i i = steps(degrees);
+	s = _mm256_i32gather_ps(SINES.values, i, 4);
+	c = _mm256_i32gather_ps(SINES.values, _mm256_add_epi32(i, _mm256_set1_epi32(ANGLE_TURN / 4)), 4);
+}
+
+TARGET_AVX2
+static void chain_2d_avx2(const float* rows, const float* offsets, uint joints, float* out)
+{
+	__m256 x = _mm256_setzero_ps(), y = _mm256_setzero_ps(), total = _mm256_setzero_ps();
+
+	for (uint n = 0; n < joints; ++n)
+	{
+		__m256 s, c;
+		sine_cosine(total, s, c);
+
+		__m256 tx = _mm256_set1_ps(offsets[n * 3]), ty = _mm256_set1_ps(offsets[n * 3 + 1]);
+		x = _mm256_add_ps(x, _mm256_fmsub_ps(c, tx, _mm256_mul_ps(s, ty)));
+		y = _mm256_add_ps(y, _mm256_fmadd_ps(s, tx, _mm256_mul_ps(c, ty)));
+
+		_mm256_storeu_ps(out + (n * 3) * LANES, x);
+		_mm256_storeu_ps(out + (n * 3 + 1) * LANES, y);
+		_mm256_storeu_ps(out + (n * 3 + 2) * LANES, _mm256_setzero_ps());
+
+		total = _mm256_add_ps(total, _mm256_loadu_ps(rows + n * LANES));
+	}
+}
+
+TARGET_AVX2
+static void chain_3d_avx2(const float* rows, const float* offsets, uint joints, float* out)
+{
+	__m256 one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+	__m256 S[9] = { one, zero, zero, zero, one, zero, zero, zero, one };
+	__m256 P[3] = { zero, zero, zero };
+
+	for (uint n = 0; n < joints; ++n)
+	{
+		__m256 tx = _mm256_set1_ps(offsets[n * 3]), ty = _mm256_set1_ps(offsets[n * 3 + 1]), tz = _mm256_set1_ps(offsets[n * 3 + 2]);
+		for (uint r = 0; r < 3; ++r)
+		{
+			P[r] = _mm256_add_ps(P[r], _mm256_fmadd_ps(S[r * 3], tx, _mm256_fmadd_ps(S[r * 3 + 1], ty, _mm256_mul_ps(S[r * 3 + 2], tz))));
+			_mm256_storeu_ps(out + (n * 3 + r) * LANES, P[r]);
+		}
+
+		__m256 sx, cx, sy, cy, sz, cz;
+		sine_cosine(_mm256_loadu_ps(rows + (n * 3) * LANES), sx, cx);
+		sine_cosine(_mm256_loadu_ps(rows + (n * 3 + 1) * LANES), sy, cy);
+		sine_cosine(_mm256_loadu_ps(rows + (n * 3 + 2) * LANES), sz, cz);
+
+		__m256 sxsy = _mm256_mul_ps(sx, sy), cxsy = _mm256_mul_ps(cx, sy);
+		__m256 R[9] = {
+			_mm256_mul_ps(cy, cz), _mm256_sub_ps(zero, _mm256_mul_ps(cy, sz)), sy,
+			_mm256_fmadd_ps(cx, sz, _mm256_mul_ps(sxsy, cz)), _mm256_fnmadd_ps(sxsy, sz, _mm256_mul_ps(cx, cz)), _mm256_sub_ps(zero, _mm256_mul_ps(sx, cy)),
+			_mm256_fnmadd_ps(cxsy, cz, _mm256_mul_ps(sx, sz)), _mm256_fmadd_ps(cxsy, sz, _mm256_mul_ps(sx, cz)), _mm256_mul_ps(cx, cy) };
+
+		__m256 next[9];
+		for (uint r = 0; r < 3; ++r)
+			for (uint c = 0; c < 3; ++c)
+				next[r * 3 + c] = _mm256_fmadd_ps(S[r * 3], R[c], _mm256_fmadd_ps(S[r * 3 + 1], R[3 + c], _mm256_mul_ps(S[r * 3 + 2], R[6 + c])));
+
+		for (uint i = 0; i < 9; ++i)
+			S[i] = next[i];
+	}
+}
+
+static const bool use_avx2 = cpu_has_avx2();
+static const chain_kernel chain_2d_rows = use_avx2 ? chain_2d_avx2 : chain_2d;
+static const chain_kernel chain_3d_rows = use_avx2 ? chain_3d_avx2 : chain_3d;
+#else
+static const chain_kernel chain_2d_rows = chain_2d;
+static const chain_kernel chain_3d_rows = chain_3d;
+#endif
+
+// R[n] of a joint (row-major): about z for a 2D joint, Rx Ry Rz for a 3D one
+static void rotation(const float* angles, uint dof, float* R)
+{
+	float x = dof == 3 ? angles[0] * (PI / 180.0f) : 0.0f;
+	float y = dof == 3 ? angles[1] * (PI / 180.0f) : 0.0f;
+	float z = angles[dof - 1] * (PI / 180.0f);
+
+	float sx = sinf(x), cx = cosf(x);
+	float sy = sinf(y), cy = cosf(y);
+	float sz = sinf(z), cz = cosf(z);
+
+	R[0] = cy * cz;						R[1] = -cy * sz;					R[2] = sy;
+	R[3] = cx * sz + sx * sy * cz;		R[4] = cx * cz - sx * sy * sz;		R[5] = -sx * cy;
+	R[6] = sx * sz - cx * sy * cz;		R[7] = sx * cz + cx * sy * sz;		R[8] = cx * cy;
+}
+
+// out = a b, which may be a or b
+static void multiply(const float* a, const float* b, float* out)
+{
+	float m[9];
+	for (uint r = 0; r < 3; ++r)
+		for (uint c = 0; c < 3; ++c)
+			m[r * 3 + c] = a[r * 3] * b[c] + a[r * 3 + 1] * b[3 + c] + a[r * 3 + 2] * b[6 + c];
+
+	std::copy(m, m + 9, out);
+}
+
+static vec3 transform(const float* m, const vec3& v)
+{
+	return vec3(m[0] * v.x + m[1] * v.y + m[2] * v.z,
+				m[3] * v.x + m[4] * v.y + m[5] * v.z,
+				m[6] * v.x + m[7] * v.y + m[8] * v.z);
+}
+
+static float length(const vec3& v)
+{
+	return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+}
+
+
+
+retargeter::retargeter() : scale(1.0f)
+{
+	source.joints = target.joints = 0;
+	source.dof = target.dof = 1;
+}
+
+void retargeter::read_rig(kinecontext& context, rig& out)
+{
+	out.joints = context.num_joints();
+	out.dof = context.degrees_of_freedom();
+
+	std::vector<float> zero(out.joints * out.dof, 0.0f);
+	std::vector<vec3> rest(out.joints);
+	if (out.joints)
+		context.joint_positions(&zero[0], &rest[0]);
+
+	// at rest every S[n] is the identity, so T[n] is the step from the parent
+	out.offsets.resize(out.joints * 3);
+	out.reached.resize(out.joints);
+
+	for (uint n = 0; n < out.joints; ++n)
+	{
+		vec3 t = n ? rest[n] - rest[n - 1] : rest[0];
+		out.offsets[n * 3] = t.x;
+		out.offsets[n * 3 + 1] = t.y;
+		out.offsets[n * 3 + 2] = t.z;
+		out.reached[n] = n ? out.reached[n - 1] + length(t) : 0.0f;
+	}
+}
+
+bool retargeter::prepare(kinecontext& from, kinecontext& to)
+{
+	read_rig(from, source);
+	read_rig(to, target);
+
+	for (const rig* r : { &source, &target })
+	{
+		if (r->joints < 2 || (r->dof != 1 && r->dof != 3) || r->reached.back() <= 0.0f)
+		{
+			std::cerr << "Error: can only retarget chains of 2D or 3D joints with bones of some length" << std::endl;
+			return false;
+		}
+	}
+
+	if (target.dof == 3)
+	{
+		for (uint n = 1; n < target.joints; ++n)
+		{
+			const float* t = &target.offsets[n * 3];
+			if (fabsf(t[1]) + fabsf(t[2]) > 1e-4f * fabsf(t[0]))
+			{
+				std::cerr << "Error: the bones of a 3D target have to lie on the x axis of their parents" << std::endl;
+				return false;
+			}
+		}
+	}
+
+	// every target joint follows the point at the same fraction of the reach along the source chain
+	float source_reach = source.reached.back();
+	float target_reach = target.reached.back();
+	scale = target_reach / source_reach;
+
+	bones.resize(target.joints);
+	weights.resize(target.joints);
+
+	for (uint j = 0; j < target.joints; ++j)
+	{
+		float along = target.reached[j] / target_reach * source_reach;
+		uint b = 0;
+		while (b + 2 < source.joints && source.reached[b + 1] <= along)
+			b++;
+
+		float span = source.reached[b + 1] - source.reached[b];
+		bones[j] = b;
+		weights[j] = span > 0.0f ? std::min(std::max((along - source.reached[b]) / span, 0.0f), 1.0f) : 0.0f;
+	}
+
+	angle_rows.assign(source_angles() * LANES, 0.0f);
+	position_rows.assign(source.joints * 3 * LANES, 0.0f);
+	goals.resize(target.joints);
+	positions.resize(target.joints);
+
+	return true;
+}
+
+void retargeter::aim(float* angles)
+{
+	std::fill(angles, angles + target_angles(), 0.0f);
+
+	if (target.dof == 1)
+	{
+		/*
+		 *	as kine2d::aim_bones: the bone from joint n to n + 1 points along S[n] T[n+1], so with a[n] the angle
+		 *	of the goal bone, s[n] = a[n] - angle(T[n+1]) and theta[n] = s[n] - s[n-1]
+		 */
+		float previous = 0.0f;
+
+		for (uint n = 0; n + 1 < target.joints; ++n)
+		{
+			vec3 w = goals[n + 1] - goals[n];
+			const float* t = &target.offsets[(n + 1) * 3];
+
+			float s = (w.x == 0.0f && w.y == 0.0f) ? previous : (atan2f(w.y, w.x) - atan2f(t[1], t[0])) * (180.0f / PI);
+			angles[n] = s - previous;
+			previous = s;
+		}
+
+		return;
+	}
+
+	// as kine3d::aim_bones without twists: in the frame of the parent the bone is (cos(y) cos(z), sin(z), -sin(y) cos(z))
+	float S[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+
+	for (uint n = 0; n + 1 < target.joints; ++n)
+	{
+		vec3 w = goals[n + 1] - goals[n];
+		vec3 d(S[0] * w.x + S[3] * w.y + S[6] * w.z,
+			   S[1] * w.x + S[4] * w.y + S[7] * w.z,
+			   S[2] * w.x + S[5] * w.y + S[8] * w.z);
+
+		float l = length(d);
+		if (l > 1e-6f)
+		{
+			angles[n * 3 + 1] = atan2f(-d.z, d.x) * (180.0f / PI);
+			angles[n * 3 + 2] = asinf(std::min(std::max(d.y / l, -1.0f), 1.0f)) * (180.0f / PI);
+		}
+
+		float R[9];
+		rotation(&angles[n * 3], 3, R);
+		multiply(S, R, S);
+	}
+}
+
+void retargeter::forward(const float* angles)
+{
+	float S[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+	vec3 P(0, 0, 0);
+
+	for (uint n = 0; n < target.joints; ++n)
+	{
+		const float* t = &target.offsets[n * 3];
+		P = P + transform(S, vec3(t[0], t[1], t[2]));
+		positions[n] = P;
+
+		float R[9];
+		rotation(&angles[n * target.dof], target.dof, R);
+		multiply(S, R, S);
+	}
+}
+
+// FABRIK iterations on positions, at least one and until the end effector is within tolerance of the goal; returns
+// its distance
+float retargeter::pull(const vec3& goal, uint iterations, float tolerance)
+{
+	/*
+	 *	FABRIK (Aristidou and Lasenby): the end effector is put on the goal and every joint back to the root is
+	 *	pulled to a bone length from the one after it, then the root is put back and every joint is pulled to a bone
+	 *	length from the one before it
+	 */
+	uint end = target.joints - 1;
+	vec3 root = positions[0];
+	float error = 0.0f;
+
+	for (uint i = 0; i < iterations; ++i)
+	{
+		positions[end] = goal;
+		for (uint n = end; n-- > 0; )
+		{
+			vec3 d = positions[n] - positions[n + 1];
+			float l = length(d);
+			if (l > 0.0f)
+				positions[n] = positions[n + 1] + d * ((target.reached[n + 1] - target.reached[n]) / l);
+		}
+
+		positions[0] = root;
+		for (uint n = 1; n <= end; ++n)
+		{
+			vec3 d = positions[n] - positions[n - 1];
+			float l = length(d);
+			if (l > 0.0f)
+				positions[n] = positions[n - 1] + d * ((target.reached[n] - target.reached[n - 1]) / l);
+		}
+
+		error = length(positions[end] - goal);
+		if (error < tolerance)
+			break;
+	}
+
+	return error;
+}
+
+void retargeter::solve(float* angles, uint iterations)
+{
+	uint end = target.joints - 1;
+	vec3 goal = goals[end];
+	vec3 root = positions[0];
+	float reach = target.reached.back();
+
+	if (length(positions[end] - goal) < reach * 1e-5f)
+		return;
+
+	pull(goal, iterations, reach * 1e-5f);
+
+	/*
+	 *	a chain that the source folds back on itself (or that its projection onto the plane folds) creeps towards
+	 *	the goal by little more than the fold each iteration. when the iterations leave it further than
+	 *	RETARGET_MAX_ERROR of the reach, it starts over unfolded, on an arc from the root to the goal, from which
+	 *	FABRIK converges in a few iterations, at the cost of the shape of the source
+	 */
+	if (length(positions[end] - goal) > reach * RETARGET_MAX_ERROR)
+	{
+		vec3 along = goal - root;
+		float distance = length(along);
+		along = distance > 0.0f ? along * (1.0f / distance) : vec3(1, 0, 0);
+
+		vec3 other = fabsf(along.x) < fabsf(along.y) ? vec3(1, 0, 0) : vec3(0, 1, 0);
+		vec3 side = target.dof == 1 ? vec3(-along.y, along.x, 0.0f)
+			: vec3(along.y * other.z - along.z * other.y, along.z * other.x - along.x * other.z, along.x * other.y - along.y * other.x);
+		side = side * (1.0f / length(side));
+
+		// an arc from the root to the goal, about as long as the chain
+		float bend = 0.5f * sqrtf(std::max(reach * reach - distance * distance, 0.0f));
+
+		for (uint n = 1; n <= end; ++n)
+		{
+			float t = target.reached[n] / reach;
+			positions[n] = root + along * (distance * t) + side * (bend * sinf(PI * t));
+		}
+
+		pull(goal, iterations, reach * 1e-5f);
+	}
+
+	// the bones are aimed at the joints as solved, which keeps their lengths
+	std::copy(positions.begin(), positions.end(), goals.begin());
+	aim(angles);
+	forward(angles);
+}
+
+void retargeter::retarget(const float* frames, uint count, float* out, uint iterations)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	stats = retarget_stats();
+	stats.frames = count;
+	stats.iterations = iterations;
+
+	chain_kernel chain = source.dof == 1 ? chain_2d_rows : chain_3d_rows;
+	uint in_angles = source_angles();
+	uint out_angles = target_angles();
+	uint end = target.joints - 1;
+
+	vec3 source_root(source.offsets[0], source.offsets[1], source.offsets[2]);
+	vec3 target_root(target.offsets[0], target.offsets[1], target.offsets[2]);
+
+	double aimed = 0.0, solved = 0.0;
+
+	for (uint first = 0; first < count; first += LANES)
+	{
+		uint lanes = std::min(LANES, count - first);
+
+		// a row per angle, with the lanes beyond the last frame at rest
+		for (uint i = 0; i < in_angles; ++i)
+			for (uint l = 0; l < LANES; ++l)
+				angle_rows[i * LANES + l] = l < lanes ? frames[(first + l) * in_angles + i] : 0.0f;
+
+		chain(&angle_rows[0], &source.offsets[0], source.joints, &position_rows[0]);
+
+		for (uint l = 0; l < lanes; ++l)
+		{
+			for (uint j = 0; j < target.joints; ++j)
+			{
+				const float* a = &position_rows[bones[j] * 3 * LANES + l];
+				const float* b = a + 3 * LANES;
+				float w = weights[j];
+
+				vec3 p(a[0] + (b[0] - a[0]) * w, a[LANES] + (b[LANES] - a[LANES]) * w, a[2 * LANES] + (b[2 * LANES] - a[2 * LANES]) * w);
+				goals[j] = target_root + (p - source_root) * scale;
+
+				if (target.dof == 1)
+					goals[j].z = 0.0f;
+			}
+
+			float* angles = out + (first + l) * out_angles;
+			vec3 goal = goals[end];
+			aim(angles);
+			forward(angles);
+			aimed += length(positions[end] - goal);
+
+			solve(angles, iterations);
+
+			float error = length(positions[end] - goal);
+			solved += error;
+			stats.max_error = std::max(stats.max_error, error);
+
+			for (uint i = 0; i < out_angles; ++i)
+				angles[i] -= 360.0f * floorf(angles[i] / 360.0f);
+		}
+	}
+
+	if (count)
+	{
+		stats.aimed_error = aimed / count;
+		stats.mean_error = solved / count;
+	}
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "structures.h"
+
+struct retarget_stats
+{
+	uint frames;
+	uint iterations;		// FABRIK iterations per frame
+	float aimed_error;		// mean distance of the end effector to its goal once the bones are aimed
+	float mean_error;		// the same after the iterations
+	float max_error;
+	double seconds;
+
+	retarget_stats() : frames(0), iterations(0), aimed_error(0.0f), mean_error(0.0f), max_error(0.0f), seconds(0.0) {}
+};
+
+/*
+ *	maps poses of one rig onto another with other bone counts and lengths
+ *
+ *	prepare() reads both rigs from their rest poses (every angle 0, where every joint frame is the world frame) and
+ *	tabulates, for every joint of the target, the point at the same fraction of the reach along the source chain
+ *	(a source bone and a weight along it), and the ratio of the reaches. frames then go through in blocks of 8, a
+ *	frame per lane: forward kinematics of the source with the sine table of quantize.h, the tabulated points
+ *	scaled onto the target, the target bones aimed along them, and a few FABRIK iterations that pull the end
+ *	effector onto the scaled end effector of the source. 2D frames map onto the z = 0 plane of a 3D rig, and 3D
+ *	frames onto a 2D rig as seen along z. 3D targets aim their bones like kine3d::aim_bones, so their bones have
+ *	to lie on the x axis of their parents, and twists are 0.
+ */
+class retargeter
+{
+public:
+	static const uint LANES = 8;
+
+private:
+	struct rig
+	{
+		uint joints;
+		uint dof;
+		std::vector<float> offsets;		// T[n], the position of joint n in the frame of its parent, x y z per joint
+		std::vector<float> reached;		// along the chain up to every joint, at rest
+	};
+
+	rig source, target;
+
+	std::vector<uint> bones;		// per target joint, the source joint that its point follows from
+	std::vector<float> weights;		// and how far towards the next source joint
+	float scale;
+
+	// the current block
+	std::vector<float> angle_rows;		// source angles, a row of LANES per angle
+	std::vector<float> position_rows;	// source joints, rows x y z of LANES per joint
+
+	// the current lane
+	std::vector<vec3> goals;
+	std::vector<vec3> positions;		// of the target joints
+
+	retarget_stats stats;
+
+private:
+	static void read_rig(kinecontext& context, rig& out);
+
+	void aim(float* angles);
+	void forward(const float* angles);
+	float pull(const vec3& goal, uint iterations, float tolerance);
+	void solve(float* angles, uint iterations);
+
+public:
+	retargeter();
+
+	bool prepare(kinecontext& from, kinecontext& to);
+
+	uint source_angles() const { return source.joints * source.dof; }
+	uint target_angles() const { return target.joints * target.dof; }
+
+	// frames of source angles, one after the other, into as many frames of target angles
+	void retarget(const float* frames, uint count, float* out, uint iterations = RETARGET_IK_ITERATIONS);
+
+	const retarget_stats& last_stats() const { return stats; }
+};
@@ -0,0 +1,152 @@
+#include "rig.h"
+#include <fstream>
+#include <sstream>
+
+static bool same(const vec3& u, const vec3& v)
+{
+	return u.x == v.x && u.y == v.y && u.z == v.z;
+}
+
+static bool same(const std::vector<vec3>& u, const std::vector<vec3>& v)
+{
+	if (u.size() != v.size())
+		return false;
+
+	for (uint i = 0; i < u.size(); ++i)
+	{
+		if (!same(u[i], v[i]))
+			return false;
+	}
+
+	return true;
+}
+
+bool rig_file::load(const std::string& path)
+{
+	std::ifstream in(path.c_str());
+	if (!in)
+	{
+		std::cerr << "Error: could not read " << path << std::endl;
+		return false;
+	}
+
+	std::vector<rig_joint> loaded;
+	std::string line;
+
+	for (uint number = 1; std::getline(in, line); ++number)
+	{
+		std::istringstream fields(line);
+		std::string kind;
+
+		if (!(fields >> kind) || kind[0] == '#')
+			continue;
+
+		vec3 v(0, 0, 0);
+		if (!(fields >> v.x >> v.y))
+		{
+			std::cerr << "Error: " << path << ":" << number << ": expected coordinates" << std::endl;
+			return false;
+		}
+		fields >> v.z;
+
+		if (kind == "joint")
+		{
+			loaded.push_back(rig_joint());
+			loaded.back().offset = v;
+		}
+		else if (kind == "point" && !loaded.empty())
+			loaded.back().points.push_back(v);
+		else
+		{
+			std::cerr << "Error: " << path << ":" << number << ": expected a joint" << std::endl;
+			return false;
+		}
+	}
+
+	if (loaded.size() < 2)
+	{
+		std::cerr << "Error: " << path << ": a rig needs at least two joints" << std::endl;
+		return false;
+	}
+
+	if (!loaded.back().points.empty())
+	{
+		std::cerr << "Error: " << path << ": the end effector has no bone to attach points to" << std::endl;
+		return false;
+	}
+
+	joints.swap(loaded);
+	return true;
+}
+
+bool rig_file::save(const std::string& path) const
+{
+	std::ofstream out(path.c_str());
+	if (!out)
+		return false;
+
+	out << "# joint x y z: the translation of the joint, point x y z: attached to its bone" << std::endl;
+
+	for (uint n = 0; n < joints.size(); ++n)
+	{
+		const vec3& t = joints[n].offset;
+		out << "joint " << t.x << " " << t.y << " " << t.z << std::endl;
+
+		for (uint i = 0; i < joints[n].points.size(); ++i)
+		{
+			const vec3& p = joints[n].points[i];
+			out << "point " << p.x << " " << p.y << " " << p.z << std::endl;
+		}
+	}
+
+	return (bool)out;
+}
+
+void rig_file::capture(kinecontext& context)
+{
+	joints.resize(context.num_joints());
+
+	for (uint n = 0; n < joints.size(); ++n)
+	{
+		joints[n].offset = context.joint_offset(n);
+		joints[n].points.resize(context.num_attachments(n));
+
+		if (!joints[n].points.empty())
+			context.get_attachments(n, &joints[n].points[0]);
+	}
+}
+
+rig_changes rig_file::patch(kinecontext& context, const rig_file& next)
+{
+	rig_changes changes;
+	uint kept = std::min(joints.size(), next.joints.size());
+
+	if (next.joints.size() != joints.size())
+	{
+		context.set_num_joints(next.joints.size());
+		changes.joints = (int)next.joints.size() - (int)joints.size();
+	}
+
+	for (uint n = 0; n < next.joints.size(); ++n)
+	{
+		const rig_joint& to = next.joints[n];
+
+		// joints that were added continue the chain along the last bone, with no points
+		if (n >= kept || !same(joints[n].offset, to.offset))
+		{
+			context.set_joint_offset(n, to.offset);
+			changes.offsets++;
+		}
+
+		// the old end effector had no bone, and gained one when joints were added
+		bool had_points = n < kept && n + 1 < joints.size();
+		if (had_points ? !same(joints[n].points, to.points) : !to.points.empty())
+		{
+			context.set_attachments(n, to.points.empty() ? nullptr : &to.points[0], to.points.size());
+			changes.attachments++;
+		}
+	}
+
+	joints = next.joints;
+	return changes;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include "structures.h"
+
+// a joint of a rig: its translation T[n], and the points attached to its bone in its own coordinates
+struct rig_joint
+{
+	vec3 offset;
+	std::vector<vec3> points;
+};
+
+// what a patch changed
+struct rig_changes
+{
+	uint offsets;		// joints whose translation changed
+	uint attachments;	// bones whose points were replaced
+	int joints;			// joints added, or removed when negative
+
+	rig_changes() : offsets(0), attachments(0), joints(0) {}
+
+	bool any() const { return offsets || attachments || joints; }
+};
+
+/*
+ *	the joints of a chain and the points attached to its bones, as kept in a text file:
+ *
+ *		joint x y [z]	T[n] of the next joint, from the root (in world coordinates) to the end effector
+ *		point x y [z]	attached to the bone of the last joint so far, in the coordinates of that joint
+ *
+ *	a missing z is 0, and lines starting with # are comments. the end effector has no bone, so no points follow
+ *	the last joint. a rig remembers what it last applied to a context, and patch() changes only the joints that
+ *	differ from that: angles, the curves and cached poses of the other joints and points that were inserted into
+ *	bones the file leaves alone all survive a reload.
+ */
+class rig_file
+{
+private:
+	std::vector<rig_joint> joints;
+
+public:
+	// leaves the rig as it was when the file does not hold a valid rig
+	bool load(const std::string& path);
+	bool save(const std::string& path) const;
+
+	// the joints and attachments of a context as they are
+	void capture(kinecontext& context);
+
+	// changes the context from this rig to the next one, which this rig becomes
+	rig_changes patch(kinecontext& context, const rig_file& next);
+
+	uint size() const { return joints.size(); }
+	const rig_joint& joint(uint n) const { return joints[n]; }
+};
@@ -0,0 +1,288 @@
+#include "script.h"
+
+/*
+ *	coroutine frames
+ *
+ *	frames are recycled in free lists by size, in steps of 64 bytes, so a steady stream of scripts (and of the
+ *	scripts they await) stops allocating once the lists hold enough frames. reserve() fills a list ahead in one
+ *	block, for as many frames as may be alive at once. scripts run on a single thread.
+ */
+static const std::size_t FRAME_STEP = 64;
+static const uint FRAME_CLASSES = 32;	// frames of up to 2 KB are recycled
+
+struct free_frame
+{
+	free_frame* next;
+};
+
+static free_frame* free_frames[FRAME_CLASSES];
+static uint free_counts[FRAME_CLASSES];
+static std::size_t last_frame_bytes = 0;	// of the frame allocated last, for the promise that is built in it
+
+void* script::promise_type::operator new(std::size_t size)
+{
+	std::size_t c = (size + FRAME_STEP - 1) / FRAME_STEP;
+	last_frame_bytes = size;
+
+	if (c >= FRAME_CLASSES)
+		return ::operator new(size);
+
+	if (free_frames[c])
+	{
+		free_frame* frame = free_frames[c];
+		free_frames[c] = frame->next;
+		free_counts[c]--;
+		return frame;
+	}
+
+	return ::operator new(c * FRAME_STEP);
+}
+
+void script::promise_type::operator delete(void* frame, std::size_t size)
+{
+	std::size_t c = (size + FRAME_STEP - 1) / FRAME_STEP;
+
+	if (c >= FRAME_CLASSES)
+	{
+		::operator delete(frame);
+		return;
+	}
+
+	free_frame* f = (free_frame*)frame;
+	f->next = free_frames[c];
+	free_frames[c] = f;
+	free_counts[c]++;
+}
+
+script::promise_type::promise_type() : scheduler(nullptr), wake(0), test(nullptr), condition(nullptr), root(-1), bytes(last_frame_bytes)
+{
+}
+
+void script::reserve(std::size_t frame_bytes, uint frames)
+{
+	std::size_t c = (frame_bytes + FRAME_STEP - 1) / FRAME_STEP;
+	if (c >= FRAME_CLASSES || free_counts[c] >= frames)
+		return;
+
+	// one block for the frames that are missing, which stay in the list for good
+	uint missing = frames - free_counts[c];
+	char* block = (char*)::operator new(missing * c * FRAME_STEP);
+
+	for (uint i = 0; i < missing; ++i)
+	{
+		free_frame* f = (free_frame*)(block + i * c * FRAME_STEP);
+		f->next = free_frames[c];
+		free_frames[c] = f;
+	}
+
+	free_counts[c] += missing;
+}
+
+std::coroutine_handle<> script::promise_type::final_awaiter::await_suspend(std::coroutine_handle<promise_type> h) noexcept
+{
+	promise_type& p = h.promise();
+
+	if (p.continuation)
+		return p.continuation;
+
+	if (p.root >= 0)
+		p.scheduler->finish(p);
+
+	return std::noop_coroutine();
+}
+
+
+
+script_scheduler::script_scheduler(float tick_seconds) : now(0), seconds_per_tick(tick_seconds), resumed(0)
+{
+}
+
+script_scheduler::~script_scheduler()
+{
+	stop_all();
+}
+
+void script_scheduler::spawn(script&& s)
+{
+	script::handle h = s.release();
+	if (!h) return;
+
+	h.promise().scheduler = this;
+	h.promise().root = roots.size();
+	roots.push_back(h);
+
+	h.resume();
+	destroy_finished();
+}
+
+void script_scheduler::tick()
+{
+	now++;
+	resumed = 0;
+
+	// due sleepers of this slot; the others sleep whole turns of the wheel longer
+	script_node& slot = wheel[now % WHEEL_SLOTS];
+
+	for (script_node* n = slot.next; n != &slot; )
+	{
+		script_node* next = n->next;
+
+		if (static_cast<script::promise_type*>(n)->wake <= now)
+			n->link_before(&ready);
+
+		n = next;
+	}
+
+	for (script_node* n = waiting.next; n != &waiting; )
+	{
+		script_node* next = n->next;
+		script::promise_type* p = static_cast<script::promise_type*>(n);
+
+		if (p->test(p->condition))
+			n->link_before(&ready);
+
+		n = next;
+	}
+
+	resume_ready();
+	destroy_finished();
+}
+
+void script_scheduler::resume_ready()
+{
+	while (ready.linked())
+	{
+		script_node* n = ready.next;
+		n->unlink();
+
+		resumed++;
+		script::handle::from_promise(*static_cast<script::promise_type*>(n)).resume();
+	}
+}
+
+void script_scheduler::destroy_finished()
+{
+	for (uint i = 0; i < finished.size(); ++i)
+	{
+		script::handle h = finished[i];
+		uint index = h.promise().root;
+
+		// the last root takes the place of the finished one
+		roots[index] = roots.back();
+		roots[index].promise().root = index;
+		roots.pop_back();
+
+		h.destroy();
+	}
+
+	finished.clear();
+}
+
+void script_scheduler::stop_all()
+{
+	// destroying a root destroys the scripts it awaits, which unlink themselves
+	for (uint i = 0; i < roots.size(); ++i)
+		roots[i].destroy();
+
+	roots.clear();
+	finished.clear();
+}
+
+uint script_scheduler::ticks_for(float seconds) const
+{
+	return std::max(1, (int)lroundf(seconds / seconds_per_tick));
+}
+
+void script_scheduler::sleep(script::promise_type& p, uint ticks)
+{
+	p.wake = now + ticks;
+	p.link_before(&wheel[p.wake % WHEEL_SLOTS]);
+}
+
+void script_scheduler::wait(script::promise_type& p)
+{
+	p.link_before(&waiting);
+}
+
+void script_scheduler::finish(script::promise_type& p)
+{
+	finished.push_back(script::handle::from_promise(p));
+}
+
+
+
+script rotate_over(kinecontext& context, uint joint, char axis, float degrees, float seconds)
+{
+	script_scheduler* scheduler = co_await current_scheduler();
+	uint steps = scheduler->ticks_for(seconds);
+	float applied = 0.0f;
+
+	for (uint i = 1; i <= steps; ++i)
+	{
+		// smoothstep: u^2 (3 - 2u)
+		float u = (float)i / steps;
+		float target = degrees * u * u * (3.0f - 2.0f * u);
+
+		context.rotate_joint_about(joint, axis, target - applied);
+		applied = target;
+
+		if (i < steps)
+			co_await wait_ticks(1);
+	}
+}
+
+script reach_for(kinecontext& context, vec3 target, float degrees_per_second, float tolerance)
+{
+	static const char axes[3] = { 'x', 'y', 'z' };
+
+	script_scheduler* scheduler = co_await current_scheduler();
+	float step = degrees_per_second * scheduler->tick_length();
+
+	uint dof = context.degrees_of_freedom();
+	std::vector<float> angles(context.num_joints() * dof);
+
+	auto distance = [&]()
+	{
+		vec3 d = context.end_effector(&angles[0]) - target;
+		return sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+	};
+
+	// every tick turns each angle by a step where that brings the end effector closer, and smaller steps are
+	// tried once no step helps
+	while (step > 0.01f)
+	{
+		context.get_angles(&angles[0]);
+		float best = distance();
+
+		if (best <= tolerance)
+			co_return;
+
+		bool moved = false;
+
+		for (uint i = 0; i < angles.size(); ++i)
+		{
+			float angle = angles[i];
+
+			for (int sign = 1; sign >= -1; sign -= 2)
+			{
+				angles[i] = angle + sign * step;
+				float d = distance();
+
+				if (d < best)
+				{
+					best = d;
+					context.rotate_joint_about(i / dof, dof == 1 ? 'z' : axes[i % dof], sign * step);
+					moved = true;
+					break;
+				}
+
+				angles[i] = angle;
+			}
+		}
+
+		if (moved)
+			co_await wait_ticks(1);
+		else
+			step *= 0.5f;
+	}
+}
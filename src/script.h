@@ -0,0 +1,227 @@
+#pragma once
+
+#include <coroutine>
+#include <cstdint>
+#include "structures.h"
+
+class script_scheduler;
+
+// links of a suspended script in a list of the scheduler (circular, so a node can unlink itself)
+struct script_node
+{
+	script_node* prev;
+	script_node* next;
+
+	script_node() : prev(this), next(this) {}
+	~script_node() { unlink(); }
+
+	bool linked() const { return next != this; }
+
+	void unlink()
+	{
+		prev->next = next;
+		next->prev = prev;
+		prev = next = this;
+	}
+
+	void link_before(script_node* other)
+	{
+		unlink();
+		prev = other->prev;
+		next = other;
+		other->prev->next = this;
+		other->prev = this;
+	}
+};
+
+/*
+ *	coroutine that animates over simulation ticks
+ *
+ *	a script suspends on wait_ticks(), wait_seconds() and wait_until(), or on another script, which then runs
+ *	to its end before the awaiting script continues. scripts are started by a scheduler (or by the script that
+ *	awaits them) and never run on their own. frames come from a pool of recycled blocks, and suspending only
+ *	links the frame into a list of the scheduler, so awaiting never touches the heap once the pool holds as many
+ *	frames of each size as are alive at once (see reserve()).
+ */
+class script
+{
+public:
+	struct promise_type : script_node
+	{
+		script_scheduler* scheduler;
+		std::coroutine_handle<> continuation;	// script that awaits this one, none for a root
+		uint64_t wake;							// tick at which a sleeping script resumes
+		bool (*test)(void*);					// condition of a waiting script
+		void* condition;
+		int root;								// index among the roots of the scheduler, -1 for awaited scripts
+		std::size_t bytes;						// of the frame
+
+		promise_type();
+
+		static void* operator new(std::size_t size);
+		static void operator delete(void* frame, std::size_t size);
+
+		script get_return_object() { return script(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		struct final_awaiter
+		{
+			bool await_ready() noexcept { return false; }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept;
+			void await_resume() noexcept {}
+		};
+
+		final_awaiter final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	typedef std::coroutine_handle<promise_type> handle;
+
+private:
+	handle frame;
+
+public:
+	explicit script(handle h) : frame(h) {}
+	script(script&& other) : frame(other.frame) { other.frame = nullptr; }
+	script(const script&) = delete;
+	script& operator=(const script&) = delete;
+	~script() { if (frame) frame.destroy(); }
+
+	handle release() { handle h = frame; frame = nullptr; return h; }
+
+	// bytes of the frame of the script, as reserve() takes them
+	std::size_t frame_bytes() const { return frame ? frame.promise().bytes : 0; }
+
+	// keeps at least a number of free frames of a size, so that up to that many scripts of that size can be alive at
+	// once without allocating; call it before the ticks that start them, as they would allocate otherwise
+	static void reserve(std::size_t frame_bytes, uint frames);
+
+	// runs the script until it ends, then continues the awaiting script
+	struct awaiter
+	{
+		handle child;
+
+		bool await_ready() { return !child || child.done(); }
+		std::coroutine_handle<> await_suspend(handle parent)
+		{
+			child.promise().scheduler = parent.promise().scheduler;
+			child.promise().continuation = parent;
+			return child;
+		}
+		void await_resume() {}
+	};
+
+	awaiter operator co_await() && { return awaiter{ frame }; }
+};
+
+/*
+ *	runs scripts tick by tick
+ *
+ *	sleeping scripts wait in a timer wheel with a slot per tick (modulo its size), so a tick only visits the
+ *	scripts that are due in its slot, plus those that sleep whole turns of the wheel longer. scripts waiting for
+ *	a condition are tested every tick.
+ */
+class script_scheduler
+{
+public:
+	static const uint WHEEL_SLOTS = 256;
+
+private:
+	script_node wheel[WHEEL_SLOTS];
+	script_node waiting;			// scripts waiting for a condition
+	script_node ready;				// scripts to resume in the current tick
+
+	std::vector<script::handle> roots;
+	std::vector<script::handle> finished;	// roots that ended, destroyed once they are off the stack
+
+	uint64_t now;
+	float seconds_per_tick;
+	uint resumed;					// in the last tick
+
+private:
+	void resume_ready();
+	void destroy_finished();
+
+public:
+	script_scheduler(float tick_seconds);
+	~script_scheduler();
+
+	// takes the script over and runs it up to its first wait
+	void spawn(script&& s);
+	void tick();
+	void stop_all();
+
+	uint64_t current_tick() const { return now; }
+	float tick_length() const { return seconds_per_tick; }
+	uint ticks_for(float seconds) const;
+	uint size() const { return roots.size(); }
+	uint resumed_last_tick() const { return resumed; }
+
+	// used by the awaiters
+	void sleep(script::promise_type& p, uint ticks);
+	void wait(script::promise_type& p);
+	void finish(script::promise_type& p);
+};
+
+// suspends for a number of ticks (none for 0)
+struct wait_ticks
+{
+	uint ticks;
+
+	explicit wait_ticks(uint n) : ticks(n) {}
+	bool await_ready() { return ticks == 0; }
+	void await_suspend(script::handle h) { h.promise().scheduler->sleep(h.promise(), ticks); }
+	void await_resume() {}
+};
+
+// suspends for the ticks closest to a duration
+struct wait_seconds
+{
+	float seconds;
+
+	explicit wait_seconds(float s) : seconds(s) {}
+	bool await_ready() { return seconds <= 0.0f; }
+	void await_suspend(script::handle h) { h.promise().scheduler->sleep(h.promise(), h.promise().scheduler->ticks_for(seconds)); }
+	void await_resume() {}
+};
+
+// suspends until a condition holds, tested once per tick
+template <typename F>
+struct wait_condition
+{
+	F condition;
+
+	static bool test(void* self) { return ((wait_condition*)self)->condition(); }
+
+	bool await_ready() { return condition(); }
+	void await_suspend(script::handle h)
+	{
+		h.promise().test = &wait_condition::test;
+		h.promise().condition = this;
+		h.promise().scheduler->wait(h.promise());
+	}
+	void await_resume() {}
+};
+
+template <typename F>
+wait_condition<F> wait_until(F condition)
+{
+	return wait_condition<F>{ condition };
+}
+
+// the scheduler of the running script, without suspending
+struct current_scheduler
+{
+	script_scheduler* scheduler;
+
+	bool await_ready() { return false; }
+	bool await_suspend(script::handle h) { scheduler = h.promise().scheduler; return false; }
+	script_scheduler* await_resume() { return scheduler; }
+};
+
+// turns a joint about one of its axes ('z' in 2D) over a duration, easing in and out
+script rotate_over(kinecontext& context, uint joint, char axis, float degrees, float seconds);
+
+// turns the joints until the end effector is within tolerance of the target, or cannot get closer
+script reach_for(kinecontext& context, vec3 target, float degrees_per_second, float tolerance);
@@ -0,0 +1,22 @@
+#pragma once
+
+// kernels with an AVX2 variant compile it with TARGET_AVX2 and pick it at startup with cpu_has_avx2(),
+// so the rest of the build keeps its flags and still runs on older processors
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+
+#define HAS_AVX2_KERNELS 1
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+
+inline bool cpu_has_avx2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#else
+inline bool cpu_has_avx2()
+{
+	return false;
+}
+#endif
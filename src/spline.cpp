@@ -0,0 +1,256 @@
+#include "spline.h"
+#include "simd.h"
+
+// ((a u + b) u + c) u + d over rows of n values (n is a multiple of 8), wrapped to [0, 360)
+static void hermite_rows(const float* c, float u, float* out, uint n)
+{
+	const float* a = c;
+	const float* b = c + n;
+	const float* v = c + 2 * n;
+	const float* d = c + 3 * n;
+
+	for (uint i = 0; i < n; ++i)
+	{
+		float r = ((a[i] * u + b[i]) * u + v[i]) * u + d[i];
+		out[i] = r - 360.0f * floorf(r / 360.0f);
+	}
+}
+
+typedef void (*hermite_kernel)(const float* c, float u, float* out, uint n);
+
+#ifdef HAS_AVX2_KERNELS
+TARGET_AVX2
+static void hermite_rows_avx2(const float* c, float u, float* out, uint n)
+{
+	__m256 vu = _mm256_set1_ps(u);
+	__m256 full = _mm256_set1_ps(360.0f);
+	__m256 inverse = _mm256_set1_ps(1.0f / 360.0f);
+
+	for (uint i = 0; i < n; i += 8)
+	{
+		__m256 r = _mm256_loadu_ps(c + i);
+		r = _mm256_fmadd_ps(r, vu, _mm256_loadu_ps(c + n + i));
+		r = _mm256_fmadd_ps(r, vu, _mm256_loadu_ps(c + 2 * n + i));
+		r = _mm256_fmadd_ps(r, vu, _mm256_loadu_ps(c + 3 * n + i));
+
+		__m256 turns = _mm256_floor_ps(_mm256_mul_ps(r, inverse));
+		_mm256_storeu_ps(out + i, _mm256_fnmadd_ps(turns, full, r));
+	}
+}
+
+static hermite_kernel hermite_row = cpu_has_avx2() ? hermite_rows_avx2 : hermite_rows;
+#else
+static hermite_kernel hermite_row = hermite_rows;
+#endif
+
+bool angle_spline::select_kernels(bool avx2)
+{
+#ifdef HAS_AVX2_KERNELS
+	avx2 = avx2 && cpu_has_avx2();
+	hermite_row = avx2 ? hermite_rows_avx2 : hermite_rows;
+	return avx2;
+#else
+	(void)avx2;
+	return false;
+#endif
+}
+
+
+void angle_spline::reset(uint num_angles)
+{
+	angles = num_angles;
+	stride = (num_angles + 7) & ~7u;
+	looping = false;
+
+	times.clear();
+	keys.clear();
+	velocities.clear();
+	given.clear();
+	coefficients.clear();
+}
+
+void angle_spline::add_key(float time, const float* key_angles, const float* key_velocities)
+{
+	if (!times.empty() && time <= times.back())
+	{
+		std::cerr << "Warning: spline key at " << time << "s is not after the previous key, skipped" << std::endl;
+		return;
+	}
+
+	uint previous = keys.size() - angles;
+
+	for (uint i = 0; i < angles; ++i)
+	{
+		// continue from the previous key along the shorter arc
+		float angle = times.empty() ? key_angles[i] : keys[previous + i] + shortest_arc(keys[previous + i], key_angles[i]);
+
+		keys.push_back(angle);
+		velocities.push_back(key_velocities ? key_velocities[i] : 0.0f);
+	}
+
+	times.push_back(time);
+	given.push_back(key_velocities != nullptr);
+}
+
+bool angle_spline::finish(bool loop)
+{
+	coefficients.clear();
+	looping = false;
+
+	if (times.empty())
+		return false;
+
+	uint n = times.size();
+
+	// a single key holds its pose
+	if (n == 1)
+	{
+		std::vector<float> held(keys.begin(), keys.end());
+		add_key(times[0] + 1.0f, &held[0]);
+		n = 2;
+	}
+	else if (loop)
+	{
+		// close the spline with the first key, one mean key interval after the last one
+		std::vector<float> first(keys.begin(), keys.begin() + angles);
+		std::vector<float> first_velocities(velocities.begin(), velocities.begin() + angles);
+
+		add_key(times.back() + duration() / (n - 1), &first[0], given[0] ? &first_velocities[0] : nullptr);
+		looping = true;
+		n++;
+	}
+
+	const float* p = &keys[0];
+
+	for (uint k = 0; k < n; ++k)
+	{
+		if (given[k])
+			continue;
+
+		for (uint i = 0; i < angles; ++i)
+		{
+			float* v = &velocities[k * angles + i];
+
+			if (k > 0 && k + 1 < n)
+			{
+				*v = (p[(k + 1) * angles + i] - p[(k - 1) * angles + i]) / (times[k + 1] - times[k - 1]);
+			}
+			else if (looping)
+			{
+				/*
+				 *	the first and last keys are the same pose, turns apart: their neighbours across the seam
+				 *	are the second key and the one before the last
+				 */
+				float turns = p[(n - 1) * angles + i] - p[i];
+				float before = p[(n - 2) * angles + i] - turns;
+				float span = (times[1] - times[0]) + (times[n - 1] - times[n - 2]);
+
+				*v = (p[angles + i] - before) / span;
+			}
+			else if (k == 0)
+			{
+				*v = (p[angles + i] - p[i]) / (times[1] - times[0]);
+			}
+			else
+			{
+				*v = (p[k * angles + i] - p[(k - 1) * angles + i]) / (times[k] - times[k - 1]);
+			}
+		}
+	}
+
+	/*
+	 *	Hermite segment from p0 to p1 with velocities m0 and m1 over h seconds, in u = (t - t0) / h:
+	 *
+	 *	a = 2 (p0 - p1) + h m0 + h m1
+	 *	b = 3 (p1 - p0) - 2 h m0 - h m1
+	 *	c = h m0
+	 *	d = p0
+	 */
+	coefficients.assign((n - 1) * 4 * stride, 0.0f);
+
+	for (uint s = 0; s + 1 < n; ++s)
+	{
+		float h = times[s + 1] - times[s];
+		float* row = &coefficients[s * 4 * stride];
+
+		for (uint i = 0; i < angles; ++i)
+		{
+			float p0 = p[s * angles + i];
+			float p1 = p[(s + 1) * angles + i];
+			float m0 = velocities[s * angles + i] * h;
+			float m1 = velocities[(s + 1) * angles + i] * h;
+
+			row[i] = 2.0f * (p0 - p1) + m0 + m1;
+			row[stride + i] = 3.0f * (p1 - p0) - 2.0f * m0 - m1;
+			row[2 * stride + i] = m0;
+			row[3 * stride + i] = p0;
+		}
+	}
+
+	return true;
+}
+
+uint angle_spline::locate(float time, float& u) const
+{
+	float t = time;
+
+	if (looping)
+	{
+		float length = duration();
+		t = times.front() + (t - times.front()) - length * floorf((t - times.front()) / length);
+	}
+
+	// last key at or before t
+	uint s = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+	s = std::min(std::max(s, 1u), (uint)times.size() - 1) - 1;
+
+	u = (t - times[s]) / (times[s + 1] - times[s]);
+	u = std::min(std::max(u, 0.0f), 1.0f);
+
+	return s;
+}
+
+void angle_spline::evaluate(float time, float* out) const
+{
+	float u;
+	uint s = locate(time, u);
+	hermite_row(segment(s), u, out, stride);
+}
+
+
+
+void spline_batch::reset(uint num_angles)
+{
+	angles = num_angles;
+	stride = (num_angles + 7) & ~7u;
+	players.clear();
+	out.clear();
+}
+
+uint spline_batch::add(const angle_spline* spline, float offset, float speed)
+{
+	if (spline->num_angles() != angles || spline->num_segments() == 0)
+	{
+		std::cerr << "Warning: spline of " << spline->num_angles() << " angles does not fit a batch of "
+			<< angles << " angles, or is not finished" << std::endl;
+		return players.size();
+	}
+
+	player p = { spline, offset, speed };
+	players.push_back(p);
+	out.resize(players.size() * stride);
+
+	return players.size() - 1;
+}
+
+void spline_batch::evaluate(float time)
+{
+	for (uint i = 0; i < players.size(); ++i)
+	{
+		const player& p = players[i];
+
+		float u;
+		uint s = p.spline->locate(p.offset + time * p.speed, u);
+		hermite_row(p.spline->segment(s), u, &out[i * stride], stride);
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "structures.h"
+
+/*
+ *	keyed joint angles of a skeleton over time
+ *
+ *	every angle follows a cubic Hermite curve between its keys. tangents are given with the keys, or follow the
+ *	neighbouring keys as a Catmull-Rom spline. keys are unwrapped along the shorter arc from the previous key, so a
+ *	joint turns from 350 to 10 degrees through 0 rather than back through 180. finish() turns the keys into four
+ *	coefficient rows per segment, so evaluating is a single polynomial per angle.
+ */
+class angle_spline
+{
+private:
+	uint angles;				// per key
+	uint stride;				// values per coefficient row, a multiple of 8
+	bool looping;
+
+	std::vector<float> times;		// seconds, increasing
+	std::vector<float> keys;		// unwrapped angles in degrees, angles per key
+	std::vector<float> velocities;	// degrees per second, angles per key
+	std::vector<bool> given;		// whether the key came with its velocities
+
+	std::vector<float> coefficients;	// rows a b c d per segment: ((a u + b) u + c) u + d, with u in [0, 1]
+
+public:
+	angle_spline() : angles(0), stride(0), looping(false) {}
+
+	void reset(uint num_angles);
+
+	// keys are added in order of time; without velocities the key is a Catmull-Rom key
+	void add_key(float time, const float* key_angles, const float* key_velocities = nullptr);
+
+	// computes the segments, and when looping closes the spline with a copy of the first key one key interval on
+	bool finish(bool loop = false);
+
+	uint num_angles() const { return angles; }
+	uint row_size() const { return stride; }
+	uint num_keys() const { return times.size(); }
+	uint num_segments() const { return times.empty() ? 0 : times.size() - 1; }
+	float start() const { return times.empty() ? 0.0f : times.front(); }
+	float duration() const { return times.empty() ? 0.0f : times.back() - times.front(); }
+	bool loops() const { return looping; }
+
+	// segment and the parameter within it at a time, clamped to the keys (or wrapped around them when looping)
+	uint locate(float time, float& u) const;
+	const float* segment(uint s) const { return &coefficients[s * 4 * stride]; }
+
+	// angles at a time, wrapped to [0, 360); out takes row_size() values
+	void evaluate(float time, float* out) const;
+
+	// evaluates splines and batches through the AVX2 kernel where the processor has it (the default), or through
+	// the scalar one; returns whether the AVX2 kernel is used
+	static bool select_kernels(bool avx2);
+};
+
+/*
+ *	many skeletons that each play a spline, evaluated together
+ *
+ *	all splines of a batch have the same number of angles. the angles of every skeleton are a padded row of
+ *	the output, so a pass over the batch runs the same polynomial kernel over contiguous rows.
+ */
+class spline_batch
+{
+private:
+	struct player
+	{
+		const angle_spline* spline;
+		float offset;	// seconds into the spline at time 0
+		float speed;
+	};
+
+	std::vector<player> players;
+	std::vector<float> out;
+	uint angles;
+	uint stride;
+
+public:
+	spline_batch() : angles(0), stride(0) {}
+
+	void reset(uint num_angles);
+	uint add(const angle_spline* spline, float offset = 0.0f, float speed = 1.0f);
+
+	void evaluate(float time);
+
+	uint size() const { return players.size(); }
+	const float* angles_of(uint skeleton) const { return &out[skeleton * stride]; }
+};
+
+// difference b - a along the shorter arc, in [-180, 180)
+inline float shortest_arc(float a, float b)
+{
+	float d = b - a;
+	return d - 360.0f * floorf(d / 360.0f + 0.5f);
+}
@@ -0,0 +1,414 @@
+#include "stream_server.h"
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+static const uint MAX_EVENTS = 32;
+
+stream_server::stream_server() : listen_fd(-1), epoll_fd(-1), wake_fd(-1), running(false), incoming_ready(false),
+	latest(0), has_latest(false), frames_sent(0), frames_dropped(0), bytes_sent(0), subscribers(0)
+{
+}
+
+stream_server::~stream_server()
+{
+	stop();
+}
+
+bool stream_server::start(const std::string& socket_path)
+{
+#ifdef __linux__
+	stop();
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0) return false;
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+	// a stale socket of an earlier run would make bind fail
+	unlink(socket_path.c_str());
+
+	if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 8) != 0)
+	{
+		::close(listen_fd);
+		listen_fd = -1;
+		return false;
+	}
+
+	path = socket_path;
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &listen_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+	ev.data.ptr = &wake_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+	history.resize(STREAM_HISTORY);
+	for (uint i = 0; i < STREAM_HISTORY; ++i)
+		history[i].number = STREAM_KEYFRAME;
+
+	running = true;
+	thread = std::thread(&stream_server::run, this);
+	return true;
+#else
+	(void)socket_path;
+	return false;
+#endif
+}
+
+void stream_server::stop()
+{
+#ifdef __linux__
+	if (!running) return;
+
+	running = false;
+	uint64_t one = 1;
+	if (write(wake_fd, &one, sizeof(one)) < 0) {}
+	thread.join();
+
+	for (uint i = 0; i < clients.size(); ++i)
+	{
+		::close(clients[i]->fd);
+		delete clients[i];
+	}
+	clients.clear();
+	subscribers = 0;
+
+	::close(listen_fd);
+	::close(epoll_fd);
+	::close(wake_fd);
+	unlink(path.c_str());
+	listen_fd = epoll_fd = wake_fd = -1;
+#endif
+}
+
+void stream_server::publish(const pose3& pose, uint frame, uint dimensions)
+{
+#ifdef __linux__
+	if (!running) return;
+
+	uint num_joints = std::min((uint)pose.joints.size(), STREAM_MAX_JOINTS);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (uint i = 0; i < num_joints; ++i)
+		{
+			const joint_pose3& jp = pose.joints[i];
+			incoming.joints[i].position[0] = jp.position.x;
+			incoming.joints[i].position[1] = jp.position.y;
+			incoming.joints[i].position[2] = jp.position.z;
+
+			for (uint k = 0; k < 9; ++k)
+				incoming.joints[i].rotation[k] = jp.rotation[k];
+		}
+
+		incoming.number = frame;
+		incoming.dimensions = dimensions;
+		incoming.num_joints = num_joints;
+		incoming_ready = true;
+	}
+
+	uint64_t one = 1;
+	if (write(wake_fd, &one, sizeof(one)) < 0) {}
+#else
+	(void)pose;
+	(void)frame;
+	(void)dimensions;
+#endif
+}
+
+void stream_server::print_stats()
+{
+	std::cout << "Stream: " << frames_sent << " frames sent (" << bytes_sent << " bytes), "
+		<< frames_dropped << " skipped by slow clients" << std::endl;
+}
+
+#ifdef __linux__
+
+void stream_server::run()
+{
+	epoll_event events[MAX_EVENTS];
+
+	while (running)
+	{
+		int n = epoll_wait(epoll_fd, events, MAX_EVENTS, 100);
+
+		for (int i = 0; i < n && running; ++i)
+		{
+			if (events[i].data.ptr == &listen_fd)
+			{
+				accept_clients();
+			}
+			else if (events[i].data.ptr == &wake_fd)
+			{
+				uint64_t count;
+				if (read(wake_fd, &count, sizeof(count)) < 0) {}
+				frame_arrived();
+			}
+			else
+			{
+				client* c = (client*)events[i].data.ptr;
+				if (c->fd < 0) continue;
+
+				if (events[i].events & (EPOLLERR | EPOLLHUP))
+				{
+					remove_client(c);
+					continue;
+				}
+
+				if (events[i].events & EPOLLIN)
+				{
+					read_acks(c);
+					if (c->fd < 0) continue;
+				}
+
+				if (events[i].events & EPOLLOUT)
+					flush(c);
+			}
+		}
+
+		// clients that disconnected during this round
+		for (uint i = 0; i < clients.size(); )
+		{
+			if (clients[i]->fd < 0)
+			{
+				delete clients[i];
+				clients[i] = clients.back();
+				clients.pop_back();
+			}
+			else ++i;
+		}
+	}
+}
+
+void stream_server::accept_clients()
+{
+	int fd;
+	while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		client* c = new client();
+		c->fd = fd;
+		c->out_pos = 0;
+		c->acked = STREAM_KEYFRAME;
+		c->in_flight = false;
+		c->sent = 0;
+		c->pending = false;
+		c->writable_wait = false;
+		c->ack_size = 0;
+		c->out.reserve(sizeof(stream_frame_header) + stream_mask_size(STREAM_MAX_JOINTS) + sizeof(pose_shm_joint) * STREAM_MAX_JOINTS);
+
+		epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = c;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+		clients.push_back(c);
+		subscribers++;
+
+		// a new subscriber starts with the latest frame rather than waiting for the next one
+		if (has_latest)
+		{
+			encode(c);
+			flush(c);
+		}
+	}
+}
+
+void stream_server::remove_client(client* c)
+{
+	if (c->fd < 0) return;
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, nullptr);
+	::close(c->fd);
+	c->fd = -1;
+	subscribers--;
+}
+
+void stream_server::read_acks(client* c)
+{
+	unsigned char buffer[256];
+	ssize_t n;
+
+	while ((n = recv(c->fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+	{
+		for (ssize_t i = 0; i < n; ++i)
+		{
+			c->ack[c->ack_size++] = buffer[i];
+			if (c->ack_size < sizeof(c->ack)) continue;
+
+			uint32_t frame;
+			memcpy(&frame, c->ack, sizeof(frame));
+			c->ack_size = 0;
+
+			// acknowledgements can arrive out of date when the client is behind, keep the newest
+			if (frame == STREAM_RESYNC || c->acked == STREAM_KEYFRAME || (int32_t)(frame - c->acked) > 0)
+				c->acked = frame;
+
+			// the frame in flight was applied, or could not be, and the client is ready for the next one
+			if (frame == STREAM_RESYNC || frame == c->sent)
+				c->in_flight = false;
+		}
+	}
+
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+	{
+		remove_client(c);
+		return;
+	}
+
+	// the latest frame, if any arrived while the client had not taken the previous one
+	if (!c->in_flight && c->pending && has_latest)
+	{
+		encode(c);
+		flush(c);
+	}
+}
+
+void stream_server::frame_arrived()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!incoming_ready) return;
+
+		stored_frame& slot = history[incoming.number % STREAM_HISTORY];
+		slot.number = incoming.number;
+		slot.dimensions = incoming.dimensions;
+		slot.num_joints = incoming.num_joints;
+		memcpy(slot.joints, incoming.joints, sizeof(pose_shm_joint) * incoming.num_joints);
+
+		latest = incoming.number;
+		has_latest = true;
+		incoming_ready = false;
+	}
+
+	for (uint i = 0; i < clients.size(); ++i)
+	{
+		client* c = clients[i];
+		if (c->fd < 0) continue;
+
+		// backpressure: a client that has not taken the previous frame only ever gets the latest one, so frames
+		// that it cannot keep up with are replaced rather than queued in the socket
+		if (c->in_flight)
+		{
+			if (c->pending) frames_dropped++;
+			c->pending = true;
+			continue;
+		}
+
+		encode(c);
+		flush(c);
+	}
+}
+
+void stream_server::encode(client* c)
+{
+	const stored_frame& f = history[latest % STREAM_HISTORY];
+
+	// the delta base must still be in the history and have the same layout
+	const stored_frame* base = nullptr;
+	if (c->acked != STREAM_KEYFRAME)
+	{
+		const stored_frame& b = history[c->acked % STREAM_HISTORY];
+		if (b.number == c->acked && b.num_joints == f.num_joints && b.dimensions == f.dimensions)
+			base = &b;
+	}
+
+	uint mask_size = stream_mask_size(f.num_joints);
+	uint max_size = sizeof(stream_frame_header) + mask_size + sizeof(pose_shm_joint) * f.num_joints;
+
+	c->out.resize(max_size);
+	c->out_pos = 0;
+	c->pending = false;
+	c->in_flight = true;
+	c->sent = f.number;
+
+	stream_frame_header* h = (stream_frame_header*)&c->out[0];
+	uint32_t* mask = (uint32_t*)(&c->out[0] + sizeof(stream_frame_header));
+	pose_shm_joint* changed = (pose_shm_joint*)(&c->out[0] + sizeof(stream_frame_header) + mask_size);
+
+	memset(mask, 0, mask_size);
+	uint num_changed = 0;
+
+	for (uint i = 0; i < f.num_joints; ++i)
+	{
+		if (base && !memcmp(&base->joints[i], &f.joints[i], sizeof(pose_shm_joint)))
+			continue;
+
+		mask[i / 32] |= 1u << (i % 32);
+		changed[num_changed++] = f.joints[i];
+	}
+
+	h->magic = STREAM_MAGIC;
+	h->size = sizeof(stream_frame_header) + mask_size + sizeof(pose_shm_joint) * num_changed;
+	h->frame = f.number;
+	h->base_frame = base ? base->number : STREAM_KEYFRAME;
+	h->dimensions = f.dimensions;
+	h->num_joints = f.num_joints;
+	h->num_changed = num_changed;
+	h->padding = 0;
+
+	// shrinking keeps the capacity, so this does not allocate
+	c->out.resize(h->size);
+	frames_sent++;
+}
+
+void stream_server::flush(client* c)
+{
+	while (c->out_pos < c->out.size())
+	{
+		ssize_t n = send(c->fd, &c->out[c->out_pos], c->out.size() - c->out_pos, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+		if (n < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				arm_writable(c, true);
+				return;
+			}
+
+			remove_client(c);
+			return;
+		}
+
+		c->out_pos += n;
+		bytes_sent += n;
+	}
+
+	// the frame went out, the next one waits for its acknowledgement
+	arm_writable(c, false);
+}
+
+void stream_server::arm_writable(client* c, bool arm)
+{
+	if (c->writable_wait == arm) return;
+
+	epoll_event ev;
+	ev.events = arm ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	ev.data.ptr = c;
+	epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+	c->writable_wait = arm;
+}
+
+#else
+
+void stream_server::run() {}
+void stream_server::accept_clients() {}
+void stream_server::remove_client(client*) {}
+void stream_server::read_acks(client*) {}
+void stream_server::encode(client*) {}
+void stream_server::flush(client*) {}
+void stream_server::arm_writable(client*, bool) {}
+void stream_server::frame_arrived() {}
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include "structures.h"
+#include "pose_stream.h"
+
+// streams poses to local subscribers over a Unix domain socket, from an epoll loop on its own thread
+class stream_server
+{
+private:
+	struct stored_frame
+	{
+		uint32_t number;
+		uint16_t dimensions;
+		uint16_t num_joints;
+		pose_shm_joint joints[STREAM_MAX_JOINTS];
+	};
+
+	struct client
+	{
+		int fd;
+		std::vector<unsigned char> out;		// encoded frame that has not been sent completely
+		size_t out_pos;
+		uint32_t acked;						// last acknowledged frame, STREAM_KEYFRAME before the first
+		bool in_flight;						// a frame was sent that the client has not acknowledged yet
+		uint32_t sent;						// that frame
+		bool pending;						// a newer frame arrived while a frame was in flight
+		bool writable_wait;					// EPOLLOUT is armed
+		unsigned char ack[4];				// partially received acknowledgement
+		uint ack_size;
+	};
+
+	std::string path;
+	int listen_fd;
+	int epoll_fd;
+	int wake_fd;						// eventfd, signaled by publish()
+	std::thread thread;
+	std::atomic<bool> running;
+
+	std::mutex mutex;					// guards incoming
+	stored_frame incoming;				// written by publish(), picked up by the server thread
+	bool incoming_ready;
+
+	std::vector<stored_frame> history;	// recently published frames, by frame number modulo its size
+	uint32_t latest;
+	bool has_latest;
+
+	std::vector<client*> clients;
+
+	std::atomic<unsigned long long> frames_sent;
+	std::atomic<unsigned long long> frames_dropped;	// frames that a slow client skipped
+	std::atomic<unsigned long long> bytes_sent;
+	std::atomic<uint> subscribers;
+
+private:
+	void run();
+	void accept_clients();
+	void remove_client(client* c);
+	void read_acks(client* c);
+	void encode(client* c);
+	void flush(client* c);
+	void arm_writable(client* c, bool arm);
+	void frame_arrived();
+
+public:
+	stream_server();
+	~stream_server();
+
+	bool start(const std::string& socket_path);
+	void stop();
+	bool is_running() const { return running; }
+
+	// hands a frame to the server thread; copies the joints and never waits on the network
+	void publish(const pose3& pose, uint frame, uint dimensions);
+
+	void print_stats();
+
+	uint num_subscribers() const { return subscribers; }
+	unsigned long long sent() const { return frames_sent; }
+	unsigned long long dropped() const { return frames_dropped; }
+};
@@ -1,12 +1,14 @@
 #pragma once
 
 #include <cmath>
+#include <cfloat>
+#include <cstdint>
 #include <stack>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <algorithm>
-#include <gl/freeglut.h>
+#include <GL/freeglut.h>
 
 #include "constants.h"
 
@@ -16,19 +18,96 @@ struct joint2;
 struct joint3;
 struct link2;
 struct link3;
+struct pose3;
+class command_buffer;
+class packed_points;
 
-class kinecontext
+// joints whose angles or attachments changed since the pose history last took them (see pose_history::commit)
+struct edit_marks
+{
+	enum { ANGLES = 1, ATTACHMENTS = 2 };
+
+	std::vector<uint> joints;		// every marked joint once
+	std::vector<uint8_t> kinds;		// what changed of every joint
+	bool all_angles;				// set_angles replaced every angle
+
+	edit_marks() : all_angles(false) {}
+
+	void mark(uint joint, uint8_t kind)
+	{
+		if (joint >= kinds.size())
+			kinds.resize(joint + 1, 0);
+
+		if (!kinds[joint])
+			joints.push_back(joint);
+		kinds[joint] |= kind;
+	}
+
+	void clear()
+	{
+		for (uint i = 0; i < joints.size(); ++i)
+			kinds[joints[i]] = 0;
+
+		joints.clear();
+		all_angles = false;
+	}
+};
+
+// what pose_history keeps of a pose and gives back: the angles and attachments of every joint
+class editable_pose
+{
+public:
+	// joint angles in degrees, degrees_of_freedom() per joint from the root to the end effector
+	virtual uint num_joints() = 0;
+	virtual uint degrees_of_freedom() = 0;
+	virtual void get_angles(float* angles) = 0;
+	virtual void set_angles(const float* angles) = 0;
+
+	// attachments of the bone of a joint, in the coordinates of that joint (z = 0 in 2D)
+	virtual uint num_attachments(uint joint) = 0;
+	virtual void get_attachments(uint joint, vec3* points) = 0;
+	virtual void set_attachments(uint joint, const vec3* points, uint count) = 0;
+
+	// the joints that turned or whose attachments changed, marked by the calls above and by the edits of a context
+	virtual edit_marks& edits() = 0;
+};
+
+class kinecontext : public editable_pose
 {
 public:
 	virtual void init(int w, int h) = 0;
+	virtual void resize(int w, int h) = 0;	// camera setup without touching OpenGL
 	virtual void draw() = 0;
+	virtual void record(command_buffer& buffer) = 0;
 
 	virtual void prev_joint() = 0;
 	virtual void next_joint() = 0;
 
 	virtual void rotate_joint(float degrees) = 0;
+	virtual void rotate_joint_about(uint joint, char axis, float degrees) = 0;	// 2D joints only turn about z
 	virtual void insert_point(float x, float y) = 0;
+	virtual bool select_joint_at(float x, float y) = 0;	// x and y as for insert_point, false when nothing is there
 	virtual void switch_rotation_axis(char axis) = 0;
+	virtual void rotate_view(float, float, float, float) {}	// the 2D view does not turn; degrees about the axis x, y, z in kine3d
+
+	// of angles laid out as get_angles writes them
+	virtual vec3 end_effector(const float* angles) = 0;	// forward kinematics of the given angles, leaves the joints alone
+	virtual void joint_positions(const float* angles, vec3* positions) = 0;	// world position of every joint
+	virtual void joint_positions_quantized(const uint16_t* angles, vec3* positions) = 0;	// the same, of angles in steps (see quantize.h)
+	virtual void aim_bones(const vec3* positions, float* angles) = 0;	// angles that point every bone at the next position
+
+	// the rig (see rig_file): T[n] of a joint in the coordinates of its parent (world coordinates for the root)
+	virtual vec3 joint_offset(uint joint) = 0;
+	virtual void set_joint_offset(uint joint, const vec3& offset) = 0;	// leaves the angles and the attachments
+	virtual void set_num_joints(uint count) = 0;	// drops joints off the end, or continues the chain along the last bone
+
+	// bulk attachments (see cloud_loader), the points of the bone of joint n at n
+	virtual std::vector<packed_points>& clouds() = 0;
+
+	virtual void print_stats() {}
+
+	// world-space joints (and attachments) of the most recently recorded frame
+	virtual const pose3& current_pose() = 0;
 };
 
 
@@ -36,18 +115,24 @@ struct vec2
 {
 	float x, y;
 
+	vec2() : x(0), y(0) {}
 	vec2(float x, float y) : x(x), y(y) {}
 
-	vec2 operator+(const vec2& other)
+	vec2 operator+(const vec2& other) const
 	{
 		return vec2((x + other.x), (y + other.y));
 	}
 
-	vec2 operator-(const vec2& other)
+	vec2 operator-(const vec2& other) const
 	{
 		return vec2((x - other.x), (y - other.y));
 	}
 
+	vec2 operator*(float scalar) const
+	{
+		return vec2(x * scalar, y * scalar);
+	}
+
 	// Euclidean distance
 	uint dist(const vec2& other)
 	{
@@ -62,18 +147,24 @@ struct vec3
 {
 	float x, y, z;
 
+	vec3() : x(0), y(0), z(0) {}
 	vec3(float x, float y, float z) : x(x), y(y), z(z) {}
 
-	vec3 operator+(const vec3& other)
+	vec3 operator+(const vec3& other) const
 	{
 		return vec3((x + other.x), (y + other.y), (z + other.z));
 	}
 
-	vec3 operator-(const vec3& other)
+	vec3 operator-(const vec3& other) const
 	{
 		return vec3((x - other.x), (y - other.y), (z - other.z));
 	}
 
+	vec3 operator*(float scalar) const
+	{
+		return vec3(x * scalar, y * scalar, z * scalar);
+	}
+
 	uint dist(const vec3& other)
 	{
 		float xsqr = (other.x - x) * (other.x - x);
@@ -82,6 +173,12 @@ struct vec3
 
 		return (uint)sqrtf(xsqr + ysqr + zsqr);
 	}
+
+	// linear interpolation between a (t = 0) and b (t = 1)
+	static vec3 lerp(const vec3& a, const vec3& b, float t)
+	{
+		return vec3(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+	}
 };
 
 
@@ -93,10 +190,11 @@ struct joint2
 	joint2* child; 						// only need one for now
 	//std::vector<Joint2*> children;	// needed when joints are able to split
 	link2* bone;						// associated link
+	bool dirty;							// rotated since the curved bones were last tessellated
 
 	// lx = length of this joint to its parent (on the x axis)
-	joint2(float lx) : t(new vec2(lx, 0)), theta(0), parent(nullptr), child(nullptr), bone(nullptr) {}
-	joint2(float x, float y) : t(new vec2(x,y)), theta(0), parent(nullptr), child(nullptr), bone(nullptr) {}
+	joint2(float lx) : t(new vec2(lx, 0)), theta(0), parent(nullptr), child(nullptr), bone(nullptr), dirty(true) {}
+	joint2(float x, float y) : t(new vec2(x,y)), theta(0), parent(nullptr), child(nullptr), bone(nullptr), dirty(true) {}
 
 	~joint2()
 	{
@@ -112,6 +210,7 @@ struct joint2
 	void rotate(float degrees)
 	{
 		theta += degrees;
+		dirty = true;
 
 		if (theta > 360 || theta < 0)
 			theta = fmodf(theta, 360.0f);
@@ -217,3 +316,61 @@ struct link3
 		attachments.push_back(v);
 	}
 };
+
+
+// axis-aligned bounding box, empty until something is added to it
+struct aabb
+{
+	vec3 min;
+	vec3 max;
+
+	aabb() : min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+
+	bool empty() const
+	{
+		return min.x > max.x;
+	}
+
+	void grow(const vec3& p, float radius = 0.0f)
+	{
+		min.x = std::min(min.x, p.x - radius); max.x = std::max(max.x, p.x + radius);
+		min.y = std::min(min.y, p.y - radius); max.y = std::max(max.y, p.y + radius);
+		min.z = std::min(min.z, p.z - radius); max.z = std::max(max.z, p.z + radius);
+	}
+
+	void grow(const aabb& other)
+	{
+		if (other.empty()) return;
+		grow(other.min);
+		grow(other.max);
+	}
+};
+
+// world-space state of a single joint, as computed by forward kinematics
+struct joint_pose3
+{
+	vec3 position;	// P[n]
+	vec3 axis_x;	// end-points of the local axes
+	vec3 axis_y;
+	vec3 axis_z;
+	float rotation[9];	// S[n], the total rotation of the joint (row-major)
+	bool visible;	// false when the joint is collapsed into its parent (see lod_level::joint_stride)
+
+	uint first_attachment;	// range of this joint's bone in pose3::attachments
+	uint num_attachments;
+
+	aabb bounds;	// joint sphere, local axes, bone to the child and its attachments
+	aabb subtree;	// bounds of this joint and all of its descendants
+};
+
+// evaluated pose of a complete 3D skeleton
+struct pose3
+{
+	std::vector<joint_pose3> joints;
+	std::vector<vec3> attachments;	// world positions of the attachments of all bones
+	vec3 center;					// bounding sphere of the joint positions
+	float radius;
+	aabb bounds;					// bounds of the complete skeleton (equal to the root's subtree)
+
+	pose3() : radius(0) {}
+};
@@ -0,0 +1,46 @@
+#include "timing.h"
+#include <fstream>
+
+double frame_timings::mean() const
+{
+	if (samples.empty()) return 0.0;
+
+	double sum = 0.0;
+	for (uint i = 0; i < samples.size(); ++i)
+		sum += samples[i];
+
+	return sum / samples.size();
+}
+
+double frame_timings::percentile(double p) const
+{
+	if (samples.empty()) return 0.0;
+
+	std::vector<double> sorted(samples);
+	std::sort(sorted.begin(), sorted.end());
+
+	uint i = (uint)(p / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(i, (uint)sorted.size() - 1)];
+}
+
+void frame_timings::report(std::ostream& out, const std::string& label) const
+{
+	out << label << ": " << count() << " frames"
+		<< ", mean " << mean() << " ms"
+		<< ", p50 " << percentile(50) << " ms"
+		<< ", p99 " << percentile(99) << " ms"
+		<< ", max " << percentile(100) << " ms"
+		<< std::endl;
+}
+
+bool frame_timings::write_csv(const std::string& path) const
+{
+	std::ofstream file(path.c_str());
+	if (!file) return false;
+
+	file << "frame,milliseconds\n";
+	for (uint i = 0; i < samples.size(); ++i)
+		file << i << "," << samples[i] << "\n";
+
+	return file.good();
+}
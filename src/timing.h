@@ -0,0 +1,21 @@
+#pragma once
+
+#include "structures.h"
+
+// collects frame times and reports their distribution
+class frame_timings
+{
+private:
+	std::vector<double> samples; // milliseconds, in frame order
+
+public:
+	void clear() { samples.clear(); }
+	void add(double milliseconds) { samples.push_back(milliseconds); }
+
+	uint count() const { return samples.size(); }
+	double mean() const;
+	double percentile(double p) const;
+
+	void report(std::ostream& out, const std::string& label) const;
+	bool write_csv(const std::string& path) const;
+};
@@ -0,0 +1,89 @@
+#include "watch.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+file_watcher::file_watcher() : fd(-1)
+{
+}
+
+file_watcher::~file_watcher()
+{
+#ifdef __linux__
+	if (fd >= 0)
+		close(fd);
+#endif
+}
+
+#ifdef __linux__
+
+int file_watcher::add(const std::string& path)
+{
+	if (fd < 0)
+	{
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0)
+			return -1;
+	}
+
+	size_t slash = path.find_last_of('/');
+	std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+
+	// watching a directory again returns the descriptor it already has
+	int descriptor = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (descriptor < 0)
+		return -1;
+
+	watched file;
+	file.descriptor = descriptor;
+	file.name = slash == std::string::npos ? path : path.substr(slash + 1);
+	files.push_back(file);
+
+	return files.size() - 1;
+}
+
+void file_watcher::poll(std::vector<uint>& changed)
+{
+	changed.clear();
+
+	if (fd < 0)
+		return;
+
+	ssize_t length;
+	while ((length = read(fd, events, sizeof(events))) > 0)
+	{
+		for (ssize_t offset = 0; offset < length; )
+		{
+			const inotify_event* event = (const inotify_event*)(events + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			if (!event->len)
+				continue;
+
+			for (uint i = 0; i < files.size(); ++i)
+			{
+				if (files[i].descriptor == event->wd && files[i].name == event->name
+					&& std::find(changed.begin(), changed.end(), i) == changed.end())
+					changed.push_back(i);
+			}
+		}
+	}
+}
+
+#else
+
+// without inotify no file is watched, and rig and clip files are read once at startup
+int file_watcher::add(const std::string&)
+{
+	return -1;
+}
+
+void file_watcher::poll(std::vector<uint>& changed)
+{
+	changed.clear();
+}
+
+#endif
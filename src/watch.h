@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include "structures.h"
+
+/*
+ *	reports files that changed, through inotify, polled once per frame without blocking (on Linux only, elsewhere
+ *	no file can be watched)
+ *
+ *	the directories of the files are watched rather than the files themselves, since editors often save by writing
+ *	another file and renaming it over the old one, which would end a watch on the file. a file counts as changed
+ *	when it was closed after writing or renamed into place.
+ */
+class file_watcher
+{
+private:
+	struct watched
+	{
+		int descriptor;		// of the watch on the directory, shared by the files in it
+		std::string name;	// within the directory
+	};
+
+	int fd;
+	std::vector<watched> files;
+	alignas(8) char events[4096];
+
+public:
+	file_watcher();
+	~file_watcher();
+
+	// the id of the file, or -1 when it cannot be watched
+	int add(const std::string& path);
+
+	// ids of the files that changed since the last poll, each once
+	void poll(std::vector<uint>& changed);
+};